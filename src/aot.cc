@@ -0,0 +1,685 @@
+#include "aot.h"
+#include "code.h"
+#include "compiler.h"
+#include "decode.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <dlfcn.h>
+#include <set>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <vector>
+
+extern char** environ;
+
+namespace axe {
+
+// FNV-1a
+class fingerprint {
+  public:
+    fingerprint() : hash(UINT64_C(0xcbf29ce484222325)) {}
+
+    void add(const void* data, size_t size) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            this->hash ^= bytes[i];
+            this->hash *= UINT64_C(0x100000001b3);
+        }
+    }
+    void add(uint64_t word) { this->add(&word, sizeof(word)); }
+    void add(const instructions& ins) {
+        this->add(ins.size());
+        this->add(ins.data(), ins.size());
+    }
+
+    uint64_t get() const { return this->hash; }
+
+  private:
+    uint64_t hash;
+};
+
+uint64_t aot_fingerprint(const byte_code& byte_code) {
+    fingerprint res;
+    res.add(byte_code.ins);
+    res.add(byte_code.constants.size());
+    for (auto& constant : byte_code.constants) {
+        auto type = constant.get_type();
+        res.add(static_cast<uint64_t>(type));
+        switch (type) {
+        case object_type::Integer:
+            res.add(static_cast<uint64_t>(constant.get_int()));
+            break;
+        case object_type::Float: {
+            double d = constant.get_float();
+            res.add(&d, sizeof(d));
+        } break;
+        case object_type::String:
+            res.add(constant.get_string().size());
+            res.add(constant.get_string().data(),
+                    constant.get_string().size());
+            break;
+        case object_type::Function: {
+            auto& fn = constant.get_function();
+            res.add(fn.get_instructions());
+            res.add(fn.get_num_locals());
+            res.add(fn.get_num_params());
+        } break;
+        default:
+            break;
+        }
+    }
+    return res.get();
+}
+
+// the part of every module that does not depend on the program. the
+// helpers take the fast paths the interpreter takes and call back into
+// the runtime for everything else.
+static const char* prelude = R"(#include "aot.h"
+
+extern "C" axe::aot_table axe_aot_table;
+
+namespace {
+
+using axe::code_word;
+using axe::jit_context;
+using axe::jit_exit;
+using axe::value;
+
+using operation = value (*)(value, value, axe::heap&);
+
+inline value* collect(jit_context* ctx, value* sp) {
+    if (ctx->heap->should_collect()) {
+        ctx->stack_pointer = sp;
+        ctx->collect(ctx);
+    }
+    return sp;
+}
+
+inline jit_exit leave(jit_context* ctx, value* sp, const code_word* site,
+                      jit_exit exit) {
+    ctx->stack_pointer = sp;
+    ctx->site = site;
+    return exit;
+}
+
+inline bool ints(value lhs, value rhs) {
+    return lhs.is_small_int() && rhs.is_small_int();
+}
+
+inline bool doubles(value lhs, value rhs) {
+    return lhs.is_double() && rhs.is_double();
+}
+
+inline value* push_int(value* sp, int64_t i) {
+    sp[-2] = value::from_small_int(i);
+    return sp - 1;
+}
+
+inline value* push_double(value* sp, double d) {
+    sp[-2] = value::from_double(d);
+    return sp - 1;
+}
+
+inline value* slow(jit_context* ctx, value* sp, operation op) {
+    sp[-2] = op(sp[-2], sp[-1], *ctx->heap);
+    return collect(ctx, sp - 1);
+}
+
+// two small ints never overflow an int64_t when added or subtracted
+inline value* add(jit_context* ctx, value* sp) {
+    value lhs = sp[-2];
+    value rhs = sp[-1];
+    if (ints(lhs, rhs)) {
+        int64_t res = lhs.as_small_int() + rhs.as_small_int();
+        if (value::fits_small_int(res)) {
+            return push_int(sp, res);
+        }
+    } else if (doubles(lhs, rhs)) {
+        return push_double(sp, lhs.as_double() + rhs.as_double());
+    }
+    return slow(ctx, sp, axe_aot_table.runtime->add);
+}
+
+inline value* sub(jit_context* ctx, value* sp) {
+    value lhs = sp[-2];
+    value rhs = sp[-1];
+    if (ints(lhs, rhs)) {
+        int64_t res = lhs.as_small_int() - rhs.as_small_int();
+        if (value::fits_small_int(res)) {
+            return push_int(sp, res);
+        }
+    } else if (doubles(lhs, rhs)) {
+        return push_double(sp, lhs.as_double() - rhs.as_double());
+    }
+    return slow(ctx, sp, axe_aot_table.runtime->sub);
+}
+
+inline value* mul(jit_context* ctx, value* sp) {
+    value lhs = sp[-2];
+    value rhs = sp[-1];
+    int64_t res;
+    if (ints(lhs, rhs)) {
+        if (!__builtin_mul_overflow(lhs.as_small_int(), rhs.as_small_int(),
+                                    &res) &&
+            value::fits_small_int(res)) {
+            return push_int(sp, res);
+        }
+    } else if (doubles(lhs, rhs)) {
+        return push_double(sp, lhs.as_double() * rhs.as_double());
+    }
+    return slow(ctx, sp, axe_aot_table.runtime->mul);
+}
+
+// dividing by zero is left to the runtime, it fails like the
+// interpreter does
+inline value* div(jit_context* ctx, value* sp) {
+    value lhs = sp[-2];
+    value rhs = sp[-1];
+    if (ints(lhs, rhs) && rhs.as_small_int() != 0) {
+        int64_t res = lhs.as_small_int() / rhs.as_small_int();
+        if (value::fits_small_int(res)) {
+            return push_int(sp, res);
+        }
+    } else if (doubles(lhs, rhs)) {
+        return push_double(sp, lhs.as_double() / rhs.as_double());
+    }
+    return slow(ctx, sp, axe_aot_table.runtime->div);
+}
+
+inline bool is_equal(value lhs, value rhs) {
+    if (ints(lhs, rhs)) {
+        return lhs.get_bits() == rhs.get_bits();
+    }
+    return axe_aot_table.runtime->equals(lhs, rhs);
+}
+
+inline bool is_greater(value lhs, value rhs) {
+    if (ints(lhs, rhs)) {
+        return lhs.as_small_int() > rhs.as_small_int();
+    }
+    if (doubles(lhs, rhs)) {
+        return lhs.as_double() > rhs.as_double();
+    }
+    return axe_aot_table.runtime->greater_than(lhs, rhs);
+}
+
+inline value* equals(value* sp, bool expected) {
+    sp[-2] = value::from_bool(is_equal(sp[-2], sp[-1]) == expected);
+    return sp - 1;
+}
+
+inline value* greater_than(value* sp) {
+    sp[-2] = value::from_bool(is_greater(sp[-2], sp[-1]));
+    return sp - 1;
+}
+
+inline bool minus(jit_context* ctx, value* sp) {
+    value v = sp[-1];
+    if (v.is_small_int() && value::fits_small_int(-v.as_small_int())) {
+        sp[-1] = value::from_small_int(-v.as_small_int());
+        return true;
+    }
+    if (v.is_double()) {
+        sp[-1] = value::from_double(-v.as_double());
+        return true;
+    }
+    auto type = axe_aot_table.runtime->type_of(v);
+    if (type != axe::object_type::Integer) {
+        ctx->error_type = type;
+        return false;
+    }
+    sp[-1] = axe_aot_table.runtime->negate(v, *ctx->heap);
+    collect(ctx, sp);
+    return true;
+}
+
+)";
+
+// translates the byte code of one function, false when it has an
+// instruction only the main program has
+class aot_translator {
+  public:
+    aot_translator(const std::vector<object>& constants, size_t index)
+        : constants(constants), index(index),
+          fn(constants[index].get_function()), ins(fn.get_instructions()),
+          num_resumes(0) {}
+
+    bool translate();
+    const std::string& get_body() const { return this->body; }
+    size_t get_num_resumes() const { return this->num_resumes; }
+
+  private:
+    const std::vector<object>& constants;
+    size_t index;
+    const compiled_function& fn;
+    const instructions& ins;
+    std::string body;
+    size_t num_resumes;
+    // the word index of every instruction by its offset and the words
+    // jumps go to
+    std::vector<size_t> words;
+    std::set<size_t> targets;
+
+    void line(const std::string& s) { this->body += "    " + s + "\n"; }
+    void label(const std::string& s) { this->body += s + ":\n"; }
+
+    std::string word(size_t word) const {
+        return "code[" + std::to_string(word) + "]";
+    }
+    std::string site(size_t word) const {
+        return "code + " + std::to_string(word);
+    }
+    std::string target(size_t offset) const {
+        return "w" + std::to_string(this->words[read_u16(this->ins, offset)]);
+    }
+
+    std::string constant(size_t constant, size_t word) const;
+    void call(size_t word, size_t num_args, bool tail);
+    bool dispatch(op_code op, size_t i, size_t word);
+    bool instruction(op_code op, size_t i, size_t word);
+};
+
+// ints and floats are baked into the code so the c++ compiler can fold
+// them, everything else lives in the heap of the vm and is read from the
+// decoded stream
+std::string aot_translator::constant(size_t constant, size_t word) const {
+    auto& obj = this->constants[constant];
+    char buf[64];
+    if (obj.get_type() == object_type::Integer &&
+        value::fits_small_int(obj.get_int())) {
+        std::snprintf(buf, sizeof(buf), "value::from_small_int(INT64_C(%" PRId64
+                      "))", obj.get_int());
+        return buf;
+    }
+    if (obj.get_type() == object_type::Float &&
+        std::isfinite(obj.get_float())) {
+        std::snprintf(buf, sizeof(buf), "value::from_double(%a)",
+                      obj.get_float());
+        return buf;
+    }
+    return "*" + this->word(word) + ".constant";
+}
+
+// the vm pushes the frame of the callee and enters this function again
+// at the resume label once the callee returned
+void aot_translator::call(size_t word, size_t num_args, bool tail) {
+    this->line("ctx->num_args = " + std::to_string(num_args) + ";");
+    this->line("ctx->cache = " + this->word(word + 2) + ".cache;");
+    if (tail) {
+        this->line("return leave(ctx, sp, " + this->site(word) +
+                   ", jit_exit::TailCall);");
+        return;
+    }
+    auto resume = std::to_string(++this->num_resumes);
+    this->line("ctx->resume = reinterpret_cast<const void*>(&f" +
+               std::to_string(this->index) + "_" + resume + ");");
+    this->line("return leave(ctx, sp, " + this->site(word) +
+               ", jit_exit::Call);");
+    this->label("r" + resume);
+}
+
+// the cases of a match become a c++ switch when they are all small
+// ints, otherwise the value is compared with one case after another. a
+// value no case has falls through to the jump to the default.
+bool aot_translator::dispatch(op_code op, size_t i, size_t word) {
+    bool table = op == op_code::OpJumpTable;
+    size_t count = read_u16(this->ins, i + (table ? 3 : 1));
+    size_t offset = i + instruction_width(op) +
+                    instruction_width(op_code::OpJump);
+    size_t entry_word = word + num_words(op) + num_words(op_code::OpJump);
+    int64_t low = 0;
+    bool small = true;
+    if (table) {
+        auto& obj = this->constants[read_u16(this->ins, i + 1)];
+        low = obj.get_int();
+        small = value::fits_small_int(low) &&
+                value::fits_small_int(low + static_cast<int64_t>(count));
+        if (!small) {
+            return false;
+        }
+    }
+    std::vector<std::pair<std::string, std::string>> cases;
+    std::vector<int64_t> keys;
+    for (size_t k = 0; k < count; ++k) {
+        if (table) {
+            keys.push_back(low + static_cast<int64_t>(k));
+            cases.emplace_back("", this->target(offset + 1));
+            offset += instruction_width(op_code::OpJump);
+            entry_word += num_words(op_code::OpJump);
+            continue;
+        }
+        size_t constant = read_u16(this->ins, offset + 1);
+        auto& obj = this->constants[constant];
+        if (obj.get_type() == object_type::Integer &&
+            value::fits_small_int(obj.get_int())) {
+            keys.push_back(obj.get_int());
+        } else {
+            small = false;
+        }
+        cases.emplace_back(this->constant(constant, entry_word + 1),
+                           this->target(offset + 3));
+        offset += instruction_width(op_code::OpCase);
+        entry_word += num_words(op_code::OpCase);
+    }
+
+    this->line("{");
+    this->line("    value v = *--sp;");
+    if (small) {
+        this->line("    if (v.is_small_int()) {");
+        this->line("        switch (v.as_small_int()) {");
+        for (size_t k = 0; k < cases.size(); ++k) {
+            this->line("        case INT64_C(" + std::to_string(keys[k]) +
+                       "):");
+            this->line("            goto " + cases[k].second + ";");
+        }
+        this->line("        }");
+        this->line("    }");
+    } else {
+        for (auto& c : cases) {
+            this->line("    if (is_equal(v, " + c.first + ")) {");
+            this->line("        goto " + c.second + ";");
+            this->line("    }");
+        }
+    }
+    this->line("}");
+    return true;
+}
+
+bool aot_translator::translate() {
+    size_t i = 0;
+    size_t word = 0;
+    this->words.assign(this->ins.size() + 1, 0);
+    while (i < this->ins.size()) {
+        op_code op = static_cast<op_code>(this->ins[i]);
+        this->words[i] = word;
+        int jump = jump_operand(op);
+        if (jump != -1) {
+            // the operands before a jump target are two bytes wide
+            this->targets.insert(read_u16(this->ins, i + 1 + 2 * jump));
+        }
+        word += num_words(op);
+        i += instruction_width(op);
+    }
+    this->words[i] = word;
+
+    i = 0;
+    while (i < this->ins.size()) {
+        op_code op = static_cast<op_code>(this->ins[i]);
+        if (this->targets.count(i) != 0) {
+            this->label("w" + std::to_string(this->words[i]));
+        }
+        if (!this->instruction(op, i, this->words[i])) {
+            return false;
+        }
+        i += instruction_width(op);
+    }
+    if (this->targets.count(i) != 0) {
+        this->label("w" + std::to_string(this->words[i]));
+    }
+    // the compiler never lets a function fall off its end
+    this->line("return leave(ctx, sp, " + this->site(this->words[i]) +
+               ", jit_exit::Return);");
+    return true;
+}
+
+bool aot_translator::instruction(op_code op, size_t i, size_t word) {
+    auto u8 = [&](size_t offset) {
+        return std::to_string(this->ins[i + offset]);
+    };
+    switch (op) {
+    case op_code::OpConstant:
+        this->line("*sp++ = " +
+                   this->constant(read_u16(this->ins, i + 1), word + 1) +
+                   ";");
+        break;
+    case op_code::OpTrue:
+        this->line("*sp++ = value::from_bool(true);");
+        break;
+    case op_code::OpFalse:
+        this->line("*sp++ = value::from_bool(false);");
+        break;
+    case op_code::OpNull:
+        this->line("*sp++ = value();");
+        break;
+    case op_code::OpPop:
+        this->line("sp--;");
+        break;
+    case op_code::OpGetLocal:
+        this->line("*sp++ = locals[" + u8(1) + "];");
+        break;
+    case op_code::OpSetLocal:
+        this->line("locals[" + u8(1) + "] = *--sp;");
+        break;
+    case op_code::OpGetGlobal:
+        this->line("*sp++ = *" + this->word(word + 1) + ".global;");
+        break;
+    case op_code::OpSetGlobal:
+        this->line("*" + this->word(word + 1) + ".global = *--sp;");
+        break;
+    case op_code::OpAdd:
+        this->line("sp = add(ctx, sp);");
+        break;
+    case op_code::OpSub:
+        this->line("sp = sub(ctx, sp);");
+        break;
+    case op_code::OpMul:
+        this->line("sp = mul(ctx, sp);");
+        break;
+    case op_code::OpDiv:
+        this->line("sp = div(ctx, sp);");
+        break;
+    case op_code::OpEq:
+        this->line("sp = equals(sp, true);");
+        break;
+    case op_code::OpNotEq:
+        this->line("sp = equals(sp, false);");
+        break;
+    case op_code::OpGreaterThan:
+        this->line("sp = greater_than(sp);");
+        break;
+    case op_code::OpMinus:
+        this->line("if (!minus(ctx, sp)) {");
+        this->line("    return leave(ctx, sp, " + this->site(word) +
+                   ", jit_exit::UnsupportedNegation);");
+        this->line("}");
+        break;
+    case op_code::OpBang:
+        this->line("sp[-1] = value::from_bool(!axe::is_truthy(sp[-1]));");
+        break;
+    case op_code::OpJump:
+        this->line("goto " + this->target(i + 1) + ";");
+        break;
+    case op_code::OpJumpTable:
+    case op_code::OpSwitch:
+        return this->dispatch(op, i, word);
+    case op_code::OpCase:
+        // read by the switch it belongs to
+        break;
+    case op_code::OpJumpNotTruthy:
+        this->line("if (!axe::is_truthy(*--sp)) {");
+        this->line("    goto " + this->target(i + 1) + ";");
+        this->line("}");
+        break;
+    case op_code::OpJumpTruthy:
+        this->line("if (axe::is_truthy(*--sp)) {");
+        this->line("    goto " + this->target(i + 1) + ";");
+        this->line("}");
+        break;
+    case op_code::OpGreaterThanJumpNotTruthy:
+    case op_code::OpEqJumpNotTruthy:
+        this->line("sp -= 2;");
+        this->line(std::string("if (!") +
+                   (op == op_code::OpEqJumpNotTruthy ? "is_equal"
+                                                     : "is_greater") +
+                   "(sp[0], sp[1])) {");
+        this->line("    goto " + this->target(i + 1) + ";");
+        this->line("}");
+        break;
+    case op_code::OpCall:
+        this->call(word, this->ins[i + 1], false);
+        break;
+    case op_code::OpTailCall:
+        this->call(word, this->ins[i + 1], true);
+        break;
+    case op_code::OpReturn:
+        this->line("*sp++ = value();");
+        this->line("return leave(ctx, sp, " + this->site(word) +
+                   ", jit_exit::Return);");
+        break;
+    case op_code::OpReturnValue:
+        this->line("return leave(ctx, sp, " + this->site(word) +
+                   ", jit_exit::Return);");
+        break;
+    case op_code::OpGetLocalGetLocal:
+        this->line("*sp++ = locals[" + u8(1) + "];");
+        this->line("*sp++ = locals[" + u8(2) + "];");
+        break;
+    case op_code::OpGetLocalConstant:
+    case op_code::OpAddLocalConstant:
+    case op_code::OpSubLocalConstant:
+        this->line("*sp++ = locals[" + u8(1) + "];");
+        this->line("*sp++ = " +
+                   this->constant(read_u16(this->ins, i + 2), word + 2) +
+                   ";");
+        if (op == op_code::OpAddLocalConstant) {
+            this->line("sp = add(ctx, sp);");
+        } else if (op == op_code::OpSubLocalConstant) {
+            this->line("sp = sub(ctx, sp);");
+        }
+        break;
+    default:
+        // OpHalt only ends the main program and the quickened forms are
+        // never in the byte code
+        return false;
+    }
+    return true;
+}
+
+std::string aot_translate(const byte_code& byte_code) {
+    std::string res = "// generated by axec, do not edit\n\n";
+    res += prelude;
+    std::string table;
+    for (size_t i = 0; i < byte_code.constants.size(); ++i) {
+        if (byte_code.constants[i].get_type() != object_type::Function) {
+            continue;
+        }
+        aot_translator translator(byte_code.constants, i);
+        if (!translator.translate()) {
+            continue;
+        }
+        // every entry point is a function of its own, the vm resumes a
+        // frame through one of them
+        auto name = "f" + std::to_string(i);
+        res += "jit_exit " + name + "(jit_context* ctx, int resume);\n";
+        for (size_t r = 0; r <= translator.get_num_resumes(); ++r) {
+            auto entry = name + "_" + std::to_string(r);
+            res += "jit_exit " + entry + "(jit_context* ctx) { return " +
+                   name + "(ctx, " + std::to_string(r) + "); }\n";
+        }
+        res += "\njit_exit " + name + "(jit_context* ctx, int resume) {\n";
+        res += "    const code_word* code = ctx->code;\n";
+        res += "    value* locals = ctx->locals;\n";
+        res += "    value* sp = ctx->stack_pointer;\n";
+        res += "    (void)code;\n    (void)locals;\n";
+        res += "    switch (resume) {\n";
+        for (size_t r = 1; r <= translator.get_num_resumes(); ++r) {
+            res += "    case " + std::to_string(r) + ":\n";
+            res += "        goto r" + std::to_string(r) + ";\n";
+        }
+        res += "    }\n";
+        res += translator.get_body();
+        res += "}\n\n";
+        table += "    {" + std::to_string(i) + ", &" + name + "_0},\n";
+    }
+    res += "} // namespace\n\n";
+
+    char fingerprint[32];
+    std::snprintf(fingerprint, sizeof(fingerprint), "UINT64_C(0x%016" PRIx64
+                  ")", aot_fingerprint(byte_code));
+    std::string functions = "nullptr";
+    size_t num_functions = 0;
+    if (!table.empty()) {
+        res += "static const axe::aot_function functions[] = {\n" + table +
+               "};\n\n";
+        functions = "functions";
+        num_functions = std::count(table.begin(), table.end(), '\n');
+    }
+    res += "extern \"C\" {\n";
+    res += "axe::aot_table axe_aot_table = {\n";
+    res += "    AXE_AOT_VERSION, " + std::string(fingerprint) + ", " +
+           std::to_string(num_functions) + ", " + functions + ", nullptr};\n";
+    res += "}\n";
+    return res;
+}
+
+std::optional<std::string> aot_build(const std::string& source,
+                                     const std::string& output,
+                                     const std::string& cxx,
+                                     const std::string& include_dir) {
+    // undefined symbols are refused, a module only reaches axe through
+    // its runtime table
+    std::vector<std::string> args = {
+        cxx,     "-std=c++17", "-O2",       "-fPIC", "-shared",
+        "-Wl,-z,defs", "-I",   include_dir, source,  "-o",
+        output};
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    int err = posix_spawnp(&pid, cxx.c_str(), nullptr, nullptr, argv.data(),
+                           environ);
+    if (err != 0) {
+        return "could not run " + cxx;
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1) {
+        return "could not wait for " + cxx;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return cxx + " failed to compile " + source;
+    }
+    return std::nullopt;
+}
+
+static object_type type_of(value v) { return v.get_type(); }
+
+static const aot_runtime runtime = {
+    &add_slow,          &sub_slow, &mul_slow, &div_slow, &equals_slow,
+    &greater_than_slow, &negate,   &type_of,
+};
+
+native_module::native_module() : handle(nullptr), table(nullptr) {}
+
+native_module::~native_module() {
+    if (this->handle != nullptr) {
+        dlclose(this->handle);
+    }
+}
+
+std::optional<std::string> native_module::open(const std::string& path) {
+    // dlopen searches the library path for names without a slash
+    auto name = path.find('/') == std::string::npos ? "./" + path : path;
+    this->handle = dlopen(name.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (this->handle == nullptr) {
+        return std::string(dlerror());
+    }
+    this->table = static_cast<aot_table*>(dlsym(this->handle, AXE_AOT_TABLE));
+    if (this->table == nullptr) {
+        return path + " is not an axe module";
+    }
+    if (this->table->version != AXE_AOT_VERSION) {
+        this->table = nullptr;
+        return path + " was built for another version of axe";
+    }
+    this->table->runtime = &runtime;
+    return std::nullopt;
+}
+
+const aot_table* native_module::get_table() const { return this->table; }
+
+} // namespace axe
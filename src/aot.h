@@ -0,0 +1,90 @@
+#ifndef __AXE_AOT_H__
+
+#define __AXE_AOT_H__
+
+#include "jit.h"
+#include "value.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// bumped whenever the layout of the structs below, jit_context or value
+// changes, a module built for another version is refused
+#define AXE_AOT_VERSION 1
+// the table every native module exports
+#define AXE_AOT_TABLE "axe_aot_table"
+
+namespace axe {
+
+struct byte_code;
+
+// what native code calls back into. a module links against nothing of
+// axe, the loader hands it these when it is opened.
+struct aot_runtime {
+    value (*add)(value lhs, value rhs, heap& heap);
+    value (*sub)(value lhs, value rhs, heap& heap);
+    value (*mul)(value lhs, value rhs, heap& heap);
+    value (*div)(value lhs, value rhs, heap& heap);
+    bool (*equals)(value lhs, value rhs);
+    bool (*greater_than)(value lhs, value rhs);
+    value (*negate)(value v, heap& heap);
+    object_type (*type_of)(value v);
+};
+
+// the machine code of the compiled function at constant in the constant
+// pool. it runs like the code of the jit, the vm enters it through
+// run_native and it exits for every call and return.
+struct aot_function {
+    size_t constant;
+    jit_entry entry;
+};
+
+struct aot_table {
+    uint32_t version;
+    // of the program the module was built from, see aot_fingerprint
+    uint64_t fingerprint;
+    size_t num_functions;
+    const aot_function* functions;
+    // filled in by native_module::open
+    const aot_runtime* runtime;
+};
+
+// a hash of the byte code and the constants of a program. a module only
+// fits the program it was translated from, constants are baked into
+// its code.
+uint64_t aot_fingerprint(const byte_code& byte_code);
+
+// a c++ translation unit with one native function per compiled function
+// of byte_code. the main program stays interpreted, it runs once.
+std::string aot_translate(const byte_code& byte_code);
+
+// compiles the translation unit at source into a shared object at
+// output with the c++ compiler cxx. include_dir is where aot.h lives.
+std::optional<std::string> aot_build(const std::string& source,
+                                     const std::string& output,
+                                     const std::string& cxx,
+                                     const std::string& include_dir);
+
+// a shared object built by aot_build, loaded with dlopen. it stays
+// loaded as long as the native_module lives, so every vm running its
+// code must be destroyed first.
+class native_module {
+  public:
+    native_module();
+    ~native_module();
+    native_module(const native_module&) = delete;
+    native_module& operator=(const native_module&) = delete;
+
+    std::optional<std::string> open(const std::string& path);
+    // nullptr until open succeeded
+    const aot_table* get_table() const;
+
+  private:
+    void* handle;
+    aot_table* table;
+};
+
+} // namespace axe
+
+#endif // __AXE_AOT_H__
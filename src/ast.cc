@@ -62,11 +62,10 @@ std::string prefix::string() const {
     return res;
 }
 
-assignment::assignment(const std::string& ident,
-                       std::unique_ptr<expression> rhs)
+assignment::assignment(atom ident, std::unique_ptr<expression> rhs)
     : ident(ident), rhs(std::move(rhs)) {}
 
-const std::string& assignment::get_ident() const { return this->ident; }
+atom assignment::get_ident() const { return this->ident; }
 
 const std::unique_ptr<expression>& assignment::get_rhs() const {
     return this->rhs;
@@ -74,7 +73,7 @@ const std::unique_ptr<expression>& assignment::get_rhs() const {
 
 std::string assignment::string() const {
     std::string res;
-    res += this->ident;
+    res += this->ident.string();
     res += " = ";
     res += this->rhs->string();
     return res;
@@ -233,16 +232,16 @@ std::string match::string() const {
     return res;
 }
 
-function_expression::function_expression(std::optional<std::string> name,
-                                         std::vector<std::string> params,
+function_expression::function_expression(std::optional<atom> name,
+                                         std::vector<atom> params,
                                          block_statement body)
     : name(std::move(name)), params(std::move(params)), body(std::move(body)) {}
 
-const std::optional<std::string>& function_expression::get_name() const {
+const std::optional<atom>& function_expression::get_name() const {
     return this->name;
 }
 
-const std::vector<std::string>& function_expression::get_params() const {
+const std::vector<atom>& function_expression::get_params() const {
     return this->params;
 }
 
@@ -253,11 +252,11 @@ const block_statement& function_expression::get_body() const {
 std::string function_expression::string() const {
     std::string res = "fn ";
     if (this->name.has_value()) {
-        res += *this->name;
+        res += this->name->string();
     }
     res += "(";
     for (size_t i = 0; i < this->params.size(); ++i) {
-        res += this->params[i];
+        res += this->params[i].string();
         if (i != this->params.size() - 1) {
             res += ", ";
         }
@@ -337,11 +336,11 @@ const std::string& expression::get_string() const {
     return std::get<std::string>(this->data);
 }
 
-const std::string& expression::get_ident() const {
+atom expression::get_ident() const {
     AXE_CHECK(this->type == expression_type::Ident,
               "trying to get Ident from type %s",
               expression_type_strings[(int)this->type]);
-    return std::get<std::string>(this->data);
+    return std::get<atom>(this->data);
 }
 
 const prefix& expression::get_prefix() const {
@@ -404,7 +403,7 @@ std::string expression::string() const {
     case expression_type::String:
         return std::get<std::string>(this->data);
     case expression_type::Ident:
-        return std::get<std::string>(this->data);
+        return std::get<atom>(this->data).string();
     case expression_type::Prefix:
         return std::get<prefix>(this->data).string();
     case expression_type::Infix:
@@ -425,16 +424,16 @@ std::string expression::string() const {
     AXE_UNREACHABLE;
 }
 
-let_statement::let_statement(std::string name, expression value)
-    : name(std::move(name)), value(std::move(value)) {}
+let_statement::let_statement(atom name, expression value)
+    : name(name), value(std::move(value)) {}
 
-const std::string& let_statement::get_name() const { return this->name; }
+atom let_statement::get_name() const { return this->name; }
 
 const expression& let_statement::get_value() const { return this->value; }
 
 std::string let_statement::string() const {
     std::string res = "let ";
-    res += this->name;
+    res += this->name.string();
     res += " = ";
     res += this->value.string();
     res += ';';
@@ -2,6 +2,7 @@
 
 #define __AXE_AST_H__
 
+#include "atom.h"
 #include <cstdint>
 #include <memory>
 #include <optional>
@@ -79,16 +80,15 @@ class block_statement : public ast_node {
 
 class assignment : public ast_node {
   public:
-    assignment(const std::string& ident,
-               std::unique_ptr<class expression> rhs);
+    assignment(atom ident, std::unique_ptr<class expression> rhs);
 
-    const std::string& get_ident() const;
+    atom get_ident() const;
     const std::unique_ptr<class expression>& get_rhs() const;
 
     std::string string() const override;
 
   private:
-    std::string ident;
+    atom ident;
     std::unique_ptr<class expression> rhs;
 };
 
@@ -189,18 +189,18 @@ class match : public ast_node {
 
 class function_expression : public ast_node {
   public:
-    function_expression(std::optional<std::string> name,
-                        std::vector<std::string> params, block_statement body);
+    function_expression(std::optional<atom> name, std::vector<atom> params,
+                        block_statement body);
 
-    const std::optional<std::string>& get_name() const;
-    const std::vector<std::string>& get_params() const;
+    const std::optional<atom>& get_name() const;
+    const std::vector<atom>& get_params() const;
     const block_statement& get_body() const;
 
     std::string string() const override;
 
   private:
-    std::optional<std::string> name;
-    std::vector<std::string> params;
+    std::optional<atom> name;
+    std::vector<atom> params;
     block_statement body;
 };
 
@@ -235,9 +235,12 @@ enum class expression_type {
     Call,
 };
 
+// idents are atoms. strings are not, the atoms live as long as the
+// program and a string literal is only needed until it is compiled.
 using expression_data =
-    std::variant<std::monostate, int64_t, double, bool, std::string, prefix,
-                 infix, assignment, if_expression, match, function_expression, call>;
+    std::variant<std::monostate, int64_t, double, bool, std::string, atom,
+                 prefix, infix, assignment, if_expression, match,
+                 function_expression, call>;
 
 class expression : public ast_node {
   public:
@@ -250,7 +253,7 @@ class expression : public ast_node {
     double get_float() const;
     bool get_bool() const;
     const std::string& get_string() const;
-    const std::string& get_ident() const;
+    atom get_ident() const;
     const prefix& get_prefix() const;
     const infix& get_infix() const;
     const assignment& get_assignment() const;
@@ -268,15 +271,15 @@ class expression : public ast_node {
 
 class let_statement : public ast_node {
   public:
-    let_statement(std::string name, expression value);
+    let_statement(atom name, expression value);
 
-    const std::string& get_name() const;
+    atom get_name() const;
     const expression& get_value() const;
 
     std::string string() const override;
 
   private:
-    std::string name;
+    atom name;
     expression value;
 };
 
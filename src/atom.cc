@@ -0,0 +1,60 @@
+#include "atom.h"
+#include "base.h"
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+namespace axe {
+
+namespace {
+
+struct atom_table {
+    std::mutex mutex;
+    // a deque so the strings never move, ids keys views of them
+    std::deque<std::string> strings;
+    std::unordered_map<std::string_view, uint32_t> ids;
+
+    atom_table() {
+        this->strings.emplace_back();
+        this->ids.emplace(this->strings.back(), 0);
+    }
+};
+
+} // namespace
+
+static atom_table& table() {
+    static atom_table table;
+    return table;
+}
+
+atom::atom() : id(0) {}
+
+atom::atom(std::string_view str) {
+    auto& table = axe::table();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    auto it = table.ids.find(str);
+    if (it != table.ids.end()) {
+        this->id = it->second;
+        return;
+    }
+    AXE_CHECK(table.strings.size() <= std::numeric_limits<uint32_t>::max(),
+              "too many atoms");
+    this->id = static_cast<uint32_t>(table.strings.size());
+    table.strings.emplace_back(str);
+    table.ids.emplace(table.strings.back(), this->id);
+}
+
+uint32_t atom::get_id() const { return this->id; }
+
+const std::string& atom::string() const {
+    auto& table = axe::table();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    return table.strings[this->id];
+}
+
+bool atom::operator==(atom other) const { return this->id == other.id; }
+
+bool atom::operator!=(atom other) const { return this->id != other.id; }
+
+} // namespace axe
@@ -0,0 +1,43 @@
+#ifndef __AXE_ATOM_H__
+
+#define __AXE_ATOM_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace axe {
+
+// an identifier interned in one table for the whole program, so each
+// distinct one is stored once and comparing two is comparing their ids.
+// interning is thread safe and atoms live until the program exits, so
+// only names are interned. string literals are data and stay strings.
+class atom {
+  public:
+    // the empty string
+    atom();
+    explicit atom(std::string_view str);
+
+    uint32_t get_id() const;
+    const std::string& string() const;
+
+    bool operator==(atom other) const;
+    bool operator!=(atom other) const;
+
+  private:
+    uint32_t id;
+};
+
+} // namespace axe
+
+namespace std {
+
+template <> struct hash<axe::atom> {
+    size_t operator()(axe::atom atom) const { return atom.get_id(); }
+};
+
+} // namespace std
+
+#endif // __AXE_ATOM_H__
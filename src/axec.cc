@@ -1,4 +1,93 @@
+#include "aot.h"
 #include "argparse.hpp"
+#include "compiler.h"
+#include "lexer.h"
+#include "parser.h"
+#include "symbol_table.h"
+#include "vm.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// where aot.h and the headers it includes are, set by the build
+#ifndef AXE_INCLUDE_DIR
+#define AXE_INCLUDE_DIR "src"
+#endif
+
+using compiler =
+    axe::compiler<std::vector<axe::object>, axe::symbol_table>;
+
+bool read_file(const std::string& path, std::string& contents) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+bool check_errors(const axe::parser& parser) {
+    for (auto& err : parser.get_errors()) {
+        std::cerr << err << '\n';
+    }
+    return parser.get_errors().size() != 0;
+}
+
+// writes the translation unit to output, or builds it into a shared
+// object at output
+int build(const axe::byte_code& byte_code, const std::string& output,
+          const std::string& cxx, const std::string& include_dir,
+          bool emit_source) {
+    auto source_path = emit_source ? output : output + ".cc";
+    std::ofstream source(source_path);
+    source << axe::aot_translate(byte_code);
+    source.close();
+    if (!source) {
+        std::cerr << "could not write " << source_path << '\n';
+        return 1;
+    }
+    if (emit_source) {
+        return 0;
+    }
+    auto err = axe::aot_build(source_path, output, cxx, include_dir);
+    std::remove(source_path.c_str());
+    if (err.has_value()) {
+        std::cerr << *err << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// runs the program with the functions of the module at path
+int run(const axe::byte_code& byte_code, const std::string& path) {
+    axe::native_module module;
+    auto err = module.open(path);
+    if (err.has_value()) {
+        std::cerr << *err << '\n';
+        return 1;
+    }
+    if (module.get_table()->fingerprint != axe::aot_fingerprint(byte_code)) {
+        std::cerr << path << " was built from another program\n";
+        return 1;
+    }
+    axe::vm_options options;
+    options.native_module = module.get_table();
+    // the byte code comes straight from the compiler
+    options.verify = false;
+    axe::vm<axe::globals_owned> vm(byte_code, options);
+    err = vm.run();
+    if (err.has_value()) {
+        std::cerr << *err << '\n';
+        return 1;
+    }
+    std::cout << vm.last_popped_stack_element().string() << '\n';
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
     argparse::ArgumentParser program("axec");
@@ -6,8 +95,28 @@ int main(int argc, char* argv[]) {
     program.add_argument("file").required().help("the file to compile");
 
     program.add_argument("-o", "--output")
-        .required()
-        .help("specifiy the output file");
+        .help("specifiy the output file, a shared object with one native "
+              "function per function of the program");
+
+    program.add_argument("--emit-source")
+        .default_value(false)
+        .implicit_value(true)
+        .help("write the generated c++ to the output file instead of "
+              "compiling it");
+
+    program.add_argument("--run")
+        .help("run the file with the functions of a shared object axec "
+              "built from it");
+
+    program.add_argument("--cxx")
+        .default_value(std::string(std::getenv("CXX") != nullptr
+                                       ? std::getenv("CXX")
+                                       : "c++"))
+        .help("the c++ compiler that builds the shared object");
+
+    program.add_argument("--include")
+        .default_value(std::string(AXE_INCLUDE_DIR))
+        .help("the directory of the axe headers");
 
     try {
         program.parse_args(argc, argv);
@@ -18,8 +127,37 @@ int main(int argc, char* argv[]) {
     }
 
     auto file = program.get<std::string>("file");
-    auto out = program.get<std::string>("-o");
+    auto out = program.present("-o");
+    auto module = program.present("--run");
+    if (!out.has_value() && !module.has_value()) {
+        std::cerr << "one of --output and --run is required\n";
+        std::cerr << program;
+        exit(1);
+    }
 
-    std::cout << file << '\n' << out << '\n';
-    return 0;
+    std::string input;
+    if (!read_file(file, input)) {
+        std::cerr << "could not read " << file << '\n';
+        return 1;
+    }
+    axe::lexer lexer(input);
+    axe::parser parser(lexer);
+    auto ast = parser.parse();
+    if (check_errors(parser)) {
+        return 1;
+    }
+    compiler compiler;
+    auto err = compiler.compile(std::move(ast));
+    if (err.has_value()) {
+        std::cerr << "COMPILE ERROR: " << *err << '\n';
+        return 1;
+    }
+    auto byte_code = compiler.get_byte_code();
+
+    if (out.has_value()) {
+        return build(byte_code, *out, program.get<std::string>("--cxx"),
+                     program.get<std::string>("--include"),
+                     program.get<bool>("--emit-source"));
+    }
+    return run(byte_code, *module);
 }
@@ -1,4 +1,6 @@
 #include "code.h"
+#include "base.h"
+#include <algorithm>
 #include <optional>
 #include <stdint.h>
 
@@ -25,45 +27,217 @@ static const definition definitions[] = {
     definition("OpGetGlobal", {2}),  definition("OpSetGlobal", {2}),
     definition("OpCall", {1}),       definition("OpReturnValue", {}),
     definition("OpReturn", {}),      definition("OpGetLocal", {1}),
-    definition("OpSetLocal", {1}),
+    definition("OpSetLocal", {1}),   definition("OpHalt", {}),
+    definition("OpGetLocalGetLocal", {1, 1}),
+    definition("OpGetLocalConstant", {1, 2}),
+    definition("OpAddLocalConstant", {1, 2}),
+    definition("OpSubLocalConstant", {1, 2}),
+    definition("OpGreaterThanJumpNotTruthy", {2}),
+    definition("OpEqJumpNotTruthy", {2}),
+    definition("OpTailCall", {1}),
+    definition("OpAddInt", {}),
+    definition("OpAddFloat", {}),
+    definition("OpSubInt", {}),
+    definition("OpSubFloat", {}),
+    definition("OpGreaterThanInt", {}),
+    definition("OpGreaterThanFloat", {}),
+    definition("OpEqInt", {}),
+    definition("OpEqFloat", {}),
+    definition("OpJumpTruthy", {2}),
+    definition("OpJumpTable", {2, 2}),
+    definition("OpSwitch", {2}),
+    definition("OpCase", {2, 2}),
+};
+
+static const definition register_definitions[] = {
+    definition("OpLoadConstant", {1, 2}),
+    definition("OpLoadTrue", {1}),
+    definition("OpLoadFalse", {1}),
+    definition("OpLoadNull", {1}),
+    definition("OpMove", {1, 1}),
+    definition("OpGetGlobal", {1, 2}),
+    definition("OpSetGlobal", {1, 2}),
+    definition("OpAdd", {1, 1, 1}),
+    definition("OpSub", {1, 1, 1}),
+    definition("OpMul", {1, 1, 1}),
+    definition("OpDiv", {1, 1, 1}),
+    definition("OpEq", {1, 1, 1}),
+    definition("OpNotEq", {1, 1, 1}),
+    definition("OpGreaterThan", {1, 1, 1}),
+    definition("OpMinus", {1, 1}),
+    definition("OpBang", {1, 1}),
+    definition("OpJump", {2}),
+    definition("OpJumpNotTruthy", {1, 2}),
+    definition("OpCall", {1, 1}),
+    definition("OpReturnValue", {1}),
+    definition("OpReturn", {}),
+    definition("OpPop", {1}),
+    definition("OpHalt", {}),
 };
 
 std::optional<const definition> lookup(op_code op) {
-    return definitions[static_cast<size_t>(op)];
+    size_t index = static_cast<size_t>(op);
+    if (index >= sizeof(definitions) / sizeof(definitions[0])) {
+        return std::nullopt;
+    }
+    return definitions[index];
 }
 
-static void put_big_endian_u16(std::vector<uint8_t>& instruction,
-                               uint16_t operand) {
-    instruction.push_back(static_cast<uint8_t>(operand >> 8));
-    instruction.push_back(static_cast<uint8_t>(operand));
+std::optional<const definition> lookup(register_op_code op) {
+    size_t index = static_cast<size_t>(op);
+    if (index >=
+        sizeof(register_definitions) / sizeof(register_definitions[0])) {
+        return std::nullopt;
+    }
+    return register_definitions[index];
 }
 
-std::vector<uint8_t> make(op_code op, const std::vector<int> operands) {
-    auto def = lookup(op);
-    if (!def.has_value()) {
-        return {};
+// the definitions without the copy lookup makes, nullptr for an
+// undefined op
+static const definition* find_definition(op_code op) {
+    size_t index = static_cast<size_t>(op);
+    if (index >= sizeof(definitions) / sizeof(definitions[0])) {
+        return nullptr;
     }
-    int instruction_length = 1;
-    auto& operand_widths = def->get_operand_widths();
+    return &definitions[index];
+}
+
+static const definition* find_definition(register_op_code op) {
+    size_t index = static_cast<size_t>(op);
+    if (index >=
+        sizeof(register_definitions) / sizeof(register_definitions[0])) {
+        return nullptr;
+    }
+    return &register_definitions[index];
+}
+
+static void put_big_endian_u16(uint8_t* ptr, uint16_t operand) {
+    ptr[0] = static_cast<uint8_t>(operand >> 8);
+    ptr[1] = static_cast<uint8_t>(operand);
+}
+
+// appends the instruction to ins, operands that are not given are 0
+static size_t encode(instructions& ins, uint8_t op, const definition& def,
+                     const int* operands, size_t num_operands) {
+    auto& operand_widths = def.get_operand_widths();
+    size_t position = ins.size();
+    size_t length = 1;
     for (auto& width : operand_widths) {
-        instruction_length += width;
-    }
-    std::vector<uint8_t> instruction;
-    instruction.reserve(instruction_length);
-    instruction.push_back((uint8_t)op);
-    for (size_t i = 0; i < operands.size(); ++i) {
-        int operand = operands[i];
-        int width = operand_widths[i];
-        switch (width) {
+        length += width;
+    }
+    ins.resize(position + length);
+    uint8_t* ptr = &ins[position];
+    *ptr++ = op;
+    for (size_t i = 0; i < operand_widths.size(); ++i) {
+        int operand = i < num_operands ? operands[i] : 0;
+        switch (operand_widths[i]) {
         case 2:
-            put_big_endian_u16(instruction, operand);
+            put_big_endian_u16(ptr, operand);
             break;
         case 1:
-            instruction.push_back(static_cast<uint8_t>(operand));
+            *ptr = static_cast<uint8_t>(operand);
             break;
         }
+        ptr += operand_widths[i];
+    }
+    return position;
+}
+
+std::vector<uint8_t> make(op_code op, const std::vector<int> operands) {
+    instructions res;
+    auto def = find_definition(op);
+    if (def != nullptr) {
+        encode(res, static_cast<uint8_t>(op), *def, operands.data(),
+               operands.size());
+    }
+    return res;
+}
+
+std::vector<uint8_t> make(register_op_code op,
+                          const std::vector<int> operands) {
+    instructions res;
+    auto def = find_definition(op);
+    if (def != nullptr) {
+        encode(res, static_cast<uint8_t>(op), *def, operands.data(),
+               operands.size());
+    }
+    return res;
+}
+
+instructions& assembler::get_instructions() { return this->ins; }
+
+const instructions& assembler::get_instructions() const { return this->ins; }
+
+size_t assembler::size() const { return this->ins.size(); }
+
+void assembler::reserve(size_t bytes) {
+    this->ins.reserve(this->ins.size() + bytes);
+}
+
+size_t assembler::emit(op_code op, std::initializer_list<int> operands) {
+    auto def = find_definition(op);
+    AXE_CHECK(def != nullptr, "emitting undefined op %d", (int)op);
+    return encode(this->ins, static_cast<uint8_t>(op), *def,
+                  operands.begin(), operands.size());
+}
+
+size_t assembler::emit(register_op_code op,
+                       std::initializer_list<int> operands) {
+    auto def = find_definition(op);
+    AXE_CHECK(def != nullptr, "emitting undefined op %d", (int)op);
+    return encode(this->ins, static_cast<uint8_t>(op), *def,
+                  operands.begin(), operands.size());
+}
+
+size_t assembler::emit(op_code op, label target) {
+    size_t position = this->emit(op, {});
+    this->jump_to(target);
+    return position;
+}
+
+size_t assembler::emit(op_code op, int operand, label target) {
+    size_t position = this->emit(op, {operand});
+    this->jump_to(target);
+    return position;
+}
+
+size_t assembler::emit(register_op_code op, label target) {
+    size_t position = this->emit(op, {});
+    this->jump_to(target);
+    return position;
+}
+
+size_t assembler::emit(register_op_code op, int operand, label target) {
+    size_t position = this->emit(op, {operand});
+    this->jump_to(target);
+    return position;
+}
+
+label assembler::new_label() {
+    this->labels.push_back({unbound, unbound});
+    return {this->labels.size() - 1};
+}
+
+void assembler::bind(label target) {
+    auto& state = this->labels[target.id];
+    AXE_CHECK(state.offset == unbound, "binding label %zu twice", target.id);
+    state.offset = this->ins.size();
+    for (size_t i = state.fixups; i != unbound; i = this->fixups[i].next) {
+        put_big_endian_u16(&this->ins[this->fixups[i].at], state.offset);
+    }
+    state.fixups = unbound;
+}
+
+// the last two bytes emitted are the jump operand
+void assembler::jump_to(label target) {
+    auto& state = this->labels[target.id];
+    size_t at = this->ins.size() - 2;
+    if (state.offset != unbound) {
+        put_big_endian_u16(&this->ins[at], state.offset);
+        return;
     }
-    return instruction;
+    this->fixups.push_back({at, state.fixups});
+    state.fixups = this->fixups.size() - 1;
 }
 
 std::string format_instructions(const definition& def,
@@ -76,26 +250,22 @@ std::string format_instructions(const definition& def,
                " does not match defined " + std::to_string(operand_count);
         return res;
     }
-    switch (operand_count) {
-    case 0:
-        return std::string(def.get_name());
-    case 1:
-        res += std::string(def.get_name()) + " " + std::to_string(operands[0]);
-        return res;
+    res += def.get_name();
+    for (auto operand : operands) {
+        res += " " + std::to_string(operand);
     }
-    res += "ERROR: unhandled operand_count for " + std::string(def.get_name()) +
-           "\n";
     return res;
 }
 
-std::string instructions_string(const instructions& ins) {
+template <typename OpCode>
+static std::string format_all_instructions(const instructions& ins) {
     std::string res;
     size_t i = 0;
     while (i < ins.size()) {
-        auto def = lookup(static_cast<op_code>(ins[i]));
+        auto def = lookup(static_cast<OpCode>(ins[i]));
         if (!def.has_value()) {
-            std::string err =
-                "ERROR: opcode " + std::to_string(ins[i]) + " undefined";
+            res += "ERROR: opcode " + std::to_string(ins[i]) + " undefined\n";
+            i++;
             continue;
         }
 
@@ -113,6 +283,14 @@ std::string instructions_string(const instructions& ins) {
     return res;
 }
 
+std::string instructions_string(const instructions& ins) {
+    return format_all_instructions<op_code>(ins);
+}
+
+std::string register_instructions_string(const instructions& ins) {
+    return format_all_instructions<register_op_code>(ins);
+}
+
 uint16_t read_u16(const instructions& ins, int offset) {
     uint16_t res = static_cast<uint16_t>(ins[offset] << 8);
     offset++;
@@ -120,6 +298,10 @@ uint16_t read_u16(const instructions& ins, int offset) {
     return res;
 }
 
+uint16_t read_u16(const uint8_t* ptr) {
+    return static_cast<uint16_t>((ptr[0] << 8) | ptr[1]);
+}
+
 const std::pair<std::vector<int>, int> read_operands(const definition& def,
                                                      const instructions& ins) {
     std::vector<int> operands;
@@ -139,4 +321,210 @@ const std::pair<std::vector<int>, int> read_operands(const definition& def,
     return std::pair<std::vector<int>, int>(operands, offset);
 }
 
+int jump_operand(op_code op) {
+    switch (op) {
+    case op_code::OpJump:
+    case op_code::OpJumpNotTruthy:
+    case op_code::OpJumpTruthy:
+    case op_code::OpGreaterThanJumpNotTruthy:
+    case op_code::OpEqJumpNotTruthy:
+        return 0;
+    case op_code::OpCase:
+        return 1;
+    default:
+        break;
+    }
+    return -1;
+}
+
+size_t switch_entries(const instruction& ins) {
+    switch (ins.op) {
+    case op_code::OpJumpTable:
+        return 1 + ins.operands[1];
+    case op_code::OpSwitch:
+        return 1 + ins.operands[0];
+    default:
+        break;
+    }
+    return 0;
+}
+
+std::vector<instruction> disassemble(const instructions& ins) {
+    std::vector<instruction> res;
+    size_t i = 0;
+    while (i < ins.size()) {
+        op_code op = static_cast<op_code>(ins[i]);
+        auto def = find_definition(op);
+        if (def == nullptr) {
+            break;
+        }
+        std::vector<int> operands;
+        size_t offset = i + 1;
+        for (auto& width : def->get_operand_widths()) {
+            switch (width) {
+            case 2:
+                operands.push_back(read_u16(ins, offset));
+                break;
+            case 1:
+                operands.push_back(ins[offset]);
+                break;
+            }
+            offset += width;
+        }
+        res.push_back({op, std::move(operands), i});
+        i = offset;
+    }
+    return res;
+}
+
+instructions assemble(const std::vector<instruction>& list) {
+    std::vector<size_t> new_positions;
+    new_positions.reserve(list.size() + 1);
+    size_t size = 0;
+    for (auto& ins : list) {
+        new_positions.push_back(size);
+        size += 1;
+        auto def = find_definition(ins.op);
+        for (auto& width : def->get_operand_widths()) {
+            size += width;
+        }
+    }
+    new_positions.push_back(size);
+
+    instructions res;
+    res.reserve(size);
+    for (auto& ins : list) {
+        auto& def = *find_definition(ins.op);
+        int jump = jump_operand(ins.op);
+        if (jump < 0) {
+            encode(res, static_cast<uint8_t>(ins.op), def,
+                   ins.operands.data(), ins.operands.size());
+            continue;
+        }
+        size_t target = static_cast<size_t>(ins.operands[jump]);
+        auto it = std::lower_bound(
+            list.begin(), list.end(), target,
+            [](const instruction& ins, size_t target) {
+                return ins.position < target;
+            });
+        size_t position =
+            encode(res, static_cast<uint8_t>(ins.op), def,
+                   ins.operands.data(), ins.operands.size());
+        // the operands up to the jump operand are two bytes wide
+        put_big_endian_u16(&res[position + 1 + 2 * jump],
+                           new_positions[it - list.begin()]);
+    }
+    return res;
+}
+
+// how many values an instruction leaves on the stack minus how many it
+// takes off
+static int stack_effect(const instruction& ins) {
+    switch (ins.op) {
+    case op_code::OpConstant:
+    case op_code::OpTrue:
+    case op_code::OpFalse:
+    case op_code::OpNull:
+    case op_code::OpGetGlobal:
+    case op_code::OpGetLocal:
+    case op_code::OpAddLocalConstant:
+    case op_code::OpSubLocalConstant:
+        return 1;
+    case op_code::OpGetLocalGetLocal:
+    case op_code::OpGetLocalConstant:
+        return 2;
+    case op_code::OpAdd:
+    case op_code::OpSub:
+    case op_code::OpMul:
+    case op_code::OpDiv:
+    case op_code::OpEq:
+    case op_code::OpNotEq:
+    case op_code::OpGreaterThan:
+    case op_code::OpPop:
+    case op_code::OpJumpNotTruthy:
+    case op_code::OpJumpTruthy:
+    case op_code::OpJumpTable:
+    case op_code::OpSwitch:
+    case op_code::OpSetGlobal:
+    case op_code::OpSetLocal:
+    case op_code::OpReturnValue:
+        return -1;
+    case op_code::OpGreaterThanJumpNotTruthy:
+    case op_code::OpEqJumpNotTruthy:
+        return -2;
+    // the callee and the arguments are replaced by the result
+    case op_code::OpCall:
+    case op_code::OpTailCall:
+        return -ins.operands[0];
+    default:
+        break;
+    }
+    return 0;
+}
+
+static bool ends_flow(op_code op) {
+    switch (op) {
+    case op_code::OpReturnValue:
+    case op_code::OpReturn:
+    case op_code::OpTailCall:
+    case op_code::OpHalt:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+// walks every path through the instructions once. the compiler only
+// emits code where the stack has the same height on every path into an
+// instruction, so the first height seen is the height.
+size_t max_stack_depth(const instructions& ins) {
+    auto list = disassemble(ins);
+    std::vector<int> heights(list.size(), -1);
+    std::vector<size_t> work;
+    int max = 0;
+    if (!list.empty()) {
+        heights[0] = 0;
+        work.push_back(0);
+    }
+    auto visit = [&](size_t index, int height) {
+        if (index < list.size() && heights[index] < 0) {
+            heights[index] = height;
+            work.push_back(index);
+        }
+    };
+    while (!work.empty()) {
+        size_t index = work.back();
+        work.pop_back();
+        auto& cur = list[index];
+        int height = heights[index] + stack_effect(cur);
+        if (height < 0) {
+            height = 0;
+        }
+        if (height > max) {
+            max = height;
+        }
+        if (ends_flow(cur.op)) {
+            continue;
+        }
+        int jump = jump_operand(cur.op);
+        if (jump >= 0) {
+            size_t target = static_cast<size_t>(cur.operands[jump]);
+            auto it = std::lower_bound(
+                list.begin(), list.end(), target,
+                [](const instruction& ins, size_t target) {
+                    return ins.position < target;
+                });
+            visit(it - list.begin(), height);
+        }
+        if (cur.op != op_code::OpJump && cur.op != op_code::OpCase) {
+            visit(index + 1, height);
+        }
+        for (size_t i = 2; i <= switch_entries(cur); ++i) {
+            visit(index + i, height);
+        }
+    }
+    return static_cast<size_t>(max);
+}
+
 } // namespace axe
@@ -2,7 +2,9 @@
 
 #define __AXE_CODE_H__
 
+#include <cstddef>
 #include <cstdint>
+#include <initializer_list>
 #include <optional>
 #include <string>
 #include <vector>
@@ -35,6 +37,71 @@ enum class op_code {
     OpReturn = 20,
     OpGetLocal = 21,
     OpSetLocal = 22,
+    OpHalt = 23,
+    // superinstructions, produced by fuse_superinstructions. the set was
+    // chosen from the most frequent sequences reported by axe-ngrams.
+    OpGetLocalGetLocal = 24,         // OpGetLocal a; OpGetLocal b
+    OpGetLocalConstant = 25,         // OpGetLocal a; OpConstant b
+    OpAddLocalConstant = 26,         // OpGetLocal a; OpConstant b; OpAdd
+    OpSubLocalConstant = 27,         // OpGetLocal a; OpConstant b; OpSub
+    OpGreaterThanJumpNotTruthy = 28, // OpGreaterThan; OpJumpNotTruthy a
+    OpEqJumpNotTruthy = 29,          // OpEq; OpJumpNotTruthy a
+    // a call whose result is returned right away, reuses the frame of
+    // the caller
+    OpTailCall = 30,
+    // quickened forms of OpAdd, OpSub, OpGreaterThan and OpEq for two
+    // ints or two floats. never emitted, the vm rewrites the generic
+    // instruction in place once it has seen the types of its operands
+    // and rewrites it back when they change.
+    OpAddInt = 31,
+    OpAddFloat = 32,
+    OpSubInt = 33,
+    OpSubFloat = 34,
+    OpGreaterThanInt = 35,
+    OpGreaterThanFloat = 36,
+    OpEqInt = 37,
+    OpEqFloat = 38,
+    // OpBang; OpJumpNotTruthy a, produced by the peephole pass
+    OpJumpTruthy = 39,
+    // the dispatch of a match, see switch_entries. both pop the value
+    // matched and are followed by an OpJump to the default.
+    // OpJumpTable low count: count more OpJumps follow, the one for the
+    // int constant low first, then low + 1 and so on.
+    // OpSwitch count: count OpCase follow, sorted by their int constant
+    // or all with string constants, which the vm hashes.
+    OpJumpTable = 40,
+    OpSwitch = 41,
+    // OpCase constant target, never run
+    OpCase = 42,
+};
+
+// three address instructions of the register backend. A, B and C are
+// one byte register operands relative to the frame, Bx is a two byte
+// constant index, global index or absolute jump target.
+enum class register_op_code {
+    OpLoadConstant = 0,   // A Bx    R[A] = constants[Bx]
+    OpLoadTrue = 1,       // A       R[A] = true
+    OpLoadFalse = 2,      // A       R[A] = false
+    OpLoadNull = 3,       // A       R[A] = null
+    OpMove = 4,           // A B     R[A] = R[B]
+    OpGetGlobal = 5,      // A Bx    R[A] = globals[Bx]
+    OpSetGlobal = 6,      // A Bx    globals[Bx] = R[A]
+    OpAdd = 7,            // A B C   R[A] = R[B] + R[C]
+    OpSub = 8,            // A B C   R[A] = R[B] - R[C]
+    OpMul = 9,            // A B C   R[A] = R[B] * R[C]
+    OpDiv = 10,           // A B C   R[A] = R[B] / R[C]
+    OpEq = 11,            // A B C   R[A] = R[B] == R[C]
+    OpNotEq = 12,         // A B C   R[A] = R[B] != R[C]
+    OpGreaterThan = 13,   // A B C   R[A] = R[B] > R[C]
+    OpMinus = 14,         // A B     R[A] = -R[B]
+    OpBang = 15,          // A B     R[A] = !R[B]
+    OpJump = 16,          // Bx      jump to Bx
+    OpJumpNotTruthy = 17, // A Bx    jump to Bx if R[A] is not truthy
+    OpCall = 18,          // A B     R[A] = R[A](R[A + 1], ..., R[A + B])
+    OpReturnValue = 19,   // A       return R[A]
+    OpReturn = 20,        //         return null
+    OpPop = 21,           // A       the result of an expression statement
+    OpHalt = 22,
 };
 
 class definition {
@@ -49,16 +116,103 @@ class definition {
 };
 
 std::optional<const definition> lookup(op_code op);
+std::optional<const definition> lookup(register_op_code op);
 
 std::vector<uint8_t> make(op_code op, const std::vector<int> operands);
+std::vector<uint8_t> make(register_op_code op,
+                          const std::vector<int> operands);
+
+// a jump target in the code of an assembler, bound to an offset once
+// the code it stands for is emitted
+struct label {
+    size_t id;
+};
+
+// writes instructions straight into byte code, without allocating for
+// each of them. jumps can target labels that are not bound yet, their
+// operands are patched when the label is.
+class assembler {
+  public:
+    instructions& get_instructions();
+    const instructions& get_instructions() const;
+    size_t size() const;
+    // makes room for about bytes more code up front
+    void reserve(size_t bytes);
+
+    // the offset of the instruction emitted
+    size_t emit(op_code op, std::initializer_list<int> operands = {});
+    size_t emit(register_op_code op, std::initializer_list<int> operands = {});
+    // emits a jump, the jump operand is the last one and comes from
+    // target
+    size_t emit(op_code op, label target);
+    size_t emit(op_code op, int operand, label target);
+    size_t emit(register_op_code op, label target);
+    size_t emit(register_op_code op, int operand, label target);
+
+    label new_label();
+    // target is the current end of the code from now on
+    void bind(label target);
+
+  private:
+    static constexpr size_t unbound = static_cast<size_t>(-1);
+
+    struct label_state {
+        size_t offset;
+        // the last of the fixups waiting for it, or unbound
+        size_t fixups;
+    };
+
+    // an operand to patch once its label is bound
+    struct fixup {
+        size_t at;
+        size_t next;
+    };
+
+    instructions ins;
+    std::vector<label_state> labels;
+    std::vector<fixup> fixups;
+
+    void jump_to(label target);
+};
 
 uint16_t read_u16(const instructions& ins, int offset);
+uint16_t read_u16(const uint8_t* ptr);
 
 std::string instructions_string(const instructions& ins);
+std::string register_instructions_string(const instructions& ins);
 
 const std::pair<std::vector<int>, int> read_operands(const definition& def,
                                                      const instructions& ins);
 
+// a single decoded instruction, used by passes that rewrite byte code.
+// position is the offset the instruction had in the byte code it was
+// disassembled from, jump operands keep referring to those offsets.
+struct instruction {
+    op_code op;
+    std::vector<int> operands;
+    size_t position;
+};
+
+// the index of the operand holding a jump target, or -1
+int jump_operand(op_code op);
+
+// how many of the instructions after ins are entries of its table, the
+// jump to the default and the cases. 0 when ins is not OpJumpTable or
+// OpSwitch. the entries only pass on the targets, they stay where they
+// are and keep their width.
+size_t switch_entries(const instruction& ins);
+
+std::vector<instruction> disassemble(const instructions& ins);
+
+// encodes instructions again, retargeting every jump to the new offset
+// of the first instruction at or after its old target. instructions
+// must be ordered by position.
+instructions assemble(const std::vector<instruction>& list);
+
+// the most values the instructions push on top of the locals of their
+// frame at any point
+size_t max_stack_depth(const instructions& ins);
+
 } // namespace axe
 
 #endif // __AXE_CODE_H__
@@ -2,73 +2,418 @@
 #include "ast.h"
 #include "base.h"
 #include "code.h"
+#include "fold.h"
+#include "ir.h"
+#include "peephole.h"
+#include "superinstructions.h"
+#include <algorithm>
+#include <cstring>
 #include <optional>
+#include <type_traits>
+#include <unordered_map>
 
 namespace axe {
 
+// about how many bytes of code a statement compiles to, the code of a
+// body is reserved up front from it
+static constexpr size_t statement_size_estimate = 12;
+
 template <>
-compiler<constants_owned, symbol_table_owned>::compiler()
-    : symb_table(symbol_table()), scope_index(0) {
-    compilation_scope main_scope = {std::vector<uint8_t>(), {}, {}};
+compiler<constants_owned, symbol_table_owned>::compiler(
+    compiler_options options)
+    : options(options), symb_table(symbol_table()), scope_index(0),
+      max_stack(0), last_lowered(false), match_depth(0) {
+    compilation_scope main_scope = {assembler(), {}, {}};
     this->scopes.push_back(main_scope);
+    this->index_constants();
 }
 
 template <>
 compiler<constants_ref, symbol_table_ref>::compiler(
-    symbol_table& symb_table, std::vector<object>& constants)
-    : symb_table(symb_table), constants(constants), scope_index(0) {
-    compilation_scope main_scope = {std::vector<uint8_t>(), {}, {}};
+    symbol_table& symb_table, std::vector<object>& constants,
+    compiler_options options)
+    : options(options), constants(constants), symb_table(symb_table),
+      scope_index(0), max_stack(0), last_lowered(false), match_depth(0) {
+    compilation_scope main_scope = {assembler(), {}, {}};
     this->scopes.push_back(main_scope);
+    this->index_constants();
+}
+
+static void count_bindings(const expression& expression,
+                           std::unordered_map<atom, size_t>& bindings);
+
+static void count_bindings(const block_statement& block,
+                           std::unordered_map<atom, size_t>& bindings);
+
+// counts the lets, named functions and assignments of every name
+static void count_bindings(const statement& statement,
+                           std::unordered_map<atom, size_t>& bindings) {
+    switch (statement.get_type()) {
+    case statement_type::LetStatement:
+        bindings[statement.get_let().get_name()]++;
+        count_bindings(statement.get_let().get_value(), bindings);
+        break;
+    case statement_type::ReturnStatement:
+        count_bindings(statement.get_return(), bindings);
+        break;
+    case statement_type::ExpressionStatement:
+        count_bindings(statement.get_expression(), bindings);
+        break;
+    default:
+        AXE_UNREACHABLE;
+    }
+}
+
+static void count_bindings(const block_statement& block,
+                           std::unordered_map<atom, size_t>& bindings) {
+    for (auto& statement : block.get_block()) {
+        count_bindings(statement, bindings);
+    }
+}
+
+static void count_bindings(const expression& expression,
+                           std::unordered_map<atom, size_t>& bindings) {
+    switch (expression.get_type()) {
+    case expression_type::Prefix:
+        count_bindings(*expression.get_prefix().get_rhs(), bindings);
+        break;
+    case expression_type::Infix:
+        count_bindings(*expression.get_infix().get_lhs(), bindings);
+        count_bindings(*expression.get_infix().get_rhs(), bindings);
+        break;
+    case expression_type::Assignment:
+        bindings[expression.get_assignment().get_ident()]++;
+        count_bindings(*expression.get_assignment().get_rhs(), bindings);
+        break;
+    case expression_type::If: {
+        auto& if_exp = expression.get_if();
+        count_bindings(*if_exp.get_cond(), bindings);
+        count_bindings(if_exp.get_consequence(), bindings);
+        if (if_exp.get_alternative().has_value()) {
+            count_bindings(*if_exp.get_alternative(), bindings);
+        }
+        break;
+    }
+    case expression_type::Function: {
+        auto& function = expression.get_function();
+        if (function.get_name().has_value()) {
+            bindings[*function.get_name()]++;
+        }
+        count_bindings(function.get_body(), bindings);
+        break;
+    }
+    case expression_type::Call:
+        count_bindings(*expression.get_call().get_function(), bindings);
+        for (auto& arg : expression.get_call().get_args()) {
+            count_bindings(arg, bindings);
+        }
+        break;
+    case expression_type::Match:
+        count_bindings(*expression.get_match().get_patten(), bindings);
+        for (auto& branch : expression.get_match().get_branches()) {
+            auto& pattern = branch.get_pattern();
+            if (pattern.get_type() == match_branch_pattern_type::Expression) {
+                count_bindings(*pattern.get_expression_pattern(), bindings);
+            }
+            auto& consequence = branch.get_consequence();
+            if (consequence.get_type() ==
+                match_branch_consequence_type::Expression) {
+                count_bindings(*consequence.get_expression_consequence(),
+                               bindings);
+            } else {
+                count_bindings(consequence.get_block_statement_consequence(),
+                               bindings);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static bool inline_size(const expression& expression, atom name, size_t& size);
+
+// adds the number of statements and expressions in the block to size,
+// false when it has something that keeps the function it is the body of
+// from being inlined: a function of its own or a reference to name
+static bool inline_size(const block_statement& block, atom name, size_t& size) {
+    for (auto& statement : block.get_block()) {
+        size++;
+        bool ok;
+        switch (statement.get_type()) {
+        case statement_type::LetStatement:
+            ok = inline_size(statement.get_let().get_value(), name, size);
+            break;
+        case statement_type::ReturnStatement:
+            ok = inline_size(statement.get_return(), name, size);
+            break;
+        case statement_type::ExpressionStatement:
+            ok = inline_size(statement.get_expression(), name, size);
+            break;
+        default:
+            AXE_UNREACHABLE;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
 }
 
+static bool inline_size(const expression& expression, atom name, size_t& size) {
+    size++;
+    switch (expression.get_type()) {
+    case expression_type::Integer:
+    case expression_type::Float:
+    case expression_type::Bool:
+    case expression_type::String:
+        return true;
+    case expression_type::Ident:
+        return expression.get_ident() != name;
+    case expression_type::Prefix:
+        return inline_size(*expression.get_prefix().get_rhs(), name, size);
+    case expression_type::Infix:
+        return inline_size(*expression.get_infix().get_lhs(), name, size) &&
+               inline_size(*expression.get_infix().get_rhs(), name, size);
+    case expression_type::Assignment:
+        return expression.get_assignment().get_ident() != name &&
+               inline_size(*expression.get_assignment().get_rhs(), name,
+                           size);
+    case expression_type::If: {
+        auto& if_exp = expression.get_if();
+        auto& alternative = if_exp.get_alternative();
+        return inline_size(*if_exp.get_cond(), name, size) &&
+               inline_size(if_exp.get_consequence(), name, size) &&
+               (!alternative.has_value() ||
+                inline_size(*alternative, name, size));
+    }
+    case expression_type::Call: {
+        auto& call = expression.get_call();
+        if (!inline_size(*call.get_function(), name, size)) {
+            return false;
+        }
+        for (auto& arg : call.get_args()) {
+            if (!inline_size(arg, name, size)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// the largest body inline_size allows and how much a function can grow
+// by inlining
+static constexpr size_t max_inline_size = 32;
+static constexpr size_t max_inline_growth = 256;
+
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 std::optional<std::string>
 compiler<ConstantsOwnership, SymbolTableOwnership>::compile(const ast& ast) {
-    return this->compile_statements(ast.get_statements());
+    if (this->inlining()) {
+        for (auto& statement : ast.get_statements()) {
+            count_bindings(statement, this->bindings);
+        }
+    }
+    this->scopes[this->scope_index].code.reserve(
+        ast.get_statements().size() * statement_size_estimate);
+    for (auto& statement : ast.get_statements()) {
+        auto err = this->compile_statement(statement);
+        if (err.has_value()) {
+            this->inline_candidates.clear();
+            this->bindings.clear();
+            return err;
+        }
+        this->add_inline_candidate(statement);
+    }
+    this->inline_candidates.clear();
+    this->bindings.clear();
+    auto& ins = this->current_instructions();
+    ins = this->optimize(std::move(ins));
+    this->max_stack = max_stack_depth(ins);
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+bool compiler<ConstantsOwnership, SymbolTableOwnership>::inlining() const {
+    return this->options.inline_calls && this->options.ssa &&
+           !std::is_reference<SymbolTableOwnership>::value;
+}
+
+// a top level function bound to a global nothing else binds is always
+// that global by the time a function compiled after it can call it
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+void compiler<ConstantsOwnership, SymbolTableOwnership>::add_inline_candidate(
+    const statement& statement) {
+    if (!this->inlining() || !this->last_lowered) {
+        return;
+    }
+    const function_expression* function = nullptr;
+    atom name;
+    if (statement.get_type() == statement_type::LetStatement &&
+        statement.get_let().get_value().get_type() ==
+            expression_type::Function) {
+        function = &statement.get_let().get_value().get_function();
+        name = statement.get_let().get_name();
+        if (function->get_name().has_value()) {
+            return;
+        }
+    } else if (statement.get_type() == statement_type::ExpressionStatement &&
+               statement.get_expression().get_type() ==
+                   expression_type::Function) {
+        function = &statement.get_expression().get_function();
+        if (!function->get_name().has_value()) {
+            return;
+        }
+        name = *function->get_name();
+    } else {
+        return;
+    }
+    if (this->bindings[name] != 1) {
+        return;
+    }
+    size_t size = 0;
+    if (!inline_size(function->get_body(), name, size) ||
+        size > max_inline_size) {
+        return;
+    }
+    auto symbol = this->symb_table.resolve(name);
+    if (!symbol.has_value() || symbol->scope != symbol_scope::GlobalScope) {
+        return;
+    }
+    this->inline_candidates.erase(symbol->index);
+    this->inline_candidates.emplace(
+        symbol->index,
+        inline_candidate{function, this->symb_table.size(), size});
+}
+
+// the function the call can be replaced with, nullptr when it has to be
+// called
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+const inline_candidate*
+compiler<ConstantsOwnership, SymbolTableOwnership>::find_inline_candidate(
+    const call& call, const ir_lowering& lowering) {
+    auto& function = *call.get_function();
+    if (function.get_type() != expression_type::Ident) {
+        return nullptr;
+    }
+    auto symbol = this->symb_table.resolve(function.get_ident());
+    if (!symbol.has_value() || symbol->scope != symbol_scope::GlobalScope) {
+        return nullptr;
+    }
+    auto it = this->inline_candidates.find(symbol->index);
+    if (it == this->inline_candidates.end()) {
+        return nullptr;
+    }
+    auto& callee = it->second;
+    // a call with the wrong number of arguments is left to fail
+    if (callee.function->get_params().size() != call.get_args().size() ||
+        callee.size > lowering.inline_budget ||
+        std::find(lowering.inlined.begin(), lowering.inlined.end(),
+                  callee.function) != lowering.inlined.end()) {
+        return nullptr;
+    }
+    return &callee;
 }
 
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 const byte_code
 compiler<ConstantsOwnership, SymbolTableOwnership>::get_byte_code() const {
-    return {this->get_current_instructions(), this->constants};
+    return {this->get_current_instructions(), this->constants,
+            this->symb_table.get_num_definitions(), this->max_stack};
 }
 
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 instructions&
 compiler<ConstantsOwnership, SymbolTableOwnership>::current_instructions() {
-    return this->scopes[this->scope_index].ins;
+    return this->scopes[this->scope_index].code.get_instructions();
 }
 
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 const instructions&
 compiler<ConstantsOwnership, SymbolTableOwnership>::get_current_instructions()
     const {
-    return this->scopes[this->scope_index].ins;
+    return this->scopes[this->scope_index].code.get_instructions();
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+size_t compiler<ConstantsOwnership, SymbolTableOwnership>::emit(
+    op_code op, std::initializer_list<int> operands) {
+    size_t pos = this->scopes[this->scope_index].code.emit(op, operands);
+    this->set_last_instruction(op, pos);
+    return pos;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+size_t compiler<ConstantsOwnership, SymbolTableOwnership>::emit(op_code op,
+                                                                label target) {
+    size_t pos = this->scopes[this->scope_index].code.emit(op, target);
+    this->set_last_instruction(op, pos);
+    return pos;
 }
 
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 size_t compiler<ConstantsOwnership, SymbolTableOwnership>::emit(
-    op_code op, const std::vector<int> operands) {
-    auto instructions = make(op, operands);
-    int pos = this->add_instruction(instructions);
+    op_code op, int operand, label target) {
+    size_t pos =
+        this->scopes[this->scope_index].code.emit(op, operand, target);
     this->set_last_instruction(op, pos);
     return pos;
 }
 
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
-size_t compiler<ConstantsOwnership, SymbolTableOwnership>::add_instruction(
-    const std::vector<uint8_t> ins) {
-    size_t pos_new_instruction = this->current_instructions().size();
-    this->current_instructions().insert(this->current_instructions().end(),
-                                        ins.begin(), ins.end());
-    return pos_new_instruction;
+label compiler<ConstantsOwnership, SymbolTableOwnership>::new_label() {
+    return this->scopes[this->scope_index].code.new_label();
 }
 
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+void compiler<ConstantsOwnership, SymbolTableOwnership>::bind(label target) {
+    this->scopes[this->scope_index].code.bind(target);
+}
+
+// constants are interned, a literal or function that is already in the
+// pool is not added again. in the repl the pool is shared between the
+// compilers of every line, so it only grows by what is new.
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 int compiler<ConstantsOwnership, SymbolTableOwnership>::add_constant(
     object obj) {
+    size_t hash = obj.hash();
+    auto range = this->constant_index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (this->constants[it->second].same_constant(obj)) {
+            return it->second;
+        }
+    }
     this->constants.push_back(std::move(obj));
-    return this->constants.size() - 1;
+    int index = this->constants.size() - 1;
+    this->constant_index.emplace(hash, index);
+    return index;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+void compiler<ConstantsOwnership, SymbolTableOwnership>::index_constants() {
+    for (size_t i = 0; i < this->constants.size(); ++i) {
+        this->constant_index.emplace(this->constants[i].hash(), i);
+    }
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+void compiler<ConstantsOwnership, SymbolTableOwnership>::truncate_constants(
+    size_t size) {
+    for (size_t i = size; i < this->constants.size(); ++i) {
+        auto hash = this->constants[i].hash();
+        auto range = this->constant_index.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (static_cast<size_t>(it->second) == i) {
+                this->constant_index.erase(it);
+                break;
+            }
+        }
+    }
+    this->constants.erase(this->constants.begin() + size,
+                          this->constants.end());
 }
 
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
@@ -104,33 +449,71 @@ void compiler<ConstantsOwnership, SymbolTableOwnership>::remove_last_pop() {
     this->scopes[this->scope_index].last_instruction = previous;
 }
 
+// the value of a block is the one of the expression statement it ends
+// with, its pop is taken back. a block that ends in a let, or is empty,
+// has the value null. one that ends in a return has none.
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
-void compiler<ConstantsOwnership, SymbolTableOwnership>::replace_instruction(
-    size_t position, std::vector<uint8_t> new_instruction) {
-    auto& ins = this->current_instructions();
-    for (size_t i = 0; i < new_instruction.size(); ++i) {
-        ins[position + i] = new_instruction[i];
+void compiler<ConstantsOwnership, SymbolTableOwnership>::leave_block_value(
+    const block_statement& block) {
+    auto& statements = block.get_block();
+    if (statements.empty()) {
+        this->emit(op_code::OpNull, {});
+    } else if (this->last_instruction_is(op_code::OpPop)) {
+        this->remove_last_pop();
+    } else if (statements.back().get_type() !=
+               statement_type::ReturnStatement) {
+        this->emit(op_code::OpNull, {});
     }
 }
 
+// both have no operands, so the return takes the place of the pop
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 void compiler<ConstantsOwnership,
               SymbolTableOwnership>::replace_last_pop_with_return() {
     size_t last_position =
         this->scopes[this->scope_index].last_instruction.position;
-    this->replace_instruction(last_position,
-                              axe::make(op_code::OpReturnValue, {}));
+    this->current_instructions()[last_position] =
+        static_cast<uint8_t>(op_code::OpReturnValue);
     this->scopes[this->scope_index].last_instruction.op =
         op_code::OpReturnValue;
 }
 
+// a call is in tail position when its result is returned right away,
+// either directly or after jumping out of the branches of an if
+static void mark_tail_calls(instructions& ins) {
+    auto list = disassemble(ins);
+    std::unordered_map<size_t, size_t> index_of;
+    for (size_t i = 0; i < list.size(); ++i) {
+        index_of[list[i].position] = i;
+    }
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i].op != op_code::OpCall) {
+            continue;
+        }
+        size_t next = i + 1;
+        while (next < list.size() && list[next].op == op_code::OpJump) {
+            auto it = index_of.find(list[next].operands[0]);
+            if (it == index_of.end()) {
+                break;
+            }
+            next = it->second;
+        }
+        if (next < list.size() && list[next].op == op_code::OpReturnValue) {
+            ins[list[i].position] = static_cast<uint8_t>(op_code::OpTailCall);
+        }
+    }
+}
+
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
-void compiler<ConstantsOwnership, SymbolTableOwnership>::change_operand(
-    size_t op_position, int operand) {
-    op_code op =
-        static_cast<op_code>(this->current_instructions()[op_position]);
-    auto new_instruction = make(op, {operand});
-    this->replace_instruction(op_position, new_instruction);
+instructions compiler<ConstantsOwnership, SymbolTableOwnership>::optimize(
+    instructions ins) const {
+    if (this->options.peephole) {
+        ins = peephole(ins);
+    }
+    if (this->options.superinstructions) {
+        ins = fuse_superinstructions(ins);
+    }
+    return ins;
 }
 
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
@@ -138,15 +521,15 @@ void compiler<ConstantsOwnership, SymbolTableOwnership>::enter_scope() {
     compilation_scope scope;
     this->scopes.push_back(scope);
     this->scope_index++;
-    this->symb_table = symbol_table::with_outer(this->symb_table);
+    this->symb_table.push_scope();
 }
 
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 instructions compiler<ConstantsOwnership, SymbolTableOwnership>::leave_scope() {
-    instructions ins = this->current_instructions();
+    instructions ins = this->optimize(this->current_instructions());
     this->scopes.pop_back();
     this->scope_index--;
-    this->symb_table = this->symb_table.get_outer();
+    this->symb_table.pop_scope();
     return ins;
 }
 
@@ -222,6 +605,14 @@ template <typename ConstantsOwnership, typename SymbolTableOwnership>
 std::optional<std::string>
 compiler<ConstantsOwnership, SymbolTableOwnership>::compile_expression(
     const expression& expression) {
+    if (this->options.fold_constants &&
+        (expression.get_type() == expression_type::Prefix ||
+         expression.get_type() == expression_type::Infix)) {
+        auto folded = fold_constant(expression);
+        if (folded.has_value()) {
+            return this->compile_constant(*folded);
+        }
+    }
     std::optional<std::string> err = std::nullopt;
     switch (expression.get_type()) {
     case expression_type::Integer:
@@ -258,6 +649,9 @@ compiler<ConstantsOwnership, SymbolTableOwnership>::compile_expression(
     case expression_type::Call:
         err = this->compile_call(expression.get_call());
         break;
+    case expression_type::Match:
+        err = this->compile_match(expression.get_match());
+        break;
     default:
         err = "cannot compile " + std::string(expression.type_to_string());
         break;
@@ -265,6 +659,19 @@ compiler<ConstantsOwnership, SymbolTableOwnership>::compile_expression(
     return err;
 }
 
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableOwnership>::compile_constant(
+    const object& constant) {
+    if (constant.get_type() == object_type::Bool) {
+        this->emit(constant.get_bool() ? op_code::OpTrue : op_code::OpFalse,
+                   {});
+        return std::nullopt;
+    }
+    this->emit(op_code::OpConstant, {this->add_constant(constant)});
+    return std::nullopt;
+}
+
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 std::optional<std::string>
 compiler<ConstantsOwnership, SymbolTableOwnership>::compile_integer(
@@ -295,10 +702,10 @@ compiler<ConstantsOwnership, SymbolTableOwnership>::compile_string(
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 std::optional<std::string>
 compiler<ConstantsOwnership, SymbolTableOwnership>::compile_ident(
-    const std::string& ident) {
+    atom ident) {
     auto symbol = this->symb_table.resolve(ident);
     if (!symbol.has_value()) {
-        return "undefined variable " + ident;
+        return "undefined variable " + ident.string();
     }
     if (symbol->scope == axe::symbol_scope::GlobalScope) {
         this->emit(op_code::OpGetGlobal, {(int)symbol->index});
@@ -390,10 +797,10 @@ std::optional<std::string>
 compiler<ConstantsOwnership, SymbolTableOwnership>::compile_assignment(
     const assignment& assignment) {
     auto err = this->compile_expression(*assignment.get_rhs());
-    auto& ident = assignment.get_ident();
+    auto ident = assignment.get_ident();
     auto symbol = this->symb_table.resolve(ident);
     if (!symbol.has_value()) {
-        return ident + " does not exist";
+        return ident.string() + " does not exist";
     }
     if ((*symbol).scope == symbol_scope::GlobalScope) {
         this->emit(op_code::OpSetGlobal, {(int)(*symbol).index});
@@ -407,25 +814,30 @@ template <typename ConstantsOwnership, typename SymbolTableOwnership>
 std::optional<std::string>
 compiler<ConstantsOwnership, SymbolTableOwnership>::compile_if(
     const if_expression& if_exp) {
+    if (this->options.fold_constants) {
+        auto cond = fold_constant(*if_exp.get_cond());
+        if (cond.has_value()) {
+            return this->compile_constant_if(if_exp, cond->is_truthy());
+        }
+    }
+
     auto err = this->compile_expression(*if_exp.get_cond());
     if (err.has_value()) {
         return err;
     }
 
-    size_t jump_not_truthy_position =
-        this->emit(op_code::OpJumpNotTruthy, {9999});
+    label after_consequence = this->new_label();
+    label after_alternative = this->new_label();
+    this->emit(op_code::OpJumpNotTruthy, after_consequence);
 
     err = this->compile_block(if_exp.get_consequence());
     if (err.has_value()) {
         return err;
     }
-    if (this->last_instruction_is(op_code::OpPop)) {
-        this->remove_last_pop();
-    }
+    this->leave_block_value(if_exp.get_consequence());
 
-    size_t jump_position = this->emit(op_code::OpJump, {9999});
-    size_t after_consequence_position = this->current_instructions().size();
-    this->change_operand(jump_not_truthy_position, after_consequence_position);
+    this->emit(op_code::OpJump, after_alternative);
+    this->bind(after_consequence);
 
     auto& alternative = if_exp.get_alternative();
     if (!alternative.has_value()) {
@@ -435,13 +847,63 @@ compiler<ConstantsOwnership, SymbolTableOwnership>::compile_if(
         if (err.has_value()) {
             return err;
         }
-        if (this->last_instruction_is(op_code::OpPop)) {
-            this->remove_last_pop();
+        this->leave_block_value(*alternative);
+    }
+
+    this->bind(after_alternative);
+    return std::nullopt;
+}
+
+// no jumps, only the branch that is taken is left
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableOwnership>::compile_constant_if(
+    const if_expression& if_exp, bool taken) {
+    auto& consequence = if_exp.get_consequence();
+    auto& alternative = if_exp.get_alternative();
+    if (!taken && !alternative.has_value()) {
+        auto err = this->compile_dead_block(consequence);
+        if (err.has_value()) {
+            return err;
+        }
+        this->emit(op_code::OpNull, {});
+        return std::nullopt;
+    }
+
+    auto err = taken ? this->compile_block(consequence)
+                     : this->compile_dead_block(consequence);
+    if (err.has_value()) {
+        return err;
+    }
+    if (alternative.has_value()) {
+        err = taken ? this->compile_dead_block(*alternative)
+                    : this->compile_block(*alternative);
+        if (err.has_value()) {
+            return err;
         }
     }
+    this->leave_block_value(taken ? consequence : *alternative);
+    return std::nullopt;
+}
 
-    size_t after_alternative_position = this->current_instructions().size();
-    this->change_operand(jump_position, after_alternative_position);
+// the branch an if never takes is compiled and thrown away, so the names
+// it defines and the errors it has are the same as without folding
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableOwnership>::compile_dead_block(
+    const block_statement& block) {
+    size_t num_constants = this->constants.size();
+    size_t size = this->current_instructions().size();
+    auto last = this->scopes[this->scope_index].last_instruction;
+    auto previous = this->scopes[this->scope_index].previous_instruction;
+    auto err = this->compile_block(block);
+    if (err.has_value()) {
+        return err;
+    }
+    this->truncate_constants(num_constants);
+    this->current_instructions().resize(size);
+    this->scopes[this->scope_index].last_instruction = last;
+    this->scopes[this->scope_index].previous_instruction = previous;
     return std::nullopt;
 }
 
@@ -449,6 +911,30 @@ template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
 std::optional<std::string>
 compiler<ConstantsOwnership, SymbolTableLIfeTime>::compile_function(
     const function_expression& function) {
+    int constant;
+    auto err = this->compile_function_constant(function, constant);
+    if (err.has_value()) {
+        return err;
+    }
+    this->emit(op_code::OpConstant, {constant});
+    auto& name = function.get_name();
+    if (name.has_value()) {
+        auto symbol = this->symb_table.define(*name);
+        if (symbol.scope == symbol_scope::GlobalScope) {
+            this->emit(op_code::OpSetGlobal, {(int)symbol.index});
+        } else {
+            this->emit(op_code::OpSetLocal, {(int)symbol.index});
+        }
+    }
+    return std::nullopt;
+}
+
+// compiles the function into the constant pool, its name is left for
+// the caller to define
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::compile_function_constant(
+    const function_expression& function, int& constant) {
     // temporarily set the name just in case it is
     // a recursive function
     auto& t_name = function.get_name();
@@ -456,36 +942,543 @@ compiler<ConstantsOwnership, SymbolTableLIfeTime>::compile_function(
         this->symb_table.define(*t_name);
     }
     this->enter_scope();
+    this->scopes[this->scope_index].code.reserve(
+        function.get_body().get_block().size() * statement_size_estimate);
     auto& params = function.get_params();
     for (auto& param : params) {
         this->symb_table.define(param);
     }
-    auto err = this->compile_block(function.get_body());
-    if (err.has_value()) {
-        return err;
+    size_t num_locals = 0;
+    bool lowered = false;
+    if (this->options.ssa) {
+        auto err = this->compile_ssa(function, lowered, num_locals);
+        if (err.has_value()) {
+            return err;
+        }
     }
-    if (this->last_instruction_is(op_code::OpPop)) {
-        this->replace_last_pop_with_return();
+    if (!lowered) {
+        auto err = this->compile_block(function.get_body());
+        if (err.has_value()) {
+            return err;
+        }
+        if (this->last_instruction_is(op_code::OpPop)) {
+            this->replace_last_pop_with_return();
+        }
+        if (!this->last_instruction_is(op_code::OpReturnValue)) {
+            this->emit(op_code::OpReturn, {});
+        }
+        num_locals = this->symb_table.get_num_definitions();
     }
-    if (!this->last_instruction_is(op_code::OpReturnValue)) {
-        this->emit(op_code::OpReturn, {});
+    if (this->options.tail_calls) {
+        mark_tail_calls(this->current_instructions());
     }
-    size_t num_locals = this->symb_table.get_num_definitions();
     instructions ins = this->leave_scope();
+    size_t max_stack = max_stack_depth(ins);
     object obj(object_type::Function,
-               compiled_function(std::move(ins), num_locals, params.size()));
-    this->emit(op_code::OpConstant, {this->add_constant(std::move(obj))});
-    auto& name = function.get_name();
-    if (name.has_value()) {
+               compiled_function(std::move(ins), num_locals, params.size(),
+                                 max_stack));
+    constant = this->add_constant(std::move(obj));
+    this->last_lowered = lowered;
+    if (t_name.has_value()) {
         // remove the temporarily set name
-        this->symb_table.erase(*name);
+        this->symb_table.erase(*t_name);
+    }
+    return std::nullopt;
+}
+
+// lowers the body of the function in the current scope to ssa,
+// optimizes it and generates its code. bodies whose stack effects the
+// ir does not model, like a branch that leaves no value, are left
+// alone: everything they defined is undone and lowered stays false.
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::compile_ssa(
+    const function_expression& function, bool& lowered, size_t& num_locals) {
+    size_t num_symbols = this->symb_table.size();
+    size_t num_constants = this->constants.size();
+    auto& params = function.get_params();
+    ir_lowering lowering = {
+        ir_function(params.size()), 0, {}, false, {}, nullptr,
+        max_inline_growth};
+    for (size_t i = 0; i < params.size(); ++i) {
+        lowering.locals.push_back(
+            lowering.fn.add(0, ir_op::Param, {}, static_cast<int>(i)));
+    }
+    ir_value result;
+    auto err = this->lower_block(function.get_body(), lowering, result);
+    if (!lowering.unsupported) {
+        if (err.has_value()) {
+            return err;
+        }
+        if (result == ir_no_value) {
+            result = lowering.fn.add(lowering.block, ir_op::Null);
+        }
+        lowering.fn.ret(lowering.block, result);
+        lowering.fn.optimize();
+        auto ins = lowering.fn.generate(num_locals);
+        if (ins.has_value()) {
+            this->current_instructions() = std::move(*ins);
+            lowered = true;
+            return std::nullopt;
+        }
+    }
+    this->symb_table.truncate(num_symbols);
+    this->truncate_constants(num_constants);
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::unsupported(
+    ir_lowering& lowering) {
+    lowering.unsupported = true;
+    return "unsupported by the ir";
+}
+
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::lower_block(
+    const block_statement& block, ir_lowering& lowering, ir_value& result) {
+    result = ir_no_value;
+    for (auto& statement : block.get_block()) {
+        auto err = this->lower_statement(statement, lowering, result);
+        if (err.has_value()) {
+            return err;
+        }
+    }
+    return std::nullopt;
+}
+
+// result is the value the statement leaves for the end of a block
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::lower_statement(
+    const statement& statement, ir_lowering& lowering, ir_value& result) {
+    result = ir_no_value;
+    switch (statement.get_type()) {
+    case statement_type::LetStatement: {
+        auto& let = statement.get_let();
+        ir_value value;
+        auto err = this->lower_operand(let.get_value(), lowering, value);
+        if (err.has_value()) {
+            return err;
+        }
+        auto symbol = this->symb_table.define(let.get_name());
+        if (symbol.scope == symbol_scope::GlobalScope) {
+            return this->unsupported(lowering);
+        }
+        this->set_local(lowering, symbol.index, value);
+        return std::nullopt;
+    }
+    case statement_type::ReturnStatement: {
+        ir_value value;
+        auto err =
+            this->lower_operand(statement.get_return(), lowering, value);
+        if (err.has_value()) {
+            return err;
+        }
+        if (lowering.returns != nullptr) {
+            // leaves the function being inlined, see lower_inlined_call
+            lowering.returns->emplace_back(lowering.block, value);
+        } else {
+            lowering.fn.ret(lowering.block, value);
+        }
+        // what follows is never run, it still defines its names
+        lowering.block = lowering.fn.new_block();
+        return std::nullopt;
+    }
+    case statement_type::ExpressionStatement:
+        return this->lower_expression(statement.get_expression(), lowering,
+                                      result);
+    default:
+        AXE_UNREACHABLE;
+    }
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+void compiler<ConstantsOwnership, SymbolTableLIfeTime>::set_local(
+    ir_lowering& lowering, size_t index, ir_value value) {
+    if (index >= lowering.locals.size()) {
+        lowering.locals.resize(index + 1, ir_no_value);
+    }
+    lowering.locals[index] =
+        lowering.fn.add(lowering.block, ir_op::Copy, {value});
+}
+
+// an expression whose value is used, one without a value is left to
+// the stack compiler
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::lower_operand(
+    const expression& expression, ir_lowering& lowering, ir_value& value) {
+    auto err = this->lower_expression(expression, lowering, value);
+    if (err.has_value()) {
+        return err;
+    }
+    if (value == ir_no_value) {
+        return this->unsupported(lowering);
+    }
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::lower_constant(
+    const object& constant, ir_lowering& lowering, ir_value& value) {
+    if (constant.get_type() == object_type::Bool) {
+        value = lowering.fn.add(lowering.block, constant.get_bool()
+                                                    ? ir_op::True
+                                                    : ir_op::False);
+        return std::nullopt;
+    }
+    value = lowering.fn.add(lowering.block, ir_op::Constant, {},
+                            this->add_constant(constant));
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::lower_expression(
+    const expression& expression, ir_lowering& lowering, ir_value& value) {
+    value = ir_no_value;
+    auto& fn = lowering.fn;
+    if (this->options.fold_constants &&
+        (expression.get_type() == expression_type::Prefix ||
+         expression.get_type() == expression_type::Infix)) {
+        auto folded = fold_constant(expression);
+        if (folded.has_value()) {
+            return this->lower_constant(*folded, lowering, value);
+        }
+    }
+    switch (expression.get_type()) {
+    case expression_type::Integer:
+        return this->lower_constant(
+            object(object_type::Integer, expression.get_int()), lowering,
+            value);
+    case expression_type::Float:
+        return this->lower_constant(
+            object(object_type::Float, expression.get_float()), lowering,
+            value);
+    case expression_type::Bool:
+        return this->lower_constant(
+            object(object_type::Bool, expression.get_bool()), lowering,
+            value);
+    case expression_type::String:
+        return this->lower_constant(
+            object(object_type::String, expression.get_string()),
+            lowering, value);
+    case expression_type::Ident: {
+        auto ident = expression.get_ident();
+        auto symbol = this->symb_table.resolve(ident);
+        if (!symbol.has_value()) {
+            return "undefined variable " + ident.string();
+        }
+        if (symbol->scope == symbol_scope::GlobalScope) {
+            value = fn.add(lowering.block, ir_op::GetGlobal, {},
+                           static_cast<int>(symbol->index));
+            return std::nullopt;
+        }
+        // a local of an enclosing function or one only some paths set
+        if (symbol->index >= lowering.locals.size() ||
+            lowering.locals[symbol->index] == ir_no_value) {
+            return this->unsupported(lowering);
+        }
+        value = lowering.locals[symbol->index];
+        return std::nullopt;
+    }
+    case expression_type::Prefix: {
+        auto& prefix = expression.get_prefix();
+        ir_value rhs;
+        auto err = this->lower_operand(*prefix.get_rhs(), lowering, rhs);
+        if (err.has_value()) {
+            return err;
+        }
+        value = fn.add(lowering.block,
+                       prefix.get_op() == prefix_operator::Bang ? ir_op::Bang
+                                                                : ir_op::Minus,
+                       {rhs});
+        return std::nullopt;
+    }
+    case expression_type::Infix:
+        return this->lower_infix(expression.get_infix(), lowering, value);
+    case expression_type::Assignment: {
+        auto& assignment = expression.get_assignment();
+        ir_value rhs;
+        auto err = this->lower_operand(*assignment.get_rhs(), lowering, rhs);
+        if (err.has_value()) {
+            // the stack compiler ignores the errors of the value
+            return this->unsupported(lowering);
+        }
+        auto ident = assignment.get_ident();
+        auto symbol = this->symb_table.resolve(ident);
+        if (!symbol.has_value()) {
+            return ident.string() + " does not exist";
+        }
+        if (symbol->scope == symbol_scope::GlobalScope) {
+            fn.add(lowering.block, ir_op::SetGlobal, {rhs},
+                   static_cast<int>(symbol->index));
+            return std::nullopt;
+        }
+        if (symbol->index >= lowering.locals.size() ||
+            lowering.locals[symbol->index] == ir_no_value) {
+            return this->unsupported(lowering);
+        }
+        this->set_local(lowering, symbol->index, rhs);
+        return std::nullopt;
+    }
+    case expression_type::If:
+        return this->lower_if(expression.get_if(), lowering, value);
+    case expression_type::Function: {
+        auto& function = expression.get_function();
+        int constant;
+        auto err = this->compile_function_constant(function, constant);
+        if (err.has_value()) {
+            return err;
+        }
+        value = fn.add(lowering.block, ir_op::Constant, {}, constant);
+        auto& name = function.get_name();
+        if (!name.has_value()) {
+            return std::nullopt;
+        }
         auto symbol = this->symb_table.define(*name);
         if (symbol.scope == symbol_scope::GlobalScope) {
-            this->emit(op_code::OpSetGlobal, {(int)symbol.index});
+            return this->unsupported(lowering);
+        }
+        this->set_local(lowering, symbol.index, value);
+        value = ir_no_value;
+        return std::nullopt;
+    }
+    case expression_type::Call: {
+        auto& call = expression.get_call();
+        auto callee = this->inlining()
+                          ? this->find_inline_candidate(call, lowering)
+                          : nullptr;
+        std::vector<ir_value> operands;
+        if (callee == nullptr) {
+            operands.push_back(ir_no_value);
+            auto err = this->lower_operand(*call.get_function(), lowering,
+                                           operands[0]);
+            if (err.has_value()) {
+                return err;
+            }
+        }
+        for (auto& arg : call.get_args()) {
+            operands.push_back(ir_no_value);
+            auto err = this->lower_operand(arg, lowering, operands.back());
+            if (err.has_value()) {
+                return err;
+            }
+        }
+        if (callee != nullptr) {
+            return this->lower_inlined_call(*callee, std::move(operands),
+                                            lowering, value);
+        }
+        value = fn.add(lowering.block, ir_op::Call, std::move(operands));
+        return std::nullopt;
+    }
+    case expression_type::Match:
+        return this->unsupported(lowering);
+    default:
+        break;
+    }
+    return "cannot compile " + std::string(expression.type_to_string());
+}
+
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::lower_infix(
+    const infix& infix, ir_lowering& lowering, ir_value& value) {
+    // a < b is b > a, with b evaluated first
+    bool swapped = infix.get_op() == infix_operator::Lt;
+    ir_value lhs;
+    ir_value rhs;
+    auto err = this->lower_operand(
+        swapped ? *infix.get_rhs() : *infix.get_lhs(), lowering, lhs);
+    if (err.has_value()) {
+        return err;
+    }
+    err = this->lower_operand(swapped ? *infix.get_lhs() : *infix.get_rhs(),
+                              lowering, rhs);
+    if (err.has_value()) {
+        return err;
+    }
+    ir_op op;
+    switch (infix.get_op()) {
+    case infix_operator::Plus:
+        op = ir_op::Add;
+        break;
+    case infix_operator::Minus:
+        op = ir_op::Sub;
+        break;
+    case infix_operator::Asterisk:
+        op = ir_op::Mul;
+        break;
+    case infix_operator::Slash:
+        op = ir_op::Div;
+        break;
+    case infix_operator::Lt:
+    case infix_operator::Gt:
+        op = ir_op::GreaterThan;
+        break;
+    case infix_operator::Eq:
+        op = ir_op::Eq;
+        break;
+    case infix_operator::NotEq:
+        op = ir_op::NotEq;
+        break;
+    default:
+        return "unknown operator " +
+               std::string(infix_operator_string(infix.get_op()));
+    }
+    value = lowering.fn.add(lowering.block, op, {lhs, rhs});
+    return std::nullopt;
+}
+
+// both branches are lowered even when the condition is constant, the
+// one never taken is left unreachable for the passes to remove
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::lower_if(
+    const if_expression& if_exp, ir_lowering& lowering, ir_value& value) {
+    auto& fn = lowering.fn;
+    std::optional<object> folded;
+    if (this->options.fold_constants) {
+        folded = fold_constant(*if_exp.get_cond());
+    }
+    ir_value cond = ir_no_value;
+    if (!folded.has_value()) {
+        auto err = this->lower_operand(*if_exp.get_cond(), lowering, cond);
+        if (err.has_value()) {
+            return err;
+        }
+    }
+    size_t then_block = fn.new_block();
+    size_t else_block = fn.new_block();
+    if (folded.has_value()) {
+        fn.jump(lowering.block,
+                folded->is_truthy() ? then_block : else_block);
+    } else {
+        fn.branch(lowering.block, cond, then_block, else_block);
+    }
+
+    auto before = lowering.locals;
+    lowering.block = then_block;
+    ir_value then_value;
+    auto err =
+        this->lower_block(if_exp.get_consequence(), lowering, then_value);
+    if (err.has_value()) {
+        return err;
+    }
+    size_t then_end = lowering.block;
+    auto then_locals = std::move(lowering.locals);
+
+    lowering.locals = std::move(before);
+    lowering.block = else_block;
+    ir_value else_value;
+    auto& alternative = if_exp.get_alternative();
+    if (alternative.has_value()) {
+        err = this->lower_block(*alternative, lowering, else_value);
+        if (err.has_value()) {
+            return err;
+        }
+    } else {
+        else_value = fn.add(else_block, ir_op::Null);
+    }
+    size_t else_end = lowering.block;
+    auto& else_locals = lowering.locals;
+
+    bool then_reachable = fn.is_reachable(then_end);
+    bool else_reachable = fn.is_reachable(else_end);
+    // the stack compiler leaves nothing for a branch like that
+    if ((then_reachable && then_value == ir_no_value) ||
+        (else_reachable && else_value == ir_no_value)) {
+        return this->unsupported(lowering);
+    }
+    // a branch that never ends takes the value of the other one
+    if (!then_reachable) {
+        then_value = else_value;
+        then_locals = else_locals;
+    } else if (!else_reachable) {
+        else_value = then_value;
+        else_locals = then_locals;
+    }
+    if (then_value == ir_no_value) {
+        then_value = else_value = fn.add(then_end, ir_op::Null);
+    }
+
+    size_t join = fn.new_block();
+    fn.jump(then_end, join);
+    fn.jump(else_end, join);
+    lowering.block = join;
+    size_t num_locals = std::max(then_locals.size(), else_locals.size());
+    then_locals.resize(num_locals, ir_no_value);
+    else_locals.resize(num_locals, ir_no_value);
+    for (size_t i = 0; i < num_locals; ++i) {
+        ir_value a = then_locals[i];
+        ir_value b = else_locals[i];
+        if (a == b) {
+            else_locals[i] = a;
+        } else if (a == ir_no_value || b == ir_no_value) {
+            // set on one path only, reading it is left to the stack
+            // compiler
+            else_locals[i] = ir_no_value;
         } else {
-            this->emit(op_code::OpSetLocal, {(int)symbol.index});
+            else_locals[i] = fn.add_phi(join, {a, b});
         }
     }
+    value = fn.add_phi(join, {then_value, else_value});
+    return std::nullopt;
+}
+
+// lowers the body of callee where a call to it with args was. its
+// locals become values of the caller and its returns jump to the code
+// after the call.
+template <typename ConstantsOwnership, typename SymbolTableLIfeTime>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableLIfeTime>::lower_inlined_call(
+    const inline_candidate& callee, std::vector<ir_value> args,
+    ir_lowering& lowering, ir_value& value) {
+    auto& fn = lowering.fn;
+    auto& function = *callee.function;
+    this->symb_table.push_scope(callee.globals);
+    for (auto& param : function.get_params()) {
+        this->symb_table.define(param);
+    }
+    auto caller_locals = std::move(lowering.locals);
+    lowering.locals = std::move(args);
+    auto caller_returns = lowering.returns;
+    std::vector<std::pair<size_t, ir_value>> returns;
+    lowering.returns = &returns;
+    lowering.inlined.push_back(&function);
+    lowering.inline_budget -= callee.size;
+
+    ir_value result;
+    auto err = this->lower_block(function.get_body(), lowering, result);
+    lowering.inlined.pop_back();
+    lowering.returns = caller_returns;
+    lowering.locals = std::move(caller_locals);
+    this->symb_table.pop_scope();
+    if (err.has_value()) {
+        return err;
+    }
+    if (result == ir_no_value) {
+        result = fn.add(lowering.block, ir_op::Null);
+    }
+    if (returns.empty()) {
+        value = result;
+        return std::nullopt;
+    }
+    returns.emplace_back(lowering.block, result);
+
+    size_t after = fn.new_block();
+    std::vector<ir_value> inputs;
+    for (auto& ret : returns) {
+        fn.jump(ret.first, after);
+        inputs.push_back(ret.second);
+    }
+    lowering.block = after;
+    value = fn.add_phi(after, std::move(inputs));
     return std::nullopt;
 }
 
@@ -508,6 +1501,254 @@ compiler<ConstantsOwnership, SymbolTableLIfeTime>::compile_call(
     return std::nullopt;
 }
 
+// the value a pattern of a match always has, when it is an int or a
+// string the match can dispatch on
+static std::optional<object> match_key(const expression& pattern,
+                                       bool fold_constants) {
+    std::optional<object> key;
+    if (pattern.get_type() == expression_type::Integer) {
+        key = object(object_type::Integer, pattern.get_int());
+    } else if (pattern.get_type() == expression_type::String) {
+        key = object(object_type::String, pattern.get_string());
+    } else if (fold_constants) {
+        key = fold_constant(pattern);
+    }
+    if (key.has_value() && key->get_type() != object_type::Integer &&
+        key->get_type() != object_type::String) {
+        return std::nullopt;
+    }
+    return key;
+}
+
+// the first branch that matches the value is taken, a match without one
+// is null. when every pattern before the first wildcard is an int or
+// every one is a string the value is dispatched on with a single
+// instruction, otherwise it is compared with one pattern after another.
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableOwnership>::compile_match(
+    const match& match) {
+    auto& branches = match.get_branches();
+    // the branches after the first wildcard are never taken
+    size_t num_live = 0;
+    while (num_live < branches.size() &&
+           branches[num_live].get_pattern().get_type() !=
+               match_branch_pattern_type::Wildcard) {
+        num_live++;
+    }
+    std::vector<std::pair<object, size_t>> cases;
+    for (size_t i = 0; i < num_live; ++i) {
+        auto key = match_key(
+            *branches[i].get_pattern().get_expression_pattern(),
+            this->options.fold_constants);
+        if (!key.has_value() ||
+            (!cases.empty() &&
+             key->get_type() != cases.front().first.get_type())) {
+            return this->compile_match_chain(match, num_live);
+        }
+        cases.emplace_back(std::move(*key), i);
+    }
+    if (cases.empty()) {
+        return this->compile_match_chain(match, num_live);
+    }
+    return this->compile_switch(match, cases, num_live);
+}
+
+// the subject is popped by OpJumpTable when the ints of the cases fill at
+// least half of the range they span, by OpSwitch otherwise
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableOwnership>::compile_switch(
+    const match& match, const std::vector<std::pair<object, size_t>>& cases,
+    size_t num_live) {
+    auto err = this->compile_expression(*match.get_patten());
+    if (err.has_value()) {
+        return err;
+    }
+    // sorted by key and then by branch, so the first branch with a key
+    // is the one that stays
+    auto sorted = cases;
+    bool ints = sorted.front().first.get_type() == object_type::Integer;
+    std::sort(sorted.begin(), sorted.end(),
+              [ints](const std::pair<object, size_t>& a,
+                     const std::pair<object, size_t>& b) {
+                  if (ints && a.first.get_int() != b.first.get_int()) {
+                      return a.first.get_int() < b.first.get_int();
+                  }
+                  if (!ints && a.first.get_string() != b.first.get_string()) {
+                      return a.first.get_string() < b.first.get_string();
+                  }
+                  return a.second < b.second;
+              });
+    sorted.erase(std::unique(sorted.begin(), sorted.end(),
+                             [](const std::pair<object, size_t>& a,
+                                const std::pair<object, size_t>& b) {
+                                 return a.first == b.first;
+                             }),
+                 sorted.end());
+
+    uint64_t range = 0;
+    if (ints) {
+        range = static_cast<uint64_t>(sorted.back().first.get_int()) -
+                static_cast<uint64_t>(sorted.front().first.get_int()) + 1;
+    }
+    bool dense = ints && range != 0 && range <= 2 * sorted.size() &&
+                 range <= UINT16_MAX;
+    if (dense) {
+        this->emit(op_code::OpJumpTable,
+                   {this->add_constant(sorted.front().first),
+                    static_cast<int>(range)});
+    } else {
+        this->emit(op_code::OpSwitch, {static_cast<int>(sorted.size())});
+    }
+    auto& branches = match.get_branches();
+    label default_label = this->new_label();
+    label end = this->new_label();
+    std::vector<label> starts;
+    for (size_t i = 0; i < num_live; ++i) {
+        starts.push_back(this->new_label());
+    }
+    this->emit(op_code::OpJump, default_label);
+    size_t num_entries = 0;
+    for (auto& entry : sorted) {
+        label start = starts[entry.second];
+        if (dense) {
+            uint64_t index =
+                static_cast<uint64_t>(entry.first.get_int()) -
+                static_cast<uint64_t>(sorted.front().first.get_int());
+            // the ints the cases skip go to the default
+            for (; num_entries < index; ++num_entries) {
+                this->emit(op_code::OpJump, default_label);
+            }
+            this->emit(op_code::OpJump, start);
+            num_entries++;
+        } else {
+            this->emit(op_code::OpCase, this->add_constant(entry.first),
+                       start);
+        }
+    }
+
+    for (size_t i = 0; i < num_live; ++i) {
+        this->bind(starts[i]);
+        err = this->compile_match_consequence(branches[i]);
+        if (err.has_value()) {
+            return err;
+        }
+        this->emit(op_code::OpJump, end);
+    }
+    this->bind(default_label);
+    err = this->compile_match_default(match, num_live, end);
+    if (err.has_value()) {
+        return err;
+    }
+    this->bind(end);
+    return std::nullopt;
+}
+
+// the slot a compare chain keeps its subject in. a match in a pattern
+// needs its own while the subject is compared with it, any other match
+// of the same scope reuses the slot, so a scope takes one per depth.
+// match is a keyword, so no name the program uses resolves to them.
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+symbol compiler<ConstantsOwnership, SymbolTableOwnership>::match_subject() {
+    atom name(this->match_depth == 0
+                  ? std::string("match")
+                  : "match " + std::to_string(this->match_depth));
+    auto subject = this->symb_table.resolve_in_scope(name);
+    if (subject.has_value()) {
+        return *subject;
+    }
+    return this->symb_table.define(name);
+}
+
+// the subject is kept in a local, or a global in the main program, that
+// every pattern is compared with
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableOwnership>::compile_match_chain(
+    const match& match, size_t num_live) {
+    auto err = this->compile_expression(*match.get_patten());
+    if (err.has_value()) {
+        return err;
+    }
+    auto subject = this->match_subject();
+    bool global = subject.scope == symbol_scope::GlobalScope;
+    int index = static_cast<int>(subject.index);
+    this->emit(global ? op_code::OpSetGlobal : op_code::OpSetLocal, {index});
+
+    label end = this->new_label();
+    auto& branches = match.get_branches();
+    for (size_t i = 0; i < num_live; ++i) {
+        this->emit(global ? op_code::OpGetGlobal : op_code::OpGetLocal,
+                   {index});
+        this->match_depth++;
+        err = this->compile_expression(
+            *branches[i].get_pattern().get_expression_pattern());
+        this->match_depth--;
+        if (err.has_value()) {
+            return err;
+        }
+        this->emit(op_code::OpEq, {});
+        label next = this->new_label();
+        this->emit(op_code::OpJumpNotTruthy, next);
+        err = this->compile_match_consequence(branches[i]);
+        if (err.has_value()) {
+            return err;
+        }
+        this->emit(op_code::OpJump, end);
+        this->bind(next);
+    }
+    err = this->compile_match_default(match, num_live, end);
+    if (err.has_value()) {
+        return err;
+    }
+    this->bind(end);
+    return std::nullopt;
+}
+
+// leaves the value of the branch on the stack, like a branch of an if
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableOwnership>::compile_match_consequence(
+    const match_branch& branch) {
+    auto& consequence = branch.get_consequence();
+    if (consequence.get_type() == match_branch_consequence_type::Expression) {
+        return this->compile_expression(
+            *consequence.get_expression_consequence());
+    }
+    auto& block = consequence.get_block_statement_consequence();
+    auto err = this->compile_block(block);
+    if (err.has_value()) {
+        return err;
+    }
+    this->leave_block_value(block);
+    return std::nullopt;
+}
+
+// what a match does when no pattern before the first wildcard matched:
+// the branch of the wildcard, or null without one. the branches after
+// it are never taken but still compiled, each after a jump to end.
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+compiler<ConstantsOwnership, SymbolTableOwnership>::compile_match_default(
+    const match& match, size_t num_live, label end) {
+    auto& branches = match.get_branches();
+    if (num_live == branches.size()) {
+        this->emit(op_code::OpNull, {});
+        return std::nullopt;
+    }
+    for (size_t i = num_live; i < branches.size(); ++i) {
+        if (i != num_live) {
+            this->emit(op_code::OpJump, end);
+        }
+        auto err = this->compile_match_consequence(branches[i]);
+        if (err.has_value()) {
+            return err;
+        }
+    }
+    return std::nullopt;
+}
+
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 std::optional<std::string>
 compiler<ConstantsOwnership, SymbolTableOwnership>::compile_block(
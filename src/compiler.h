@@ -4,14 +4,21 @@
 
 #include "ast.h"
 #include "code.h"
+#include "ir.h"
 #include "object.h"
 #include "symbol_table.h"
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace axe {
 
 struct byte_code {
     const instructions& ins;
     const std::vector<object>& constants;
+    size_t num_globals;
+    // see max_stack_depth
+    size_t max_stack;
 };
 
 struct emitted_instruction {
@@ -20,11 +27,63 @@ struct emitted_instruction {
 };
 
 struct compilation_scope {
-    instructions ins;
+    assembler code;
     emitted_instruction last_instruction;
     emitted_instruction previous_instruction;
 };
 
+struct compiler_options {
+    // rewrite common instruction sequences into superinstructions
+    bool superinstructions = true;
+    // calls in tail position reuse the frame of the caller
+    bool tail_calls = true;
+    // evaluate operators on literals at compile time and compile only
+    // the branch a constant if condition takes
+    bool fold_constants = true;
+    // thread jumps and drop the dead code and no-op pairs the lowering
+    // of if leaves behind
+    bool peephole = true;
+    // lower function bodies to ssa and generate their code from it after
+    // dead code elimination, common subexpression elimination and copy
+    // propagation
+    bool ssa = true;
+    // replace calls in functions lowered to ssa with the bodies of the
+    // small functions bound once to a global that they call. only when
+    // the compiler owns its symbol table, later compilations that share
+    // it could bind the global again.
+    bool inline_calls = true;
+};
+
+// a function whose calls can be replaced with its body
+struct inline_candidate {
+    const function_expression* function;
+    // the number of globals the function saw when it was compiled, see
+    // symbol_table::push_scope
+    size_t globals;
+    // the number of statements and expressions in its body
+    size_t size;
+};
+
+// the state of lowering one function body, see compile_ssa
+struct ir_lowering {
+    ir_function fn;
+    // where the code being lowered goes
+    size_t block;
+    // the value of every local by its index in the symbol table, or
+    // ir_no_value
+    std::vector<ir_value> locals;
+    // set once the body has something the ir does not model
+    bool unsupported;
+    // the functions being inlined, innermost last
+    std::vector<const function_expression*> inlined;
+    // where the returns of the innermost function being inlined go, the
+    // block each leaves and the value it returns. nullptr outside of
+    // one.
+    std::vector<std::pair<size_t, ir_value>>* returns;
+    // the size left for the bodies of inlined functions
+    size_t inline_budget;
+};
+
 using constants_owned = std::vector<object>;
 using constants_ref = std::vector<object>&;
 
@@ -34,30 +93,56 @@ using symbol_table_ref = symbol_table&;
 template <typename ConstantsOwnership, typename SymbolTableOwnership>
 class compiler {
   public:
-    compiler();
-    compiler(symbol_table_ref symb_table, constants_ref constants);
+    compiler(compiler_options options = compiler_options());
+    compiler(symbol_table_ref symb_table, constants_ref constants,
+             compiler_options options = compiler_options());
     std::optional<std::string> compile(const ast& ast);
     const byte_code get_byte_code() const;
 
   private:
+    compiler_options options;
     ConstantsOwnership constants;
+    // the indices of the constants by their hash, see add_constant
+    std::unordered_multimap<size_t, int> constant_index;
     SymbolTableOwnership symb_table;
     std::vector<compilation_scope> scopes;
     size_t scope_index;
+    // of the main program
+    size_t max_stack;
+    // the functions calls can be inlined with by the index of the global
+    // bound to them, only while compile runs
+    std::unordered_map<size_t, inline_candidate> inline_candidates;
+    // how many times each name is bound in the program compile runs on
+    std::unordered_map<atom, size_t> bindings;
+    // whether the last function compile_function_constant compiled was
+    // lowered to ssa
+    bool last_lowered;
+    // how many matches are comparing their subject with the pattern
+    // being compiled, see match_subject
+    size_t match_depth;
 
     const instructions& get_current_instructions() const;
     instructions& current_instructions();
-    size_t emit(op_code op, const std::vector<int> operands);
-    size_t add_instruction(const std::vector<uint8_t> ins);
+    size_t emit(op_code op, std::initializer_list<int> operands);
+    size_t emit(op_code op, label target);
+    size_t emit(op_code op, int operand, label target);
+    label new_label();
+    void bind(label target);
     int add_constant(object obj);
+    void index_constants();
+    void truncate_constants(size_t size);
     void set_last_instruction(op_code op, size_t position);
     bool last_instruction_is_pop();
     bool last_instruction_is(op_code op);
     void remove_last_pop();
-    void replace_instruction(size_t position,
-                             std::vector<uint8_t> new_instruction);
+    void leave_block_value(const block_statement& block);
     void replace_last_pop_with_return();
-    void change_operand(size_t op_position, int operand);
+    instructions optimize(instructions ins) const;
+
+    bool inlining() const;
+    void add_inline_candidate(const statement& statement);
+    const inline_candidate* find_inline_candidate(const call& call,
+                                                  const ir_lowering& lowering);
 
     void enter_scope();
     instructions leave_scope();
@@ -69,17 +154,65 @@ class compiler {
     std::optional<std::string>
     compile_return_statement(const return_statement& ret);
     std::optional<std::string> compile_expression(const expression& expression);
+    std::optional<std::string> compile_constant(const object& constant);
     std::optional<std::string> compile_integer(int64_t value);
     std::optional<std::string> compile_float(double value);
     std::optional<std::string> compile_string(const std::string& value);
-    std::optional<std::string> compile_ident(const std::string& ident);
+    std::optional<std::string> compile_ident(atom ident);
     std::optional<std::string> compile_prefix(const prefix& prefix);
     std::optional<std::string> compile_infix(const infix& infix);
     std::optional<std::string> compile_assignment(const assignment& assignment);
     std::optional<std::string> compile_if(const if_expression& if_exp);
+    std::optional<std::string> compile_constant_if(const if_expression& if_exp,
+                                                   bool taken);
+    std::optional<std::string> compile_dead_block(const block_statement& block);
     std::optional<std::string>
     compile_function(const function_expression& function);
+    std::optional<std::string>
+    compile_function_constant(const function_expression& function,
+                              int& constant);
+    std::optional<std::string>
+    compile_ssa(const function_expression& function, bool& lowered,
+                size_t& num_locals);
+    std::optional<std::string> unsupported(ir_lowering& lowering);
+    void set_local(ir_lowering& lowering, size_t index, ir_value value);
+    std::optional<std::string> lower_block(const block_statement& block,
+                                           ir_lowering& lowering,
+                                           ir_value& result);
+    std::optional<std::string> lower_statement(const statement& statement,
+                                               ir_lowering& lowering,
+                                               ir_value& result);
+    std::optional<std::string> lower_operand(const expression& expression,
+                                             ir_lowering& lowering,
+                                             ir_value& value);
+    std::optional<std::string> lower_constant(const object& constant,
+                                              ir_lowering& lowering,
+                                              ir_value& value);
+    std::optional<std::string> lower_expression(const expression& expression,
+                                                ir_lowering& lowering,
+                                                ir_value& value);
+    std::optional<std::string>
+    lower_infix(const infix& infix, ir_lowering& lowering, ir_value& value);
+    std::optional<std::string> lower_if(const if_expression& if_exp,
+                                        ir_lowering& lowering,
+                                        ir_value& value);
+    std::optional<std::string>
+    lower_inlined_call(const inline_candidate& callee,
+                       std::vector<ir_value> args, ir_lowering& lowering,
+                       ir_value& value);
     std::optional<std::string> compile_call(const call& call);
+    std::optional<std::string> compile_match(const match& match);
+    std::optional<std::string>
+    compile_switch(const match& match,
+                   const std::vector<std::pair<object, size_t>>& cases,
+                   size_t num_live);
+    symbol match_subject();
+    std::optional<std::string> compile_match_chain(const match& match,
+                                                   size_t num_live);
+    std::optional<std::string>
+    compile_match_consequence(const match_branch& branch);
+    std::optional<std::string>
+    compile_match_default(const match& match, size_t num_live, label end);
 
     std::optional<std::string> compile_block(const block_statement& block);
 };
@@ -0,0 +1,206 @@
+#include "decode.h"
+#include "base.h"
+#include "code.h"
+
+namespace axe {
+
+code_word opcode_word(op_code op, const void* const* handlers) {
+    code_word word;
+    if (handlers != nullptr) {
+        word.handler = handlers[static_cast<size_t>(op)];
+    } else {
+        word.op = op;
+    }
+    return word;
+}
+
+static code_word operand_word(size_t operand) {
+    code_word word;
+    word.operand = operand;
+    return word;
+}
+
+static bool is_call(op_code op) {
+    return op == op_code::OpCall || op == op_code::OpTailCall;
+}
+
+size_t num_words(op_code op) {
+    auto def = lookup(op);
+    AXE_CHECK(def.has_value(), "opcode %d undefined", static_cast<int>(op));
+    return 1 + def->get_operand_widths().size() +
+           (is_call(op) || op == op_code::OpSwitch ? 1 : 0);
+}
+
+size_t instruction_width(op_code op) {
+    auto def = lookup(op);
+    size_t width = 1;
+    for (auto& operand_width : def->get_operand_widths()) {
+        width += operand_width;
+    }
+    return width;
+}
+
+decoded_function decode(const instructions& ins, size_t num_locals,
+                        size_t num_params, size_t max_stack,
+                        const void* const* handlers,
+                        const std::vector<value>& constants, value* globals) {
+    decoded_function res = {
+        {}, num_locals, num_params, max_stack, &ins, {}, {}, 0, 0, nullptr,
+        nullptr};
+
+    // first pass, find the word index of every instruction so jumps can
+    // be resolved
+    std::vector<size_t> word_index(ins.size() + 1, 0);
+    size_t total_words = 0;
+    size_t num_calls = 0;
+    size_t num_switches = 0;
+    size_t i = 0;
+    while (i < ins.size()) {
+        op_code op = static_cast<op_code>(ins[i]);
+        word_index[i] = total_words;
+        total_words += num_words(op);
+        if (is_call(op)) {
+            num_calls++;
+        }
+        if (op == op_code::OpSwitch) {
+            num_switches++;
+        }
+        i += instruction_width(op);
+    }
+    word_index[ins.size()] = total_words;
+
+    // sized up front, the call words point into it
+    res.caches.assign(num_calls,
+                      {value::from_heap_object(nullptr), nullptr, 0, 0});
+    size_t next_cache = 0;
+    // filled in with the targets once they are pointers
+    res.switches.reserve(num_switches);
+
+    // second pass, emit the words. jump targets are stored as word
+    // indices and turned into pointers once the stream stops growing.
+    std::vector<size_t> jumps;
+    std::vector<size_t> switches;
+    res.code.reserve(total_words);
+    i = 0;
+    while (i < ins.size()) {
+        op_code op = static_cast<op_code>(ins[i]);
+        res.code.push_back(opcode_word(op, handlers));
+        switch (op) {
+        case op_code::OpConstant: {
+            code_word word;
+            word.constant = &constants[read_u16(ins, i + 1)];
+            res.code.push_back(word);
+            i += 3;
+        } break;
+        case op_code::OpGetGlobal:
+        case op_code::OpSetGlobal: {
+            code_word word;
+            word.global = globals + read_u16(ins, i + 1);
+            res.code.push_back(word);
+            i += 3;
+        } break;
+        case op_code::OpJump:
+        case op_code::OpJumpNotTruthy:
+        case op_code::OpJumpTruthy:
+        case op_code::OpGreaterThanJumpNotTruthy:
+        case op_code::OpEqJumpNotTruthy:
+            jumps.push_back(res.code.size());
+            res.code.push_back(operand_word(word_index[read_u16(ins, i + 1)]));
+            i += 3;
+            break;
+        case op_code::OpJumpTable: {
+            code_word word;
+            word.constant = &constants[read_u16(ins, i + 1)];
+            res.code.push_back(word);
+            res.code.push_back(operand_word(read_u16(ins, i + 3)));
+            i += 5;
+        } break;
+        case op_code::OpSwitch: {
+            res.code.push_back(operand_word(read_u16(ins, i + 1)));
+            switches.push_back(res.code.size());
+            code_word word;
+            word.table = nullptr;
+            res.code.push_back(word);
+            i += 3;
+        } break;
+        case op_code::OpCase: {
+            code_word word;
+            word.constant = &constants[read_u16(ins, i + 1)];
+            res.code.push_back(word);
+            jumps.push_back(res.code.size());
+            res.code.push_back(operand_word(word_index[read_u16(ins, i + 3)]));
+            i += 5;
+        } break;
+        case op_code::OpCall:
+        case op_code::OpTailCall: {
+            res.code.push_back(operand_word(ins[i + 1]));
+            code_word word;
+            word.cache = &res.caches[next_cache++];
+            res.code.push_back(word);
+            i += 2;
+        } break;
+        case op_code::OpGetLocal:
+        case op_code::OpSetLocal:
+            res.code.push_back(operand_word(ins[i + 1]));
+            i += 2;
+            break;
+        case op_code::OpGetLocalGetLocal:
+            res.code.push_back(operand_word(ins[i + 1]));
+            res.code.push_back(operand_word(ins[i + 2]));
+            i += 3;
+            break;
+        case op_code::OpGetLocalConstant:
+        case op_code::OpAddLocalConstant:
+        case op_code::OpSubLocalConstant: {
+            res.code.push_back(operand_word(ins[i + 1]));
+            code_word word;
+            word.constant = &constants[read_u16(ins, i + 2)];
+            res.code.push_back(word);
+            i += 4;
+        } break;
+        default:
+            i++;
+            break;
+        }
+    }
+
+    for (auto& jump : jumps) {
+        res.code[jump].target = res.code.data() + res.code[jump].operand;
+    }
+    // the cases start past the count, the table and the jump to the
+    // default. the first case wins when two have the same string.
+    for (auto& index : switches) {
+        size_t count = res.code[index - 1].operand;
+        const code_word* cases = &res.code[index + 3];
+        if (count == 0 ||
+            cases[1].constant->get_type() != object_type::String) {
+            continue;
+        }
+        res.switches.emplace_back();
+        auto& table = res.switches.back();
+        for (size_t j = 0; j < count; ++j) {
+            auto entry = cases + j * num_words(op_code::OpCase);
+            table.emplace(entry[1].constant->get_string(), entry[2].target);
+        }
+        res.code[index].table = &table;
+    }
+    return res;
+}
+
+size_t source_position(const decoded_function& fn, const code_word* word) {
+    size_t target = word - fn.code.data();
+    auto& ins = *fn.source;
+    size_t words = 0;
+    size_t i = 0;
+    while (i < ins.size()) {
+        op_code op = static_cast<op_code>(ins[i]);
+        words += num_words(op);
+        if (words > target) {
+            break;
+        }
+        i += instruction_width(op);
+    }
+    return i;
+}
+
+} // namespace axe
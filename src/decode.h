@@ -0,0 +1,96 @@
+#ifndef __AXE_DECODE_H__
+
+#define __AXE_DECODE_H__
+
+#include "code.h"
+#include "value.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace axe {
+
+// the monomorphic inline cache of a call site. it remembers the last
+// function the site called, a call of the same function again skips
+// the type and arity checks.
+struct call_cache {
+    // starts out as a null pointer, which no value on the stack equals
+    value callee;
+    const decoded_function* prototype;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+union code_word;
+
+// the targets of an OpSwitch on strings by the string of their case
+using string_switch = std::unordered_map<std::string, const code_word*>;
+
+// one native width word of the pre-decoded instruction stream. every
+// instruction is a handler address (or the op_code when the vm is built
+// without computed goto) followed by its already decoded operands.
+union code_word {
+    const void* handler;
+    op_code op;
+    size_t operand;
+    const value* constant;
+    value* global;
+    const code_word* target;
+    call_cache* cache;
+    const string_switch* table;
+};
+
+static_assert(sizeof(code_word) == sizeof(void*),
+              "code_word must be a single native word");
+
+struct decoded_function {
+    std::vector<code_word> code;
+    size_t num_locals;
+    size_t num_params;
+    // stack slots needed above the locals, see max_stack_depth
+    size_t max_stack;
+    // the byte code code was decoded from
+    const instructions* source;
+    // one per OpCall and OpTailCall, the words of the calls point here
+    std::vector<call_cache> caches;
+    // one per OpSwitch on strings, the words of the switches point here
+    std::vector<string_switch> switches;
+    // how often the vm called the function and how often its optimized
+    // code deoptimized
+    uint64_t calls;
+    uint64_t deopts;
+    // the machine code a call runs, nullptr while interpreted, and the
+    // code of the baseline tier it falls back to
+    const void* native;
+    const void* baseline;
+};
+
+// the word an instruction starts with
+code_word opcode_word(op_code op, const void* const* handlers);
+
+// an instruction becomes one word for the handler, one word per operand,
+// one for the cache of a call and one for the table of an OpSwitch
+size_t num_words(op_code op);
+// the size of an instruction in the byte code
+size_t instruction_width(op_code op);
+
+// translates the big endian byte code of a function into a stream of
+// code_words. constant and global operands become pointers into
+// constants and globals, jump operands become pointers into the decoded
+// stream, calls get an extra word pointing at their call_cache and
+// switches on strings one pointing at their string_switch.
+// handlers is indexed by op_code, when it is nullptr the op_code itself
+// is stored instead of a handler address.
+decoded_function decode(const instructions& ins, size_t num_locals,
+                        size_t num_params, size_t max_stack,
+                        const void* const* handlers,
+                        const std::vector<value>& constants, value* globals);
+
+// the offset in the byte code of the instruction word belongs to. only
+// needed to report errors, so it walks the byte code instead of keeping
+// a table around.
+size_t source_position(const decoded_function& fn, const code_word* word);
+
+} // namespace axe
+
+#endif // __AXE_DECODE_H__
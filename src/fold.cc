@@ -0,0 +1,128 @@
+#include "fold.h"
+#include <cstdint>
+
+namespace axe {
+
+static std::optional<object> fold_prefix(const prefix& prefix) {
+    auto rhs = fold_constant(*prefix.get_rhs());
+    if (!rhs.has_value()) {
+        return std::nullopt;
+    }
+    switch (prefix.get_op()) {
+    case prefix_operator::Bang:
+        return object(object_type::Bool, !rhs->is_truthy());
+    case prefix_operator::Minus:
+        if (rhs->get_type() == object_type::Integer &&
+            rhs->get_int() != INT64_MIN) {
+            return object(object_type::Integer, -rhs->get_int());
+        }
+        if (rhs->get_type() == object_type::Float) {
+            return object(object_type::Float, -rhs->get_float());
+        }
+        break;
+    }
+    return std::nullopt;
+}
+
+// the int64_t arithmetic of the vm is undefined where it overflows and
+// it traps on division by zero, folding leaves both alone
+static std::optional<object> fold_ints(infix_operator op, int64_t lhs,
+                                       int64_t rhs) {
+    int64_t res;
+    bool overflow = false;
+    switch (op) {
+    case infix_operator::Plus:
+        overflow = __builtin_add_overflow(lhs, rhs, &res);
+        break;
+    case infix_operator::Minus:
+        overflow = __builtin_sub_overflow(lhs, rhs, &res);
+        break;
+    case infix_operator::Asterisk:
+        overflow = __builtin_mul_overflow(lhs, rhs, &res);
+        break;
+    case infix_operator::Slash:
+        if (rhs == 0 || (lhs == INT64_MIN && rhs == -1)) {
+            return std::nullopt;
+        }
+        res = lhs / rhs;
+        break;
+    default:
+        return std::nullopt;
+    }
+    if (overflow) {
+        return std::nullopt;
+    }
+    return object(object_type::Integer, res);
+}
+
+static std::optional<object> fold_infix(const infix& infix) {
+    auto lhs = fold_constant(*infix.get_lhs());
+    if (!lhs.has_value()) {
+        return std::nullopt;
+    }
+    auto rhs = fold_constant(*infix.get_rhs());
+    if (!rhs.has_value()) {
+        return std::nullopt;
+    }
+    auto op = infix.get_op();
+    switch (op) {
+    case infix_operator::Eq:
+        return object(object_type::Bool, *lhs == *rhs);
+    case infix_operator::NotEq:
+        return object(object_type::Bool, *lhs != *rhs);
+    case infix_operator::Gt:
+        return object(object_type::Bool, *lhs > *rhs);
+    case infix_operator::Lt:
+        return object(object_type::Bool, *rhs > *lhs);
+    default:
+        break;
+    }
+    if (lhs->get_type() == object_type::Integer &&
+        rhs->get_type() == object_type::Integer) {
+        return fold_ints(op, lhs->get_int(), rhs->get_int());
+    }
+    object res;
+    switch (op) {
+    case infix_operator::Plus:
+        res = *lhs + *rhs;
+        break;
+    case infix_operator::Minus:
+        res = *lhs - *rhs;
+        break;
+    case infix_operator::Asterisk:
+        res = *lhs * *rhs;
+        break;
+    case infix_operator::Slash:
+        res = *lhs / *rhs;
+        break;
+    default:
+        break;
+    }
+    // mixed types make null at run time
+    if (res.get_type() == object_type::Null) {
+        return std::nullopt;
+    }
+    return res;
+}
+
+std::optional<object> fold_constant(const expression& exp) {
+    switch (exp.get_type()) {
+    case expression_type::Integer:
+        return object(object_type::Integer, exp.get_int());
+    case expression_type::Float:
+        return object(object_type::Float, exp.get_float());
+    case expression_type::Bool:
+        return object(object_type::Bool, exp.get_bool());
+    case expression_type::String:
+        return object(object_type::String, exp.get_string());
+    case expression_type::Prefix:
+        return fold_prefix(exp.get_prefix());
+    case expression_type::Infix:
+        return fold_infix(exp.get_infix());
+    default:
+        break;
+    }
+    return std::nullopt;
+}
+
+} // namespace axe
@@ -0,0 +1,19 @@
+#ifndef __AXE_FOLD_H__
+
+#define __AXE_FOLD_H__
+
+#include "ast.h"
+#include "object.h"
+#include <optional>
+
+namespace axe {
+
+// the value of an expression built only from literals, prefix and infix
+// operators, evaluated the way the vm would. std::nullopt when it reads
+// anything else or when the vm would fail, overflow or produce null, so
+// those are still left to run time.
+std::optional<object> fold_constant(const expression& exp);
+
+} // namespace axe
+
+#endif // __AXE_FOLD_H__
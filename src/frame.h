@@ -2,22 +2,20 @@
 
 #define __AXE_FRAME_H__
 
-#include "object.h"
+#include "decode.h"
 
 namespace axe {
 
-class frame {
-  public:
-    frame();
-    frame(compiled_function function, size_t base_pointer);
-
-    ssize_t instruction_pointer;
+// a call in progress. the prototype is shared by every call of the
+// function, so pushing and popping a frame copies four words and
+// allocates nothing.
+struct frame {
+    const decoded_function* function;
+    const code_word* instruction_pointer;
     size_t base_pointer;
-
-    const instructions& get_instructions() const;
-
-  private:
-    compiled_function function;
+    // where the machine code of a jitted frame continues, nullptr when
+    // the frame is interpreted
+    const void* native;
 };
 
 } // namespace axe
@@ -0,0 +1,910 @@
+#include "ir.h"
+#include "base.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+namespace axe {
+
+static const size_t NO_BLOCK = static_cast<size_t>(-1);
+
+const char* ir_op_string(ir_op op) {
+    switch (op) {
+    case ir_op::Param:
+        return "param";
+    case ir_op::Constant:
+        return "constant";
+    case ir_op::True:
+        return "true";
+    case ir_op::False:
+        return "false";
+    case ir_op::Null:
+        return "null";
+    case ir_op::GetGlobal:
+        return "get_global";
+    case ir_op::SetGlobal:
+        return "set_global";
+    case ir_op::Add:
+        return "add";
+    case ir_op::Sub:
+        return "sub";
+    case ir_op::Mul:
+        return "mul";
+    case ir_op::Div:
+        return "div";
+    case ir_op::Eq:
+        return "eq";
+    case ir_op::NotEq:
+        return "not_eq";
+    case ir_op::GreaterThan:
+        return "greater_than";
+    case ir_op::Minus:
+        return "minus";
+    case ir_op::Bang:
+        return "bang";
+    case ir_op::Call:
+        return "call";
+    case ir_op::Phi:
+        return "phi";
+    case ir_op::Copy:
+        return "copy";
+    }
+    AXE_UNREACHABLE;
+    return "";
+}
+
+static bool has_immediate(ir_op op) {
+    switch (op) {
+    case ir_op::Param:
+    case ir_op::Constant:
+    case ir_op::GetGlobal:
+    case ir_op::SetGlobal:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+// calls and writes change what the program sees, a division by zero
+// and negating what is not a number stop it
+static bool has_effect(ir_op op) {
+    switch (op) {
+    case ir_op::SetGlobal:
+    case ir_op::Call:
+    case ir_op::Div:
+    case ir_op::Minus:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+// the same operands always give the same result, so a second one can
+// take the result of a first one that always runs before it. a failing
+// first one never lets the second one run.
+static bool is_redundant_when_repeated(ir_op op) {
+    switch (op) {
+    case ir_op::SetGlobal:
+    case ir_op::GetGlobal:
+    case ir_op::Call:
+    case ir_op::Phi:
+    case ir_op::Copy:
+        return false;
+    default:
+        break;
+    }
+    return true;
+}
+
+// values that are cheaper to push again at every use than to keep in a
+// local
+static bool is_rematerializable(ir_op op) {
+    switch (op) {
+    case ir_op::Param:
+    case ir_op::Constant:
+    case ir_op::True:
+    case ir_op::False:
+    case ir_op::Null:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+ir_function::ir_function(size_t num_params) : num_params(num_params) {
+    this->new_block();
+    this->blocks[0].reachable = true;
+}
+
+size_t ir_function::new_block() {
+    ir_block block;
+    block.terminator = {ir_terminator_type::None, 0, {0, 0}};
+    block.reachable = false;
+    this->blocks.push_back(std::move(block));
+    return this->blocks.size() - 1;
+}
+
+ir_value ir_function::add(size_t block, ir_op op,
+                          std::vector<ir_value> operands, int immediate) {
+    this->values.push_back({op, std::move(operands), immediate, block, false});
+    ir_value value = this->values.size() - 1;
+    this->blocks[block].body.push_back(value);
+    return value;
+}
+
+ir_value ir_function::add_phi(size_t block, std::vector<ir_value> inputs) {
+    AXE_CHECK(inputs.size() == this->blocks[block].preds.size(),
+              "a phi needs one input per predecessor");
+    this->values.push_back(
+        {ir_op::Phi, std::move(inputs), 0, block, false});
+    ir_value value = this->values.size() - 1;
+    this->blocks[block].phis.push_back(value);
+    return value;
+}
+
+void ir_function::add_edge(size_t from, size_t to) {
+    AXE_CHECK(to > from, "blocks only jump forward");
+    this->blocks[to].preds.push_back(from);
+    if (this->blocks[from].reachable) {
+        this->blocks[to].reachable = true;
+    }
+}
+
+void ir_function::remove_edge(size_t from, size_t to) {
+    auto& block = this->blocks[to];
+    auto it = std::find(block.preds.begin(), block.preds.end(), from);
+    AXE_CHECK(it != block.preds.end(), "no edge to remove");
+    size_t index = it - block.preds.begin();
+    block.preds.erase(it);
+    for (auto phi : block.phis) {
+        auto& operands = this->values[phi].operands;
+        operands.erase(operands.begin() + index);
+    }
+}
+
+void ir_function::jump(size_t from, size_t to) {
+    this->blocks[from].terminator = {ir_terminator_type::Jump, 0, {to, 0}};
+    this->add_edge(from, to);
+}
+
+void ir_function::branch(size_t from, ir_value cond, size_t then_block,
+                         size_t else_block) {
+    this->blocks[from].terminator = {ir_terminator_type::Branch,
+                                     cond,
+                                     {then_block, else_block}};
+    this->add_edge(from, then_block);
+    this->add_edge(from, else_block);
+}
+
+void ir_function::ret(size_t from, ir_value value) {
+    this->blocks[from].terminator = {ir_terminator_type::Return, value, {}};
+}
+
+bool ir_function::is_terminated(size_t block) const {
+    return this->blocks[block].terminator.type != ir_terminator_type::None;
+}
+
+bool ir_function::is_reachable(size_t block) const {
+    return this->blocks[block].reachable;
+}
+
+const ir_instruction& ir_function::get(ir_value value) const {
+    return this->values[value];
+}
+
+const ir_block& ir_function::get_block(size_t block) const {
+    return this->blocks[block];
+}
+
+size_t ir_function::num_blocks() const { return this->blocks.size(); }
+
+void ir_function::replace_uses(ir_value from, ir_value to) {
+    for (auto& ins : this->values) {
+        if (ins.dead) {
+            continue;
+        }
+        for (auto& operand : ins.operands) {
+            if (operand == from) {
+                operand = to;
+            }
+        }
+    }
+    for (auto& block : this->blocks) {
+        auto& terminator = block.terminator;
+        if ((terminator.type == ir_terminator_type::Branch ||
+             terminator.type == ir_terminator_type::Return) &&
+            terminator.value == from) {
+            terminator.value = to;
+        }
+    }
+}
+
+void ir_function::kill(ir_value value) {
+    auto& ins = this->values[value];
+    ins.dead = true;
+    auto& list = ins.op == ir_op::Phi ? this->blocks[ins.block].phis
+                                      : this->blocks[ins.block].body;
+    list.erase(std::find(list.begin(), list.end(), value));
+}
+
+void ir_function::optimize() {
+    bool changed = true;
+    while (changed) {
+        changed = this->fold_branches();
+        changed |= this->remove_unreachable_blocks();
+        changed |= this->propagate_copies();
+        changed |= this->eliminate_redundant_globals();
+        changed |= this->eliminate_common_subexpressions();
+        changed |= this->eliminate_dead_code();
+    }
+}
+
+bool ir_function::fold_branches() {
+    bool changed = false;
+    for (size_t i = 0; i < this->blocks.size(); ++i) {
+        auto& terminator = this->blocks[i].terminator;
+        if (terminator.type != ir_terminator_type::Branch) {
+            continue;
+        }
+        ir_op op = this->values[terminator.value].op;
+        if (op != ir_op::True && op != ir_op::False && op != ir_op::Null) {
+            continue;
+        }
+        size_t taken = terminator.targets[op == ir_op::True ? 0 : 1];
+        size_t not_taken = terminator.targets[op == ir_op::True ? 1 : 0];
+        this->remove_edge(i, not_taken);
+        terminator = {ir_terminator_type::Jump, 0, {taken, 0}};
+        changed = true;
+    }
+    return changed;
+}
+
+bool ir_function::remove_unreachable_blocks() {
+    std::vector<bool> reachable(this->blocks.size(), false);
+    reachable[0] = true;
+    // blocks only jump forward, one pass in order sees every edge
+    for (size_t i = 0; i < this->blocks.size(); ++i) {
+        if (!reachable[i]) {
+            continue;
+        }
+        auto& terminator = this->blocks[i].terminator;
+        if (terminator.type == ir_terminator_type::Jump) {
+            reachable[terminator.targets[0]] = true;
+        } else if (terminator.type == ir_terminator_type::Branch) {
+            reachable[terminator.targets[0]] = true;
+            reachable[terminator.targets[1]] = true;
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < this->blocks.size(); ++i) {
+        auto& block = this->blocks[i];
+        block.reachable = reachable[i];
+        if (reachable[i]) {
+            continue;
+        }
+        auto& terminator = block.terminator;
+        if (terminator.type == ir_terminator_type::Jump) {
+            this->remove_edge(i, terminator.targets[0]);
+        } else if (terminator.type == ir_terminator_type::Branch) {
+            this->remove_edge(i, terminator.targets[0]);
+            this->remove_edge(i, terminator.targets[1]);
+        }
+        if (terminator.type != ir_terminator_type::None ||
+            !block.phis.empty() || !block.body.empty()) {
+            changed = true;
+        }
+        terminator = {ir_terminator_type::None, 0, {0, 0}};
+        for (auto value : block.phis) {
+            this->values[value].dead = true;
+        }
+        for (auto value : block.body) {
+            this->values[value].dead = true;
+        }
+        block.phis.clear();
+        block.body.clear();
+    }
+    return changed;
+}
+
+bool ir_function::propagate_copies() {
+    bool changed = false;
+    for (ir_value value = 0; value < this->values.size(); ++value) {
+        auto& ins = this->values[value];
+        if (ins.dead) {
+            continue;
+        }
+        ir_value same = ir_no_value;
+        if (ins.op == ir_op::Copy) {
+            same = ins.operands[0];
+        } else if (ins.op == ir_op::Phi) {
+            // an input that is the phi itself does not count
+            for (auto input : ins.operands) {
+                if (input == value || input == same) {
+                    continue;
+                }
+                if (same != ir_no_value) {
+                    same = ir_no_value;
+                    break;
+                }
+                same = input;
+            }
+        }
+        if (same == ir_no_value) {
+            continue;
+        }
+        this->replace_uses(value, same);
+        this->kill(value);
+        changed = true;
+    }
+    return changed;
+}
+
+bool ir_function::eliminate_redundant_globals() {
+    bool changed = false;
+    for (auto& block : this->blocks) {
+        // the value every global is known to have
+        std::unordered_map<int, ir_value> known;
+        // writes nothing has seen yet
+        std::unordered_map<int, ir_value> unseen;
+        auto body = block.body;
+        for (auto value : body) {
+            auto& ins = this->values[value];
+            switch (ins.op) {
+            case ir_op::GetGlobal: {
+                unseen.erase(ins.immediate);
+                auto it = known.find(ins.immediate);
+                if (it != known.end()) {
+                    this->replace_uses(value, it->second);
+                    this->kill(value);
+                    changed = true;
+                } else {
+                    known[ins.immediate] = value;
+                }
+            } break;
+            case ir_op::SetGlobal: {
+                auto it = unseen.find(ins.immediate);
+                if (it != unseen.end()) {
+                    this->kill(it->second);
+                    changed = true;
+                }
+                unseen[ins.immediate] = value;
+                known[ins.immediate] = ins.operands[0];
+            } break;
+            case ir_op::Call:
+                known.clear();
+                unseen.clear();
+                break;
+            default:
+                // an error shows the globals as they are
+                if (has_effect(ins.op)) {
+                    unseen.clear();
+                }
+                break;
+            }
+        }
+    }
+    return changed;
+}
+
+std::vector<size_t> ir_function::immediate_dominators() const {
+    std::vector<size_t> idoms(this->blocks.size(), NO_BLOCK);
+    idoms[0] = 0;
+    // preds always come before a block, so theirs are already known
+    for (size_t i = 1; i < this->blocks.size(); ++i) {
+        size_t idom = NO_BLOCK;
+        for (auto pred : this->blocks[i].preds) {
+            if (idoms[pred] == NO_BLOCK) {
+                continue;
+            }
+            if (idom == NO_BLOCK) {
+                idom = pred;
+                continue;
+            }
+            size_t a = idom;
+            size_t b = pred;
+            while (a != b) {
+                while (a > b) {
+                    a = idoms[a];
+                }
+                while (b > a) {
+                    b = idoms[b];
+                }
+            }
+            idom = a;
+        }
+        idoms[i] = idom;
+    }
+    return idoms;
+}
+
+bool ir_function::dominates(size_t a, size_t b,
+                            const std::vector<size_t>& idoms) const {
+    while (b > a) {
+        b = idoms[b];
+    }
+    return a == b;
+}
+
+bool ir_function::eliminate_common_subexpressions() {
+    auto idoms = this->immediate_dominators();
+    std::map<std::tuple<ir_op, int, std::vector<ir_value>>,
+             std::vector<ir_value>>
+        seen;
+    bool changed = false;
+    for (size_t i = 0; i < this->blocks.size(); ++i) {
+        if (idoms[i] == NO_BLOCK) {
+            continue;
+        }
+        auto body = this->blocks[i].body;
+        for (auto value : body) {
+            auto& ins = this->values[value];
+            if (!is_redundant_when_repeated(ins.op)) {
+                continue;
+            }
+            auto& candidates =
+                seen[std::make_tuple(ins.op, ins.immediate, ins.operands)];
+            auto it = std::find_if(
+                candidates.begin(), candidates.end(), [&](ir_value other) {
+                    return this->dominates(this->values[other].block, i,
+                                           idoms);
+                });
+            if (it == candidates.end()) {
+                candidates.push_back(value);
+                continue;
+            }
+            this->replace_uses(value, *it);
+            this->kill(value);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool ir_function::eliminate_dead_code() {
+    std::vector<bool> live(this->values.size(), false);
+    std::vector<ir_value> work;
+    auto mark = [&](ir_value value) {
+        if (!live[value]) {
+            live[value] = true;
+            work.push_back(value);
+        }
+    };
+    for (auto& block : this->blocks) {
+        for (auto value : block.body) {
+            if (has_effect(this->values[value].op)) {
+                mark(value);
+            }
+        }
+        auto& terminator = block.terminator;
+        if (terminator.type == ir_terminator_type::Branch ||
+            terminator.type == ir_terminator_type::Return) {
+            mark(terminator.value);
+        }
+    }
+    while (!work.empty()) {
+        ir_value value = work.back();
+        work.pop_back();
+        for (auto operand : this->values[value].operands) {
+            mark(operand);
+        }
+    }
+
+    bool changed = false;
+    for (ir_value value = 0; value < this->values.size(); ++value) {
+        if (!live[value] && !this->values[value].dead) {
+            this->kill(value);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// lays the ssa values out on the stack. a value that has one use, right
+// after it in the same block, is left on the stack for it, like the
+// operands of an expression tree. every other value goes in a local of
+// its own. a phi that is the first thing its block evaluates is pushed
+// by the jumps into the block.
+class ir_generator {
+  public:
+    ir_generator(const std::vector<ir_instruction>& values,
+                 const std::vector<ir_block>& blocks, size_t num_params)
+        : values(values), blocks(blocks), uses(values.size(), 0),
+          inlined(values.size(), false), slots(values.size(), -1),
+          positions(values.size(), -1), next_slot(num_params),
+          num_params(num_params) {}
+
+    std::optional<instructions> generate(size_t& num_locals) {
+        this->lay_out();
+        for (auto& ins : this->values) {
+            if (ins.dead) {
+                continue;
+            }
+            for (auto operand : ins.operands) {
+                this->uses[operand]++;
+            }
+        }
+        for (auto i : this->layout) {
+            auto& terminator = this->blocks[i].terminator;
+            if (terminator.type == ir_terminator_type::Branch ||
+                terminator.type == ir_terminator_type::Return) {
+                this->uses[terminator.value]++;
+            }
+        }
+        // a block needs to know which phis its successors take on the
+        // stack, so the last one goes first
+        for (auto it = this->layout.rbegin(); it != this->layout.rend();
+             ++it) {
+            this->stackify(*it);
+        }
+
+        this->block_starts.resize(this->blocks.size(), 0);
+        for (size_t i = 0; i < this->layout.size(); ++i) {
+            size_t next = i + 1 < this->layout.size() ? this->layout[i + 1]
+                                                      : NO_BLOCK;
+            this->emit_block(this->layout[i], next);
+        }
+        for (auto& fixup : this->fixups) {
+            this->list[fixup.first].operands[0] =
+                this->block_starts[fixup.second];
+        }
+        if (this->next_slot > 256) {
+            return std::nullopt;
+        }
+        num_locals = std::max(this->next_slot, this->num_params);
+        return assemble(this->list);
+    }
+
+  private:
+    const std::vector<ir_instruction>& values;
+    const std::vector<ir_block>& blocks;
+    std::vector<size_t> layout;
+    std::vector<size_t> uses;
+    std::vector<bool> inlined;
+    std::vector<int> slots;
+    // of a value in the sequence of its block that stackify walks
+    std::vector<long> positions;
+    long point;
+    size_t current;
+    std::vector<instruction> list;
+    std::vector<size_t> block_starts;
+    // an instruction in list and the block it jumps to
+    std::vector<std::pair<size_t, size_t>> fixups;
+    size_t next_slot;
+    size_t num_params;
+
+    // reverse postorder, which keeps a branch next to the code after
+    // it. the else side is visited first so the then side comes right
+    // after the branch.
+    void lay_out() {
+        std::vector<bool> visited(this->blocks.size(), false);
+        // a block and how many of its successors were visited
+        std::vector<std::pair<size_t, size_t>> work = {{0, 0}};
+        visited[0] = true;
+        while (!work.empty()) {
+            auto& top = work.back();
+            auto& terminator = this->blocks[top.first].terminator;
+            size_t num_successors = 0;
+            size_t successors[2];
+            if (terminator.type == ir_terminator_type::Jump) {
+                successors[num_successors++] = terminator.targets[0];
+            } else if (terminator.type == ir_terminator_type::Branch) {
+                successors[num_successors++] = terminator.targets[1];
+                successors[num_successors++] = terminator.targets[0];
+            }
+            if (top.second == num_successors) {
+                this->layout.push_back(top.first);
+                work.pop_back();
+                continue;
+            }
+            size_t next = successors[top.second++];
+            if (!visited[next]) {
+                visited[next] = true;
+                work.push_back({next, 0});
+            }
+        }
+        std::reverse(this->layout.begin(), this->layout.end());
+    }
+
+    // the values the terminator of block uses, in the order it pushes
+    // them
+    std::vector<ir_value> terminator_operands(size_t block) const {
+        auto& terminator = this->blocks[block].terminator;
+        switch (terminator.type) {
+        case ir_terminator_type::Branch:
+        case ir_terminator_type::Return:
+            return {terminator.value};
+        case ir_terminator_type::Jump: {
+            auto& target = this->blocks[terminator.targets[0]];
+            size_t index = std::find(target.preds.begin(), target.preds.end(),
+                                     block) -
+                           target.preds.begin();
+            std::vector<ir_value> inputs;
+            for (auto phi : target.phis) {
+                inputs.push_back(this->values[phi].operands[index]);
+            }
+            return inputs;
+        }
+        default:
+            break;
+        }
+        return {};
+    }
+
+    bool can_inline(ir_value value, bool leftmost) const {
+        auto& ins = this->values[value];
+        if (is_rematerializable(ins.op) || ins.block != this->current ||
+            this->uses[value] != 1 ||
+            this->positions[value] != this->point - 1) {
+            return false;
+        }
+        if (ins.op != ir_op::Phi) {
+            return true;
+        }
+        // the jumps push it before anything else of the block runs
+        if (!leftmost) {
+            return false;
+        }
+        for (auto pred : this->blocks[ins.block].preds) {
+            if (this->blocks[pred].terminator.type !=
+                ir_terminator_type::Jump) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // walks operands from the last one, taking every one that was
+    // computed right before the part of the tree taken so far
+    void take(const std::vector<ir_value>& operands, bool leftmost) {
+        for (size_t i = operands.size(); i-- > 0;) {
+            ir_value operand = operands[i];
+            if (!this->can_inline(operand, leftmost && i == 0)) {
+                continue;
+            }
+            this->inlined[operand] = true;
+            this->point = this->positions[operand];
+            if (this->values[operand].op != ir_op::Phi) {
+                this->take(this->values[operand].operands,
+                           leftmost && i == 0);
+            }
+        }
+    }
+
+    void stackify(size_t block) {
+        std::vector<ir_value> sequence;
+        auto& b = this->blocks[block];
+        sequence.insert(sequence.end(), b.phis.begin(), b.phis.end());
+        for (auto value : b.body) {
+            if (!is_rematerializable(this->values[value].op)) {
+                sequence.push_back(value);
+            }
+        }
+        for (size_t i = 0; i < sequence.size(); ++i) {
+            this->positions[sequence[i]] = i;
+        }
+        this->current = block;
+        this->point = sequence.size();
+        this->take(this->terminator_operands(block), true);
+        long i = this->point - 1;
+        while (i >= 0) {
+            ir_value root = sequence[i];
+            this->point = i;
+            if (this->values[root].op != ir_op::Phi) {
+                this->take(this->values[root].operands, true);
+            }
+            i = this->point - 1;
+        }
+    }
+
+    void emit(op_code op, std::vector<int> operands = {}) {
+        size_t position = this->list.size();
+        this->list.push_back({op, std::move(operands), position});
+    }
+
+    void emit_jump(op_code op, size_t target) {
+        this->fixups.push_back({this->list.size(), target});
+        this->emit(op, {0});
+    }
+
+    int slot_of(ir_value value) {
+        if (this->slots[value] < 0) {
+            this->slots[value] = this->next_slot++;
+        }
+        return this->slots[value];
+    }
+
+    void emit_operand(ir_value value) {
+        auto& ins = this->values[value];
+        switch (ins.op) {
+        case ir_op::Param:
+            this->emit(op_code::OpGetLocal, {ins.immediate});
+            return;
+        case ir_op::Constant:
+            this->emit(op_code::OpConstant, {ins.immediate});
+            return;
+        case ir_op::True:
+            this->emit(op_code::OpTrue);
+            return;
+        case ir_op::False:
+            this->emit(op_code::OpFalse);
+            return;
+        case ir_op::Null:
+            this->emit(op_code::OpNull);
+            return;
+        default:
+            break;
+        }
+        if (!this->inlined[value]) {
+            AXE_CHECK(this->slots[value] >= 0, "value used before stored");
+            this->emit(op_code::OpGetLocal, {this->slots[value]});
+        } else if (ins.op != ir_op::Phi) {
+            this->emit_tree(value);
+        }
+    }
+
+    void emit_tree(ir_value value) {
+        auto& ins = this->values[value];
+        for (auto operand : ins.operands) {
+            this->emit_operand(operand);
+        }
+        switch (ins.op) {
+        case ir_op::GetGlobal:
+            this->emit(op_code::OpGetGlobal, {ins.immediate});
+            break;
+        case ir_op::SetGlobal:
+            this->emit(op_code::OpSetGlobal, {ins.immediate});
+            break;
+        case ir_op::Add:
+            this->emit(op_code::OpAdd);
+            break;
+        case ir_op::Sub:
+            this->emit(op_code::OpSub);
+            break;
+        case ir_op::Mul:
+            this->emit(op_code::OpMul);
+            break;
+        case ir_op::Div:
+            this->emit(op_code::OpDiv);
+            break;
+        case ir_op::Eq:
+            this->emit(op_code::OpEq);
+            break;
+        case ir_op::NotEq:
+            this->emit(op_code::OpNotEq);
+            break;
+        case ir_op::GreaterThan:
+            this->emit(op_code::OpGreaterThan);
+            break;
+        case ir_op::Minus:
+            this->emit(op_code::OpMinus);
+            break;
+        case ir_op::Bang:
+            this->emit(op_code::OpBang);
+            break;
+        case ir_op::Call:
+            this->emit(op_code::OpCall,
+                       {static_cast<int>(ins.operands.size() - 1)});
+            break;
+        default:
+            AXE_UNREACHABLE;
+            break;
+        }
+    }
+
+    void emit_block(size_t block, size_t next) {
+        this->block_starts[block] = this->list.size();
+        auto& b = this->blocks[block];
+        for (auto value : b.body) {
+            auto op = this->values[value].op;
+            if (is_rematerializable(op) || this->inlined[value]) {
+                continue;
+            }
+            this->emit_tree(value);
+            if (op == ir_op::SetGlobal) {
+                continue;
+            }
+            if (this->uses[value] == 0) {
+                this->emit(op_code::OpPop);
+            } else {
+                this->emit(op_code::OpSetLocal, {this->slot_of(value)});
+            }
+        }
+
+        auto& terminator = b.terminator;
+        switch (terminator.type) {
+        case ir_terminator_type::Return:
+            if (this->values[terminator.value].op == ir_op::Null) {
+                this->emit(op_code::OpReturn);
+            } else {
+                this->emit_operand(terminator.value);
+                this->emit(op_code::OpReturnValue);
+            }
+            break;
+        case ir_terminator_type::Branch:
+            this->emit_operand(terminator.value);
+            this->emit_jump(op_code::OpJumpNotTruthy, terminator.targets[1]);
+            if (terminator.targets[0] != next) {
+                this->emit_jump(op_code::OpJump, terminator.targets[0]);
+            }
+            break;
+        case ir_terminator_type::Jump: {
+            size_t target = terminator.targets[0];
+            auto inputs = this->terminator_operands(block);
+            auto& phis = this->blocks[target].phis;
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                this->emit_operand(inputs[i]);
+                if (!this->inlined[phis[i]]) {
+                    this->emit(op_code::OpSetLocal,
+                               {this->slot_of(phis[i])});
+                }
+            }
+            if (target != next) {
+                this->emit_jump(op_code::OpJump, target);
+            }
+        } break;
+        default:
+            AXE_UNREACHABLE;
+            break;
+        }
+    }
+};
+
+std::optional<instructions> ir_function::generate(size_t& num_locals) const {
+    ir_generator generator(this->values, this->blocks, this->num_params);
+    return generator.generate(num_locals);
+}
+
+std::string ir_function::string() const {
+    std::string res;
+    auto value_string = [](ir_value value) {
+        return "%" + std::to_string(value);
+    };
+    for (size_t i = 0; i < this->blocks.size(); ++i) {
+        auto& block = this->blocks[i];
+        if (!block.reachable) {
+            continue;
+        }
+        res += "b" + std::to_string(i) + ":\n";
+        std::vector<ir_value> all = block.phis;
+        all.insert(all.end(), block.body.begin(), block.body.end());
+        for (auto value : all) {
+            auto& ins = this->values[value];
+            res += "  ";
+            if (ins.op != ir_op::SetGlobal) {
+                res += value_string(value) + " = ";
+            }
+            res += ir_op_string(ins.op);
+            if (has_immediate(ins.op)) {
+                res += " " + std::to_string(ins.immediate);
+            }
+            for (auto operand : ins.operands) {
+                res += " " + value_string(operand);
+            }
+            res += '\n';
+        }
+        auto& terminator = block.terminator;
+        switch (terminator.type) {
+        case ir_terminator_type::Jump:
+            res += "  jump b" + std::to_string(terminator.targets[0]) + '\n';
+            break;
+        case ir_terminator_type::Branch:
+            res += "  branch " + value_string(terminator.value) + " b" +
+                   std::to_string(terminator.targets[0]) + " b" +
+                   std::to_string(terminator.targets[1]) + '\n';
+            break;
+        case ir_terminator_type::Return:
+            res += "  return " + value_string(terminator.value) + '\n';
+            break;
+        case ir_terminator_type::None:
+            break;
+        }
+    }
+    return res;
+}
+
+} // namespace axe
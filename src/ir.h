@@ -0,0 +1,140 @@
+#ifndef __AXE_IR_H__
+
+#define __AXE_IR_H__
+
+#include "code.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace axe {
+
+// the id of an instruction, which is the value it defines
+using ir_value = size_t;
+
+// what an expression with no value lowers to, an assignment or a named
+// function
+constexpr ir_value ir_no_value = static_cast<ir_value>(-1);
+
+enum class ir_op {
+    Param,     // immediate is the index of the argument
+    Constant,  // immediate is the index in the constant pool
+    True,
+    False,
+    Null,
+    GetGlobal, // immediate is the index of the global
+    SetGlobal, // immediate is the index of the global, defines no value
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Eq,
+    NotEq,
+    GreaterThan,
+    Minus,
+    Bang,
+    Call, // the callee and then the arguments
+    // one input per predecessor of its block, in the same order
+    Phi,
+    // binds a local to a value, removed by propagate_copies
+    Copy,
+};
+
+struct ir_instruction {
+    ir_op op;
+    std::vector<ir_value> operands;
+    int immediate;
+    size_t block;
+    bool dead;
+};
+
+enum class ir_terminator_type {
+    None,
+    Jump,   // to targets[0]
+    Branch, // to targets[0] when value is truthy, else to targets[1]
+    Return, // value
+};
+
+struct ir_terminator {
+    ir_terminator_type type;
+    ir_value value;
+    size_t targets[2];
+};
+
+struct ir_block {
+    std::vector<ir_value> phis;
+    std::vector<ir_value> body;
+    std::vector<size_t> preds;
+    ir_terminator terminator;
+    bool reachable;
+};
+
+// a function body in ssa form. blocks are created in the order their
+// code is lowered and only jump forward, which is what the passes and
+// the code generator rely on. block 0 is the entry.
+class ir_function {
+  public:
+    ir_function(size_t num_params);
+
+    size_t new_block();
+    ir_value add(size_t block, ir_op op, std::vector<ir_value> operands = {},
+                 int immediate = 0);
+    ir_value add_phi(size_t block, std::vector<ir_value> inputs);
+    void jump(size_t from, size_t to);
+    void branch(size_t from, ir_value cond, size_t then_block,
+                size_t else_block);
+    void ret(size_t from, ir_value value);
+
+    bool is_terminated(size_t block) const;
+    // false for the code after a return, whose block nothing jumps to
+    bool is_reachable(size_t block) const;
+    const ir_instruction& get(ir_value value) const;
+    const ir_block& get_block(size_t block) const;
+    size_t num_blocks() const;
+
+    // runs every pass below until nothing changes
+    void optimize();
+
+    // branches on a constant become jumps
+    bool fold_branches();
+    // drops the blocks nothing reaches and their inputs to phis
+    bool remove_unreachable_blocks();
+    // uses of copies and of phis whose inputs are all the same value use
+    // that value instead
+    bool propagate_copies();
+    // a pure instruction computed by a dominating one is replaced by it
+    bool eliminate_common_subexpressions();
+    // reads of a global that is known from an earlier read or write in
+    // the same block and writes that are overwritten before anything
+    // could see them
+    bool eliminate_redundant_globals();
+    // instructions whose value is not used and that have no effect
+    bool eliminate_dead_code();
+
+    // stack byte code for the function, nullopt when it would need more
+    // locals than an operand can address. num_locals is set to the size
+    // of the frame it needs.
+    std::optional<instructions> generate(size_t& num_locals) const;
+
+    std::string string() const;
+
+  private:
+    std::vector<ir_instruction> values;
+    std::vector<ir_block> blocks;
+    size_t num_params;
+
+    void add_edge(size_t from, size_t to);
+    void remove_edge(size_t from, size_t to);
+    void replace_uses(ir_value from, ir_value to);
+    void kill(ir_value value);
+    bool dominates(size_t a, size_t b,
+                   const std::vector<size_t>& idoms) const;
+    std::vector<size_t> immediate_dominators() const;
+};
+
+const char* ir_op_string(ir_op op);
+
+} // namespace axe
+
+#endif // __AXE_IR_H__
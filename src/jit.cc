@@ -0,0 +1,1462 @@
+#include "jit.h"
+#include "code.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef AXE_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace axe {
+
+#ifdef AXE_JIT
+
+// the calls native code makes into the vm. they work on the stack
+// through the context, so the stack pointer is written back before and
+// reloaded after every call.
+
+static void collect_if_needed(jit_context* ctx) {
+    if (ctx->heap->should_collect()) {
+        ctx->collect(ctx);
+    }
+}
+
+template <value (*operation)(value, value, heap&)>
+static void arithmetic(jit_context* ctx) {
+    value rhs = *--ctx->stack_pointer;
+    value& lhs = ctx->stack_pointer[-1];
+    lhs = operation(lhs, rhs, *ctx->heap);
+    collect_if_needed(ctx);
+}
+
+template <bool (*comparison)(value, value), bool expected>
+static void compare(jit_context* ctx) {
+    value rhs = *--ctx->stack_pointer;
+    value& lhs = ctx->stack_pointer[-1];
+    lhs = value::from_bool(comparison(lhs, rhs) == expected);
+}
+
+static int minus(jit_context* ctx) {
+    value& rhs = ctx->stack_pointer[-1];
+    auto type = rhs.get_type();
+    if (type != object_type::Integer && type != object_type::Float) {
+        ctx->error_type = type;
+        return 0;
+    }
+    rhs = negate(rhs, *ctx->heap);
+    collect_if_needed(ctx);
+    return 1;
+}
+
+static int truthy(const value* v) { return is_truthy(*v); }
+
+static void bang(value* v) { *v = value::from_bool(!is_truthy(*v)); }
+
+namespace {
+
+enum reg : uint8_t {
+    rax = 0,
+    rcx = 1,
+    rdx = 2,
+    rbx = 3,
+    rsp = 4,
+    rbp = 5,
+    rsi = 6,
+    rdi = 7,
+    r12 = 12,
+    r13 = 13,
+};
+
+// the low nibble of jcc and setcc
+enum cond : uint8_t {
+    Overflow = 0x0,
+    Equal = 0x4,
+    NotEqual = 0x5,
+    Above = 0x7,
+    Parity = 0xa,
+    Greater = 0xf,
+};
+
+// the few x86-64 instructions the templates need. every memory operand
+// is a base register plus a 32 bit displacement and every jump is
+// rel32, so the code does not depend on where it ends up.
+class emitter {
+  public:
+    explicit emitter(size_t num_labels) : labels(num_labels, UNBOUND) {}
+
+    std::vector<uint8_t> code;
+
+    size_t new_label() {
+        this->labels.push_back(UNBOUND);
+        return this->labels.size() - 1;
+    }
+    void bind(size_t label) { this->labels[label] = this->code.size(); }
+
+    // patches every jump with the label it targets
+    void resolve() {
+        for (auto& fixup : this->fixups) {
+            int32_t rel = static_cast<int32_t>(this->labels[fixup.label] -
+                                               (fixup.position + 4));
+            std::memcpy(&this->code[fixup.position], &rel, sizeof(rel));
+        }
+    }
+
+    void load(reg dst, reg base, int32_t disp) {
+        this->memory(0x8b, dst, base, disp);
+    }
+    void store(reg base, int32_t disp, reg src) {
+        this->memory(0x89, src, base, disp);
+    }
+    void mov(reg dst, reg src) { this->register_op(0x89, dst, src); }
+    void add(reg dst, reg src) { this->register_op(0x01, dst, src); }
+    void sub(reg dst, reg src) { this->register_op(0x29, dst, src); }
+    void bitwise_or(reg dst, reg src) { this->register_op(0x09, dst, src); }
+    void cmp(reg lhs, reg rhs) { this->register_op(0x39, lhs, rhs); }
+    // the helpers return int, only the low half of rax is theirs
+    void test32(reg lhs, reg rhs) {
+        this->register_op(0x85, lhs, rhs, false);
+    }
+
+    void add(reg dst, int32_t imm) { this->immediate_op(0, dst, imm); }
+    void cmp(reg lhs, int32_t imm) { this->immediate_op(7, lhs, imm); }
+
+    void shl(reg dst, uint8_t n) { this->shift(4, dst, n); }
+    void shr(reg dst, uint8_t n) { this->shift(5, dst, n); }
+    void sar(reg dst, uint8_t n) { this->shift(7, dst, n); }
+
+    void imul(reg dst, reg src) {
+        this->rex(true, dst, src);
+        this->byte(0x0f);
+        this->byte(0xaf);
+        this->byte(0xc0 | ((dst & 7) << 3) | (src & 7));
+    }
+
+    // scalar doubles, only xmm0 and xmm1 are used
+    void movq_to_xmm(uint8_t xmm, reg src) { this->sse(0x66, 0x6e, xmm, src); }
+    void movq_from_xmm(reg dst, uint8_t xmm) {
+        this->sse(0x66, 0x7e, xmm, dst);
+    }
+    void addsd(uint8_t dst, uint8_t src) { this->sse(0xf2, 0x58, dst, src); }
+    void subsd(uint8_t dst, uint8_t src) { this->sse(0xf2, 0x5c, dst, src); }
+    void mulsd(uint8_t dst, uint8_t src) { this->sse(0xf2, 0x59, dst, src); }
+    void ucomisd(uint8_t lhs, uint8_t rhs) {
+        this->sse(0x66, 0x2e, lhs, rhs);
+    }
+
+    void mov(reg dst, uint64_t imm) {
+        this->rex(true, 0, dst);
+        this->byte(0xb8 + (dst & 7));
+        this->bytes(&imm, sizeof(imm));
+    }
+    void mov32(reg dst, uint32_t imm) {
+        if (dst >= 8) {
+            this->byte(0x41);
+        }
+        this->byte(0xb8 + (dst & 7));
+        this->bytes(&imm, sizeof(imm));
+    }
+
+    void push(reg src) {
+        if (src >= 8) {
+            this->byte(0x41);
+        }
+        this->byte(0x50 + (src & 7));
+    }
+    void pop(reg dst) {
+        if (dst >= 8) {
+            this->byte(0x41);
+        }
+        this->byte(0x58 + (dst & 7));
+    }
+
+    void call(reg target) {
+        if (target >= 8) {
+            this->byte(0x41);
+        }
+        this->byte(0xff);
+        this->byte(0xd0 + (target & 7));
+    }
+    void ret() { this->byte(0xc3); }
+
+    // al = condition, then zero extended into eax
+    void setcc(cond condition) {
+        this->byte(0x0f);
+        this->byte(0x90 + condition);
+        this->byte(0xc0);
+        this->byte(0x0f);
+        this->byte(0xb6);
+        this->byte(0xc0);
+    }
+
+    void jmp(size_t label) {
+        this->byte(0xe9);
+        this->fixup(label);
+    }
+    void jcc(cond condition, size_t label) {
+        this->byte(0x0f);
+        this->byte(0x80 + condition);
+        this->fixup(label);
+    }
+    // dst = the address of label
+    void lea(reg dst, size_t label) {
+        this->rex(true, dst, 0);
+        this->byte(0x8d);
+        this->byte(0x05 + ((dst & 7) << 3));
+        this->fixup(label);
+    }
+
+  private:
+    static constexpr size_t UNBOUND = SIZE_MAX;
+
+    struct jump {
+        size_t position;
+        size_t label;
+    };
+
+    std::vector<size_t> labels;
+    std::vector<jump> fixups;
+
+    void byte(uint8_t b) { this->code.push_back(b); }
+    void bytes(const void* src, size_t size) {
+        auto begin = static_cast<const uint8_t*>(src);
+        this->code.insert(this->code.end(), begin, begin + size);
+    }
+    void fixup(size_t label) {
+        this->fixups.push_back({this->code.size(), label});
+        this->bytes("\0\0\0\0", 4);
+    }
+
+    void rex(bool wide, uint8_t r, uint8_t base) {
+        uint8_t prefix = 0x40 | (wide ? 8 : 0) | ((r >> 3) << 2) | (base >> 3);
+        if (prefix != 0x40) {
+            this->byte(prefix);
+        }
+    }
+    // op r, [base + disp32]
+    void memory(uint8_t opcode, reg r, reg base, int32_t disp) {
+        this->rex(true, r, base);
+        this->byte(opcode);
+        this->byte(0x80 | ((r & 7) << 3) | (base & 7));
+        // rsp and r12 as a base need a sib byte
+        if ((base & 7) == rsp) {
+            this->byte(0x24);
+        }
+        this->bytes(&disp, sizeof(disp));
+    }
+    // op dst, src
+    void register_op(uint8_t opcode, reg dst, reg src, bool wide = true) {
+        this->rex(wide, src, dst);
+        this->byte(opcode);
+        this->byte(0xc0 | ((src & 7) << 3) | (dst & 7));
+    }
+    void immediate_op(uint8_t extension, reg dst, int32_t imm) {
+        this->rex(true, 0, dst);
+        this->byte(0x81);
+        this->byte(0xc0 | (extension << 3) | (dst & 7));
+        this->bytes(&imm, sizeof(imm));
+    }
+    // movq takes a wide prefix, the arithmetic does not
+    void sse(uint8_t prefix, uint8_t opcode, uint8_t r, uint8_t rm) {
+        this->byte(prefix);
+        if (opcode == 0x6e || opcode == 0x7e) {
+            this->byte(0x48);
+        }
+        this->byte(0x0f);
+        this->byte(opcode);
+        this->byte(0xc0 | (r << 3) | rm);
+    }
+    void shift(uint8_t extension, reg dst, uint8_t n) {
+        this->rex(true, 0, dst);
+        this->byte(0xc1);
+        this->byte(0xc0 | (extension << 3) | (dst & 7));
+        this->byte(n);
+    }
+};
+
+// rbx holds the context, r12 the locals and r13 the next free slot of
+// the stack. all three are callee saved, so the calls into the vm keep
+// them.
+#define CONTEXT(field) static_cast<int32_t>(offsetof(jit_context, field))
+#define SLOT(i) static_cast<int32_t>((i) * sizeof(value))
+
+static uint64_t bits(value v) { return v.get_bits(); }
+
+// the upper 16 bits of every small int
+static int32_t int_tag() {
+    return static_cast<int32_t>(bits(value::from_small_int(0)) >> 48);
+}
+
+template <typename F> static uint64_t address(F* function) {
+    return reinterpret_cast<uintptr_t>(function);
+}
+
+// the baseline tier. it keeps the stack in memory exactly like the
+// interpreter does, r13 moves with every push and pop.
+class baseline {
+  public:
+    explicit baseline(const decoded_function& fn)
+        : fn(fn), e(fn.code.size() + 1), epilogue(e.new_label()) {}
+
+    bool translate();
+    std::vector<uint8_t>& get_code() { return this->e.code; }
+
+  private:
+    const decoded_function& fn;
+    emitter e;
+    size_t epilogue;
+
+    size_t label_of(const code_word* target) {
+        return target - this->fn.code.data();
+    }
+
+    void prologue() {
+        this->e.push(rbx);
+        this->e.push(r12);
+        this->e.push(r13);
+        this->e.mov(rbx, rdi);
+        this->e.load(r12, rbx, CONTEXT(locals));
+        this->e.load(r13, rbx, CONTEXT(stack_pointer));
+    }
+
+    void push(reg src) {
+        this->e.store(r13, 0, src);
+        this->e.add(r13, SLOT(1));
+    }
+    void pop(reg dst) {
+        this->e.add(r13, -SLOT(1));
+        this->e.load(dst, r13, 0);
+    }
+    void push_bits(uint64_t bits) {
+        this->e.mov(rax, bits);
+        this->push(rax);
+    }
+
+    void call_out(uint64_t function) {
+        this->e.store(rbx, CONTEXT(stack_pointer), r13);
+        this->e.mov(rdi, rbx);
+        this->e.mov(rax, function);
+        this->e.call(rax);
+        this->e.load(r13, rbx, CONTEXT(stack_pointer));
+    }
+
+    void exit(jit_exit exit, const code_word* site) {
+        this->e.mov(rax, reinterpret_cast<uint64_t>(site));
+        this->e.store(rbx, CONTEXT(site), rax);
+        this->e.mov32(rax, static_cast<uint32_t>(exit));
+        this->e.jmp(this->epilogue);
+    }
+
+    // loads the two operands on top of the stack into rax and rcx and
+    // jumps to slow unless both are small ints
+    void int_operands(size_t slow) {
+        this->e.load(rax, r13, -SLOT(2));
+        this->e.load(rcx, r13, -SLOT(1));
+        this->e.mov(rdx, rax);
+        this->e.shr(rdx, 48);
+        this->e.cmp(rdx, int_tag());
+        this->e.jcc(NotEqual, slow);
+        this->e.mov(rdx, rcx);
+        this->e.shr(rdx, 48);
+        this->e.cmp(rdx, int_tag());
+        this->e.jcc(NotEqual, slow);
+    }
+
+    void arithmetic(bool subtract, uint64_t slow_path) {
+        size_t slow = this->e.new_label();
+        size_t done = this->e.new_label();
+        this->int_operands(slow);
+        // shifted up the payloads overflow exactly when the result does
+        // not fit in 48 bits
+        this->e.shl(rax, 16);
+        this->e.shl(rcx, 16);
+        if (subtract) {
+            this->e.sub(rax, rcx);
+        } else {
+            this->e.add(rax, rcx);
+        }
+        this->e.jcc(Overflow, slow);
+        this->e.shr(rax, 16);
+        this->e.mov(rdx, bits(value::from_small_int(0)));
+        this->e.bitwise_or(rax, rdx);
+        this->e.store(r13, -SLOT(2), rax);
+        this->e.add(r13, -SLOT(1));
+        this->e.jmp(done);
+        this->e.bind(slow);
+        this->call_out(slow_path);
+        this->e.bind(done);
+    }
+
+    // the fast paths shift both ints up, so comparing the 64 bit words
+    // orders them like their payloads
+    void comparison(cond condition, uint64_t slow_path) {
+        size_t slow = this->e.new_label();
+        size_t done = this->e.new_label();
+        this->int_operands(slow);
+        this->e.shl(rax, 16);
+        this->e.shl(rcx, 16);
+        this->e.cmp(rax, rcx);
+        this->e.setcc(condition);
+        this->e.mov(rdx, bits(value::from_bool(false)));
+        this->e.bitwise_or(rax, rdx);
+        this->e.store(r13, -SLOT(2), rax);
+        this->e.add(r13, -SLOT(1));
+        this->e.jmp(done);
+        this->e.bind(slow);
+        this->call_out(slow_path);
+        this->e.bind(done);
+    }
+
+    // the fused compare and jump never materializes the bool for ints
+    void comparison_jump(cond condition, uint64_t slow_path, size_t target) {
+        size_t slow = this->e.new_label();
+        size_t done = this->e.new_label();
+        this->int_operands(slow);
+        this->e.shl(rax, 16);
+        this->e.shl(rcx, 16);
+        // pops before the compare, add would clobber the flags
+        this->e.add(r13, -SLOT(2));
+        this->e.cmp(rax, rcx);
+        // flipping the lowest bit negates a condition
+        this->e.jcc(static_cast<cond>(condition ^ 1), target);
+        this->e.jmp(done);
+        this->e.bind(slow);
+        this->call_out(slow_path);
+        this->jump_not_truthy(target);
+        this->e.bind(done);
+    }
+
+    // inverted jumps when the value is truthy instead
+    void jump_not_truthy(size_t target, bool inverted = false) {
+        size_t done = this->e.new_label();
+        this->pop(rax);
+        this->e.mov(rcx, bits(value::from_bool(false)));
+        this->e.cmp(rax, rcx);
+        this->e.jcc(Equal, inverted ? done : target);
+        this->e.mov(rcx, bits(value::from_bool(true)));
+        this->e.cmp(rax, rcx);
+        this->e.jcc(Equal, inverted ? target : done);
+        this->e.mov(rdi, r13);
+        this->e.mov(rax, address(&truthy));
+        this->e.call(rax);
+        this->e.test32(rax, rax);
+        this->e.jcc(inverted ? NotEqual : Equal, target);
+        this->e.bind(done);
+    }
+
+    void call(const code_word* site, jit_exit exit) {
+        this->e.mov(rax, site[1].operand);
+        this->e.store(rbx, CONTEXT(num_args), rax);
+        this->e.mov(rax, reinterpret_cast<uint64_t>(site[2].cache));
+        this->e.store(rbx, CONTEXT(cache), rax);
+        size_t resume = this->e.new_label();
+        if (exit == jit_exit::Call) {
+            this->e.lea(rax, resume);
+            this->e.store(rbx, CONTEXT(resume), rax);
+        }
+        this->exit(exit, site);
+        if (exit == jit_exit::Call) {
+            this->e.bind(resume);
+            this->prologue();
+        }
+    }
+
+    bool instruction(op_code op, const code_word* words);
+};
+
+bool baseline::translate() {
+    this->prologue();
+    auto& ins = *this->fn.source;
+    size_t i = 0;
+    size_t word = 0;
+    while (i < ins.size()) {
+        op_code op = static_cast<op_code>(ins[i]);
+        this->e.bind(word);
+        if (!this->instruction(op, this->fn.code.data() + word)) {
+            return false;
+        }
+        i += instruction_width(op);
+        word += num_words(op);
+    }
+    this->e.bind(word);
+
+    // falling off the end returns whatever is on top of the stack, the
+    // compiler never lets that happen
+    this->e.bind(this->epilogue);
+    this->e.store(rbx, CONTEXT(stack_pointer), r13);
+    this->e.pop(r13);
+    this->e.pop(r12);
+    this->e.pop(rbx);
+    this->e.ret();
+    this->e.resolve();
+    return true;
+}
+
+bool baseline::instruction(op_code op, const code_word* words) {
+    switch (op) {
+    case op_code::OpConstant:
+        this->push_bits(bits(*words[1].constant));
+        break;
+    case op_code::OpTrue:
+        this->push_bits(bits(value::from_bool(true)));
+        break;
+    case op_code::OpFalse:
+        this->push_bits(bits(value::from_bool(false)));
+        break;
+    case op_code::OpNull:
+        this->push_bits(bits(value()));
+        break;
+    case op_code::OpPop:
+        this->e.add(r13, -SLOT(1));
+        break;
+    case op_code::OpGetLocal:
+        this->e.load(rax, r12, SLOT(words[1].operand));
+        this->push(rax);
+        break;
+    case op_code::OpSetLocal:
+        this->pop(rax);
+        this->e.store(r12, SLOT(words[1].operand), rax);
+        break;
+    case op_code::OpGetGlobal:
+        this->e.mov(rcx, reinterpret_cast<uint64_t>(words[1].global));
+        this->e.load(rax, rcx, 0);
+        this->push(rax);
+        break;
+    case op_code::OpSetGlobal:
+        this->pop(rax);
+        this->e.mov(rcx, reinterpret_cast<uint64_t>(words[1].global));
+        this->e.store(rcx, 0, rax);
+        break;
+    case op_code::OpAdd:
+        this->arithmetic(false, address(&axe::arithmetic<axe::add>));
+        break;
+    case op_code::OpSub:
+        this->arithmetic(true, address(&axe::arithmetic<axe::sub>));
+        break;
+    case op_code::OpMul:
+        this->call_out(address(&axe::arithmetic<axe::mul>));
+        break;
+    case op_code::OpDiv:
+        this->call_out(address(&axe::arithmetic<axe::div>));
+        break;
+    case op_code::OpEq:
+        this->comparison(Equal, address(&compare<equals, true>));
+        break;
+    case op_code::OpNotEq:
+        this->call_out(address(&compare<equals, false>));
+        break;
+    case op_code::OpGreaterThan:
+        this->comparison(Greater, address(&compare<greater_than, true>));
+        break;
+    case op_code::OpMinus: {
+        size_t done = this->e.new_label();
+        this->call_out(address(&minus));
+        this->e.test32(rax, rax);
+        this->e.jcc(NotEqual, done);
+        this->exit(jit_exit::UnsupportedNegation, words);
+        this->e.bind(done);
+    } break;
+    case op_code::OpBang:
+        this->e.mov(rdi, r13);
+        this->e.add(rdi, -SLOT(1));
+        this->e.mov(rax, address(&bang));
+        this->e.call(rax);
+        break;
+    case op_code::OpJump:
+        this->e.jmp(this->label_of(words[1].target));
+        break;
+    case op_code::OpJumpNotTruthy:
+        this->jump_not_truthy(this->label_of(words[1].target));
+        break;
+    case op_code::OpJumpTruthy:
+        this->jump_not_truthy(this->label_of(words[1].target), true);
+        break;
+    case op_code::OpCall:
+        this->call(words, jit_exit::Call);
+        break;
+    case op_code::OpTailCall:
+        this->call(words, jit_exit::TailCall);
+        break;
+    case op_code::OpReturn:
+        this->push_bits(bits(value()));
+        this->exit(jit_exit::Return, words);
+        break;
+    case op_code::OpReturnValue:
+        this->exit(jit_exit::Return, words);
+        break;
+    // the superinstructions are emitted as the instructions they fuse,
+    // the machine code has no dispatch to save
+    case op_code::OpGetLocalGetLocal:
+        this->e.load(rax, r12, SLOT(words[1].operand));
+        this->push(rax);
+        this->e.load(rax, r12, SLOT(words[2].operand));
+        this->push(rax);
+        break;
+    case op_code::OpGetLocalConstant:
+    case op_code::OpAddLocalConstant:
+    case op_code::OpSubLocalConstant:
+        this->e.load(rax, r12, SLOT(words[1].operand));
+        this->push(rax);
+        this->push_bits(bits(*words[2].constant));
+        if (op == op_code::OpAddLocalConstant) {
+            this->instruction(op_code::OpAdd, words);
+        } else if (op == op_code::OpSubLocalConstant) {
+            this->instruction(op_code::OpSub, words);
+        }
+        break;
+    case op_code::OpGreaterThanJumpNotTruthy:
+        this->comparison_jump(Greater, address(&compare<greater_than, true>),
+                              this->label_of(words[1].target));
+        break;
+    case op_code::OpEqJumpNotTruthy:
+        this->comparison_jump(Equal, address(&compare<equals, true>),
+                              this->label_of(words[1].target));
+        break;
+    default:
+        // OpHalt only ends the main program and the quickened forms are
+        // never in the byte code
+        return false;
+    }
+    return true;
+}
+
+// the optimizing tier. operands that are constants or locals are not
+// pushed at all, they stay virtual until an instruction needs them in a
+// register or the vm needs them on the stack. the depth of the stack is
+// known at every instruction, so slots are addressed from r13, which
+// stays at the first slot above the locals. arithmetic and comparisons
+// are specialized for the types the interpreter saw and the types of
+// their constant operands, behind guards that deoptimize: the stub of a
+// guard writes the virtual slots out and the interpreter runs the rest
+// of the frame, starting with the instruction whose guard failed.
+class optimizer {
+  public:
+    optimizer(const decoded_function& fn,
+              const std::vector<type_feedback>& feedback)
+        : fn(fn), feedback(feedback), e(fn.code.size() + 1),
+          epilogue(e.new_label()), local_types(fn.num_locals),
+          depths(fn.code.size() + 1, UNKNOWN_DEPTH) {}
+
+    bool translate();
+    std::vector<uint8_t>& get_code() { return this->e.code; }
+
+  private:
+    static constexpr size_t UNKNOWN_DEPTH = SIZE_MAX;
+
+    enum class slot_kind {
+        Memory,
+        Constant,
+        Local,
+    };
+
+    struct slot {
+        slot_kind kind;
+        value constant;
+        size_t local;
+        // what the slot is known to hold, None when it is not known
+        type_feedback type;
+    };
+
+    struct deopt_stub {
+        size_t label;
+        std::vector<slot> stack;
+        const code_word* site;
+    };
+
+    const decoded_function& fn;
+    const std::vector<type_feedback>& feedback;
+    emitter e;
+    size_t epilogue;
+
+    std::vector<slot> stack;
+    // what the guards proved about the locals since the last jump target
+    std::vector<type_feedback> local_types;
+    // the depth of the stack at every jump target that was jumped to
+    std::vector<size_t> depths;
+    bool reachable = true;
+
+    // the instruction being translated and the stack it started with
+    const code_word* site;
+    std::vector<slot> entry_stack;
+    size_t deopt;
+    std::vector<deopt_stub> stubs;
+
+    size_t depth() const { return this->stack.size(); }
+    size_t top(size_t n = 0) const { return this->stack.size() - 1 - n; }
+
+    size_t label_of(const code_word* target) {
+        return target - this->fn.code.data();
+    }
+
+    void prologue() {
+        this->e.push(rbx);
+        this->e.push(r12);
+        this->e.push(r13);
+        this->e.mov(rbx, rdi);
+        this->e.load(r12, rbx, CONTEXT(locals));
+        this->e.mov(r13, r12);
+        this->e.add(r13, SLOT(this->fn.num_locals));
+    }
+
+    static type_feedback type_of(value v) {
+        if (v.is_small_int()) {
+            return type_feedback::Int;
+        }
+        if (v.is_double()) {
+            return type_feedback::Float;
+        }
+        return type_feedback::None;
+    }
+
+    void push_constant(value v) {
+        this->stack.push_back({slot_kind::Constant, v, 0, type_of(v)});
+    }
+    void push_local(size_t local) {
+        this->stack.push_back(
+            {slot_kind::Local, value(), local, this->local_types[local]});
+    }
+    void push_memory(type_feedback type) {
+        this->stack.push_back({slot_kind::Memory, value(), 0, type});
+    }
+    void pop(size_t n = 1) { this->stack.resize(this->depth() - n); }
+
+    void load(const slot& slot, size_t index, reg dst) {
+        switch (slot.kind) {
+        case slot_kind::Memory:
+            this->e.load(dst, r13, SLOT(index));
+            break;
+        case slot_kind::Constant:
+            this->e.mov(dst, bits(slot.constant));
+            break;
+        case slot_kind::Local:
+            this->e.load(dst, r12, SLOT(slot.local));
+            break;
+        }
+    }
+    void load(size_t index, reg dst) {
+        this->load(this->stack[index], index, dst);
+    }
+
+    void materialize(size_t index) {
+        if (this->stack[index].kind != slot_kind::Memory) {
+            this->load(index, rax);
+            this->e.store(r13, SLOT(index), rax);
+            this->stack[index].kind = slot_kind::Memory;
+        }
+    }
+    // writes out every slot below end
+    void flush(size_t end) {
+        for (size_t i = 0; i < end; ++i) {
+            this->materialize(i);
+        }
+    }
+    void flush() { this->flush(this->depth()); }
+
+    // hands the stack to the vm, every slot must be in memory
+    void sync_stack_pointer(size_t depth) {
+        this->e.mov(rax, r13);
+        this->e.add(rax, SLOT(depth));
+        this->e.store(rbx, CONTEXT(stack_pointer), rax);
+    }
+    // the collector also marks the slot above the stack
+    void clear_slot(size_t index) {
+        this->e.mov(rax, bits(value()));
+        this->e.store(r13, SLOT(index), rax);
+    }
+
+    // calls a baseline helper on the stack in memory
+    void call_out(uint64_t function) {
+        this->flush();
+        this->sync_stack_pointer(this->depth());
+        this->e.mov(rdi, rbx);
+        this->e.mov(rax, function);
+        this->e.call(rax);
+    }
+
+    void exit(jit_exit exit) {
+        this->e.mov(rax, reinterpret_cast<uint64_t>(this->site));
+        this->e.store(rbx, CONTEXT(site), rax);
+        this->e.mov32(rax, static_cast<uint32_t>(exit));
+        this->e.jmp(this->epilogue);
+    }
+
+    // all the guards of an instruction share one stub
+    size_t deopt_label() {
+        if (this->deopt == UNKNOWN_DEPTH) {
+            this->deopt = this->e.new_label();
+            this->stubs.push_back(
+                {this->deopt, this->entry_stack, this->site});
+        }
+        return this->deopt;
+    }
+
+    void emit_stub(const deopt_stub& stub) {
+        this->e.bind(stub.label);
+        for (size_t i = 0; i < stub.stack.size(); ++i) {
+            if (stub.stack[i].kind != slot_kind::Memory) {
+                this->load(stub.stack[i], i, rax);
+                this->e.store(r13, SLOT(i), rax);
+            }
+        }
+        this->clear_slot(stub.stack.size());
+        this->sync_stack_pointer(stub.stack.size());
+        this->e.mov(rax, reinterpret_cast<uint64_t>(stub.site));
+        this->e.store(rbx, CONTEXT(site), rax);
+        this->e.mov32(rax, static_cast<uint32_t>(jit_exit::Deoptimize));
+        this->e.jmp(this->epilogue);
+    }
+
+    // proves that the value of slot index, loaded into src, has type
+    void guard(size_t index, reg src, type_feedback type) {
+        auto& slot = this->stack[index];
+        if (slot.type == type) {
+            return;
+        }
+        this->e.mov(rdx, src);
+        if (type == type_feedback::Int) {
+            this->e.shr(rdx, 48);
+            this->e.cmp(rdx, int_tag());
+            this->e.jcc(NotEqual, this->deopt_label());
+        } else {
+            // a double unless all bits of the quiet NaN are set
+            this->e.shl(rdx, 1);
+            this->e.shr(rdx, 51);
+            this->e.cmp(rdx, 0x1fff);
+            this->e.jcc(Equal, this->deopt_label());
+        }
+        slot.type = type;
+        if (slot.kind == slot_kind::Local) {
+            this->local_types[slot.local] = type;
+        }
+    }
+
+    // the types two operands are specialized for. what the operands are
+    // known to be wins over what the interpreter saw, which wins over
+    // the type of a constant operand. the fused instructions are never
+    // quickened, they only have their constants to go by.
+    type_feedback specialize(type_feedback seen) {
+        auto lhs = this->stack[this->top(1)].type;
+        auto rhs = this->stack[this->top()].type;
+        auto type = seen;
+        if (lhs == rhs && lhs != type_feedback::None) {
+            type = lhs;
+        } else if (type == type_feedback::None) {
+            type = lhs != type_feedback::None ? lhs : rhs;
+        }
+        // a guard on a constant of another type would always fail
+        for (size_t i = 0; i < 2; ++i) {
+            auto& operand = this->stack[this->top(i)];
+            if (operand.kind == slot_kind::Constant && operand.type != type) {
+                return type_feedback::None;
+            }
+        }
+        return type;
+    }
+
+    // loads both operands into rax and rcx, checked to be of type
+    void operands(type_feedback type) {
+        this->load(this->top(1), rax);
+        this->guard(this->top(1), rax, type);
+        this->load(this->top(), rcx);
+        this->guard(this->top(), rcx, type);
+    }
+
+    // leaves the result in rax, or in xmm0 for floats
+    void arithmetic(op_code op, type_feedback seen, uint64_t slow_path) {
+        auto type = this->specialize(seen);
+        if (type == type_feedback::Int) {
+            this->operands(type);
+            this->e.shl(rax, 16);
+            if (op == op_code::OpMul) {
+                // (a << 16) * b overflows exactly when a * b does not
+                // fit in 48 bits
+                this->e.shl(rcx, 16);
+                this->e.sar(rcx, 16);
+                this->e.imul(rax, rcx);
+            } else {
+                this->e.shl(rcx, 16);
+                if (op == op_code::OpAdd) {
+                    this->e.add(rax, rcx);
+                } else {
+                    this->e.sub(rax, rcx);
+                }
+            }
+            this->e.jcc(Overflow, this->deopt_label());
+            this->e.shr(rax, 16);
+            this->e.mov(rdx, bits(value::from_small_int(0)));
+            this->e.bitwise_or(rax, rdx);
+        } else if (type == type_feedback::Float) {
+            this->operands(type);
+            this->e.movq_to_xmm(0, rax);
+            this->e.movq_to_xmm(1, rcx);
+            if (op == op_code::OpAdd) {
+                this->e.addsd(0, 1);
+            } else if (op == op_code::OpSub) {
+                this->e.subsd(0, 1);
+            } else {
+                this->e.mulsd(0, 1);
+            }
+            // the interpreter canonicalizes a NaN
+            this->e.ucomisd(0, 0);
+            this->e.jcc(Parity, this->deopt_label());
+            this->e.movq_from_xmm(rax, 0);
+        } else {
+            this->call_out(slow_path);
+            this->pop(2);
+            this->push_memory(type_feedback::None);
+            return;
+        }
+        this->pop(2);
+        this->e.store(r13, SLOT(this->depth()), rax);
+        this->push_memory(type);
+    }
+
+    // sets the flags for the comparison and returns the condition that
+    // holds when it is true, or returns false when it has to call out
+    bool compare_operands(op_code op, type_feedback seen, cond& condition) {
+        auto type = this->specialize(seen);
+        if (type == type_feedback::Int) {
+            this->operands(type);
+            if (op == op_code::OpGreaterThan) {
+                this->e.shl(rax, 16);
+                this->e.shl(rcx, 16);
+                condition = Greater;
+            } else {
+                condition = op == op_code::OpEq ? Equal : NotEqual;
+            }
+            this->e.cmp(rax, rcx);
+            return true;
+        }
+        if (type == type_feedback::Float && op != op_code::OpNotEq) {
+            this->operands(type);
+            this->e.movq_to_xmm(0, rax);
+            this->e.movq_to_xmm(1, rcx);
+            this->e.ucomisd(0, 1);
+            if (op == op_code::OpGreaterThan) {
+                // an unordered compare is not above
+                condition = Above;
+            } else {
+                this->e.jcc(Parity, this->deopt_label());
+                condition = Equal;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void comparison(op_code op, type_feedback seen, uint64_t slow_path) {
+        cond condition;
+        if (!this->compare_operands(op, seen, condition)) {
+            this->call_out(slow_path);
+            this->pop(2);
+            this->push_memory(type_feedback::None);
+            return;
+        }
+        this->e.setcc(condition);
+        this->e.mov(rdx, bits(value::from_bool(false)));
+        this->e.bitwise_or(rax, rdx);
+        this->pop(2);
+        this->e.store(r13, SLOT(this->depth()), rax);
+        this->push_memory(type_feedback::None);
+    }
+
+    // leaves the block, the stack at target is all in memory. the
+    // compiler only jumps forward, a backward jump would need the state
+    // at a target that is already translated.
+    bool jump_to(size_t target) {
+        if (target <= this->label_of(this->site)) {
+            return false;
+        }
+        if (this->depths[target] == UNKNOWN_DEPTH) {
+            this->depths[target] = this->depth();
+        }
+        return this->depths[target] == this->depth();
+    }
+
+    bool comparison_jump(op_code op, uint64_t slow_path, size_t target) {
+        // the flags have to survive until the jump, so nothing may be
+        // written out in between
+        this->flush(this->top(1));
+        cond condition;
+        if (this->compare_operands(op, type_feedback::None, condition)) {
+            this->pop(2);
+            this->e.jcc(static_cast<cond>(condition ^ 1), target);
+            return this->jump_to(target);
+        }
+        this->call_out(slow_path);
+        this->pop(1);
+        this->stack[this->top()].type = type_feedback::None;
+        return this->jump_not_truthy(target);
+    }
+
+    // inverted jumps when the value is truthy instead
+    bool jump_not_truthy(size_t target, bool inverted = false) {
+        auto& condition = this->stack[this->top()];
+        if (condition.kind == slot_kind::Constant) {
+            bool jumps = is_truthy(condition.constant) == inverted;
+            this->pop();
+            this->flush();
+            if (jumps) {
+                this->e.jmp(target);
+                this->reachable = false;
+            }
+            return !jumps || this->jump_to(target);
+        }
+        this->flush();
+        this->load(this->top(), rax);
+        this->pop();
+        size_t done = this->e.new_label();
+        this->e.mov(rcx, bits(value::from_bool(false)));
+        this->e.cmp(rax, rcx);
+        this->e.jcc(Equal, inverted ? done : target);
+        this->e.mov(rcx, bits(value::from_bool(true)));
+        this->e.cmp(rax, rcx);
+        this->e.jcc(Equal, inverted ? target : done);
+        this->e.mov(rdi, r13);
+        this->e.add(rdi, SLOT(this->depth()));
+        this->e.mov(rax, address(&truthy));
+        this->e.call(rax);
+        this->e.test32(rax, rax);
+        this->e.jcc(inverted ? NotEqual : Equal, target);
+        this->e.bind(done);
+        return this->jump_to(target);
+    }
+
+    bool call(const code_word* words, jit_exit exit) {
+        size_t num_args = words[1].operand;
+        if (num_args + 1 > this->depth()) {
+            return false;
+        }
+        this->flush();
+        this->e.mov(rax, num_args);
+        this->e.store(rbx, CONTEXT(num_args), rax);
+        this->e.mov(rax, reinterpret_cast<uint64_t>(words[2].cache));
+        this->e.store(rbx, CONTEXT(cache), rax);
+        this->sync_stack_pointer(this->depth());
+        size_t resume = this->e.new_label();
+        if (exit == jit_exit::Call) {
+            this->e.lea(rax, resume);
+            this->e.store(rbx, CONTEXT(resume), rax);
+        }
+        this->exit(exit);
+        this->pop(num_args + 1);
+        if (exit == jit_exit::Call) {
+            // the callee cannot touch the locals, what is known about
+            // them still holds
+            this->e.bind(resume);
+            this->prologue();
+            this->push_memory(type_feedback::None);
+        } else {
+            this->reachable = false;
+        }
+        return true;
+    }
+
+    bool instruction(op_code op, const code_word* words);
+};
+
+bool optimizer::translate() {
+    this->prologue();
+    auto& ins = *this->fn.source;
+    size_t i = 0;
+    size_t word = 0;
+    while (i < ins.size()) {
+        op_code op = static_cast<op_code>(ins[i]);
+        if (this->depths[word] != UNKNOWN_DEPTH) {
+            // a jump target. every path into it has its stack in
+            // memory and what one path proved does not hold on another.
+            if (this->reachable) {
+                this->flush();
+                if (this->depths[word] != this->depth()) {
+                    return false;
+                }
+            }
+            this->stack.assign(this->depths[word],
+                               {slot_kind::Memory, value(), 0,
+                                type_feedback::None});
+            this->local_types.assign(this->fn.num_locals,
+                                     type_feedback::None);
+            this->reachable = true;
+        }
+        this->e.bind(word);
+        // code no jump reaches, like the rest of a block after a return
+        if (this->reachable) {
+            this->site = this->fn.code.data() + word;
+            this->entry_stack = this->stack;
+            this->deopt = UNKNOWN_DEPTH;
+            if (!this->instruction(op, this->site)) {
+                return false;
+            }
+        }
+        i += instruction_width(op);
+        word += num_words(op);
+    }
+    this->e.bind(word);
+    if (this->reachable) {
+        return false;
+    }
+
+    for (auto& stub : this->stubs) {
+        this->emit_stub(stub);
+    }
+    this->e.bind(this->epilogue);
+    this->e.pop(r13);
+    this->e.pop(r12);
+    this->e.pop(rbx);
+    this->e.ret();
+    this->e.resolve();
+    return true;
+}
+
+// how many values an instruction pops, not counting the arguments of
+// a call
+static size_t num_operands(op_code op) {
+    switch (op) {
+    case op_code::OpPop:
+    case op_code::OpSetLocal:
+    case op_code::OpSetGlobal:
+    case op_code::OpMinus:
+    case op_code::OpBang:
+    case op_code::OpJumpNotTruthy:
+    case op_code::OpJumpTruthy:
+    case op_code::OpReturnValue:
+        return 1;
+    case op_code::OpAdd:
+    case op_code::OpSub:
+    case op_code::OpMul:
+    case op_code::OpDiv:
+    case op_code::OpEq:
+    case op_code::OpNotEq:
+    case op_code::OpGreaterThan:
+    case op_code::OpGreaterThanJumpNotTruthy:
+    case op_code::OpEqJumpNotTruthy:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+bool optimizer::instruction(op_code op, const code_word* words) {
+    if (this->depth() < num_operands(op)) {
+        return false;
+    }
+    size_t word = words - this->fn.code.data();
+    auto seen = this->feedback[word];
+    switch (op) {
+    case op_code::OpConstant:
+        this->push_constant(*words[1].constant);
+        break;
+    case op_code::OpTrue:
+        this->push_constant(value::from_bool(true));
+        break;
+    case op_code::OpFalse:
+        this->push_constant(value::from_bool(false));
+        break;
+    case op_code::OpNull:
+        this->push_constant(value());
+        break;
+    case op_code::OpPop:
+        this->pop();
+        break;
+    case op_code::OpGetLocal:
+        this->push_local(words[1].operand);
+        break;
+    case op_code::OpSetLocal: {
+        size_t local = words[1].operand;
+        for (size_t i = 0; i < this->top(); ++i) {
+            if (this->stack[i].kind == slot_kind::Local &&
+                this->stack[i].local == local) {
+                this->materialize(i);
+            }
+        }
+        this->load(this->top(), rax);
+        this->e.store(r12, SLOT(local), rax);
+        this->local_types[local] = this->stack[this->top()].type;
+        this->pop();
+    } break;
+    case op_code::OpGetGlobal:
+        this->e.mov(rcx, reinterpret_cast<uint64_t>(words[1].global));
+        this->e.load(rax, rcx, 0);
+        this->e.store(r13, SLOT(this->depth()), rax);
+        this->push_memory(type_feedback::None);
+        break;
+    case op_code::OpSetGlobal:
+        this->load(this->top(), rax);
+        this->e.mov(rcx, reinterpret_cast<uint64_t>(words[1].global));
+        this->e.store(rcx, 0, rax);
+        this->pop();
+        break;
+    case op_code::OpAdd:
+        this->arithmetic(op, seen, address(&axe::arithmetic<axe::add>));
+        break;
+    case op_code::OpSub:
+        this->arithmetic(op, seen, address(&axe::arithmetic<axe::sub>));
+        break;
+    case op_code::OpMul:
+        this->arithmetic(op, seen, address(&axe::arithmetic<axe::mul>));
+        break;
+    case op_code::OpDiv:
+        this->call_out(address(&axe::arithmetic<axe::div>));
+        this->pop(2);
+        this->push_memory(type_feedback::None);
+        break;
+    case op_code::OpEq:
+        this->comparison(op, seen, address(&compare<equals, true>));
+        break;
+    case op_code::OpNotEq:
+        this->comparison(op, seen, address(&compare<equals, false>));
+        break;
+    case op_code::OpGreaterThan:
+        this->comparison(op, seen, address(&compare<greater_than, true>));
+        break;
+    case op_code::OpMinus:
+        // the interpreter reports the error
+        this->flush();
+        this->clear_slot(this->depth());
+        this->call_out(address(&minus));
+        this->e.test32(rax, rax);
+        this->e.jcc(Equal, this->deopt_label());
+        this->pop();
+        this->push_memory(type_feedback::None);
+        break;
+    case op_code::OpBang: {
+        auto& operand = this->stack[this->top()];
+        if (operand.kind == slot_kind::Constant) {
+            bool truthy = is_truthy(operand.constant);
+            this->pop();
+            this->push_constant(value::from_bool(!truthy));
+            break;
+        }
+        this->materialize(this->top());
+        this->e.mov(rdi, r13);
+        this->e.add(rdi, SLOT(this->top()));
+        this->e.mov(rax, address(&bang));
+        this->e.call(rax);
+        this->pop();
+        this->push_memory(type_feedback::None);
+    } break;
+    case op_code::OpJump:
+        this->flush();
+        this->e.jmp(this->label_of(words[1].target));
+        this->reachable = false;
+        return this->jump_to(this->label_of(words[1].target));
+    case op_code::OpJumpNotTruthy:
+        return this->jump_not_truthy(this->label_of(words[1].target));
+    case op_code::OpJumpTruthy:
+        return this->jump_not_truthy(this->label_of(words[1].target), true);
+    case op_code::OpCall:
+        return this->call(words, jit_exit::Call);
+    case op_code::OpTailCall:
+        return this->call(words, jit_exit::TailCall);
+    case op_code::OpReturn:
+        this->clear_slot(this->depth());
+        this->sync_stack_pointer(this->depth() + 1);
+        this->exit(jit_exit::Return);
+        this->reachable = false;
+        break;
+    case op_code::OpReturnValue:
+        this->materialize(this->top());
+        this->sync_stack_pointer(this->depth());
+        this->exit(jit_exit::Return);
+        this->reachable = false;
+        break;
+    case op_code::OpGetLocalGetLocal:
+        this->push_local(words[1].operand);
+        this->push_local(words[2].operand);
+        break;
+    case op_code::OpGetLocalConstant:
+        this->push_local(words[1].operand);
+        this->push_constant(*words[2].constant);
+        break;
+    case op_code::OpAddLocalConstant:
+        this->push_local(words[1].operand);
+        this->push_constant(*words[2].constant);
+        this->arithmetic(op_code::OpAdd, seen,
+                         address(&axe::arithmetic<axe::add>));
+        break;
+    case op_code::OpSubLocalConstant:
+        this->push_local(words[1].operand);
+        this->push_constant(*words[2].constant);
+        this->arithmetic(op_code::OpSub, seen,
+                         address(&axe::arithmetic<axe::sub>));
+        break;
+    case op_code::OpGreaterThanJumpNotTruthy:
+        return this->comparison_jump(op_code::OpGreaterThan,
+                                     address(&compare<greater_than, true>),
+                                     this->label_of(words[1].target));
+    case op_code::OpEqJumpNotTruthy:
+        return this->comparison_jump(op_code::OpEq,
+                                     address(&compare<equals, true>),
+                                     this->label_of(words[1].target));
+    default:
+        return false;
+    }
+    return true;
+}
+
+#undef CONTEXT
+#undef SLOT
+
+} // namespace
+
+static bool baseline_code(const decoded_function& fn,
+                          std::vector<uint8_t>& code) {
+    baseline baseline(fn);
+    if (!baseline.translate()) {
+        return false;
+    }
+    code = std::move(baseline.get_code());
+    return true;
+}
+
+static bool optimized_code(const decoded_function& fn,
+                           const std::vector<type_feedback>& feedback,
+                           std::vector<uint8_t>& code) {
+    optimizer optimizer(fn, feedback);
+    if (!optimizer.translate()) {
+        return false;
+    }
+    code = std::move(optimizer.get_code());
+    return true;
+}
+
+// the code is written while the pages are writable and only then made
+// executable, they are never both
+const void* jit::map(const std::vector<uint8_t>& code) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t size = (code.size() + page_size - 1) / page_size * page_size;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+    this->regions.push_back({memory, size});
+    return memory;
+}
+
+#else
+
+static bool baseline_code(const decoded_function&, std::vector<uint8_t>&) {
+    return false;
+}
+
+static bool optimized_code(const decoded_function&,
+                           const std::vector<type_feedback>&,
+                           std::vector<uint8_t>&) {
+    return false;
+}
+
+const void* jit::map(const std::vector<uint8_t>&) { return nullptr; }
+
+#endif
+
+jit::jit() : compiled(0), optimized(0), finished(false), stopping(false) {}
+
+jit::~jit() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    if (this->worker.joinable()) {
+        this->worker.join();
+    }
+#ifdef AXE_JIT
+    for (auto& region : this->regions) {
+        munmap(region.memory, region.size);
+    }
+#endif
+}
+
+const void* jit::compile(const decoded_function& fn) {
+    std::vector<uint8_t> code;
+    if (!baseline_code(fn, code)) {
+        return nullptr;
+    }
+    auto entry = this->map(code);
+    if (entry != nullptr) {
+        this->compiled++;
+    }
+    return entry;
+}
+
+const void* jit::optimize(const decoded_function& fn,
+                          const std::vector<type_feedback>& feedback) {
+    std::vector<uint8_t> code;
+    if (!optimized_code(fn, feedback, code)) {
+        return nullptr;
+    }
+    auto entry = this->map(code);
+    if (entry != nullptr) {
+        this->optimized++;
+    }
+    return entry;
+}
+
+void jit::optimize_in_background(const decoded_function& fn,
+                                 std::vector<type_feedback> feedback) {
+#ifdef AXE_JIT
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->jobs.push_back({&fn, std::move(feedback), {}});
+    if (!this->worker.joinable()) {
+        this->worker = std::thread(&jit::work, this);
+    }
+    this->wake.notify_one();
+#else
+    (void)fn;
+    (void)feedback;
+#endif
+}
+
+// only the translation runs on the background thread, the code is
+// mapped by the thread that runs it
+void jit::work() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+        this->wake.wait(lock, [this] {
+            return this->stopping || !this->jobs.empty();
+        });
+        if (this->stopping) {
+            return;
+        }
+        auto job = std::move(this->jobs.front());
+        this->jobs.pop_front();
+        lock.unlock();
+        if (!optimized_code(*job.fn, job.feedback, job.code)) {
+            job.code.clear();
+        }
+        lock.lock();
+        this->done.push_back(std::move(job));
+        this->finished.store(true, std::memory_order_release);
+    }
+}
+
+std::vector<std::pair<const decoded_function*, const void*>>
+jit::take_optimized() {
+    std::vector<job> jobs;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        jobs.swap(this->done);
+        this->finished.store(false, std::memory_order_release);
+    }
+    std::vector<std::pair<const decoded_function*, const void*>> res;
+    for (auto& job : jobs) {
+        if (job.code.empty()) {
+            continue;
+        }
+        auto entry = this->map(job.code);
+        if (entry != nullptr) {
+            this->optimized++;
+            res.push_back({job.fn, entry});
+        }
+    }
+    return res;
+}
+
+} // namespace axe
@@ -0,0 +1,146 @@
+#ifndef __AXE_JIT_H__
+
+#define __AXE_JIT_H__
+
+#include "decode.h"
+#include "value.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// the baseline compiler emits x86-64 machine code and maps it with
+// mmap, so it is only built for x86-64 linux. everywhere else compile
+// returns nullptr and every function stays interpreted. define
+// AXE_NO_JIT to leave it out.
+#if defined(__x86_64__) && defined(__linux__) && !defined(AXE_NO_JIT)
+#define AXE_JIT
+#endif
+
+namespace axe {
+
+// why native code handed control back to the vm
+enum class jit_exit : int {
+    // the return value is on top of the stack
+    Return,
+    // the callee and num_args arguments are on top of the stack, the
+    // frame continues at resume once the callee returned
+    Call,
+    TailCall,
+    UnsupportedNegation,
+    // a guard of optimized code failed, the interpreter continues the
+    // frame at site
+    Deoptimize,
+};
+
+// the operand types the interpreter saw at an instruction, read off the
+// quickened opcodes
+enum class type_feedback : uint8_t {
+    None,
+    Int,
+    Float,
+};
+
+// what native code shares with the vm. the vm fills in locals and
+// stack_pointer before it enters a frame, native code writes
+// stack_pointer back whenever it calls out or exits.
+struct jit_context {
+    value* locals;
+    // the next free slot of the stack
+    value* stack_pointer;
+    // the decoded stream of the frame, code compiled ahead of time reads
+    // the operands it cannot bake in from it
+    const code_word* code;
+    axe::heap* heap;
+    // collects garbage on behalf of vm, stack_pointer must be current
+    void (*collect)(jit_context* ctx);
+    void* vm;
+
+    // set by the exits
+    const void* resume;
+    size_t num_args;
+    call_cache* cache;
+    // the word of the instruction that exited, to report errors
+    const code_word* site;
+    object_type error_type;
+};
+
+// runs a frame from its start or from the resume address of an exit
+using jit_entry = jit_exit (*)(jit_context* ctx);
+
+// two tiers of machine code. the baseline tier is a template
+// compiler, every instruction of a function becomes a fixed sequence
+// of machine code with its operands baked in. ints take an inline fast
+// path, everything else calls into the same value operations the
+// interpreter uses. the optimizing tier keeps constants and locals out
+// of the stack until they are needed and specializes arithmetic and
+// comparisons on type feedback, behind guards that deoptimize to the
+// interpreter.
+//
+// in both tiers calls and returns exit to the vm, which pushes and pops
+// the frames, so native and interpreted frames mix freely on the one
+// stack.
+class jit {
+  public:
+    jit();
+    ~jit();
+    jit(const jit&) = delete;
+    jit& operator=(const jit&) = delete;
+
+    // the entry of fn, or nullptr when fn uses an instruction the jit
+    // does not know. the code lives as long as the jit.
+    const void* compile(const decoded_function& fn);
+    // the entry of fn compiled by the optimizing tier. feedback has an
+    // entry for every word of fn.
+    const void* optimize(const decoded_function& fn,
+                         const std::vector<type_feedback>& feedback);
+    // optimizes fn on a background thread. only the byte code and the
+    // operand words of fn are read there, which never change.
+    void optimize_in_background(const decoded_function& fn,
+                                std::vector<type_feedback> feedback);
+    // whether background work finished since the last take_optimized
+    bool has_optimized() const {
+        return this->finished.load(std::memory_order_acquire);
+    }
+    // the entries the background thread made since the last call
+    std::vector<std::pair<const decoded_function*, const void*>>
+    take_optimized();
+
+    size_t num_compiled() const { return this->compiled; }
+    size_t num_optimized() const { return this->optimized; }
+
+  private:
+    struct region {
+        void* memory;
+        size_t size;
+    };
+    struct job {
+        const decoded_function* fn;
+        std::vector<type_feedback> feedback;
+        std::vector<uint8_t> code;
+    };
+
+    std::vector<region> regions;
+    size_t compiled;
+    size_t optimized;
+
+    // the background thread is started by the first job
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<job> jobs;
+    std::vector<job> done;
+    std::atomic<bool> finished;
+    bool stopping;
+
+    const void* map(const std::vector<uint8_t>& code);
+    void work();
+};
+
+} // namespace axe
+
+#endif // __AXE_JIT_H__
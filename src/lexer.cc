@@ -94,12 +94,11 @@ token lexer::next_token() {
         tok.set_type(token_type::Underscore);
         break;
     case '"':
-        tok = token(token_type::String, this->read_string());
+        tok = token(token_type::String, std::string(this->read_string()));
         break;
     default:
         if (is_valid_start_of_ident(this->ch)) {
-            std::string ident = this->read_ident();
-            return token(ident);
+            return token(this->read_ident());
         } else if (isdigit(this->ch)) {
             std::string literal = this->read_integer();
             if (this->ch == '.' && isdigit(this->peek_char())) {
@@ -132,13 +131,15 @@ void lexer::read_char() {
     this->position++;
 }
 
-std::string lexer::read_ident() {
-    std::string res;
+// views of the input, so a name that was interned before is not copied
+std::string_view lexer::read_ident() {
+    size_t start = this->position - 1;
+    size_t length = 0;
     while (is_valid_ident_char(this->ch)) {
-        res.push_back(this->ch);
+        length++;
         this->read_char();
     }
-    return res;
+    return std::string_view(this->input).substr(start, length);
 }
 
 std::string lexer::read_integer() {
@@ -150,14 +151,15 @@ std::string lexer::read_integer() {
     return res;
 }
 
-std::string lexer::read_string() {
-    std::string res;
+std::string_view lexer::read_string() {
     this->read_char();
+    size_t start = this->position - 1;
+    size_t length = 0;
     while (this->ch != '"' && this->ch != 0) {
-        res.push_back(this->ch);
+        length++;
         this->read_char();
     }
-    return res;
+    return std::string_view(this->input).substr(start, length);
 }
 
 void lexer::skip_whitespace() {
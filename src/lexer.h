@@ -4,6 +4,7 @@
 
 #include "token.h"
 #include <string>
+#include <string_view>
 
 namespace axe {
 
@@ -20,9 +21,9 @@ class lexer {
     char peek_char();
     void read_char();
     void skip_whitespace();
-    std::string read_ident();
+    std::string_view read_ident();
     std::string read_integer();
-    std::string read_string();
+    std::string_view read_string();
 };
 } // namespace axe
 
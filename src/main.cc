@@ -23,7 +23,7 @@ bool check_errors(const axe::parser& parser) {
 }
 
 void main_loop() {
-    std::vector<axe::object> globals(GLOBALS_SIZE, axe::object());
+    axe::globals_store globals;
     axe::symbol_table symbol_table;
     std::vector<axe::object> constants;
     while (true) {
@@ -44,8 +44,7 @@ void main_loop() {
             std::cout << "COMPILE ERROR: " << *err << '\n';
             continue;
         }
-        axe::vm<std::vector<axe::object>&> vm(compiler.get_byte_code(),
-                                              globals);
+        axe::vm<axe::globals_ref> vm(compiler.get_byte_code(), globals);
         err = vm.run();
         if (err.has_value()) {
             std::cout << *err << '\n';
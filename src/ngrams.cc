@@ -0,0 +1,146 @@
+#include "argparse.hpp"
+#include "code.h"
+#include "compiler.h"
+#include "lexer.h"
+#include "object.h"
+#include "parser.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// counts sequences of opcodes in the unfused byte code of the given
+// programs. the most frequent ones are the candidates for
+// superinstructions.
+
+using ngram_counts = std::map<std::vector<axe::op_code>, size_t>;
+
+static std::set<size_t>
+jump_targets(const std::vector<axe::instruction>& list) {
+    std::set<size_t> targets;
+    for (auto& ins : list) {
+        int jump = axe::jump_operand(ins.op);
+        if (jump >= 0) {
+            targets.insert(ins.operands[jump]);
+        }
+    }
+    return targets;
+}
+
+static void count_ngrams(const axe::instructions& ins, size_t max_length,
+                         ngram_counts& counts) {
+    auto list = axe::disassemble(ins);
+    auto targets = jump_targets(list);
+    for (size_t i = 0; i < list.size(); ++i) {
+        std::vector<axe::op_code> ngram = {list[i].op};
+        for (size_t j = i + 1; j < list.size() && ngram.size() < max_length;
+             ++j) {
+            // control can enter in the middle of the sequence, so it
+            // can not be fused
+            if (targets.count(list[j].position) != 0) {
+                break;
+            }
+            ngram.push_back(list[j].op);
+            counts[ngram]++;
+            if (axe::jump_operand(list[j].op) >= 0 ||
+                list[j].op == axe::op_code::OpReturnValue ||
+                list[j].op == axe::op_code::OpReturn) {
+                break;
+            }
+        }
+    }
+}
+
+static std::optional<std::string> count_file(const std::string& path,
+                                             size_t max_length,
+                                             ngram_counts& counts) {
+    std::ifstream file(path);
+    if (!file) {
+        return "could not open " + path;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    std::string input = ss.str();
+    axe::lexer lexer(input);
+    axe::parser parser(lexer);
+    auto ast = parser.parse();
+    if (parser.get_errors().size() != 0) {
+        return path + ": " + parser.get_errors()[0];
+    }
+    axe::compiler_options options;
+    options.superinstructions = false;
+    options.tail_calls = false;
+    axe::compiler<axe::constants_owned, axe::symbol_table_owned> compiler(
+        options);
+    auto err = compiler.compile(ast);
+    if (err.has_value()) {
+        return path + ": " + *err;
+    }
+    auto byte_code = compiler.get_byte_code();
+    count_ngrams(byte_code.ins, max_length, counts);
+    for (auto& constant : byte_code.constants) {
+        if (constant.get_type() == axe::object_type::Function) {
+            count_ngrams(constant.get_function().get_instructions(),
+                         max_length, counts);
+        }
+    }
+    return std::nullopt;
+}
+
+int main(int argc, char* argv[]) {
+    argparse::ArgumentParser program("axe-ngrams");
+
+    program.add_argument("files")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .help("the programs to mine");
+
+    program.add_argument("-n", "--length")
+        .default_value(4)
+        .scan<'i', int>()
+        .help("the longest sequence to count");
+
+    program.add_argument("-t", "--top")
+        .default_value(20)
+        .scan<'i', int>()
+        .help("the number of sequences to print");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        std::cerr << program;
+        exit(1);
+    }
+
+    auto files = program.get<std::vector<std::string>>("files");
+    size_t max_length = program.get<int>("--length");
+    size_t top = program.get<int>("--top");
+
+    ngram_counts counts;
+    for (auto& file : files) {
+        auto err = count_file(file, max_length, counts);
+        if (err.has_value()) {
+            std::cerr << *err << '\n';
+            exit(1);
+        }
+    }
+
+    std::vector<std::pair<std::vector<axe::op_code>, size_t>> sorted(
+        counts.begin(), counts.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const auto& a, const auto& b) {
+                         return a.second > b.second;
+                     });
+    for (size_t i = 0; i < sorted.size() && i < top; ++i) {
+        std::cout << sorted[i].second;
+        for (auto& op : sorted[i].first) {
+            std::cout << ' ' << axe::lookup(op)->get_name();
+        }
+        std::cout << '\n';
+    }
+    return 0;
+}
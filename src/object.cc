@@ -1,23 +1,57 @@
 #include "object.h"
 #include "base.h"
+#include <cstring>
+#include <functional>
+#include <string_view>
 
 namespace axe {
 
+static size_t combine(size_t seed, size_t hash) {
+    return seed ^ (hash + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
+// max_stack follows from the byte code, it is left out
+static size_t hash_function(const instructions& ins, size_t num_locals,
+                            size_t num_params) {
+    std::string_view bytes(reinterpret_cast<const char*>(ins.data()),
+                           ins.size());
+    size_t res = std::hash<std::string_view>()(bytes);
+    res = combine(res, num_locals);
+    return combine(res, num_params);
+}
+
 compiled_function::compiled_function()
-    : ins(std::vector<uint8_t>()), num_locals(0), num_params(0) {}
+    : ins(std::make_shared<const instructions>()), num_locals(0),
+      num_params(0), max_stack(0), hash(hash_function(*this->ins, 0, 0)) {}
 
 compiled_function::compiled_function(instructions ins, size_t num_locals,
-                                     size_t num_params)
-    : ins(ins), num_locals(num_locals), num_params(num_params) {}
+                                     size_t num_params, size_t max_stack)
+    : ins(std::make_shared<const instructions>(std::move(ins))),
+      num_locals(num_locals), num_params(num_params), max_stack(max_stack),
+      hash(hash_function(*this->ins, num_locals, num_params)) {}
 
 const instructions& compiled_function::get_instructions() const {
-    return this->ins;
+    return *this->ins;
 }
 
 size_t compiled_function::get_num_locals() const { return this->num_locals; }
 
 size_t compiled_function::get_num_params() const { return this->num_params; }
 
+size_t compiled_function::get_max_stack() const { return this->max_stack; }
+
+size_t compiled_function::get_hash() const { return this->hash; }
+
+// the hashes tell most functions apart without looking at their byte
+// code, copies share it
+bool compiled_function::operator==(const compiled_function& other) const {
+    if (this->hash != other.hash || this->num_locals != other.num_locals ||
+        this->num_params != other.num_params) {
+        return false;
+    }
+    return this->ins == other.ins || *this->ins == *other.ins;
+}
+
 object::object() : type(object_type::Null), data(std::monostate()) {}
 
 object::object(object_type type, object_data data)
@@ -29,6 +63,10 @@ const char* const object_type_strings[] = {
     "Null", "Bool", "Integer", "Float", "String", "Error", "Function",
 };
 
+const char* object_type_to_string(object_type type) {
+    return object_type_strings[(int)type];
+}
+
 const char* object::type_to_string() const {
     return object_type_strings[(int)this->type];
 }
@@ -105,6 +143,44 @@ std::string object::string() const {
 
 bool object::is_error() const { return this->type == object_type::Error; }
 
+size_t object::hash() const {
+    size_t res = 0;
+    switch (this->type) {
+    case object_type::Null:
+        break;
+    case object_type::Bool:
+        res = this->get_bool();
+        break;
+    case object_type::Integer:
+        res = std::hash<int64_t>()(this->get_int());
+        break;
+    case object_type::Float: {
+        uint64_t bits;
+        double d = this->get_float();
+        std::memcpy(&bits, &d, sizeof(bits));
+        res = std::hash<uint64_t>()(bits);
+    } break;
+    case object_type::String:
+    case object_type::Error:
+        res = std::hash<std::string>()(std::get<std::string>(this->data));
+        break;
+    case object_type::Function:
+        res = this->get_function().get_hash();
+        break;
+    }
+    return combine(static_cast<size_t>(this->type), res);
+}
+
+bool object::same_constant(const object& other) const {
+    if (this->type == object_type::Float &&
+        other.type == object_type::Float) {
+        double x = this->get_float();
+        double y = other.get_float();
+        return std::memcmp(&x, &y, sizeof(x)) == 0;
+    }
+    return *this == other;
+}
+
 bool object::is_truthy() const {
     switch (this->type) {
     case object_type::Bool:
@@ -141,28 +217,8 @@ bool object::operator==(const object& other) const {
         return this->get_string() == other.get_string();
     case object_type::Error:
         return false;
-    case object_type::Function: {
-        // TODO: probably not this
-        auto& this_func = this->get_function();
-        auto& other_func = other.get_function();
-        auto& this_ins = this_func.get_instructions();
-        auto& other_ins = other_func.get_instructions();
-        if (this_func.get_num_params() != other_func.get_num_params()) {
-            return false;
-        }
-        if (this_func.get_num_locals() != other_func.get_num_locals()) {
-            return false;
-        }
-        if (this_ins.size() != other_ins.size()) {
-            return false;
-        }
-        for (size_t i = 0; i < this_ins.size(); ++i) {
-            if (this_ins[i] != other_ins[i]) {
-                return false;
-            }
-        }
-        return true;
-    };
+    case object_type::Function:
+        return this->get_function() == other.get_function();
     default:
         break;
     }
@@ -3,6 +3,7 @@
 #define __AXE_OBJECT_H__
 
 #include "code.h"
+#include <memory>
 #include <string>
 #include <variant>
 
@@ -18,18 +19,31 @@ enum class object_type {
     Function,
 };
 
+const char* object_type_to_string(object_type type);
+
 class compiled_function {
   public:
     compiled_function();
-    compiled_function(instructions ins, size_t num_locals, size_t num_params);
+    // max_stack is filled in by the compiler, see max_stack_depth
+    compiled_function(instructions ins, size_t num_locals, size_t num_params,
+                      size_t max_stack = 0);
     const instructions& get_instructions() const;
     size_t get_num_locals() const;
     size_t get_num_params() const;
+    size_t get_max_stack() const;
+    // of the byte code, the locals and the params, computed once since
+    // none of them changes
+    size_t get_hash() const;
+    // the same byte code, locals and params
+    bool operator==(const compiled_function& other) const;
 
   private:
-    instructions ins;
+    // shared so copying a function object does not copy its byte code
+    std::shared_ptr<const instructions> ins;
     size_t num_locals;
     size_t num_params;
+    size_t max_stack;
+    size_t hash;
 };
 
 using object_data = std::variant<std::monostate, bool, int64_t, double,
@@ -53,6 +67,11 @@ class object {
 
     bool is_error() const;
     bool is_truthy() const;
+    // floats hash their bits, so 0.0 and -0.0 hash apart
+    size_t hash() const;
+    // equal as constants of a pool, which tells floats apart by their
+    // bits like hash does
+    bool same_constant(const object& other) const;
 
     bool operator==(const object& other) const;
     bool operator>(const object& other) const;
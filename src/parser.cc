@@ -68,7 +68,7 @@ statement parser::parse_let_statement() {
     if (!this->expect_peek(token_type::Ident)) {
         return statement();
     }
-    auto name = this->cur_token.get_literal();
+    auto name = this->cur_token.get_atom();
     if (!this->expect_peek(token_type::Assign)) {
         return statement();
     }
@@ -77,7 +77,7 @@ statement parser::parse_let_statement() {
     if (this->peek_token_is(token_type::Semicolon)) {
         this->next_token();
     }
-    let_statement let(std::move(name), std::move(value));
+    let_statement let(name, std::move(value));
     return statement(statement_type::LetStatement, std::move(let));
 }
 
@@ -218,13 +218,11 @@ expression parser::parse_bool(bool value) {
 }
 
 expression parser::parse_string() {
-    auto value = this->cur_token.get_literal();
-    return expression(expression_type::String, std::move(value));
+    return expression(expression_type::String, this->cur_token.get_literal());
 }
 
 expression parser::parse_ident() {
-    auto& ident = this->cur_token.get_literal();
-    return expression(expression_type::Ident, std::move(ident));
+    return expression(expression_type::Ident, this->cur_token.get_atom());
 }
 
 expression parser::parse_prefix(prefix_operator op) {
@@ -320,10 +318,10 @@ expression parser::parse_match() {
 }
 
 expression parser::parse_function() {
-    std::optional<std::string> name = std::nullopt;
+    std::optional<atom> name = std::nullopt;
     if (this->peek_token_is(token_type::Ident)) {
         this->next_token();
-        name = this->cur_token.get_literal();
+        name = this->cur_token.get_atom();
     }
     if (!this->expect_peek(token_type::LParen)) {
         return expression();
@@ -372,8 +370,8 @@ std::optional<match_branch> parser::parse_match_branch() {
     return match_branch(std::move(pattern), std::move(*consequence));
 }
 
-std::vector<std::string> parser::parse_function_params() {
-    std::vector<std::string> res;
+std::vector<atom> parser::parse_function_params() {
+    std::vector<atom> res;
     if (this->peek_token_is(token_type::RParen)) {
         this->next_token();
         return res;
@@ -381,16 +379,14 @@ std::vector<std::string> parser::parse_function_params() {
     if (!this->expect_peek(token_type::Ident)) {
         return res;
     }
-    auto ident = this->cur_token.get_literal();
-    res.push_back(ident);
+    res.push_back(this->cur_token.get_atom());
     while (this->peek_token_is(token_type::Comma)) {
         this->next_token();
         if (!this->expect_peek(token_type::Ident)) {
             res.clear();
             return res;
         }
-        ident = this->cur_token.get_literal();
-        res.push_back(ident);
+        res.push_back(this->cur_token.get_atom());
     }
     if (!this->expect_peek(token_type::RParen)) {
         res.clear();
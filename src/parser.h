@@ -59,7 +59,7 @@ class parser {
     match_branch_pattern parse_match_branch_pattern();
     std::optional<match_branch_consequence> parse_match_branch_consequence();
 
-    std::vector<std::string> parse_function_params();
+    std::vector<atom> parse_function_params();
 
     std::vector<expression> parse_call_args();
 
@@ -0,0 +1,161 @@
+#include "peephole.h"
+#include <algorithm>
+#include <set>
+
+namespace axe {
+
+// the index of the first instruction at or after position, where a
+// jump to position ends up once assemble has run
+static size_t index_at(const std::vector<instruction>& list,
+                       size_t position) {
+    auto it = std::lower_bound(list.begin(), list.end(), position,
+                               [](const instruction& ins, size_t position) {
+                                   return ins.position < position;
+                               });
+    return it - list.begin();
+}
+
+// OpNull; OpPop at index does nothing but set the last popped value,
+// which is what the repl prints. every statement pops, so only a pair
+// at the end of the program is seen.
+static bool is_null_pop(const std::vector<instruction>& list, size_t index) {
+    return index + 2 < list.size() && list[index].op == op_code::OpNull &&
+           list[index + 1].op == op_code::OpPop;
+}
+
+// follows target through the instructions that only pass control on. a
+// jump to a jump goes to where the second one goes, a jump to OpNull;
+// OpPop goes past them. the compiler only jumps forward, so this ends.
+static size_t thread(const std::vector<instruction>& list, size_t target) {
+    while (true) {
+        size_t i = index_at(list, target);
+        if (i < list.size() && list[i].op == op_code::OpJump) {
+            target = list[i].operands[0];
+        } else if (is_null_pop(list, i)) {
+            target = list[i + 2].position;
+        } else {
+            return target;
+        }
+    }
+}
+
+static bool ends_block(op_code op) {
+    switch (op) {
+    case op_code::OpJump:
+    case op_code::OpReturnValue:
+    case op_code::OpReturn:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+static bool is_branch(op_code op) {
+    return op == op_code::OpJumpNotTruthy || op == op_code::OpJumpTruthy;
+}
+
+static op_code invert(op_code op) {
+    return op == op_code::OpJumpNotTruthy ? op_code::OpJumpTruthy
+                                          : op_code::OpJumpNotTruthy;
+}
+
+// one round over the instructions, true when anything changed
+static bool simplify(std::vector<instruction>& list) {
+    bool changed = false;
+    std::set<size_t> targets;
+    // the entries of switch tables, they are threaded but stay jumps
+    std::vector<bool> entries(list.size(), false);
+    for (size_t i = 0; i < list.size(); ++i) {
+        size_t num_entries = switch_entries(list[i]);
+        for (size_t j = 1; j <= num_entries; ++j) {
+            entries[i + j] = true;
+        }
+    }
+    for (size_t index = 0; index < list.size(); ++index) {
+        auto& cur = list[index];
+        int jump = jump_operand(cur.op);
+        if (jump < 0) {
+            continue;
+        }
+        size_t target = thread(list, cur.operands[jump]);
+        if (target != static_cast<size_t>(cur.operands[jump])) {
+            cur.operands[jump] = target;
+            changed = true;
+        }
+        // a jump to a return returns right away
+        size_t i = index_at(list, target);
+        if (cur.op == op_code::OpJump && !entries[index] &&
+            i < list.size() &&
+            (list[i].op == op_code::OpReturnValue ||
+             list[i].op == op_code::OpReturn)) {
+            cur = {list[i].op, {}, cur.position};
+            changed = true;
+            continue;
+        }
+        targets.insert(target);
+    }
+
+    std::vector<instruction> res;
+    res.reserve(list.size());
+    size_t i = 0;
+    while (i < list.size()) {
+        auto& cur = list[i];
+        if (!res.empty() && ends_block(res.back().op) &&
+            targets.count(cur.position) == 0) {
+            i++;
+            changed = true;
+            continue;
+        }
+        size_t num_entries = switch_entries(cur);
+        if (num_entries != 0) {
+            res.insert(res.end(), list.begin() + i,
+                       list.begin() + i + 1 + num_entries);
+            i += 1 + num_entries;
+            continue;
+        }
+        if (cur.op == op_code::OpJump &&
+            index_at(list, cur.operands[0]) == i + 1) {
+            i++;
+            changed = true;
+            continue;
+        }
+        // the rest are pairs, the second one must not be jumped to on
+        // its own
+        if (i + 1 == list.size() ||
+            targets.count(list[i + 1].position) != 0) {
+            res.push_back(cur);
+            i++;
+            continue;
+        }
+        auto& next = list[i + 1];
+        if ((cur.op == op_code::OpTrue || cur.op == op_code::OpFalse) &&
+            is_branch(next.op)) {
+            bool jumps = (cur.op == op_code::OpTrue) ==
+                         (next.op == op_code::OpJumpTruthy);
+            if (jumps) {
+                res.push_back({op_code::OpJump, next.operands, cur.position});
+            }
+        } else if (cur.op == op_code::OpBang && is_branch(next.op)) {
+            res.push_back({invert(next.op), next.operands, cur.position});
+        } else if (is_null_pop(list, i)) {
+        } else {
+            res.push_back(cur);
+            i++;
+            continue;
+        }
+        i += 2;
+        changed = true;
+    }
+    list = std::move(res);
+    return changed;
+}
+
+instructions peephole(const instructions& ins) {
+    auto list = disassemble(ins);
+    while (simplify(list)) {
+    }
+    return assemble(list);
+}
+
+} // namespace axe
@@ -0,0 +1,17 @@
+#ifndef __AXE_PEEPHOLE_H__
+
+#define __AXE_PEEPHOLE_H__
+
+#include "code.h"
+
+namespace axe {
+
+// removes jumps to the next instruction and code nothing jumps to after
+// a jump or a return, threads jumps that land on another jump and
+// folds branches on constants and negations into a single jump. runs
+// until nothing changes, jump offsets are patched as the code shrinks.
+instructions peephole(const instructions& ins);
+
+} // namespace axe
+
+#endif // __AXE_PEEPHOLE_H__
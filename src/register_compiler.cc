@@ -0,0 +1,732 @@
+#include "register_compiler.h"
+#include "ast.h"
+#include "base.h"
+#include "code.h"
+#include <optional>
+
+#define MAX_REGISTERS 256
+
+namespace axe {
+
+static size_t count_definitions(const expression& expression);
+
+// counts the symbols a function body defines in its own scope, so the
+// registers of all locals are known before any temporary is allocated.
+// nested function bodies get their own frame and are not counted.
+static size_t count_definitions(const std::vector<statement>& statements) {
+    size_t res = 0;
+    for (auto& statement : statements) {
+        switch (statement.get_type()) {
+        case statement_type::LetStatement:
+            res += 1 + count_definitions(statement.get_let().get_value());
+            break;
+        case statement_type::ReturnStatement:
+            res += count_definitions(statement.get_return());
+            break;
+        case statement_type::ExpressionStatement:
+            res += count_definitions(statement.get_expression());
+            break;
+        default:
+            break;
+        }
+    }
+    return res;
+}
+
+static size_t count_definitions(const expression& expression) {
+    switch (expression.get_type()) {
+    case expression_type::Prefix:
+        return count_definitions(*expression.get_prefix().get_rhs());
+    case expression_type::Infix: {
+        auto& infix = expression.get_infix();
+        return count_definitions(*infix.get_lhs()) +
+               count_definitions(*infix.get_rhs());
+    }
+    case expression_type::Assignment:
+        return count_definitions(*expression.get_assignment().get_rhs());
+    case expression_type::If: {
+        auto& if_exp = expression.get_if();
+        size_t res = count_definitions(*if_exp.get_cond()) +
+                     count_definitions(if_exp.get_consequence().get_block());
+        auto& alternative = if_exp.get_alternative();
+        if (alternative.has_value()) {
+            res += count_definitions(alternative->get_block());
+        }
+        return res;
+    }
+    case expression_type::Function:
+        return expression.get_function().get_name().has_value() ? 1 : 0;
+    case expression_type::Call: {
+        auto& call = expression.get_call();
+        size_t res = count_definitions(*call.get_function());
+        for (auto& arg : call.get_args()) {
+            res += count_definitions(arg);
+        }
+        return res;
+    }
+    default:
+        break;
+    }
+    return 0;
+}
+
+template <>
+register_compiler<constants_owned, symbol_table_owned>::register_compiler()
+    : symb_table(symbol_table()), scope_index(0) {
+    register_compilation_scope main_scope = {assembler(), {}, 0, 0, 0};
+    this->scopes.push_back(main_scope);
+    this->index_constants();
+}
+
+template <>
+register_compiler<constants_ref, symbol_table_ref>::register_compiler(
+    symbol_table& symb_table, std::vector<object>& constants)
+    : constants(constants), symb_table(symb_table), scope_index(0) {
+    register_compilation_scope main_scope = {assembler(), {}, 0, 0, 0};
+    this->scopes.push_back(main_scope);
+    this->index_constants();
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile(
+    const ast& ast) {
+    auto err = this->compile_statements(ast.get_statements());
+    if (err.has_value()) {
+        return err;
+    }
+    return this->check_registers();
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+const register_byte_code
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::get_byte_code()
+    const {
+    return {this->get_current_instructions(), this->constants,
+            this->scopes[this->scope_index].num_registers,
+            this->symb_table.get_num_definitions()};
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+instructions& register_compiler<ConstantsOwnership,
+                                SymbolTableOwnership>::current_instructions() {
+    return this->scopes[this->scope_index].code.get_instructions();
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+const instructions&
+register_compiler<ConstantsOwnership,
+                  SymbolTableOwnership>::get_current_instructions() const {
+    return this->scopes[this->scope_index].code.get_instructions();
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+register_compilation_scope&
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::current_scope() {
+    return this->scopes[this->scope_index];
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+size_t register_compiler<ConstantsOwnership, SymbolTableOwnership>::emit(
+    register_op_code op, std::initializer_list<int> operands) {
+    size_t pos = this->current_scope().code.emit(op, operands);
+    this->set_last_instruction(op, pos);
+    return pos;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+size_t register_compiler<ConstantsOwnership, SymbolTableOwnership>::emit(
+    register_op_code op, label target) {
+    size_t pos = this->current_scope().code.emit(op, target);
+    this->set_last_instruction(op, pos);
+    return pos;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+size_t register_compiler<ConstantsOwnership, SymbolTableOwnership>::emit(
+    register_op_code op, int operand, label target) {
+    size_t pos = this->current_scope().code.emit(op, operand, target);
+    this->set_last_instruction(op, pos);
+    return pos;
+}
+
+// interned like the constants of the stack compiler, the repl shares
+// the pool between the compilers of every line
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+int register_compiler<ConstantsOwnership, SymbolTableOwnership>::add_constant(
+    object obj) {
+    size_t hash = obj.hash();
+    auto range = this->constant_index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (this->constants[it->second].same_constant(obj)) {
+            return it->second;
+        }
+    }
+    this->constants.push_back(std::move(obj));
+    int index = this->constants.size() - 1;
+    this->constant_index.emplace(hash, index);
+    return index;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+void register_compiler<ConstantsOwnership,
+                       SymbolTableOwnership>::index_constants() {
+    for (size_t i = 0; i < this->constants.size(); ++i) {
+        this->constant_index.emplace(this->constants[i].hash(), i);
+    }
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+void register_compiler<ConstantsOwnership, SymbolTableOwnership>::
+    set_last_instruction(register_op_code op, size_t position) {
+    this->current_scope().last_instruction = {op, position};
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+bool register_compiler<ConstantsOwnership,
+                       SymbolTableOwnership>::last_instruction_is(
+    register_op_code op) {
+    if (this->current_instructions().size() == 0) {
+        return false;
+    }
+    return this->current_scope().last_instruction.op == op;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+size_t register_compiler<ConstantsOwnership,
+                         SymbolTableOwnership>::allocate_register() {
+    auto& scope = this->current_scope();
+    size_t reg = scope.next_register;
+    scope.next_register++;
+    if (scope.next_register > scope.num_registers) {
+        scope.num_registers = scope.next_register;
+    }
+    return reg;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::check_registers() {
+    if (this->current_scope().num_registers > MAX_REGISTERS) {
+        return "too many registers: " +
+               std::to_string(this->current_scope().num_registers);
+    }
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+void register_compiler<ConstantsOwnership, SymbolTableOwnership>::enter_scope() {
+    register_compilation_scope scope = {assembler(), {}, 0, 0, 0};
+    this->scopes.push_back(scope);
+    this->scope_index++;
+    this->symb_table.push_scope();
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+instructions
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::leave_scope() {
+    instructions ins = this->current_instructions();
+    this->scopes.pop_back();
+    this->scope_index--;
+    this->symb_table.pop_scope();
+    return ins;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_statements(
+    const std::vector<statement>& statements) {
+    for (auto& statement : statements) {
+        auto err = this->compile_statement(statement);
+        if (err.has_value()) {
+            return err;
+        }
+    }
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_statement(
+    const statement& statement) {
+    // temporaries never outlive the statement that allocated them
+    size_t mark = this->current_scope().next_register;
+    std::optional<std::string> err = std::nullopt;
+    switch (statement.get_type()) {
+    case statement_type::LetStatement:
+        err = this->compile_let_statement(statement.get_let());
+        break;
+    case statement_type::ReturnStatement:
+        err = this->compile_return_statement(statement.get_return());
+        break;
+    case statement_type::ExpressionStatement:
+        err = this->compile_expression_statement(statement.get_expression());
+        break;
+    default:
+        AXE_UNREACHABLE;
+    }
+    this->current_scope().next_register = mark;
+    return err;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string> register_compiler<
+    ConstantsOwnership,
+    SymbolTableOwnership>::compile_let_statement(const let_statement& let) {
+    auto& value = let.get_value();
+    size_t reg;
+    std::optional<std::string> err;
+    // a local can be computed straight into its own register unless the
+    // value defines other symbols, which would take that register first
+    bool direct = this->scope_index > 0 && count_definitions(value) == 0;
+    if (direct) {
+        reg = this->symb_table.get_num_definitions();
+        err = this->compile_expression(value, reg);
+    } else {
+        err = this->compile_operand(value, reg);
+    }
+    if (err.has_value()) {
+        return err;
+    }
+    auto symbol = this->symb_table.define(let.get_name());
+    if (symbol.scope == symbol_scope::GlobalScope) {
+        this->emit(register_op_code::OpSetGlobal,
+                   {(int)reg, (int)symbol.index});
+    } else if (symbol.index != reg) {
+        this->emit(register_op_code::OpMove, {(int)symbol.index, (int)reg});
+    }
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string> register_compiler<ConstantsOwnership,
+                                             SymbolTableOwnership>::
+    compile_return_statement(const return_statement& ret) {
+    size_t reg;
+    auto err = this->compile_operand(ret, reg);
+    if (err.has_value()) {
+        return err;
+    }
+    this->emit(register_op_code::OpReturnValue, {(int)reg});
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string> register_compiler<ConstantsOwnership,
+                                             SymbolTableOwnership>::
+    compile_expression_statement(const expression& expression) {
+    // assignments and named functions only store their value, just like
+    // the stack compiler does not pop after them
+    if (expression.get_type() == expression_type::Assignment) {
+        return this->compile_assignment(expression.get_assignment(),
+                                        std::nullopt);
+    }
+    if (expression.get_type() == expression_type::Function &&
+        expression.get_function().get_name().has_value()) {
+        return this->compile_function(expression.get_function(),
+                                      std::nullopt);
+    }
+    size_t reg;
+    auto err = this->compile_operand(expression, reg);
+    if (err.has_value()) {
+        return err;
+    }
+    this->emit(register_op_code::OpPop, {(int)reg});
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_operand(
+    const expression& expression, size_t& reg) {
+    // locals are used in place, everything else goes through a temporary
+    if (expression.get_type() == expression_type::Ident) {
+        auto symbol = this->symb_table.resolve(expression.get_ident());
+        if (symbol.has_value() && symbol->scope == symbol_scope::LocalScope) {
+            reg = symbol->index;
+            return std::nullopt;
+        }
+    }
+    reg = this->allocate_register();
+    return this->compile_expression(expression, reg);
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_expression(
+    const expression& expression, size_t dest) {
+    std::optional<std::string> err = std::nullopt;
+    switch (expression.get_type()) {
+    case expression_type::Integer:
+        err = this->compile_constant(
+            object(object_type::Integer, expression.get_int()), dest);
+        break;
+    case expression_type::Float:
+        err = this->compile_constant(
+            object(object_type::Float, expression.get_float()), dest);
+        break;
+    case expression_type::Bool:
+        this->emit(expression.get_bool() ? register_op_code::OpLoadTrue
+                                         : register_op_code::OpLoadFalse,
+                   {(int)dest});
+        break;
+    case expression_type::String:
+        err = this->compile_constant(
+            object(object_type::String, expression.get_string()),
+            dest);
+        break;
+    case expression_type::Ident:
+        err = this->compile_ident(expression.get_ident(), dest);
+        break;
+    case expression_type::Prefix:
+        err = this->compile_prefix(expression.get_prefix(), dest);
+        break;
+    case expression_type::Infix:
+        err = this->compile_infix(expression.get_infix(), dest);
+        break;
+    case expression_type::Assignment:
+        err = this->compile_assignment(expression.get_assignment(), dest);
+        break;
+    case expression_type::If:
+        err = this->compile_if(expression.get_if(), dest);
+        break;
+    case expression_type::Function:
+        err = this->compile_function(expression.get_function(), dest);
+        break;
+    case expression_type::Call:
+        err = this->compile_call(expression.get_call(), dest);
+        break;
+    default:
+        err = "cannot compile " + std::string(expression.type_to_string());
+        break;
+    }
+    return err;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_constant(
+    object obj, size_t dest) {
+    this->emit(register_op_code::OpLoadConstant,
+               {(int)dest, this->add_constant(std::move(obj))});
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_ident(
+    atom ident, size_t dest) {
+    auto symbol = this->symb_table.resolve(ident);
+    if (!symbol.has_value()) {
+        return "undefined variable " + ident.string();
+    }
+    if (symbol->scope == symbol_scope::GlobalScope) {
+        this->emit(register_op_code::OpGetGlobal,
+                   {(int)dest, (int)symbol->index});
+    } else if (symbol->index != dest) {
+        this->emit(register_op_code::OpMove, {(int)dest, (int)symbol->index});
+    }
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_prefix(
+    const prefix& prefix, size_t dest) {
+    size_t mark = this->current_scope().next_register;
+    size_t rhs;
+    auto err = this->compile_operand(*prefix.get_rhs(), rhs);
+    if (err.has_value()) {
+        return err;
+    }
+    switch (prefix.get_op()) {
+    case prefix_operator::Bang:
+        this->emit(register_op_code::OpBang, {(int)dest, (int)rhs});
+        break;
+    case prefix_operator::Minus:
+        this->emit(register_op_code::OpMinus, {(int)dest, (int)rhs});
+        break;
+    }
+    this->current_scope().next_register = mark;
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_infix(
+    const infix& infix, size_t dest) {
+    size_t mark = this->current_scope().next_register;
+    size_t lhs;
+    size_t rhs;
+
+    if (infix.get_op() == infix_operator::Lt) {
+        auto err = this->compile_operand(*infix.get_rhs(), rhs);
+        if (err.has_value()) {
+            return err;
+        }
+        err = this->compile_operand(*infix.get_lhs(), lhs);
+        if (err.has_value()) {
+            return err;
+        }
+        this->emit(register_op_code::OpGreaterThan,
+                   {(int)dest, (int)rhs, (int)lhs});
+        this->current_scope().next_register = mark;
+        return std::nullopt;
+    }
+
+    auto err = this->compile_operand(*infix.get_lhs(), lhs);
+    if (err.has_value()) {
+        return err;
+    }
+    err = this->compile_operand(*infix.get_rhs(), rhs);
+    if (err.has_value()) {
+        return err;
+    }
+
+    register_op_code op;
+    switch (infix.get_op()) {
+    case infix_operator::Plus:
+        op = register_op_code::OpAdd;
+        break;
+    case infix_operator::Minus:
+        op = register_op_code::OpSub;
+        break;
+    case infix_operator::Asterisk:
+        op = register_op_code::OpMul;
+        break;
+    case infix_operator::Slash:
+        op = register_op_code::OpDiv;
+        break;
+    case infix_operator::Gt:
+        op = register_op_code::OpGreaterThan;
+        break;
+    case infix_operator::Eq:
+        op = register_op_code::OpEq;
+        break;
+    case infix_operator::NotEq:
+        op = register_op_code::OpNotEq;
+        break;
+    default: {
+        auto err = "unknown operator " +
+                   std::string(infix_operator_string(infix.get_op()));
+        return err;
+    }
+    }
+    this->emit(op, {(int)dest, (int)lhs, (int)rhs});
+    this->current_scope().next_register = mark;
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_assignment(
+    const assignment& assignment, std::optional<size_t> dest) {
+    auto ident = assignment.get_ident();
+    auto symbol = this->symb_table.resolve(ident);
+    if (!symbol.has_value()) {
+        return ident.string() + " does not exist";
+    }
+    size_t mark = this->current_scope().next_register;
+    std::optional<std::string> err;
+    if (symbol->scope == symbol_scope::LocalScope) {
+        err = this->compile_expression(*assignment.get_rhs(), symbol->index);
+        if (err.has_value()) {
+            return err;
+        }
+        if (dest.has_value() && *dest != symbol->index) {
+            this->emit(register_op_code::OpMove,
+                       {(int)*dest, (int)symbol->index});
+        }
+        return std::nullopt;
+    }
+    size_t reg;
+    if (dest.has_value()) {
+        reg = *dest;
+        err = this->compile_expression(*assignment.get_rhs(), reg);
+    } else {
+        err = this->compile_operand(*assignment.get_rhs(), reg);
+    }
+    if (err.has_value()) {
+        return err;
+    }
+    this->emit(register_op_code::OpSetGlobal, {(int)reg, (int)symbol->index});
+    this->current_scope().next_register = mark;
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_if(
+    const if_expression& if_exp, size_t dest) {
+    size_t mark = this->current_scope().next_register;
+    size_t cond;
+    auto err = this->compile_operand(*if_exp.get_cond(), cond);
+    if (err.has_value()) {
+        return err;
+    }
+    this->current_scope().next_register = mark;
+
+    label after_consequence = this->current_scope().code.new_label();
+    label after_alternative = this->current_scope().code.new_label();
+    this->emit(register_op_code::OpJumpNotTruthy, (int)cond,
+               after_consequence);
+
+    err = this->compile_block(if_exp.get_consequence(), dest);
+    if (err.has_value()) {
+        return err;
+    }
+
+    this->emit(register_op_code::OpJump, after_alternative);
+    this->current_scope().code.bind(after_consequence);
+
+    auto& alternative = if_exp.get_alternative();
+    if (!alternative.has_value()) {
+        this->emit(register_op_code::OpLoadNull, {(int)dest});
+    } else {
+        err = this->compile_block(*alternative, dest);
+        if (err.has_value()) {
+            return err;
+        }
+    }
+
+    this->current_scope().code.bind(after_alternative);
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_function(
+    const function_expression& function, std::optional<size_t> dest) {
+    // temporarily set the name just in case it is
+    // a recursive function
+    auto& name = function.get_name();
+    if (name.has_value()) {
+        this->symb_table.define(*name);
+    }
+    this->enter_scope();
+    auto& params = function.get_params();
+    for (auto& param : params) {
+        this->symb_table.define(param);
+    }
+    auto& body = function.get_body().get_block();
+    auto& scope = this->current_scope();
+    scope.first_temporary = params.size() + count_definitions(body);
+    scope.next_register = scope.first_temporary;
+    scope.num_registers = scope.first_temporary;
+
+    auto err = this->compile_statements(body);
+    if (err.has_value()) {
+        return err;
+    }
+    if (this->last_instruction_is(register_op_code::OpPop)) {
+        size_t position = this->current_scope().last_instruction.position;
+        // both take the register as their only operand
+        this->current_instructions()[position] =
+            static_cast<uint8_t>(register_op_code::OpReturnValue);
+        this->current_scope().last_instruction.op =
+            register_op_code::OpReturnValue;
+    }
+    if (!this->last_instruction_is(register_op_code::OpReturnValue)) {
+        this->emit(register_op_code::OpReturn, {});
+    }
+    err = this->check_registers();
+    if (err.has_value()) {
+        return err;
+    }
+    size_t num_registers = this->current_scope().num_registers;
+    instructions ins = this->leave_scope();
+    object obj(object_type::Function,
+               compiled_function(std::move(ins), num_registers, params.size()));
+    int constant = this->add_constant(std::move(obj));
+
+    if (!name.has_value()) {
+        size_t reg = dest.has_value() ? *dest : this->allocate_register();
+        this->emit(register_op_code::OpLoadConstant, {(int)reg, constant});
+        return std::nullopt;
+    }
+
+    // remove the temporarily set name
+    this->symb_table.erase(*name);
+    auto symbol = this->symb_table.define(*name);
+    if (symbol.scope == symbol_scope::GlobalScope) {
+        size_t reg = dest.has_value() ? *dest : this->allocate_register();
+        this->emit(register_op_code::OpLoadConstant, {(int)reg, constant});
+        this->emit(register_op_code::OpSetGlobal,
+                   {(int)reg, (int)symbol.index});
+    } else {
+        this->emit(register_op_code::OpLoadConstant,
+                   {(int)symbol.index, constant});
+        if (dest.has_value() && *dest != symbol.index) {
+            this->emit(register_op_code::OpMove,
+                       {(int)*dest, (int)symbol.index});
+        }
+    }
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_call(
+    const call& call, size_t dest) {
+    auto& scope = this->current_scope();
+    size_t mark = scope.next_register;
+    // the callee and its arguments have to be in consecutive registers.
+    // when dest is the newest temporary the call can be built on it.
+    size_t base;
+    if (dest >= scope.first_temporary && dest + 1 == scope.next_register) {
+        base = dest;
+    } else {
+        base = this->allocate_register();
+    }
+    auto err = this->compile_expression(*call.get_function(), base);
+    if (err.has_value()) {
+        return err;
+    }
+    auto& args = call.get_args();
+    for (auto& arg : args) {
+        size_t reg = this->allocate_register();
+        err = this->compile_expression(arg, reg);
+        if (err.has_value()) {
+            return err;
+        }
+    }
+    this->emit(register_op_code::OpCall, {(int)base, (int)args.size()});
+    if (base != dest) {
+        this->emit(register_op_code::OpMove, {(int)dest, (int)base});
+    }
+    this->current_scope().next_register = mark;
+    return std::nullopt;
+}
+
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+std::optional<std::string>
+register_compiler<ConstantsOwnership, SymbolTableOwnership>::compile_block(
+    const block_statement& block, size_t dest) {
+    // the value of a block is the value of its last expression statement
+    auto& statements = block.get_block();
+    if (statements.empty() ||
+        statements.back().get_type() != statement_type::ExpressionStatement) {
+        auto err = this->compile_statements(statements);
+        if (err.has_value()) {
+            return err;
+        }
+        this->emit(register_op_code::OpLoadNull, {(int)dest});
+        return std::nullopt;
+    }
+    for (size_t i = 0; i < statements.size() - 1; ++i) {
+        auto err = this->compile_statement(statements[i]);
+        if (err.has_value()) {
+            return err;
+        }
+    }
+    size_t mark = this->current_scope().next_register;
+    auto err = this->compile_expression(statements.back().get_expression(),
+                                        dest);
+    this->current_scope().next_register = mark;
+    return err;
+}
+
+template class register_compiler<constants_owned, symbol_table_owned>;
+template class register_compiler<constants_ref, symbol_table_ref>;
+
+} // namespace axe
@@ -0,0 +1,106 @@
+#ifndef __AXE_REGISTER_COMPILER_H__
+
+#define __AXE_REGISTER_COMPILER_H__
+
+#include "ast.h"
+#include "code.h"
+#include "compiler.h"
+#include "object.h"
+#include "symbol_table.h"
+
+namespace axe {
+
+struct register_byte_code {
+    const instructions& ins;
+    const std::vector<object>& constants;
+    size_t num_registers;
+    size_t num_globals;
+};
+
+struct emitted_register_instruction {
+    register_op_code op;
+    size_t position;
+};
+
+struct register_compilation_scope {
+    assembler code;
+    emitted_register_instruction last_instruction;
+    // locals live in the registers below first_temporary, temporaries
+    // are allocated from next_register in stack order
+    size_t first_temporary;
+    size_t next_register;
+    size_t num_registers;
+};
+
+// generates three address code for the register backend. locals are
+// mapped directly onto frame registers, temporaries are allocated above
+// them in stack order.
+template <typename ConstantsOwnership, typename SymbolTableOwnership>
+class register_compiler {
+  public:
+    register_compiler();
+    register_compiler(symbol_table_ref symb_table, constants_ref constants);
+    std::optional<std::string> compile(const ast& ast);
+    const register_byte_code get_byte_code() const;
+
+  private:
+    ConstantsOwnership constants;
+    // the indices of the constants by their hash, see add_constant
+    std::unordered_multimap<size_t, int> constant_index;
+    SymbolTableOwnership symb_table;
+    std::vector<register_compilation_scope> scopes;
+    size_t scope_index;
+
+    const instructions& get_current_instructions() const;
+    instructions& current_instructions();
+    register_compilation_scope& current_scope();
+    size_t emit(register_op_code op, std::initializer_list<int> operands);
+    size_t emit(register_op_code op, label target);
+    size_t emit(register_op_code op, int operand, label target);
+    int add_constant(object obj);
+    void index_constants();
+    void set_last_instruction(register_op_code op, size_t position);
+    bool last_instruction_is(register_op_code op);
+
+    size_t allocate_register();
+    std::optional<std::string> check_registers();
+
+    void enter_scope();
+    instructions leave_scope();
+
+    std::optional<std::string>
+    compile_statements(const std::vector<statement>& statements);
+    std::optional<std::string> compile_statement(const statement& statement);
+    std::optional<std::string> compile_let_statement(const let_statement& let);
+    std::optional<std::string>
+    compile_return_statement(const return_statement& ret);
+    std::optional<std::string>
+    compile_expression_statement(const expression& expression);
+
+    std::optional<std::string> compile_operand(const expression& expression,
+                                               size_t& reg);
+    std::optional<std::string> compile_expression(const expression& expression,
+                                                  size_t dest);
+    std::optional<std::string> compile_constant(object obj, size_t dest);
+    std::optional<std::string> compile_ident(atom ident,
+                                             size_t dest);
+    std::optional<std::string> compile_prefix(const prefix& prefix,
+                                              size_t dest);
+    std::optional<std::string> compile_infix(const infix& infix, size_t dest);
+    std::optional<std::string>
+    compile_assignment(const assignment& assignment,
+                       std::optional<size_t> dest);
+    std::optional<std::string> compile_if(const if_expression& if_exp,
+                                          size_t dest);
+    std::optional<std::string>
+    compile_function(const function_expression& function,
+                     std::optional<size_t> dest);
+    std::optional<std::string> compile_call(const call& call, size_t dest);
+
+    std::optional<std::string> compile_block(const block_statement& block,
+                                             size_t dest);
+};
+
+} // namespace axe
+
+#endif // __AXE_REGISTER_COMPILER_H__
@@ -0,0 +1,334 @@
+#include "register_vm.h"
+#include "code.h"
+#include <optional>
+
+namespace axe {
+
+static instructions main_instructions(const instructions& ins) {
+    instructions res;
+    res.reserve(ins.size() + 1);
+    res.insert(res.end(), ins.begin(), ins.end());
+    res.push_back(static_cast<uint8_t>(register_op_code::OpHalt));
+    return res;
+}
+
+static std::vector<value>
+constant_values(const std::vector<object>& constants, heap& heap) {
+    std::vector<value> res;
+    res.reserve(constants.size());
+    for (auto& constant : constants) {
+        auto val = to_value(constant, heap);
+        heap.pin(val);
+        res.push_back(val);
+    }
+    return res;
+}
+
+template <>
+register_vm<globals_owned>::register_vm(register_byte_code byte_code,
+                                        vm_options options)
+    : globals(),
+      constants(constant_values(byte_code.constants, this->globals.heap)),
+      main_instructions(axe::main_instructions(byte_code.ins)),
+      main_num_registers(byte_code.num_registers), frames_index(0),
+      max_frames(options.max_frames), registers(options.max_stack_size) {
+    this->globals.grow(byte_code.num_globals);
+}
+
+template <>
+register_vm<globals_ref>::register_vm(register_byte_code byte_code,
+                                      globals_ref globals, vm_options options)
+    : globals(globals),
+      constants(constant_values(byte_code.constants, this->globals.heap)),
+      main_instructions(axe::main_instructions(byte_code.ins)),
+      main_num_registers(byte_code.num_registers), frames_index(0),
+      max_frames(options.max_frames), registers(options.max_stack_size) {
+    this->globals.grow(byte_code.num_globals);
+}
+
+template <typename GlobalsLifeTime>
+register_vm<GlobalsLifeTime>::~register_vm() {
+    for (auto& constant : this->constants) {
+        this->globals.heap.unpin(constant);
+    }
+}
+
+#ifdef AXE_COMPUTED_GOTO
+#define VM_CASE(op) op_##op:
+#define VM_DISPATCH() goto* dispatch_table[*ip++]
+#else
+#define VM_CASE(op) case register_op_code::op:
+#define VM_DISPATCH() continue
+#endif
+
+#define R(index) (this->registers[base_pointer + (index)])
+
+#ifdef AXE_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+template <typename GlobalsLifeTime>
+std::optional<std::string> register_vm<GlobalsLifeTime>::run() {
+#ifdef AXE_COMPUTED_GOTO
+    // must stay in the same order as register_op_code
+    static const void* const dispatch_table[] = {
+        &&op_OpLoadConstant, &&op_OpLoadTrue,      &&op_OpLoadFalse,
+        &&op_OpLoadNull,     &&op_OpMove,          &&op_OpGetGlobal,
+        &&op_OpSetGlobal,    &&op_OpAdd,           &&op_OpSub,
+        &&op_OpMul,          &&op_OpDiv,           &&op_OpEq,
+        &&op_OpNotEq,        &&op_OpGreaterThan,   &&op_OpMinus,
+        &&op_OpBang,         &&op_OpJump,          &&op_OpJumpNotTruthy,
+        &&op_OpCall,         &&op_OpReturnValue,   &&op_OpReturn,
+        &&op_OpPop,          &&op_OpHalt,
+    };
+    static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) ==
+                      static_cast<size_t>(register_op_code::OpHalt) + 1,
+                  "dispatch table out of sync with register_op_code");
+#endif
+
+    if (this->frames_index == 0) {
+        if (!this->registers.reserve(this->main_num_registers)) {
+            return "stack overflow";
+        }
+        const uint8_t* main = this->main_instructions.data();
+        this->push_frame({main, main, 0});
+    }
+
+    register_frame* active_frame = &this->frames[this->frames_index - 1];
+    const uint8_t* ins = active_frame->ins;
+    const uint8_t* ip = active_frame->instruction_pointer;
+    size_t base_pointer = active_frame->base_pointer;
+
+#ifdef AXE_COMPUTED_GOTO
+    VM_DISPATCH();
+#else
+    while (true) {
+        switch (static_cast<register_op_code>(*ip++)) {
+#endif
+
+    VM_CASE(OpLoadConstant) {
+        R(ip[0]) = this->constants[read_u16(ip + 1)];
+        ip += 3;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpLoadTrue) {
+        R(ip[0]) = value::from_bool(true);
+        ip += 1;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpLoadFalse) {
+        R(ip[0]) = value::from_bool(false);
+        ip += 1;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpLoadNull) {
+        R(ip[0]) = value();
+        ip += 1;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpMove) {
+        R(ip[0]) = R(ip[1]);
+        ip += 2;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpGetGlobal) {
+        R(ip[0]) = this->globals.values[read_u16(ip + 1)];
+        ip += 3;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpSetGlobal) {
+        this->globals.values[read_u16(ip + 1)] = R(ip[0]);
+        ip += 3;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpAdd) {
+        R(ip[0]) = add(R(ip[1]), R(ip[2]), this->globals.heap);
+        ip += 3;
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpSub) {
+        R(ip[0]) = sub(R(ip[1]), R(ip[2]), this->globals.heap);
+        ip += 3;
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpMul) {
+        R(ip[0]) = mul(R(ip[1]), R(ip[2]), this->globals.heap);
+        ip += 3;
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpDiv) {
+        R(ip[0]) = div(R(ip[1]), R(ip[2]), this->globals.heap);
+        ip += 3;
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpEq) {
+        R(ip[0]) = value::from_bool(equals(R(ip[1]), R(ip[2])));
+        ip += 3;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpNotEq) {
+        R(ip[0]) = value::from_bool(!equals(R(ip[1]), R(ip[2])));
+        ip += 3;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpGreaterThan) {
+        R(ip[0]) = value::from_bool(greater_than(R(ip[1]), R(ip[2])));
+        ip += 3;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpMinus) {
+        auto rhs = R(ip[1]);
+        auto type = rhs.get_type();
+        if (type != object_type::Integer && type != object_type::Float) {
+            return "unsupported type for negation " +
+                   std::string(object_type_to_string(type));
+        }
+        R(ip[0]) = negate(rhs, this->globals.heap);
+        ip += 2;
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpBang) {
+        R(ip[0]) = value::from_bool(!is_truthy(R(ip[1])));
+        ip += 2;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpJump) {
+        ip = ins + read_u16(ip);
+        VM_DISPATCH();
+    }
+    VM_CASE(OpJumpNotTruthy) {
+        if (!is_truthy(R(ip[0]))) {
+            ip = ins + read_u16(ip + 1);
+        } else {
+            ip += 3;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(OpCall) {
+        size_t callee = ip[0];
+        size_t num_args = ip[1];
+        active_frame->instruction_pointer = ip + 2;
+        auto err = this->call_function(*active_frame, callee, num_args);
+        if (err.has_value()) {
+            return err;
+        }
+        active_frame = &this->frames[this->frames_index - 1];
+        ins = active_frame->ins;
+        ip = active_frame->instruction_pointer;
+        base_pointer = active_frame->base_pointer;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpReturnValue) {
+        this->registers[base_pointer - 1] = R(ip[0]);
+        this->frames_index--;
+        active_frame = &this->frames[this->frames_index - 1];
+        ins = active_frame->ins;
+        ip = active_frame->instruction_pointer;
+        base_pointer = active_frame->base_pointer;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpReturn) {
+        this->registers[base_pointer - 1] = value();
+        this->frames_index--;
+        active_frame = &this->frames[this->frames_index - 1];
+        ins = active_frame->ins;
+        ip = active_frame->instruction_pointer;
+        base_pointer = active_frame->base_pointer;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpPop) {
+        this->last_popped = R(ip[0]);
+        ip += 1;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpHalt) {
+        // leave the instruction pointer on the halt so running again
+        // is a no-op
+        active_frame->instruction_pointer = ip - 1;
+        return std::nullopt;
+    }
+
+#ifndef AXE_COMPUTED_GOTO
+        }
+    }
+#endif
+}
+
+#ifdef AXE_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+#undef R
+#undef VM_CASE
+#undef VM_DISPATCH
+
+template <typename GlobalsLifeTime>
+void register_vm<GlobalsLifeTime>::push_frame(register_frame frame) {
+    if (this->frames_index == this->frames.size()) {
+        this->frames.push_back(frame);
+    } else {
+        this->frames[this->frames_index] = frame;
+    }
+    this->frames_index++;
+}
+
+template <typename GlobalsLifeTime>
+object register_vm<GlobalsLifeTime>::last_popped_stack_element() {
+    return to_object(this->last_popped);
+}
+
+template <typename GlobalsLifeTime>
+void register_vm<GlobalsLifeTime>::maybe_collect_garbage() {
+    if (this->globals.heap.should_collect()) {
+        this->collect_garbage();
+    }
+}
+
+// registers above the active frame may hold stale values, marking them
+// only keeps some garbage alive a little longer
+template <typename GlobalsLifeTime>
+void register_vm<GlobalsLifeTime>::collect_garbage() {
+    auto& heap = this->globals.heap;
+    heap.mark(this->registers.data(),
+              this->registers.data() + this->registers.capacity());
+    heap.mark(this->last_popped);
+    heap.mark(this->globals.values.data(),
+              this->globals.values.data() + this->globals.values.size());
+    heap.sweep();
+}
+
+template <typename GlobalsLifeTime>
+std::optional<std::string>
+register_vm<GlobalsLifeTime>::call_function(register_frame& caller,
+                                            size_t callee, size_t num_args) {
+    auto fn_obj = this->registers[caller.base_pointer + callee];
+    if (fn_obj.get_type() != object_type::Function) {
+        return "calling non-function, " +
+               std::string(object_type_to_string(fn_obj.get_type()));
+    }
+    auto& fn = fn_obj.get_function();
+    if (fn.get_num_params() != num_args) {
+        return "wrong number of arguments: want " +
+               std::to_string(fn.get_num_params()) + ", got " +
+               std::to_string(num_args);
+    }
+    size_t base_pointer = caller.base_pointer + callee + 1;
+    if (this->frames_index >= this->max_frames ||
+        !this->registers.reserve(base_pointer + fn.get_num_locals())) {
+        return "stack overflow";
+    }
+    const uint8_t* ins = fn.get_instructions().data();
+    this->push_frame({ins, ins, base_pointer});
+    return std::nullopt;
+}
+
+template class register_vm<globals_owned>;
+template class register_vm<globals_ref>;
+
+} // namespace axe
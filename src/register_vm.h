@@ -0,0 +1,62 @@
+#ifndef __AXE_REGISTER_VM_H__
+
+#define __AXE_REGISTER_VM_H__
+
+#include "code.h"
+#include "object.h"
+#include "register_compiler.h"
+#include "value.h"
+#include "vm.h"
+#include <vector>
+
+namespace axe {
+
+struct register_frame {
+    const uint8_t* ins;
+    const uint8_t* instruction_pointer;
+    // register 0 of the frame. the callee sits right below it and is
+    // overwritten with the return value.
+    size_t base_pointer;
+};
+
+// interpreter for the code generated by register_compiler. frames are
+// windows into one register file and the arguments of a call become the
+// first registers of the callee without being copied.
+template <typename GlobalsLifeTime> class register_vm {
+  public:
+    register_vm(register_byte_code byte_code,
+                vm_options options = vm_options());
+    register_vm(register_byte_code byte_code, GlobalsLifeTime globals,
+                vm_options options = vm_options());
+    ~register_vm();
+
+    std::optional<std::string> run();
+    object last_popped_stack_element();
+
+  private:
+    // first so the heap exists before the constants are moved into it
+    GlobalsLifeTime globals;
+
+    std::vector<value> constants;
+    instructions main_instructions;
+    size_t main_num_registers;
+
+    std::vector<register_frame> frames;
+    size_t frames_index;
+    size_t max_frames;
+
+    value_stack registers;
+    value last_popped;
+
+    void push_frame(register_frame frame);
+
+    void maybe_collect_garbage();
+    void collect_garbage();
+
+    std::optional<std::string> call_function(register_frame& caller,
+                                             size_t callee, size_t num_args);
+};
+
+} // namespace axe
+
+#endif // __AXE_REGISTER_VM_H__
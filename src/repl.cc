@@ -1,6 +1,9 @@
+#include "argparse.hpp"
 #include "compiler.h"
 #include "lexer.h"
 #include "parser.h"
+#include "register_compiler.h"
+#include "register_vm.h"
 #include "symbol_table.h"
 #include "vm.h"
 #include <iostream>
@@ -22,8 +25,9 @@ bool check_errors(const axe::parser& parser) {
     return parser.get_errors().size() != 0;
 }
 
-void main_loop() {
-    std::vector<axe::object> globals(GLOBALS_SIZE, axe::object());
+template <typename Compiler, typename VM>
+void main_loop(axe::vm_options options) {
+    axe::globals_store globals;
     axe::symbol_table symbol_table;
     std::vector<axe::object> constants;
     while (true) {
@@ -37,15 +41,13 @@ void main_loop() {
         if (check_errors(parser)) {
             continue;
         }
-        axe::compiler<axe::constants_ref, axe::symbol_table_ref> compiler(
-            symbol_table, constants);
+        Compiler compiler(symbol_table, constants);
         auto err = compiler.compile(ast);
         if (err.has_value()) {
             std::cout << "COMPILE ERROR: " << *err << '\n';
             continue;
         }
-        axe::vm<std::vector<axe::object>&> vm(compiler.get_byte_code(),
-                                              globals);
+        VM vm(compiler.get_byte_code(), globals, options);
         err = vm.run();
         if (err.has_value()) {
             std::cout << *err << '\n';
@@ -58,7 +60,49 @@ void main_loop() {
     }
 }
 
-int main() {
-    main_loop();
+int main(int argc, char* argv[]) {
+    argparse::ArgumentParser program("axe-repl");
+
+    program.add_argument("--backend")
+        .default_value(std::string("stack"))
+        .help("the code generator and interpreter to use, stack or register");
+
+    program.add_argument("--jit")
+        .default_value(0)
+        .scan<'i', int>()
+        .help("compile functions to machine code once they were called this "
+              "many times, 0 never does. only the stack backend has a jit");
+
+    program.add_argument("--optimize")
+        .default_value(0)
+        .scan<'i', int>()
+        .help("optimize functions in the background once they were called "
+              "this many times, 0 never does");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        std::cerr << program;
+        exit(1);
+    }
+
+    auto backend = program.get<std::string>("--backend");
+    axe::vm_options options;
+    // the byte code comes straight from the compiler
+    options.verify = false;
+    options.jit_threshold = program.get<int>("--jit");
+    options.optimize_threshold = program.get<int>("--optimize");
+    if (backend == "stack") {
+        main_loop<axe::compiler<axe::constants_ref, axe::symbol_table_ref>,
+                  axe::vm<axe::globals_ref>>(options);
+    } else if (backend == "register") {
+        main_loop<
+            axe::register_compiler<axe::constants_ref, axe::symbol_table_ref>,
+            axe::register_vm<axe::globals_ref>>(options);
+    } else {
+        std::cerr << "unknown backend " << backend << '\n';
+        exit(1);
+    }
     return 0;
 }
@@ -0,0 +1,82 @@
+#include "superinstructions.h"
+#include <set>
+
+namespace axe {
+
+struct fusion {
+    std::vector<op_code> sequence;
+    op_code fused;
+};
+
+// longer sequences come first so they win over their prefixes
+static const fusion fusions[] = {
+    {{op_code::OpGetLocal, op_code::OpConstant, op_code::OpAdd},
+     op_code::OpAddLocalConstant},
+    {{op_code::OpGetLocal, op_code::OpConstant, op_code::OpSub},
+     op_code::OpSubLocalConstant},
+    {{op_code::OpGreaterThan, op_code::OpJumpNotTruthy},
+     op_code::OpGreaterThanJumpNotTruthy},
+    {{op_code::OpEq, op_code::OpJumpNotTruthy}, op_code::OpEqJumpNotTruthy},
+    {{op_code::OpGetLocal, op_code::OpGetLocal}, op_code::OpGetLocalGetLocal},
+    {{op_code::OpGetLocal, op_code::OpConstant}, op_code::OpGetLocalConstant},
+};
+
+static bool matches(const std::vector<instruction>& list, size_t start,
+                    const fusion& fusion, const std::set<size_t>& targets) {
+    if (start + fusion.sequence.size() > list.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < fusion.sequence.size(); ++i) {
+        auto& ins = list[start + i];
+        if (ins.op != fusion.sequence[i]) {
+            return false;
+        }
+        // only the first instruction of the sequence may be jumped to
+        if (i != 0 && targets.count(ins.position) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+instructions fuse_superinstructions(const instructions& ins) {
+    auto list = disassemble(ins);
+    std::set<size_t> targets;
+    for (auto& ins : list) {
+        int jump = jump_operand(ins.op);
+        if (jump >= 0) {
+            targets.insert(ins.operands[jump]);
+        }
+    }
+
+    std::vector<instruction> res;
+    res.reserve(list.size());
+    size_t i = 0;
+    while (i < list.size()) {
+        const fusion* found = nullptr;
+        for (auto& fusion : fusions) {
+            if (matches(list, i, fusion, targets)) {
+                found = &fusion;
+                break;
+            }
+        }
+        if (found == nullptr) {
+            res.push_back(list[i]);
+            i++;
+            continue;
+        }
+        // the fused instruction takes the operands of the sequence in
+        // order and the position of its first instruction
+        instruction fused = {found->fused, {}, list[i].position};
+        for (size_t j = 0; j < found->sequence.size(); ++j) {
+            auto& operands = list[i + j].operands;
+            fused.operands.insert(fused.operands.end(), operands.begin(),
+                                  operands.end());
+        }
+        res.push_back(std::move(fused));
+        i += found->sequence.size();
+    }
+    return assemble(res);
+}
+
+} // namespace axe
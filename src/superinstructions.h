@@ -0,0 +1,16 @@
+#ifndef __AXE_SUPERINSTRUCTIONS_H__
+
+#define __AXE_SUPERINSTRUCTIONS_H__
+
+#include "code.h"
+
+namespace axe {
+
+// replaces frequent instruction sequences with a single fused
+// instruction. sequences that are entered by a jump somewhere other than
+// their first instruction are left alone.
+instructions fuse_superinstructions(const instructions& ins);
+
+} // namespace axe
+
+#endif // __AXE_SUPERINSTRUCTIONS_H__
@@ -4,7 +4,7 @@
 
 namespace axe {
 
-symbol::symbol(std::string name, symbol_scope scope, size_t index)
+symbol::symbol(atom name, symbol_scope scope, size_t index)
     : name(name), scope(scope), index(index) {}
 
 bool symbol::operator==(const symbol& other) const {
@@ -20,50 +20,111 @@ bool symbol::operator==(const symbol& other) const {
     return true;
 }
 
-symbol_table::symbol_table() : outer(std::nullopt), num_definitions(0) {}
+symbol_table::symbol_table() : scopes({{0, 0, 0}}) {}
 
-symbol_table symbol_table::with_outer(symbol_table& outer) {
-    symbol_table res;
-    res.outer = std::make_shared<symbol_table>(outer);
-    return res;
+void symbol_table::push_scope() { this->push_scope(this->size()); }
+
+void symbol_table::push_scope(size_t visible) {
+    AXE_CHECK(visible <= this->size(),
+              "trying to push a scope that sees undefined symbols");
+    if (visible != this->size()) {
+        this->hidden.emplace_back(visible, this->size());
+    }
+    this->scopes.push_back({this->size(), 0, visible});
 }
 
-symbol symbol_table::define(std::string name) {
-    symbol symb = {name, symbol_scope::GlobalScope, this->num_definitions};
-    if (this->outer.has_value()) {
-        symb.scope = symbol_scope::LocalScope;
+void symbol_table::pop_scope() {
+    AXE_CHECK(this->scopes.size() > 1,
+              "trying to pop the global scope of a symbol table");
+    auto& scope = this->scopes.back();
+    while (this->definitions.size() > scope.begin) {
+        this->pop_definition();
+    }
+    if (scope.visible != scope.begin) {
+        this->hidden.pop_back();
     }
-    auto to_insert = std::pair<std::string, symbol>(name, symb);
-    this->store.insert(to_insert);
-    this->num_definitions++;
-    return symb;
+    this->scopes.pop_back();
+}
+
+symbol symbol_table::define(atom name) {
+    auto& scope = this->scopes.back();
+    auto symb_scope = this->scopes.size() == 1 ? symbol_scope::GlobalScope
+                                               : symbol_scope::LocalScope;
+    auto binding = this->bindings.emplace(name, none).first;
+    this->definitions.push_back(
+        {name, symb_scope, scope.num_definitions, binding->second});
+    binding->second = this->definitions.size() - 1;
+    scope.num_definitions++;
+    return symbol(name, symb_scope, scope.num_definitions - 1);
 }
 
 std::optional<const symbol>
-symbol_table::resolve(const std::string& name) const {
-    auto it = this->store.find(name);
-    if (it != this->store.end()) {
-        return it->second;
+symbol_table::resolve(atom name) const {
+    auto binding = this->bindings.find(name);
+    if (binding == this->bindings.end()) {
+        return std::nullopt;
     }
-    if (this->outer.has_value()) {
-        return (*this->outer)->resolve(name);
+    auto index = binding->second;
+    while (index != none && this->is_hidden(index)) {
+        index = this->definitions[index].shadowed;
     }
-    return std::nullopt;
+    if (index == none) {
+        return std::nullopt;
+    }
+    auto& def = this->definitions[index];
+    return symbol(name, def.scope, def.index);
 }
 
-void symbol_table::erase(const std::string& name) {
-    this->store.erase(name);
-    this->num_definitions--;
+std::optional<const symbol>
+symbol_table::resolve_in_scope(atom name) const {
+    auto binding = this->bindings.find(name);
+    if (binding == this->bindings.end() ||
+        binding->second < this->scopes.back().begin) {
+        return std::nullopt;
+    }
+    auto& def = this->definitions[binding->second];
+    return symbol(name, def.scope, def.index);
 }
 
-symbol_table symbol_table::get_outer() {
-    AXE_CHECK(this->outer.has_value(),
-              "trying to get outer from symbol table without outer");
-    return **this->outer;
+void symbol_table::erase(atom name) {
+    AXE_CHECK(this->definitions.size() > this->scopes.back().begin &&
+                  this->definitions.back().name == name,
+              "trying to erase a symbol that is not the last defined");
+    this->pop_definition();
 }
 
 size_t symbol_table::get_num_definitions() const {
-    return this->num_definitions;
+    return this->scopes.back().num_definitions;
+}
+
+size_t symbol_table::size() const { return this->definitions.size(); }
+
+void symbol_table::truncate(size_t size) {
+    AXE_CHECK(size >= this->scopes.back().begin,
+              "trying to truncate a symbol table past its current scope");
+    while (this->definitions.size() > size) {
+        this->pop_definition();
+    }
+}
+
+bool symbol_table::is_hidden(size_t definition) const {
+    for (auto& range : this->hidden) {
+        if (definition >= range.first && definition < range.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void symbol_table::pop_definition() {
+    auto& def = this->definitions.back();
+    if (def.shadowed == none) {
+        this->bindings.erase(def.name);
+    } else {
+        this->bindings[def.name] = def.shadowed;
+    }
+    this->scopes.back().num_definitions--;
+    this->definitions.pop_back();
 }
 
 } // namespace axe
@@ -2,11 +2,12 @@
 
 #define __SYMBOL_TABLE_H__
 
+#include "atom.h"
 #include <cstddef>
-#include <memory>
 #include <optional>
-#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace axe {
 
@@ -16,28 +17,73 @@ enum class symbol_scope {
 };
 
 struct symbol {
-    std::string name;
+    atom name;
     symbol_scope scope;
     size_t index;
 
-    symbol(std::string name, symbol_scope scope, size_t index);
+    symbol(atom name, symbol_scope scope, size_t index);
     bool operator==(const symbol& other) const;
 };
 
+// the definitions of every scope that is open, the global one first, in
+// one array. a scope is the range of the definitions made since it was
+// pushed, so pushing and popping one does not copy the others. the
+// definition a name resolves to is found from the id of its atom without
+// walking the scopes.
 class symbol_table {
   public:
     symbol_table();
-    static symbol_table with_outer(symbol_table& outer);
-    symbol define(std::string name);
-    std::optional<const symbol> resolve(const std::string& name) const;
-    void erase(const std::string& name);
-    symbol_table get_outer();
+    // enters a function, whose definitions are locals
+    void push_scope();
+    // enters a function that only sees the first visible definitions of
+    // the scopes that are open, see size
+    void push_scope(size_t visible);
+    // leaves it, undoing everything it defined
+    void pop_scope();
+    symbol define(atom name);
+    std::optional<const symbol> resolve(atom name) const;
+    // like resolve, but only to a definition of the current scope
+    std::optional<const symbol> resolve_in_scope(atom name) const;
+    // undoes the last definition, which has to be of name
+    void erase(atom name);
+    // the number of definitions in the current scope
     size_t get_num_definitions() const;
+    // the number of definitions in all the scopes that are open
+    size_t size() const;
+    // undoes the definitions of the current scope made after there were
+    // size of them
+    void truncate(size_t size);
 
   private:
-    std::unordered_map<std::string, symbol> store;
-    std::optional<std::shared_ptr<symbol_table>> outer;
-    size_t num_definitions;
+    static constexpr size_t none = static_cast<size_t>(-1);
+
+    struct definition {
+        atom name;
+        symbol_scope scope;
+        size_t index;
+        // the definition of the same name this one shadows, or none
+        size_t shadowed;
+    };
+
+    struct scope {
+        // the first of its definitions
+        size_t begin;
+        size_t num_definitions;
+        // the definitions in [visible, begin) are hidden from it
+        size_t visible;
+    };
+
+    // the innermost definition of each name that has one. a map, ids
+    // are handed out for the whole program and most are not defined
+    // here.
+    std::unordered_map<atom, size_t> bindings;
+    std::vector<definition> definitions;
+    std::vector<scope> scopes;
+    // the ranges scopes pushed with visible hide, usually none
+    std::vector<std::pair<size_t, size_t>> hidden;
+
+    bool is_hidden(size_t definition) const;
+    void pop_definition();
 };
 
 } // namespace axe
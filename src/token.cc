@@ -11,6 +11,8 @@ token::token(token_type type) : type(type), literal(std::monostate()) {}
 token::token(token_type type, const std::string& literal)
     : type(type), literal(literal) {}
 
+token::token(token_type type, atom literal) : type(type), literal(literal) {}
+
 struct token_lookup {
     const char* str;
     size_t str_len;
@@ -27,11 +29,11 @@ static const token_lookup token_lookups[] = {
 static const size_t token_lookups_size =
     sizeof token_lookups / sizeof token_lookups[0];
 
-token::token(const std::string& literal)
+token::token(std::string_view literal)
     : type(token_type::Illegal), literal(std::monostate()) {
 
     size_t literal_length = literal.size();
-    const char* literal_cstr = literal.c_str();
+    const char* literal_cstr = literal.data();
 
     for (size_t i = 0; i < token_lookups_size; ++i) {
         token_lookup lookup = token_lookups[i];
@@ -46,7 +48,7 @@ token::token(const std::string& literal)
     }
 
     this->type = token_type::Ident;
-    this->literal = literal;
+    this->literal = atom(literal);
 }
 
 void token::set_type(token_type type) { this->type = type; }
@@ -81,15 +83,24 @@ const std::string& token::get_literal() const {
         this->type == token_type::Integer || this->type == token_type::Ident ||
             this->type == token_type::Float || this->type == token_type::String,
         "tried to get literal from type %s", this->type_to_string());
+    if (std::holds_alternative<atom>(this->literal)) {
+        return std::get<atom>(this->literal).string();
+    }
     return std::get<std::string>(this->literal);
 }
 
+atom token::get_atom() const {
+    AXE_CHECK(this->type == token_type::Ident,
+              "tried to get atom from type %s", this->type_to_string());
+    return std::get<atom>(this->literal);
+}
+
 std::string token::string() const {
     std::string res(this->type_to_string());
     if (this->type == token_type::Ident || this->type == token_type::Integer ||
         this->type == token_type::Float || this->type == token_type::String) {
         res.push_back(' ');
-        res += std::get<std::string>(this->literal);
+        res += this->get_literal();
     }
     return res;
 }
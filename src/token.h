@@ -2,7 +2,9 @@
 
 #define __AXE_TOKEN_H__
 
+#include "atom.h"
 #include <string>
+#include <string_view>
 #include <variant>
 
 namespace axe {
@@ -55,19 +57,24 @@ class token {
     token();
     token(token_type type);
     token(token_type, const std::string& literal);
-    token(const std::string& literal);
+    token(token_type, atom literal);
+    // a keyword, or an ident with literal interned
+    token(std::string_view literal);
 
     void set_type(token_type type);
     void set_literal(const std::string& literal);
 
     token_type get_type() const;
     const std::string& get_literal() const;
+    // the literal of an ident
+    atom get_atom() const;
     const char* type_to_string() const;
     std::string string() const;
 
   private:
     token_type type;
-    std::variant<std::monostate, std::string> literal;
+    // an atom for idents
+    std::variant<std::monostate, std::string, atom> literal;
 };
 
 } // namespace axe
@@ -0,0 +1,335 @@
+#include "value.h"
+#include "base.h"
+
+namespace axe {
+
+// collect once this many objects are alive, grows with the live set so
+// a large heap is not walked over and over
+#define MIN_COLLECTION_THRESHOLD 1024
+// slots a value_stack starts with
+#define INITIAL_STACK_SIZE 64
+
+object_type value::get_type() const {
+    if (this->is_double()) {
+        return object_type::Float;
+    }
+    if (this->is_small_int()) {
+        return object_type::Integer;
+    }
+    if (this->is_bool()) {
+        return object_type::Bool;
+    }
+    if (this->is_heap_object()) {
+        switch (this->as_heap_object()->type) {
+        case heap_type::Integer:
+            return object_type::Integer;
+        case heap_type::String:
+            return object_type::String;
+        case heap_type::Error:
+            return object_type::Error;
+        case heap_type::Function:
+            return object_type::Function;
+        }
+    }
+    return object_type::Null;
+}
+
+int64_t value::get_int() const {
+    if (this->is_small_int()) {
+        return this->as_small_int();
+    }
+    AXE_CHECK(this->get_type() == object_type::Integer,
+              "trying to get Integer from type %s",
+              object_type_to_string(this->get_type()));
+    return static_cast<heap_integer*>(this->as_heap_object())->value;
+}
+
+double value::get_float() const {
+    AXE_CHECK(this->is_double(), "trying to get Float from type %s",
+              object_type_to_string(this->get_type()));
+    return this->as_double();
+}
+
+bool value::get_bool() const {
+    AXE_CHECK(this->is_bool(), "trying to get Bool from type %s",
+              object_type_to_string(this->get_type()));
+    return this->as_bool();
+}
+
+const std::string& value::get_string() const {
+    AXE_CHECK(this->get_type() == object_type::String ||
+                  this->get_type() == object_type::Error,
+              "trying to get String from type %s",
+              object_type_to_string(this->get_type()));
+    return static_cast<heap_string*>(this->as_heap_object())->value;
+}
+
+const compiled_function& value::get_function() const {
+    AXE_CHECK(this->get_type() == object_type::Function,
+              "trying to get Function from type %s",
+              object_type_to_string(this->get_type()));
+    return static_cast<heap_function*>(this->as_heap_object())->function;
+}
+
+heap::heap()
+    : objects(nullptr), num_objects(0), threshold(MIN_COLLECTION_THRESHOLD) {}
+
+static void free_object(heap_object* obj) {
+    switch (obj->type) {
+    case heap_type::Integer:
+        delete static_cast<heap_integer*>(obj);
+        break;
+    case heap_type::String:
+    case heap_type::Error:
+        delete static_cast<heap_string*>(obj);
+        break;
+    case heap_type::Function:
+        delete static_cast<heap_function*>(obj);
+        break;
+    }
+}
+
+heap::~heap() {
+    heap_object* obj = this->objects;
+    while (obj != nullptr) {
+        heap_object* next = obj->next;
+        free_object(obj);
+        obj = next;
+    }
+}
+
+void heap::add(heap_object* obj, heap_type type) {
+    obj->type = type;
+    obj->marked = false;
+    obj->pins = 0;
+    obj->next = this->objects;
+    this->objects = obj;
+    this->num_objects++;
+}
+
+value heap::make_big_int(int64_t i) {
+    auto obj = new heap_integer;
+    obj->value = i;
+    this->add(obj, heap_type::Integer);
+    return value::from_heap_object(obj);
+}
+
+value heap::make_string(std::string s) {
+    auto obj = new heap_string;
+    obj->value = std::move(s);
+    this->add(obj, heap_type::String);
+    return value::from_heap_object(obj);
+}
+
+value heap::make_error(std::string s) {
+    auto obj = new heap_string;
+    obj->value = std::move(s);
+    this->add(obj, heap_type::Error);
+    return value::from_heap_object(obj);
+}
+
+value heap::make_function(compiled_function fn) {
+    auto obj = new heap_function;
+    obj->function = std::move(fn);
+    obj->decoded = nullptr;
+    obj->decoded_by = 0;
+    this->add(obj, heap_type::Function);
+    return value::from_heap_object(obj);
+}
+
+void heap::pin(value v) {
+    if (v.is_heap_object()) {
+        v.as_heap_object()->pins++;
+    }
+}
+
+void heap::unpin(value v) {
+    if (v.is_heap_object()) {
+        AXE_CHECK(v.as_heap_object()->pins > 0, "unpinning unpinned object");
+        v.as_heap_object()->pins--;
+    }
+}
+
+void heap::sweep() {
+    heap_object** link = &this->objects;
+    while (*link != nullptr) {
+        heap_object* obj = *link;
+        if (obj->marked || obj->pins != 0) {
+            obj->marked = false;
+            link = &obj->next;
+            continue;
+        }
+        *link = obj->next;
+        free_object(obj);
+        this->num_objects--;
+    }
+    this->threshold = this->num_objects * 2;
+    if (this->threshold < MIN_COLLECTION_THRESHOLD) {
+        this->threshold = MIN_COLLECTION_THRESHOLD;
+    }
+}
+
+void globals_store::grow(size_t num_globals) {
+    if (this->values.size() < num_globals) {
+        this->values.resize(num_globals, value());
+    }
+}
+
+value_stack::value_stack(size_t limit)
+    : values(limit < INITIAL_STACK_SIZE ? limit : INITIAL_STACK_SIZE),
+      max_size(limit) {}
+
+bool value_stack::grow(size_t size) {
+    if (size > this->max_size) {
+        return false;
+    }
+    size_t capacity = this->values.size();
+    if (capacity == 0) {
+        capacity = INITIAL_STACK_SIZE;
+    }
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    if (capacity > this->max_size) {
+        capacity = this->max_size;
+    }
+    this->values.resize(capacity, value());
+    return true;
+}
+
+value add_slow(value lhs, value rhs, heap& heap) {
+    auto type = lhs.get_type();
+    if (type != rhs.get_type()) {
+        return value();
+    }
+    switch (type) {
+    case object_type::Integer:
+        return heap.make_int(lhs.get_int() + rhs.get_int());
+    case object_type::Float:
+        return value::from_double(lhs.as_double() + rhs.as_double());
+    case object_type::String:
+        return heap.make_string(lhs.get_string() + rhs.get_string());
+    default:
+        break;
+    }
+    return value();
+}
+
+value sub_slow(value lhs, value rhs, heap& heap) {
+    auto type = lhs.get_type();
+    if (type == object_type::Integer && rhs.get_type() == type) {
+        return heap.make_int(lhs.get_int() - rhs.get_int());
+    }
+    if (lhs.is_double() && rhs.is_double()) {
+        return value::from_double(lhs.as_double() - rhs.as_double());
+    }
+    return value();
+}
+
+value mul_slow(value lhs, value rhs, heap& heap) {
+    auto type = lhs.get_type();
+    if (type == object_type::Integer && rhs.get_type() == type) {
+        uint64_t res = static_cast<uint64_t>(lhs.get_int()) *
+                       static_cast<uint64_t>(rhs.get_int());
+        return heap.make_int(static_cast<int64_t>(res));
+    }
+    if (lhs.is_double() && rhs.is_double()) {
+        return value::from_double(lhs.as_double() * rhs.as_double());
+    }
+    return value();
+}
+
+value div_slow(value lhs, value rhs, heap& heap) {
+    auto type = lhs.get_type();
+    if (type == object_type::Integer && rhs.get_type() == type) {
+        return heap.make_int(lhs.get_int() / rhs.get_int());
+    }
+    if (lhs.is_double() && rhs.is_double()) {
+        return value::from_double(lhs.as_double() / rhs.as_double());
+    }
+    return value();
+}
+
+bool equals_slow(value lhs, value rhs) {
+    auto type = lhs.get_type();
+    if (type != rhs.get_type()) {
+        return false;
+    }
+    switch (type) {
+    case object_type::Null:
+        return true;
+    case object_type::Bool:
+        return lhs.as_bool() == rhs.as_bool();
+    case object_type::Integer:
+        return lhs.get_int() == rhs.get_int();
+    case object_type::Float:
+        return lhs.as_double() == rhs.as_double();
+    case object_type::String:
+        return lhs.get_string() == rhs.get_string();
+    case object_type::Function:
+        return to_object(lhs) == to_object(rhs);
+    default:
+        break;
+    }
+    return false;
+}
+
+bool greater_than_slow(value lhs, value rhs) {
+    auto type = lhs.get_type();
+    if (type == object_type::Integer && rhs.get_type() == type) {
+        return lhs.get_int() > rhs.get_int();
+    }
+    if (lhs.is_double() && rhs.is_double()) {
+        return lhs.as_double() > rhs.as_double();
+    }
+    return false;
+}
+
+value negate(value v, heap& heap) {
+    if (v.is_double()) {
+        return value::from_double(-v.as_double());
+    }
+    return heap.make_int(-v.get_int());
+}
+
+object to_object(value v) {
+    switch (v.get_type()) {
+    case object_type::Null:
+        return object();
+    case object_type::Bool:
+        return object(object_type::Bool, v.as_bool());
+    case object_type::Integer:
+        return object(object_type::Integer, v.get_int());
+    case object_type::Float:
+        return object(object_type::Float, v.as_double());
+    case object_type::String:
+        return object(object_type::String, v.get_string());
+    case object_type::Error:
+        return object(object_type::Error, v.get_string());
+    case object_type::Function:
+        return object(object_type::Function, v.get_function());
+    }
+    return object();
+}
+
+value to_value(const object& obj, heap& heap) {
+    switch (obj.get_type()) {
+    case object_type::Null:
+        return value();
+    case object_type::Bool:
+        return value::from_bool(obj.get_bool());
+    case object_type::Integer:
+        return heap.make_int(obj.get_int());
+    case object_type::Float:
+        return value::from_double(obj.get_float());
+    case object_type::String:
+        return heap.make_string(obj.get_string());
+    case object_type::Error:
+        return heap.make_error(obj.get_error());
+    case object_type::Function:
+        return heap.make_function(obj.get_function());
+    }
+    return value();
+}
+
+} // namespace axe
@@ -0,0 +1,323 @@
+#ifndef __AXE_VALUE_H__
+
+#define __AXE_VALUE_H__
+
+#include "object.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace axe {
+
+struct decoded_function;
+
+enum class heap_type : uint8_t {
+    Integer,
+    String,
+    Error,
+    Function,
+};
+
+// header of every object owned by a heap
+struct heap_object {
+    heap_type type;
+    bool marked;
+    uint32_t pins;
+    heap_object* next;
+};
+
+// integers that do not fit in the 48 bit payload of a value
+struct heap_integer : heap_object {
+    int64_t value;
+};
+
+// used for both strings and errors
+struct heap_string : heap_object {
+    std::string value;
+};
+
+struct heap_function : heap_object {
+    compiled_function function;
+    // the prototype the vm with the id decoded_by made for function.
+    // cached here so a call does not have to look it up, values can
+    // outlive the vm that made them so the id is always checked.
+    const decoded_function* decoded;
+    uint64_t decoded_by;
+};
+
+// the runtime representation of an object in a single 64 bit word.
+//
+// doubles are stored as themselves. everything else is hidden in the
+// payload of a quiet NaN, bits 48 and 49 and the sign bit select what:
+//
+//   0111 1111 1111 11 01 [48 bits]  null
+//   0111 1111 1111 11 10 [48 bits]  bool, the lowest bit is the value
+//   0111 1111 1111 11 11 [48 bits]  int, sign extended from 48 bits
+//   1111 1111 1111 11 00 [48 bits]  pointer to a heap_object
+//
+// a NaN produced by arithmetic is canonicalized so it never looks like a
+// tagged value.
+class value {
+  public:
+    value() : bits(NULL_BITS) {}
+
+    static value from_bool(bool b) {
+        return value(BOOL_BITS | static_cast<uint64_t>(b));
+    }
+
+    static value from_double(double d) {
+        if (d != d) {
+            return value(CANONICAL_NAN);
+        }
+        uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        return value(bits);
+    }
+
+    static bool fits_small_int(int64_t i) {
+        return i >= -(INT64_C(1) << 47) && i < (INT64_C(1) << 47);
+    }
+
+    // i must fit in 48 bits, see heap::make_int
+    static value from_small_int(int64_t i) {
+        return value(INT_BITS | (static_cast<uint64_t>(i) & PAYLOAD_MASK));
+    }
+
+    static value from_heap_object(const heap_object* obj) {
+        return value(POINTER_BITS | reinterpret_cast<uintptr_t>(obj));
+    }
+
+    bool is_null() const { return this->bits == NULL_BITS; }
+    bool is_bool() const { return (this->bits & TAG_MASK) == BOOL_BITS; }
+    bool is_small_int() const { return (this->bits & TAG_MASK) == INT_BITS; }
+    bool is_double() const { return (this->bits & QNAN) != QNAN; }
+    bool is_heap_object() const {
+        return (this->bits & TAG_MASK) == POINTER_BITS;
+    }
+
+    bool as_bool() const { return this->bits & 1; }
+    int64_t as_small_int() const {
+        return static_cast<int64_t>(this->bits << 16) >> 16;
+    }
+    double as_double() const {
+        double d;
+        std::memcpy(&d, &this->bits, sizeof(d));
+        return d;
+    }
+    heap_object* as_heap_object() const {
+        return reinterpret_cast<heap_object*>(this->bits & PAYLOAD_MASK);
+    }
+
+    object_type get_type() const;
+    // these check the type like their object counterparts
+    int64_t get_int() const;
+    double get_float() const;
+    bool get_bool() const;
+    const std::string& get_string() const;
+    const compiled_function& get_function() const;
+
+    uint64_t get_bits() const { return this->bits; }
+
+  private:
+    explicit value(uint64_t bits) : bits(bits) {}
+
+    static constexpr uint64_t QNAN = UINT64_C(0x7ffc000000000000);
+    static constexpr uint64_t SIGN = UINT64_C(0x8000000000000000);
+    static constexpr uint64_t TAG_MASK = SIGN | QNAN | (UINT64_C(3) << 48);
+    static constexpr uint64_t PAYLOAD_MASK = (UINT64_C(1) << 48) - 1;
+    static constexpr uint64_t NULL_BITS = QNAN | (UINT64_C(1) << 48);
+    static constexpr uint64_t BOOL_BITS = QNAN | (UINT64_C(2) << 48);
+    static constexpr uint64_t INT_BITS = QNAN | (UINT64_C(3) << 48);
+    static constexpr uint64_t POINTER_BITS = SIGN | QNAN;
+    static constexpr uint64_t CANONICAL_NAN = UINT64_C(0x7ff8000000000000);
+
+    uint64_t bits;
+};
+
+static_assert(sizeof(value) == 8, "value must be a single word");
+static_assert(std::is_trivially_copyable<value>::value,
+              "value must be trivially copyable");
+
+// owns the strings, functions and big integers values point to.
+// objects are freed by a mark and sweep collection, the owner of the
+// heap marks its roots and calls sweep once should_collect says so.
+// pinned objects, like the ones made for constants, are never freed.
+class heap {
+  public:
+    heap();
+    ~heap();
+    heap(const heap&) = delete;
+    heap& operator=(const heap&) = delete;
+
+    value make_int(int64_t i) {
+        if (value::fits_small_int(i)) {
+            return value::from_small_int(i);
+        }
+        return this->make_big_int(i);
+    }
+    value make_string(std::string s);
+    value make_error(std::string s);
+    value make_function(compiled_function fn);
+
+    void pin(value v);
+    void unpin(value v);
+
+    bool should_collect() const {
+        return this->num_objects >= this->threshold;
+    }
+    void mark(value v) {
+        if (v.is_heap_object()) {
+            v.as_heap_object()->marked = true;
+        }
+    }
+    void mark(const value* begin, const value* end) {
+        for (auto it = begin; it != end; ++it) {
+            this->mark(*it);
+        }
+    }
+    // frees every object that was neither marked nor pinned since the
+    // last sweep
+    void sweep();
+
+    size_t size() const { return this->num_objects; }
+
+  private:
+    heap_object* objects;
+    size_t num_objects;
+    size_t threshold;
+
+    value make_big_int(int64_t i);
+    void add(heap_object* obj, heap_type type);
+};
+
+// the globals of a program and the heap their values live in. the
+// repl keeps one alive across lines so later lines see earlier values.
+struct globals_store {
+    // makes room for at least num_globals globals. pointers into values
+    // are invalidated, so a vm only grows the store before it runs.
+    void grow(size_t num_globals);
+
+    std::vector<value> values;
+    axe::heap heap;
+};
+
+using globals_owned = globals_store;
+using globals_ref = globals_store&;
+
+// the stack or the registers of a vm. it starts small and doubles
+// whenever it runs full, up to a hard limit. slots are addressed by
+// index because growing moves them.
+class value_stack {
+  public:
+    explicit value_stack(size_t limit);
+
+    value& operator[](size_t i) { return this->values[i]; }
+    value* data() { return this->values.data(); }
+    size_t capacity() const { return this->values.size(); }
+    size_t limit() const { return this->max_size; }
+
+    // makes sure the slots below size exist, false when size is over
+    // the limit
+    bool reserve(size_t size) {
+        if (size <= this->values.size()) {
+            return true;
+        }
+        return this->grow(size);
+    }
+
+  private:
+    std::vector<value> values;
+    size_t max_size;
+
+    bool grow(size_t size);
+};
+
+inline bool is_truthy(value v) {
+    if (v.is_bool()) {
+        return v.as_bool();
+    }
+    if (v.is_small_int()) {
+        return v.as_small_int() != 0;
+    }
+    if (v.is_double()) {
+        return v.as_double() != 0;
+    }
+    if (v.is_heap_object()) {
+        switch (v.as_heap_object()->type) {
+        case heap_type::Integer:
+            return true;
+        case heap_type::String:
+            return true;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+// the slow paths cover everything except two small ints, they follow
+// the semantics of the object operators
+value add_slow(value lhs, value rhs, heap& heap);
+value sub_slow(value lhs, value rhs, heap& heap);
+value mul_slow(value lhs, value rhs, heap& heap);
+value div_slow(value lhs, value rhs, heap& heap);
+bool equals_slow(value lhs, value rhs);
+bool greater_than_slow(value lhs, value rhs);
+
+inline value add(value lhs, value rhs, heap& heap) {
+    if (lhs.is_small_int() && rhs.is_small_int()) {
+        return heap.make_int(lhs.as_small_int() + rhs.as_small_int());
+    }
+    return add_slow(lhs, rhs, heap);
+}
+
+inline value sub(value lhs, value rhs, heap& heap) {
+    if (lhs.is_small_int() && rhs.is_small_int()) {
+        return heap.make_int(lhs.as_small_int() - rhs.as_small_int());
+    }
+    return sub_slow(lhs, rhs, heap);
+}
+
+inline value mul(value lhs, value rhs, heap& heap) {
+    if (lhs.is_small_int() && rhs.is_small_int()) {
+        // wraps around like the int64_t multiplication of object
+        uint64_t res = static_cast<uint64_t>(lhs.as_small_int()) *
+                       static_cast<uint64_t>(rhs.as_small_int());
+        return heap.make_int(static_cast<int64_t>(res));
+    }
+    return mul_slow(lhs, rhs, heap);
+}
+
+inline value div(value lhs, value rhs, heap& heap) {
+    if (lhs.is_small_int() && rhs.is_small_int()) {
+        return heap.make_int(lhs.as_small_int() / rhs.as_small_int());
+    }
+    return div_slow(lhs, rhs, heap);
+}
+
+inline bool equals(value lhs, value rhs) {
+    if (lhs.is_small_int() && rhs.is_small_int()) {
+        return lhs.get_bits() == rhs.get_bits();
+    }
+    return equals_slow(lhs, rhs);
+}
+
+inline bool greater_than(value lhs, value rhs) {
+    if (lhs.is_small_int() && rhs.is_small_int()) {
+        return lhs.as_small_int() > rhs.as_small_int();
+    }
+    return greater_than_slow(lhs, rhs);
+}
+
+value negate(value v, heap& heap);
+
+// boxes a value back into an object
+object to_object(value v);
+// strings, errors and functions are allocated in heap
+value to_value(const object& obj, heap& heap);
+
+} // namespace axe
+
+#endif // __AXE_VALUE_H__
@@ -0,0 +1,365 @@
+#include "verify.h"
+
+namespace axe {
+
+static constexpr size_t not_an_instruction = static_cast<size_t>(-1);
+
+// what the byte code of one function may refer to
+struct code_limits {
+    const std::vector<object>& constants;
+    size_t num_globals;
+    size_t num_locals;
+    size_t max_stack;
+    // the vm ends the main program with an OpHalt, so it may run and
+    // jump off its end but has nothing to return from
+    bool main;
+};
+
+// how many values an instruction takes off the stack before it pushes
+// its results
+struct stack_use {
+    int pops;
+    int pushes;
+};
+
+static stack_use stack_use_of(const instruction& ins) {
+    switch (ins.op) {
+    case op_code::OpConstant:
+    case op_code::OpTrue:
+    case op_code::OpFalse:
+    case op_code::OpNull:
+    case op_code::OpGetGlobal:
+    case op_code::OpGetLocal:
+    case op_code::OpAddLocalConstant:
+    case op_code::OpSubLocalConstant:
+        return {0, 1};
+    case op_code::OpGetLocalGetLocal:
+    case op_code::OpGetLocalConstant:
+        return {0, 2};
+    case op_code::OpAdd:
+    case op_code::OpSub:
+    case op_code::OpMul:
+    case op_code::OpDiv:
+    case op_code::OpEq:
+    case op_code::OpNotEq:
+    case op_code::OpGreaterThan:
+    case op_code::OpAddInt:
+    case op_code::OpAddFloat:
+    case op_code::OpSubInt:
+    case op_code::OpSubFloat:
+    case op_code::OpGreaterThanInt:
+    case op_code::OpGreaterThanFloat:
+    case op_code::OpEqInt:
+    case op_code::OpEqFloat:
+        return {2, 1};
+    case op_code::OpMinus:
+    case op_code::OpBang:
+        return {1, 1};
+    case op_code::OpPop:
+    case op_code::OpJumpNotTruthy:
+    case op_code::OpJumpTruthy:
+    case op_code::OpJumpTable:
+    case op_code::OpSwitch:
+    case op_code::OpSetGlobal:
+    case op_code::OpSetLocal:
+    case op_code::OpReturnValue:
+        return {1, 0};
+    case op_code::OpGreaterThanJumpNotTruthy:
+    case op_code::OpEqJumpNotTruthy:
+        return {2, 0};
+    // the callee and the arguments are replaced by the result
+    case op_code::OpCall:
+    case op_code::OpTailCall:
+        return {ins.operands[0] + 1, 1};
+    default:
+        break;
+    }
+    return {0, 0};
+}
+
+static bool ends_flow(op_code op) {
+    switch (op) {
+    case op_code::OpReturnValue:
+    case op_code::OpReturn:
+    case op_code::OpTailCall:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+static std::string at(size_t position, const std::string& what) {
+    return "at " + std::to_string(position) + ": " + what;
+}
+
+static std::optional<std::string> check_index(int index, size_t size,
+                                              const char* what) {
+    if (static_cast<size_t>(index) >= size) {
+        return std::string(what) + " " + std::to_string(index) +
+               " out of range";
+    }
+    return std::nullopt;
+}
+
+static std::optional<std::string> check_operands(const instruction& ins,
+                                                 const code_limits& limits) {
+    size_t num_constants = limits.constants.size();
+    std::optional<std::string> err;
+    switch (ins.op) {
+    case op_code::OpConstant:
+    case op_code::OpCase:
+        err = check_index(ins.operands[0], num_constants, "constant");
+        break;
+    case op_code::OpJumpTable:
+        err = check_index(ins.operands[0], num_constants, "constant");
+        if (!err.has_value() &&
+            limits.constants[ins.operands[0]].get_type() !=
+                object_type::Integer) {
+            err = "the low end of a jump table is not an int";
+        }
+        break;
+    case op_code::OpGetGlobal:
+    case op_code::OpSetGlobal:
+        err = check_index(ins.operands[0], limits.num_globals, "global");
+        break;
+    case op_code::OpGetLocal:
+    case op_code::OpSetLocal:
+        err = check_index(ins.operands[0], limits.num_locals, "local");
+        break;
+    case op_code::OpGetLocalGetLocal:
+        err = check_index(ins.operands[0], limits.num_locals, "local");
+        if (!err.has_value()) {
+            err = check_index(ins.operands[1], limits.num_locals, "local");
+        }
+        break;
+    case op_code::OpGetLocalConstant:
+    case op_code::OpAddLocalConstant:
+    case op_code::OpSubLocalConstant:
+        err = check_index(ins.operands[0], limits.num_locals, "local");
+        if (!err.has_value()) {
+            err = check_index(ins.operands[1], num_constants, "constant");
+        }
+        break;
+    case op_code::OpReturnValue:
+    case op_code::OpReturn:
+    case op_code::OpTailCall:
+        if (limits.main) {
+            err = "return outside of a function";
+        }
+        break;
+    case op_code::OpHalt:
+        err = "OpHalt is only appended by the vm";
+        break;
+    default:
+        break;
+    }
+    return err;
+}
+
+// the entries of an OpJumpTable are jumps, the ones of an OpSwitch are
+// a jump to the default and cases the vm either hashes by their
+// strings or searches by their ints
+static std::optional<std::string>
+check_entries(const std::vector<instruction>& list, size_t index,
+              const code_limits& limits) {
+    auto& table = list[index];
+    size_t num_entries = switch_entries(table);
+    if (list.size() - index - 1 < num_entries) {
+        return std::string("the entries of a table are cut off");
+    }
+    for (size_t i = 1; i <= num_entries; ++i) {
+        auto op = list[index + i].op;
+        bool is_case = table.op == op_code::OpSwitch && i > 1;
+        if (op != (is_case ? op_code::OpCase : op_code::OpJump)) {
+            return std::string(is_case ? "an entry of a switch is not a case"
+                                       : "an entry of a table is not a jump");
+        }
+    }
+    if (table.op != op_code::OpSwitch || num_entries == 1) {
+        return std::nullopt;
+    }
+    auto& constants = limits.constants;
+    auto type = constants[list[index + 2].operands[0]].get_type();
+    if (type != object_type::Integer && type != object_type::String) {
+        return std::string("a case is neither an int nor a string");
+    }
+    for (size_t i = 3; i <= num_entries; ++i) {
+        auto& prev = constants[list[index + i - 1].operands[0]];
+        auto& cur = constants[list[index + i].operands[0]];
+        if (cur.get_type() != type) {
+            return std::string("the cases of a switch differ in type");
+        }
+        if (type == object_type::Integer && prev.get_int() >= cur.get_int()) {
+            return std::string("the cases of a switch are not sorted");
+        }
+    }
+    return std::nullopt;
+}
+
+static std::optional<std::string> verify_code(const instructions& ins,
+                                              const code_limits& limits) {
+    // first pass, split the byte code into instructions and remember
+    // where each of them starts
+    std::vector<instruction> list;
+    std::vector<size_t> index(ins.size() + 1, not_an_instruction);
+    size_t i = 0;
+    while (i < ins.size()) {
+        op_code op = static_cast<op_code>(ins[i]);
+        auto def = lookup(op);
+        if (!def.has_value()) {
+            return at(i, "undefined opcode " + std::to_string(ins[i]));
+        }
+        instruction cur = {op, {}, i};
+        size_t offset = i + 1;
+        for (auto width : def->get_operand_widths()) {
+            if (offset + width > ins.size()) {
+                return at(i, std::string(def->get_name()) + " is cut off");
+            }
+            cur.operands.push_back(width == 2 ? read_u16(ins, offset)
+                                              : ins[offset]);
+            offset += width;
+        }
+        index[i] = list.size();
+        list.push_back(std::move(cur));
+        i = offset;
+    }
+    if (limits.main) {
+        index[ins.size()] = list.size();
+    }
+
+    // second pass, the operands and the tables. the entries of a table
+    // are never run, they only hold its targets.
+    std::vector<bool> entries(list.size() + 1, false);
+    for (size_t j = 0; j < list.size(); ++j) {
+        auto& cur = list[j];
+        auto err = check_operands(cur, limits);
+        if (err.has_value()) {
+            return at(cur.position, *err);
+        }
+        if (switch_entries(cur) == 0) {
+            continue;
+        }
+        err = check_entries(list, j, limits);
+        if (err.has_value()) {
+            return at(cur.position, *err);
+        }
+        for (size_t k = 1; k <= switch_entries(cur); ++k) {
+            entries[j + k] = true;
+        }
+    }
+    for (auto& cur : list) {
+        if (cur.op == op_code::OpCase && !entries[index[cur.position]]) {
+            return at(cur.position, "OpCase outside of a switch");
+        }
+        int jump = jump_operand(cur.op);
+        if (jump < 0) {
+            continue;
+        }
+        size_t target = static_cast<size_t>(cur.operands[jump]);
+        if (target > ins.size() || index[target] == not_an_instruction ||
+            entries[index[target]]) {
+            return at(cur.position, "jump to " + std::to_string(target) +
+                                        ", which is not an instruction");
+        }
+    }
+
+    // third pass, walks every path once with the height of the stack
+    // on top of the locals. a path of the main program may end up past
+    // the last instruction, where the vm put the OpHalt.
+    std::vector<int> heights(list.size() + 1, -1);
+    std::vector<size_t> work;
+    int max_stack = static_cast<int>(limits.max_stack);
+    auto visit = [&](size_t from, size_t to,
+                     int height) -> std::optional<std::string> {
+        if (to == list.size() && !limits.main) {
+            return at(from, "runs off the end of the function");
+        }
+        if (heights[to] < 0) {
+            heights[to] = height;
+            if (to < list.size()) {
+                work.push_back(to);
+            }
+        } else if (heights[to] != height) {
+            return at(from, "the stack has " + std::to_string(heights[to]) +
+                                " or " + std::to_string(height) +
+                                " values where paths merge");
+        }
+        return std::nullopt;
+    };
+    auto err = visit(0, 0, 0);
+    if (err.has_value()) {
+        return err;
+    }
+    while (!work.empty()) {
+        size_t j = work.back();
+        work.pop_back();
+        auto& cur = list[j];
+        auto use = stack_use_of(cur);
+        int height = heights[j];
+        if (height < use.pops) {
+            return at(cur.position,
+                      "takes " + std::to_string(use.pops) + " values off " +
+                          std::to_string(height));
+        }
+        height += use.pushes - use.pops;
+        if (height > max_stack) {
+            return at(cur.position, "needs more than " +
+                                        std::to_string(max_stack) +
+                                        " values on the stack");
+        }
+        if (ends_flow(cur.op)) {
+            continue;
+        }
+        int jump = jump_operand(cur.op);
+        if (jump >= 0) {
+            err = visit(cur.position,
+                        index[static_cast<size_t>(cur.operands[jump])],
+                        height);
+            if (err.has_value()) {
+                return err;
+            }
+        }
+        if (cur.op != op_code::OpJump && cur.op != op_code::OpCase) {
+            err = visit(cur.position, j + 1, height);
+            if (err.has_value()) {
+                return err;
+            }
+        }
+        for (size_t k = 2; k <= switch_entries(cur); ++k) {
+            err = visit(cur.position, j + k, height);
+            if (err.has_value()) {
+                return err;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> verify(const instructions& ins,
+                                  const std::vector<object>& constants,
+                                  size_t num_globals, size_t max_stack) {
+    auto err = verify_code(ins, {constants, num_globals, 0, max_stack, true});
+    if (err.has_value()) {
+        return "main program " + *err;
+    }
+    for (size_t i = 0; i < constants.size(); ++i) {
+        if (constants[i].get_type() != object_type::Function) {
+            continue;
+        }
+        auto& fn = constants[i].get_function();
+        if (fn.get_num_params() > fn.get_num_locals()) {
+            return "function " + std::to_string(i) +
+                   " has more params than locals";
+        }
+        err = verify_code(fn.get_instructions(),
+                          {constants, num_globals, fn.get_num_locals(),
+                           fn.get_max_stack(), false});
+        if (err.has_value()) {
+            return "function " + std::to_string(i) + " " + *err;
+        }
+    }
+    return std::nullopt;
+}
+
+} // namespace axe
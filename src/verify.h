@@ -0,0 +1,32 @@
+#ifndef __AXE_VERIFY_H__
+
+#define __AXE_VERIFY_H__
+
+#include "code.h"
+#include "object.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace axe {
+
+// proves that the main program ins and every function in constants can
+// run without the vm checking anything it trusts:
+//
+//   - every instruction is defined and has all of its operands
+//   - jumps land on the start of an instruction that is not the entry
+//     of a table, and only the main program runs or jumps off its end
+//   - constant, global and local indices are in range, and the
+//     constants of tables have the types the vm reads them as
+//   - the stack has the same height on every path into an instruction,
+//     never has fewer values than an instruction takes and never more
+//     than max_stack values on top of the locals
+//
+// nullopt when it does, else what is wrong and where
+std::optional<std::string> verify(const instructions& ins,
+                                  const std::vector<object>& constants,
+                                  size_t num_globals, size_t max_stack);
+
+} // namespace axe
+
+#endif // __AXE_VERIFY_H__
@@ -1,28 +1,194 @@
 #include "vm.h"
+#include "base.h"
 #include "code.h"
+#include "verify.h"
+#include <algorithm>
+#include <atomic>
 #include <optional>
 
 namespace axe {
 
+// the compiler does not terminate the main program, so we append an
+// OpHalt instead of comparing the instruction pointer against the end of
+// the instructions before every dispatch
+static instructions main_instructions(const instructions& ins) {
+    instructions res;
+    res.reserve(ins.size() + 1);
+    res.insert(res.end(), ins.begin(), ins.end());
+    res.push_back(static_cast<uint8_t>(op_code::OpHalt));
+    return res;
+}
+
+// constants are pinned in the heap of the globals for as long as the vm
+// lives, so the collector never has to look at them
+static std::vector<value>
+constant_values(const std::vector<object>& constants, heap& heap) {
+    std::vector<value> res;
+    res.reserve(constants.size());
+    for (auto& constant : constants) {
+        auto val = to_value(constant, heap);
+        heap.pin(val);
+        res.push_back(val);
+    }
+    return res;
+}
+
+static std::optional<std::string>
+verify_byte_code(const byte_code& byte_code, const vm_options& options) {
+    if (!options.verify) {
+        return std::nullopt;
+    }
+    auto err = verify(byte_code.ins, byte_code.constants,
+                      byte_code.num_globals, byte_code.max_stack);
+    if (err.has_value()) {
+        return "invalid byte code, " + *err;
+    }
+    return std::nullopt;
+}
+
+static std::atomic<uint64_t> next_vm_id(1);
+
+// the decoded words of an OpJump and of an OpCase, see num_words. the
+// entries of a switch are read at these strides.
+static constexpr size_t jump_words = 2;
+static constexpr size_t case_words = 3;
+
+std::string vm_error::message() const {
+    switch (this->code) {
+    case vm_error_code::StackOverflow:
+        return "stack overflow";
+    case vm_error_code::CallingNonFunction:
+        return "calling non-function, " +
+               std::string(object_type_to_string(this->type));
+    case vm_error_code::WrongNumberOfArguments:
+        return "wrong number of arguments: want " +
+               std::to_string(this->want) + ", got " +
+               std::to_string(this->got);
+    case vm_error_code::UnsupportedNegation:
+        return "unsupported type for negation " +
+               std::string(object_type_to_string(this->type));
+    }
+    return "unknown error";
+}
+
+size_t vm_error::position() const {
+    return source_position(*this->function, this->instruction_pointer);
+}
+
+// globals are sized from the symbol table of the compiler, frames and
+// the stack are only grown once the program needs them, so constructing
+// a vm costs about as much as the program it runs
 template <>
-vm<std::vector<object>>::vm(byte_code byte_code)
-    : constants(std::move(byte_code.constants)),
-      frames(std::vector<frame>(MAX_FRAMES, frame())),
-      globals(std::vector<object>(GLOBALS_SIZE, object())), stack_pointer(0),
-      frames_index(1) {
-    auto main_fn = compiled_function(std::move(byte_code.ins), 0, 0);
-    auto main_frame = frame(main_fn, 0);
-    this->frames[0] = main_frame;
+vm<globals_owned>::vm(byte_code byte_code, vm_options options)
+    : globals(), id(next_vm_id++),
+      constants(constant_values(byte_code.constants, this->globals.heap)),
+      main_instructions(axe::main_instructions(byte_code.ins)),
+      handlers(nullptr), frames_index(0), max_frames(options.max_frames),
+      stack(options.max_stack_size), stack_pointer(0),
+      max_stack(byte_code.max_stack), error(),
+      invalid(axe::verify_byte_code(byte_code, options)), jit(),
+      jit_threshold(options.jit_threshold),
+      optimize_threshold(options.optimize_threshold),
+      background_optimization(options.background_optimization),
+      deoptimizations(0) {
+    this->globals.grow(byte_code.num_globals);
+    if (!this->invalid.has_value()) {
+        this->invalid =
+            this->load_native_module(byte_code, options.native_module);
+    }
 }
 
+template <>
+vm<globals_ref>::vm(byte_code byte_code, globals_ref globals,
+                    vm_options options)
+    : globals(globals), id(next_vm_id++),
+      constants(constant_values(byte_code.constants, this->globals.heap)),
+      main_instructions(axe::main_instructions(byte_code.ins)),
+      handlers(nullptr), frames_index(0), max_frames(options.max_frames),
+      stack(options.max_stack_size), stack_pointer(0),
+      max_stack(byte_code.max_stack), error(),
+      invalid(axe::verify_byte_code(byte_code, options)), jit(),
+      jit_threshold(options.jit_threshold),
+      optimize_threshold(options.optimize_threshold),
+      background_optimization(options.background_optimization),
+      deoptimizations(0) {
+    this->globals.grow(byte_code.num_globals);
+    if (!this->invalid.has_value()) {
+        this->invalid =
+            this->load_native_module(byte_code, options.native_module);
+    }
+}
+
+// the compiled functions of the pool are the values the program calls,
+// so their byte code identifies them once they are decoded. the machine
+// code of a module has the constants of its program baked in, a module
+// built from other byte code is refused before any of it is installed.
 template <typename GlobalsLifeTime>
-vm<GlobalsLifeTime>::vm(byte_code byte_code, GlobalsLifeTime globals)
-    : constants(std::move(byte_code.constants)),
-      frames(std::vector<frame>(MAX_FRAMES, frame())), globals(globals),
-      stack_pointer(0), frames_index(1) {
-    auto main_fn = compiled_function(std::move(byte_code.ins), 0, 0);
-    auto main_frame = frame(main_fn, 0);
-    this->frames[0] = main_frame;
+std::optional<std::string>
+vm<GlobalsLifeTime>::load_native_module(const byte_code& byte_code,
+                                        const aot_table* table) {
+    if (table == nullptr) {
+        return std::nullopt;
+    }
+    if (table->fingerprint != aot_fingerprint(byte_code)) {
+        return std::string("native module built from another program");
+    }
+    for (size_t i = 0; i < table->num_functions; ++i) {
+        auto constant = table->functions[i].constant;
+        if (constant >= this->constants.size() ||
+            this->constants[constant].get_type() != object_type::Function) {
+            return "native module entry for constant " +
+                   std::to_string(constant) + ", which is not a function";
+        }
+    }
+    this->jit_threshold = 0;
+    this->optimize_threshold = 0;
+    for (size_t i = 0; i < table->num_functions; ++i) {
+        auto& fn = table->functions[i];
+        auto& function = this->constants[fn.constant].get_function();
+        this->native_entries[&function.get_instructions()] =
+            reinterpret_cast<const void*>(fn.entry);
+    }
+    return std::nullopt;
+}
+
+template <typename GlobalsLifeTime> vm<GlobalsLifeTime>::~vm() {
+    for (auto& constant : this->constants) {
+        this->globals.heap.unpin(constant);
+    }
+}
+
+template <typename GlobalsLifeTime>
+const decoded_function&
+vm<GlobalsLifeTime>::decode_function(const instructions& ins,
+                                     size_t num_locals, size_t num_params,
+                                     size_t max_stack) {
+    auto it = this->functions.find(&ins);
+    if (it != this->functions.end()) {
+        return it->second;
+    }
+    auto res = this->functions.emplace(
+        &ins, decode(ins, num_locals, num_params, max_stack, this->handlers,
+                     this->constants, this->globals.values.data()));
+    auto native = this->native_entries.find(&ins);
+    if (native != this->native_entries.end()) {
+        res.first->second.native = native->second;
+        res.first->second.baseline = native->second;
+    }
+    return res.first->second;
+}
+
+template <typename GlobalsLifeTime>
+const decoded_function&
+vm<GlobalsLifeTime>::function_prototype(heap_function* fn) {
+    if (fn->decoded_by != this->id) {
+        auto& ins = fn->function;
+        fn->decoded = &this->decode_function(
+            ins.get_instructions(), ins.get_num_locals(),
+            ins.get_num_params(), ins.get_max_stack());
+        fn->decoded_by = this->id;
+    }
+    return *fn->decoded;
 }
 
 template <typename GlobalsLifeTime>
@@ -32,7 +198,11 @@ frame& vm<GlobalsLifeTime>::current_frame() {
 
 template <typename GlobalsLifeTime>
 void vm<GlobalsLifeTime>::push_frame(frame frame) {
-    this->frames[this->frames_index] = frame;
+    if (this->frames_index == this->frames.size()) {
+        this->frames.push_back(frame);
+    } else {
+        this->frames[this->frames_index] = frame;
+    }
     this->frames_index++;
 }
 
@@ -41,145 +211,668 @@ template <typename GlobalsLifeTime> frame& vm<GlobalsLifeTime>::pop_frame() {
     return this->frames[this->frames_index];
 }
 
+// the decoded streams belong to this vm, so it may rewrite them
+template <typename GlobalsLifeTime>
+void vm<GlobalsLifeTime>::rewrite(const code_word* word, op_code op) {
+    *const_cast<code_word*>(word) = opcode_word(op, this->handlers);
+}
+
+// turns the generic instruction at word into the form for two ints or
+// two floats when its operands are one of those
+template <typename GlobalsLifeTime>
+void vm<GlobalsLifeTime>::quicken(const code_word* word, value lhs, value rhs,
+                                  op_code int_op, op_code float_op) {
+    if (lhs.is_small_int() && rhs.is_small_int()) {
+        this->rewrite(word, int_op);
+    } else if (lhs.is_double() && rhs.is_double()) {
+        this->rewrite(word, float_op);
+    }
+}
+
+// puts the generic instruction back at word and returns where to
+// continue, which is that instruction
+template <typename GlobalsLifeTime>
+const code_word* vm<GlobalsLifeTime>::deoptimize(const code_word* word,
+                                                 op_code op) {
+    this->rewrite(word, op);
+    return word;
+}
+
+// replaces the top of the stack with the result of int arithmetic, only
+// results that do not fit in a value allocate
+template <typename GlobalsLifeTime>
+void vm<GlobalsLifeTime>::set_top_int(int64_t i) {
+    if (value::fits_small_int(i)) {
+        this->stack[this->stack_pointer - 1] = value::from_small_int(i);
+        return;
+    }
+    this->stack[this->stack_pointer - 1] = this->globals.heap.make_int(i);
+    this->maybe_collect_garbage();
+}
+
+#ifdef AXE_COMPUTED_GOTO
+#define VM_CASE(op) op_##op:
+#define VM_DISPATCH() goto*(ip++)->handler
+#else
+#define VM_CASE(op) case op_code::op:
+#define VM_DISPATCH() continue
+#endif
+
+// picks up the current frame after a call or a return switched frames.
+// a native frame runs until it gets back to an interpreted one.
+#define VM_ENTER_FRAME()                                                       \
+    active_frame = &this->current_frame();                                     \
+    if (active_frame->native != nullptr) {                                     \
+        if (!this->run_native()) {                                             \
+            return this->error.message();                                      \
+        }                                                                      \
+        active_frame = &this->current_frame();                                 \
+    }                                                                          \
+    ip = active_frame->instruction_pointer
+
+#ifdef AXE_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
 template <typename GlobalsLifeTime>
 std::optional<std::string> vm<GlobalsLifeTime>::run() {
-    std::optional<std::string> err = std::nullopt;
-    while (this->current_frame().instruction_pointer <
-           static_cast<ssize_t>(
-               this->current_frame().get_instructions().size() - 1)) {
-        this->current_frame().instruction_pointer++;
-        size_t instruction_pointer = this->current_frame().instruction_pointer;
-        auto& ins = this->current_frame().get_instructions();
-        op_code op = static_cast<op_code>(ins[instruction_pointer]);
-        switch (op) {
-        case op_code::OpConstant: {
-            uint16_t const_index = read_u16(ins, instruction_pointer + 1);
-            err = this->push(this->constants[const_index]);
-            if (err.has_value()) {
-                return err;
+#ifdef AXE_COMPUTED_GOTO
+    // must stay in the same order as op_code
+    static const void* const dispatch_table[] = {
+        &&op_OpConstant,                 &&op_OpAdd,
+        &&op_OpPop,                      &&op_OpSub,
+        &&op_OpMul,                      &&op_OpDiv,
+        &&op_OpTrue,                     &&op_OpFalse,
+        &&op_OpEq,                       &&op_OpNotEq,
+        &&op_OpGreaterThan,              &&op_OpMinus,
+        &&op_OpBang,                     &&op_OpJumpNotTruthy,
+        &&op_OpJump,                     &&op_OpNull,
+        &&op_OpGetGlobal,                &&op_OpSetGlobal,
+        &&op_OpCall,                     &&op_OpReturnValue,
+        &&op_OpReturn,                   &&op_OpGetLocal,
+        &&op_OpSetLocal,                 &&op_OpHalt,
+        &&op_OpGetLocalGetLocal,         &&op_OpGetLocalConstant,
+        &&op_OpAddLocalConstant,         &&op_OpSubLocalConstant,
+        &&op_OpGreaterThanJumpNotTruthy, &&op_OpEqJumpNotTruthy,
+        &&op_OpTailCall,                 &&op_OpAddInt,
+        &&op_OpAddFloat,                 &&op_OpSubInt,
+        &&op_OpSubFloat,                 &&op_OpGreaterThanInt,
+        &&op_OpGreaterThanFloat,         &&op_OpEqInt,
+        &&op_OpEqFloat,                  &&op_OpJumpTruthy,
+        &&op_OpJumpTable,                &&op_OpSwitch,
+        &&op_OpCase,
+    };
+    static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) ==
+                      static_cast<size_t>(op_code::OpCase) + 1,
+                  "dispatch table out of sync with op_code");
+#endif
+
+#ifdef AXE_COMPUTED_GOTO
+    this->handlers = dispatch_table;
+#endif
+    if (this->invalid.has_value()) {
+        return this->invalid;
+    }
+    if (this->frames_index == 0) {
+        auto& main_fn = this->decode_function(this->main_instructions, 0, 0,
+                                              this->max_stack);
+        if (!this->reserve_frame(0, main_fn)) {
+            this->error.function = &main_fn;
+            this->error.instruction_pointer = main_fn.code.data();
+            return this->error.message();
+        }
+        this->push_frame({&main_fn, main_fn.code.data(), 0, nullptr});
+    }
+
+    // the hot state lives in locals, it is only written back to the
+    // frame when we switch frames or stop running
+    frame* active_frame = &this->current_frame();
+    const code_word* ip = active_frame->instruction_pointer;
+
+#ifdef AXE_COMPUTED_GOTO
+    VM_DISPATCH();
+#else
+    while (true) {
+        switch ((ip++)->op) {
+#endif
+
+    VM_CASE(OpConstant) {
+        this->push(*(ip++)->constant);
+        VM_DISPATCH();
+    }
+    VM_CASE(OpAdd) {
+        auto rhs = this->pop();
+        auto lhs = this->pop();
+        this->quicken(ip - 1, lhs, rhs, op_code::OpAddInt, op_code::OpAddFloat);
+        this->push(add(lhs, rhs, this->globals.heap));
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpPop) {
+        this->pop();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpSub) {
+        auto rhs = this->pop();
+        auto lhs = this->pop();
+        this->quicken(ip - 1, lhs, rhs, op_code::OpSubInt, op_code::OpSubFloat);
+        this->push(sub(lhs, rhs, this->globals.heap));
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpMul) {
+        auto rhs = this->pop();
+        auto lhs = this->pop();
+        this->push(mul(lhs, rhs, this->globals.heap));
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpDiv) {
+        auto rhs = this->pop();
+        auto lhs = this->pop();
+        this->push(div(lhs, rhs, this->globals.heap));
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpTrue) {
+        this->push(value::from_bool(true));
+        VM_DISPATCH();
+    }
+    VM_CASE(OpFalse) {
+        this->push(value::from_bool(false));
+        VM_DISPATCH();
+    }
+    VM_CASE(OpEq) {
+        auto rhs = this->pop();
+        auto lhs = this->pop();
+        this->quicken(ip - 1, lhs, rhs, op_code::OpEqInt, op_code::OpEqFloat);
+        this->push(value::from_bool(equals(lhs, rhs)));
+        VM_DISPATCH();
+    }
+    VM_CASE(OpNotEq) {
+        auto rhs = this->pop();
+        auto lhs = this->pop();
+        this->push(value::from_bool(!equals(lhs, rhs)));
+        VM_DISPATCH();
+    }
+    VM_CASE(OpGreaterThan) {
+        auto rhs = this->pop();
+        auto lhs = this->pop();
+        this->quicken(ip - 1, lhs, rhs, op_code::OpGreaterThanInt,
+                      op_code::OpGreaterThanFloat);
+        this->push(value::from_bool(greater_than(lhs, rhs)));
+        VM_DISPATCH();
+    }
+    VM_CASE(OpMinus) {
+        auto rhs = this->pop();
+        auto type = rhs.get_type();
+        if (type != object_type::Integer && type != object_type::Float) {
+            this->error.code = vm_error_code::UnsupportedNegation;
+            this->error.type = type;
+            goto error;
+        }
+        this->push(negate(rhs, this->globals.heap));
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpBang) {
+        auto rhs = this->pop();
+        this->push(value::from_bool(!is_truthy(rhs)));
+        VM_DISPATCH();
+    }
+    VM_CASE(OpJumpNotTruthy) {
+        const code_word* target = (ip++)->target;
+        auto condition = this->pop();
+        if (!is_truthy(condition)) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(OpJumpTruthy) {
+        const code_word* target = (ip++)->target;
+        auto condition = this->pop();
+        if (is_truthy(condition)) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(OpJump) {
+        ip = ip->target;
+        VM_DISPATCH();
+    }
+    // a value that matches no case falls through to the jump to the
+    // default
+    VM_CASE(OpJumpTable) {
+        int64_t low = (ip++)->constant->get_int();
+        size_t count = (ip++)->operand;
+        auto subject = this->pop();
+        if (subject.get_type() == object_type::Integer) {
+            uint64_t index = static_cast<uint64_t>(subject.get_int()) -
+                             static_cast<uint64_t>(low);
+            if (index < count) {
+                // the target of the jump past the default one
+                ip = ip[(index + 1) * jump_words + 1].target;
             }
-            this->current_frame().instruction_pointer += 2;
-        } break;
-        case op_code::OpAdd: {
-            auto& rhs = this->pop();
-            auto& lhs = this->pop();
-            err = this->push(lhs + rhs);
-        } break;
-        case op_code::OpPop:
-            this->pop();
-            break;
-        case op_code::OpSub: {
-            auto& rhs = this->pop();
-            auto& lhs = this->pop();
-            err = this->push(lhs - rhs);
-        } break;
-        case op_code::OpMul: {
-            auto& rhs = this->pop();
-            auto& lhs = this->pop();
-            err = this->push(lhs * rhs);
-        } break;
-        case op_code::OpDiv: {
-            auto& rhs = this->pop();
-            auto& lhs = this->pop();
-            err = this->push(lhs / rhs);
-        } break;
-        case op_code::OpTrue:
-            err = this->push(object(object_type::Bool, true));
-            break;
-        case op_code::OpFalse:
-            err = this->push(object(object_type::Bool, false));
-            break;
-        case op_code::OpEq: {
-            auto& rhs = this->pop();
-            auto& lhs = this->pop();
-            err = this->push(object(object_type::Bool, lhs == rhs));
-        } break;
-        case op_code::OpNotEq: {
-            auto& rhs = this->pop();
-            auto& lhs = this->pop();
-            err = this->push(object(object_type::Bool, lhs != rhs));
-        } break;
-        case op_code::OpGreaterThan: {
-            auto& rhs = this->pop();
-            auto& lhs = this->pop();
-            err = this->push(object(object_type::Bool, lhs > rhs));
-        } break;
-        case op_code::OpBang: {
-            auto& rhs = this->pop();
-            err = this->push(object(object_type::Bool, !rhs.is_truthy()));
-        } break;
-        case op_code::OpMinus: {
-            auto& rhs = this->pop();
-            if (rhs.get_type() == object_type::Integer) {
-                err = this->push(object(object_type::Integer, -rhs.get_int()));
-            } else if (rhs.get_type() == object_type::Float) {
-                err = this->push(object(object_type::Float, -rhs.get_float()));
-            } else {
-                err = "unsupported type for negation " +
-                      std::string(rhs.type_to_string());
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(OpSwitch) {
+        size_t count = (ip++)->operand;
+        const string_switch* table = (ip++)->table;
+        const code_word* cases = ip + jump_words;
+        auto subject = this->pop();
+        auto type = subject.get_type();
+        if (table != nullptr) {
+            if (type == object_type::String) {
+                auto it = table->find(subject.get_string());
+                if (it != table->end()) {
+                    ip = it->second;
+                }
             }
-        } break;
-        case op_code::OpJump: {
-            size_t position =
-                static_cast<size_t>(read_u16(ins, instruction_pointer + 1));
-            this->current_frame().instruction_pointer = position - 1;
-        } break;
-        case op_code::OpJumpNotTruthy: {
-            size_t position =
-                static_cast<size_t>(read_u16(ins, instruction_pointer + 1));
-            this->current_frame().instruction_pointer += 2;
-            auto& condition = this->pop();
-            if (!condition.is_truthy()) {
-                this->current_frame().instruction_pointer = position - 1;
+        } else if (type == object_type::Integer) {
+            int64_t key = subject.get_int();
+            size_t lo = 0;
+            size_t hi = count;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                auto entry = cases + mid * case_words;
+                int64_t found = entry[1].constant->get_int();
+                if (found == key) {
+                    ip = entry[2].target;
+                    break;
+                }
+                if (found < key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
             }
-        } break;
-        case op_code::OpNull:
-            err = this->push(object());
-            break;
-        case op_code::OpSetGlobal: {
-            size_t global_index =
-                static_cast<size_t>(read_u16(ins, instruction_pointer + 1));
-            this->current_frame().instruction_pointer += 2;
-            this->globals[global_index] = this->pop();
-        } break;
-        case op_code::OpGetGlobal: {
-            size_t global_index =
-                static_cast<size_t>(read_u16(ins, instruction_pointer + 1));
-            this->current_frame().instruction_pointer += 2;
-            err = this->push(this->globals[global_index]);
-        } break;
-        case op_code::OpCall: {
-            size_t num_args = ins[instruction_pointer + 1];
-            this->current_frame().instruction_pointer++;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(OpCase) {
+        // only read by OpSwitch
+        AXE_UNREACHABLE;
+        VM_DISPATCH();
+    }
+    VM_CASE(OpNull) {
+        this->push(value());
+        VM_DISPATCH();
+    }
+    VM_CASE(OpGetGlobal) {
+        this->push(*(ip++)->global);
+        VM_DISPATCH();
+    }
+    VM_CASE(OpSetGlobal) {
+        *(ip++)->global = this->pop();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpCall) {
+        size_t num_args = (ip++)->operand;
+        call_cache* cache = (ip++)->cache;
+        active_frame->instruction_pointer = ip;
+        const decoded_function* fn;
+        if (!this->cached_prototype(num_args, cache, fn) ||
+            !this->call_function(num_args, *fn)) {
+            goto error;
+        }
+        VM_ENTER_FRAME();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpTailCall) {
+        size_t num_args = (ip++)->operand;
+        call_cache* cache = (ip++)->cache;
+        const decoded_function* fn;
+        if (!this->cached_prototype(num_args, cache, fn) ||
+            !this->tail_call_function(num_args, *fn)) {
+            goto error;
+        }
+        VM_ENTER_FRAME();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpReturnValue) {
+        auto return_value = this->pop();
+        auto& frame = this->pop_frame();
+        this->stack_pointer = frame.base_pointer - 1;
+        this->push(return_value);
+        VM_ENTER_FRAME();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpReturn) {
+        auto& frame = this->pop_frame();
+        this->stack_pointer = frame.base_pointer - 1;
+        this->push(value());
+        VM_ENTER_FRAME();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpGetLocal) {
+        size_t local_index = (ip++)->operand;
+        this->push(this->stack[active_frame->base_pointer + local_index]);
+        VM_DISPATCH();
+    }
+    VM_CASE(OpSetLocal) {
+        size_t local_index = (ip++)->operand;
+        this->stack[active_frame->base_pointer + local_index] = this->pop();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpHalt) {
+        // leave the instruction pointer on the halt so running again
+        // is a no-op
+        active_frame->instruction_pointer = ip - 1;
+        return std::nullopt;
+    }
+    VM_CASE(OpGetLocalGetLocal) {
+        size_t base_pointer = active_frame->base_pointer;
+        this->push(this->stack[base_pointer + (ip++)->operand]);
+        this->push(this->stack[base_pointer + (ip++)->operand]);
+        VM_DISPATCH();
+    }
+    VM_CASE(OpGetLocalConstant) {
+        size_t local_index = (ip++)->operand;
+        this->push(this->stack[active_frame->base_pointer + local_index]);
+        this->push(*(ip++)->constant);
+        VM_DISPATCH();
+    }
+    VM_CASE(OpAddLocalConstant) {
+        size_t local_index = (ip++)->operand;
+        auto lhs = this->stack[active_frame->base_pointer + local_index];
+        this->push(add(lhs, *(ip++)->constant, this->globals.heap));
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpSubLocalConstant) {
+        size_t local_index = (ip++)->operand;
+        auto lhs = this->stack[active_frame->base_pointer + local_index];
+        this->push(sub(lhs, *(ip++)->constant, this->globals.heap));
+        this->maybe_collect_garbage();
+        VM_DISPATCH();
+    }
+    VM_CASE(OpGreaterThanJumpNotTruthy) {
+        const code_word* target = (ip++)->target;
+        auto rhs = this->pop();
+        auto lhs = this->pop();
+        if (!greater_than(lhs, rhs)) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(OpEqJumpNotTruthy) {
+        const code_word* target = (ip++)->target;
+        auto rhs = this->pop();
+        auto lhs = this->pop();
+        if (!equals(lhs, rhs)) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    // the quickened handlers look at their operands before popping
+    // them, so when the types do not match they can put the generic
+    // instruction back and run it instead
+    VM_CASE(OpAddInt) {
+        auto rhs = this->stack[this->stack_pointer - 1];
+        auto lhs = this->stack[this->stack_pointer - 2];
+        if (!lhs.is_small_int() || !rhs.is_small_int()) {
+            ip = this->deoptimize(ip - 1, op_code::OpAdd);
+            VM_DISPATCH();
+        }
+        this->stack_pointer--;
+        this->set_top_int(lhs.as_small_int() + rhs.as_small_int());
+        VM_DISPATCH();
+    }
+    VM_CASE(OpAddFloat) {
+        auto rhs = this->stack[this->stack_pointer - 1];
+        auto lhs = this->stack[this->stack_pointer - 2];
+        if (!lhs.is_double() || !rhs.is_double()) {
+            ip = this->deoptimize(ip - 1, op_code::OpAdd);
+            VM_DISPATCH();
+        }
+        this->stack_pointer--;
+        this->stack[this->stack_pointer - 1] =
+            value::from_double(lhs.as_double() + rhs.as_double());
+        VM_DISPATCH();
+    }
+    VM_CASE(OpSubInt) {
+        auto rhs = this->stack[this->stack_pointer - 1];
+        auto lhs = this->stack[this->stack_pointer - 2];
+        if (!lhs.is_small_int() || !rhs.is_small_int()) {
+            ip = this->deoptimize(ip - 1, op_code::OpSub);
+            VM_DISPATCH();
+        }
+        this->stack_pointer--;
+        this->set_top_int(lhs.as_small_int() - rhs.as_small_int());
+        VM_DISPATCH();
+    }
+    VM_CASE(OpSubFloat) {
+        auto rhs = this->stack[this->stack_pointer - 1];
+        auto lhs = this->stack[this->stack_pointer - 2];
+        if (!lhs.is_double() || !rhs.is_double()) {
+            ip = this->deoptimize(ip - 1, op_code::OpSub);
+            VM_DISPATCH();
+        }
+        this->stack_pointer--;
+        this->stack[this->stack_pointer - 1] =
+            value::from_double(lhs.as_double() - rhs.as_double());
+        VM_DISPATCH();
+    }
+    VM_CASE(OpGreaterThanInt) {
+        auto rhs = this->stack[this->stack_pointer - 1];
+        auto lhs = this->stack[this->stack_pointer - 2];
+        if (!lhs.is_small_int() || !rhs.is_small_int()) {
+            ip = this->deoptimize(ip - 1, op_code::OpGreaterThan);
+            VM_DISPATCH();
+        }
+        this->stack_pointer--;
+        this->stack[this->stack_pointer - 1] =
+            value::from_bool(lhs.as_small_int() > rhs.as_small_int());
+        VM_DISPATCH();
+    }
+    VM_CASE(OpGreaterThanFloat) {
+        auto rhs = this->stack[this->stack_pointer - 1];
+        auto lhs = this->stack[this->stack_pointer - 2];
+        if (!lhs.is_double() || !rhs.is_double()) {
+            ip = this->deoptimize(ip - 1, op_code::OpGreaterThan);
+            VM_DISPATCH();
+        }
+        this->stack_pointer--;
+        this->stack[this->stack_pointer - 1] =
+            value::from_bool(lhs.as_double() > rhs.as_double());
+        VM_DISPATCH();
+    }
+    VM_CASE(OpEqInt) {
+        auto rhs = this->stack[this->stack_pointer - 1];
+        auto lhs = this->stack[this->stack_pointer - 2];
+        if (!lhs.is_small_int() || !rhs.is_small_int()) {
+            ip = this->deoptimize(ip - 1, op_code::OpEq);
+            VM_DISPATCH();
+        }
+        this->stack_pointer--;
+        this->stack[this->stack_pointer - 1] =
+            value::from_bool(lhs.get_bits() == rhs.get_bits());
+        VM_DISPATCH();
+    }
+    VM_CASE(OpEqFloat) {
+        auto rhs = this->stack[this->stack_pointer - 1];
+        auto lhs = this->stack[this->stack_pointer - 2];
+        if (!lhs.is_double() || !rhs.is_double()) {
+            ip = this->deoptimize(ip - 1, op_code::OpEq);
+            VM_DISPATCH();
+        }
+        this->stack_pointer--;
+        this->stack[this->stack_pointer - 1] =
+            value::from_bool(lhs.as_double() == rhs.as_double());
+        VM_DISPATCH();
+    }
 
-            err = this->call_function(num_args);
-        } break;
-        case op_code::OpReturnValue: {
+#ifndef AXE_COMPUTED_GOTO
+        }
+    }
+#endif
+
+error:
+    // every handler that fails has moved ip past its opcode
+    this->error.function = active_frame->function;
+    this->error.instruction_pointer = ip - 1;
+    return this->error.message();
+}
+
+#ifdef AXE_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+#undef VM_CASE
+#undef VM_DISPATCH
+#undef VM_ENTER_FRAME
+
+// native code exits to here for every call and return, the frames are
+// pushed and popped the same way as for interpreted code
+template <typename GlobalsLifeTime> bool vm<GlobalsLifeTime>::run_native() {
+    jit_context ctx;
+    ctx.heap = &this->globals.heap;
+    ctx.collect = &vm::jit_collect;
+    ctx.vm = this;
+    while (true) {
+        auto& frame = this->current_frame();
+        if (frame.native == nullptr) {
+            return true;
+        }
+        ctx.locals = this->stack.data() + frame.base_pointer;
+        ctx.code = frame.function->code.data();
+        ctx.stack_pointer = this->stack.data() + this->stack_pointer;
+        auto entry =
+            reinterpret_cast<jit_entry>(const_cast<void*>(frame.native));
+        auto exit = entry(&ctx);
+        this->stack_pointer = ctx.stack_pointer - this->stack.data();
+        const decoded_function* fn;
+        switch (exit) {
+        case jit_exit::Return: {
             auto return_value = this->pop();
-            auto& frame = this->pop_frame();
-            this->stack_pointer = frame.base_pointer - 1;
-            err = this->push(return_value);
-        } break;
-        case op_code::OpReturn: {
-            auto& frame = this->pop_frame();
+            this->pop_frame();
             this->stack_pointer = frame.base_pointer - 1;
-            err = this->push(object());
-        } break;
-        case op_code::OpSetLocal: {
-            size_t local_index = ins[instruction_pointer + 1];
-            this->current_frame().instruction_pointer += 1;
-            auto& frame = this->current_frame();
-            this->stack[frame.base_pointer + local_index] = this->pop();
-        } break;
-        case op_code::OpGetLocal: {
-            size_t local_index = ins[instruction_pointer + 1];
-            this->current_frame().instruction_pointer += 1;
-            auto& frame = this->current_frame();
-            err = this->push(this->stack[frame.base_pointer + local_index]);
+            this->push(return_value);
         } break;
+        case jit_exit::Call:
+            frame.native = ctx.resume;
+            if (!this->cached_prototype(ctx.num_args, ctx.cache, fn) ||
+                !this->call_function(ctx.num_args, *fn)) {
+                goto error;
+            }
+            break;
+        case jit_exit::TailCall:
+            if (!this->cached_prototype(ctx.num_args, ctx.cache, fn) ||
+                !this->tail_call_function(ctx.num_args, *fn)) {
+                goto error;
+            }
+            break;
+        case jit_exit::UnsupportedNegation:
+            this->error.code = vm_error_code::UnsupportedNegation;
+            this->error.type = ctx.error_type;
+            goto error;
+        case jit_exit::Deoptimize:
+            this->deoptimize_frame(frame, ctx.site);
+            break;
+        }
+    }
+
+error:
+    this->error.function = this->current_frame().function;
+    this->error.instruction_pointer = ctx.site;
+    return false;
+}
+
+template <typename GlobalsLifeTime>
+void vm<GlobalsLifeTime>::jit_collect(jit_context* ctx) {
+    auto self = static_cast<vm*>(ctx->vm);
+    self->stack_pointer = ctx->stack_pointer - self->stack.data();
+    self->collect_garbage();
+}
+
+// the interpreter takes over where the guard failed. the frame stays
+// interpreted until it returns, the next call runs the optimized code
+// again unless it failed too often.
+template <typename GlobalsLifeTime>
+void vm<GlobalsLifeTime>::deoptimize_frame(frame& frame,
+                                           const code_word* site) {
+    this->deoptimizations++;
+    frame.native = nullptr;
+    frame.instruction_pointer = site;
+    auto& fn = const_cast<decoded_function&>(*frame.function);
+    fn.deopts++;
+    if (fn.deopts == MAX_DEOPTIMIZATIONS) {
+        fn.native = fn.baseline;
+    }
+}
+
+// the prototypes belong to this vm, so like rewrite it may change them.
+// there are no loops in the language, every hot path is a call, so the
+// calls of a function are all the hotness there is to count.
+template <typename GlobalsLifeTime>
+void vm<GlobalsLifeTime>::count_call(const decoded_function& fn) {
+    if (this->jit_threshold == 0 && this->optimize_threshold == 0) {
+        return;
+    }
+    if (this->jit.has_optimized()) {
+        this->install_optimized();
+    }
+    auto& counted = const_cast<decoded_function&>(fn);
+    counted.calls++;
+    if (counted.calls == this->jit_threshold) {
+        counted.baseline = this->jit.compile(fn);
+        counted.native = counted.baseline;
+    }
+    if (counted.calls == this->optimize_threshold) {
+        if (this->background_optimization) {
+            this->jit.optimize_in_background(fn, this->feedback(fn));
+        } else if (auto code = this->jit.optimize(fn, this->feedback(fn))) {
+            counted.native = code;
+        }
+    }
+}
+
+template <typename GlobalsLifeTime>
+void vm<GlobalsLifeTime>::install_optimized() {
+    for (auto& [fn, code] : this->jit.take_optimized()) {
+        const_cast<decoded_function*>(fn)->native = code;
+    }
+}
+
+// what the quickened instructions of fn saw so far. it is read here,
+// the background thread must not look at words the vm rewrites.
+template <typename GlobalsLifeTime>
+std::vector<type_feedback>
+vm<GlobalsLifeTime>::feedback(const decoded_function& fn) {
+    struct quickened {
+        op_code op;
+        type_feedback type;
+    };
+    static const quickened forms[] = {
+        {op_code::OpAddInt, type_feedback::Int},
+        {op_code::OpAddFloat, type_feedback::Float},
+        {op_code::OpSubInt, type_feedback::Int},
+        {op_code::OpSubFloat, type_feedback::Float},
+        {op_code::OpGreaterThanInt, type_feedback::Int},
+        {op_code::OpGreaterThanFloat, type_feedback::Float},
+        {op_code::OpEqInt, type_feedback::Int},
+        {op_code::OpEqFloat, type_feedback::Float},
+    };
+    std::vector<type_feedback> res(fn.code.size(), type_feedback::None);
+    auto& ins = *fn.source;
+    size_t word = 0;
+    for (size_t i = 0; i < ins.size();) {
+        op_code op = static_cast<op_code>(ins[i]);
+        for (auto& form : forms) {
+            auto quickened = opcode_word(form.op, this->handlers);
+            bool same = this->handlers != nullptr
+                            ? fn.code[word].handler == quickened.handler
+                            : fn.code[word].op == quickened.op;
+            if (same) {
+                res[word] = form.type;
+            }
         }
+        i += instruction_width(op);
+        word += num_words(op);
     }
-    return err;
+    return res;
 }
 
 template <typename GlobalsLifeTime>
@@ -187,49 +880,189 @@ std::optional<const object> vm<GlobalsLifeTime>::stack_top() {
     if (this->stack_pointer == 0) {
         return std::nullopt;
     }
-    return this->stack[this->stack_pointer - 1];
+    return to_object(this->stack[this->stack_pointer - 1]);
 }
 
 template <typename GlobalsLifeTime>
-const object& vm<GlobalsLifeTime>::last_popped_stack_element() {
-    return this->stack[this->stack_pointer];
+object vm<GlobalsLifeTime>::last_popped_stack_element() {
+    if (this->stack_pointer >= this->stack.capacity()) {
+        return object();
+    }
+    return to_object(this->stack[this->stack_pointer]);
 }
 
 template <typename GlobalsLifeTime>
-std::optional<std::string> vm<GlobalsLifeTime>::push(const object& obj) {
-    if (this->stack_pointer >= STACK_SIZE) {
-        return "stack overflow";
+const vm_error& vm<GlobalsLifeTime>::get_error() const {
+    return this->error;
+}
+
+template <typename GlobalsLifeTime>
+call_cache_stats vm<GlobalsLifeTime>::get_call_cache_stats() const {
+    call_cache_stats stats = {0, 0};
+    for (auto& [ins, fn] : this->functions) {
+        for (auto& cache : fn.caches) {
+            stats.hits += cache.hits;
+            stats.misses += cache.misses;
+        }
     }
-    this->stack[this->stack_pointer] = obj;
+    return stats;
+}
+
+template <typename GlobalsLifeTime>
+jit_stats vm<GlobalsLifeTime>::get_jit_stats() const {
+    return {this->jit.num_compiled(), this->jit.num_optimized(),
+            this->deoptimizations, this->native_entries.size()};
+}
+
+template <typename GlobalsLifeTime> void vm<GlobalsLifeTime>::push(value val) {
+    this->stack[this->stack_pointer] = val;
     this->stack_pointer++;
-    return std::nullopt;
 }
 
-template <typename GlobalsLifeTime> const object& vm<GlobalsLifeTime>::pop() {
-    auto& res = this->stack[this->stack_pointer - 1];
+template <typename GlobalsLifeTime> value vm<GlobalsLifeTime>::pop() {
     this->stack_pointer--;
-    return res;
+    return this->stack[this->stack_pointer];
+}
+
+template <typename GlobalsLifeTime>
+void vm<GlobalsLifeTime>::maybe_collect_garbage() {
+    if (this->globals.heap.should_collect()) {
+        this->collect_garbage();
+    }
 }
 
+// the roots are the live part of the stack, the slot right above it
+// that holds the last popped value, and the globals. constants are
+// pinned.
 template <typename GlobalsLifeTime>
-std::optional<std::string> vm<GlobalsLifeTime>::call_function(size_t num_args) {
-    auto& fn_obj = this->stack[this->stack_pointer - 1 - num_args];
+void vm<GlobalsLifeTime>::collect_garbage() {
+    auto& heap = this->globals.heap;
+    size_t stack_end = this->stack_pointer + 1;
+    if (stack_end > this->stack.capacity()) {
+        stack_end = this->stack.capacity();
+    }
+    heap.mark(this->stack.data(), this->stack.data() + stack_end);
+    heap.mark(this->globals.values.data(),
+              this->globals.values.data() + this->globals.values.size());
+    // a cached callee must stay alive, otherwise a new object could end
+    // up at its address and hit in the cache
+    for (auto& [ins, fn] : this->functions) {
+        for (auto& cache : fn.caches) {
+            if (cache.prototype != nullptr) {
+                heap.mark(cache.callee);
+            }
+        }
+    }
+    heap.sweep();
+}
+
+// the callee sits below its num_args arguments on top of the stack
+template <typename GlobalsLifeTime>
+bool vm<GlobalsLifeTime>::callee_prototype(size_t num_args,
+                                           const decoded_function*& fn) {
+    auto fn_obj = this->stack[this->stack_pointer - 1 - num_args];
     if (fn_obj.get_type() != object_type::Function) {
-        return "calling non-function, " + std::string(fn_obj.type_to_string());
+        this->error.code = vm_error_code::CallingNonFunction;
+        this->error.type = fn_obj.get_type();
+        return false;
     }
-    auto& fn = fn_obj.get_function();
-    if (fn.get_num_params() != num_args) {
-        return "wrong number of arguments: want " +
-               std::to_string(fn.get_num_params()) + ", got " +
-               std::to_string(num_args);
+    fn = &this->function_prototype(
+        static_cast<heap_function*>(fn_obj.as_heap_object()));
+    if (fn->num_params != num_args) {
+        this->error.code = vm_error_code::WrongNumberOfArguments;
+        this->error.want = fn->num_params;
+        this->error.got = num_args;
+        return false;
     }
-    frame frame(fn, this->stack_pointer - num_args);
-    this->push_frame(frame);
-    this->stack_pointer = frame.base_pointer + fn.get_num_locals();
-    return std::nullopt;
+    return true;
+}
+
+// the locals a call has not set yet and the slot above them still hold
+// values of earlier frames, which may have been collected since. they
+// are cleared so the collector only ever sees live values.
+template <typename GlobalsLifeTime>
+void vm<GlobalsLifeTime>::clear_locals(size_t begin) {
+    value* stack = this->stack.data();
+    std::fill(stack + begin, stack + this->stack_pointer + 1, value());
+}
+
+// the one stack check of a call, it covers the locals of fn,
+// everything fn pushes on top of them and the slot above that the
+// collector looks at
+template <typename GlobalsLifeTime>
+bool vm<GlobalsLifeTime>::reserve_frame(size_t base_pointer,
+                                        const decoded_function& fn) {
+    size_t size = base_pointer + fn.num_locals + fn.max_stack + 1;
+    if (!this->stack.reserve(size)) {
+        this->error.code = vm_error_code::StackOverflow;
+        return false;
+    }
+    return true;
+}
+
+// a site calls the function it called last time, so its cache only
+// has to compare the callee. the arity check holds as long as the
+// callee does, the number of arguments of a site never changes.
+template <typename GlobalsLifeTime>
+bool vm<GlobalsLifeTime>::cached_prototype(size_t num_args, call_cache* cache,
+                                           const decoded_function*& fn) {
+    auto callee = this->stack[this->stack_pointer - 1 - num_args];
+    if (callee.get_bits() == cache->callee.get_bits()) {
+        cache->hits++;
+        fn = cache->prototype;
+        return true;
+    }
+    cache->misses++;
+    if (!this->callee_prototype(num_args, fn)) {
+        return false;
+    }
+    cache->callee = callee;
+    cache->prototype = fn;
+    return true;
+}
+
+template <typename GlobalsLifeTime>
+bool vm<GlobalsLifeTime>::call_function(size_t num_args,
+                                        const decoded_function& fn) {
+    if (this->frames_index >= this->max_frames) {
+        this->error.code = vm_error_code::StackOverflow;
+        return false;
+    }
+    size_t base_pointer = this->stack_pointer - num_args;
+    if (!this->reserve_frame(base_pointer, fn)) {
+        return false;
+    }
+    this->count_call(fn);
+    this->push_frame({&fn, fn.code.data(), base_pointer, fn.native});
+    this->stack_pointer = base_pointer + fn.num_locals;
+    this->clear_locals(base_pointer + num_args);
+    return true;
+}
+
+// moves the callee and its arguments over the ones of the current frame
+// and restarts the frame with the callee, the caller of the current
+// frame gets the result
+template <typename GlobalsLifeTime>
+bool vm<GlobalsLifeTime>::tail_call_function(size_t num_args,
+                                             const decoded_function& fn) {
+    auto& frame = this->current_frame();
+    if (!this->reserve_frame(frame.base_pointer, fn)) {
+        return false;
+    }
+    value* stack = this->stack.data();
+    size_t callee = this->stack_pointer - 1 - num_args;
+    std::copy(stack + callee, stack + this->stack_pointer,
+              stack + frame.base_pointer - 1);
+    this->count_call(fn);
+    frame.function = &fn;
+    frame.instruction_pointer = fn.code.data();
+    frame.native = fn.native;
+    this->stack_pointer = frame.base_pointer + fn.num_locals;
+    this->clear_locals(frame.base_pointer + num_args);
+    return true;
 }
 
-template class vm<std::vector<object>>;
-template class vm<std::vector<object>&>;
+template class vm<globals_owned>;
+template class vm<globals_ref>;
 
 } // namespace axe
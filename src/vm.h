@@ -2,46 +2,203 @@
 
 #define __AXE_VM_H__
 
+#include "aot.h"
 #include "code.h"
 #include "compiler.h"
+#include "decode.h"
 #include "frame.h"
+#include "jit.h"
 #include "object.h"
+#include "value.h"
+#include <unordered_map>
 #include <vector>
 
-#define STACK_SIZE 2048
+#define MAX_STACK_SIZE (1 << 20)
 #define GLOBALS_SIZE 65536
-#define MAX_FRAMES 1024
+#define MAX_FRAMES (1 << 16)
+// optimized code that deoptimizes this often is replaced by the
+// baseline code for good
+#define MAX_DEOPTIMIZATIONS 16
+
+// computed goto (labels as values) is a GNU extension. when it is
+// available every handler jumps straight to the next handler through
+// its own indirect branch, otherwise we fall back to a portable switch.
+// define AXE_NO_COMPUTED_GOTO to force the switch loop.
+#if defined(__GNUC__) && !defined(AXE_NO_COMPUTED_GOTO)
+#define AXE_COMPUTED_GOTO
+#endif
 
 namespace axe {
 
+struct vm_options {
+    // hard limits. the stack and the frames start small and only grow
+    // towards these when a program needs them.
+    size_t max_stack_size = MAX_STACK_SIZE;
+    size_t max_frames = MAX_FRAMES;
+    // a function is compiled to machine code on its jit_threshold-th
+    // call and optimized on its optimize_threshold-th call, 0 never
+    // does. the optimizer specializes on the types the interpreter saw,
+    // so it wants a higher threshold than the baseline. only the stack
+    // vm has a jit.
+    uint64_t jit_threshold = 0;
+    uint64_t optimize_threshold = 0;
+    // optimize on a background thread while the function keeps running
+    // in its current tier
+    bool background_optimization = true;
+    // the machine code axec built for the program ahead of time, see
+    // native_module. it must come from the same byte code, run fails
+    // when it does not. functions it has run natively from their first
+    // call and nothing is jitted.
+    const aot_table* native_module = nullptr;
+    // verify the byte code before running any of it, run fails with
+    // what is wrong instead. the interpreter trusts the indices and the
+    // stack depths of the byte code, so only callers that run what the
+    // compiler just built, like the repl and axec, turn this off.
+    bool verify = true;
+};
+
+enum class vm_error_code {
+    StackOverflow,
+    CallingNonFunction,
+    WrongNumberOfArguments,
+    UnsupportedNegation,
+};
+
+// what went wrong and where. run records it on its cold path and only
+// turns it into a message once it returns.
+struct vm_error {
+    vm_error_code code;
+    // the function and the instruction that failed
+    const decoded_function* function;
+    const code_word* instruction_pointer;
+    // the type of the value that could not be called or negated
+    object_type type;
+    // the number of arguments a function wants and the number it got
+    size_t want;
+    size_t got;
+
+    std::string message() const;
+    // the offset of the failing instruction in the byte code of function
+    size_t position() const;
+};
+
+// how often the inline caches of the call sites knew the callee
+struct call_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+};
+
+// how many functions run as machine code of either tier or from a
+// native module and how often optimized code fell back to the
+// interpreter
+struct jit_stats {
+    size_t compiled;
+    size_t optimized;
+    uint64_t deoptimizations;
+    size_t ahead_of_time;
+};
+
 template <typename GlobalsLifeTime> class vm {
   public:
-    vm(byte_code byte_code);
-    vm(byte_code byte_code, GlobalsLifeTime globals);
+    // the byte code is verified unless options.verify is off, run
+    // returns what is wrong with it before running any of it
+    vm(byte_code byte_code, vm_options options = vm_options());
+    vm(byte_code byte_code, GlobalsLifeTime globals,
+       vm_options options = vm_options());
+    ~vm();
 
     std::optional<std::string> run();
+    // the error behind the last message run returned
+    const vm_error& get_error() const;
+    // summed over every call site this vm has run
+    call_cache_stats get_call_cache_stats() const;
+    jit_stats get_jit_stats() const;
+    // results are boxed into objects, the stack itself holds values
     std::optional<const object> stack_top();
-    const object& last_popped_stack_element();
+    object last_popped_stack_element();
 
   private:
-    std::vector<object> constants;
+    // first so the heap exists before the constants are moved into it
+    GlobalsLifeTime globals;
+
+    // tags the prototypes this vm caches in function values
+    uint64_t id;
+    std::vector<value> constants;
+    instructions main_instructions;
+
+    // dispatch targets of run, indexed by op_code. nullptr when run
+    // dispatches with a switch.
+    const void* const* handlers;
+    // decoded streams keyed by the byte code they were decoded from
+    std::unordered_map<const instructions*, decoded_function> functions;
 
     std::vector<frame> frames;
     size_t frames_index;
+    size_t max_frames;
 
-    object stack[STACK_SIZE];
+    value_stack stack;
     size_t stack_pointer;
+    // of the main program
+    size_t max_stack;
 
-    GlobalsLifeTime globals;
+    vm_error error;
+    // why the byte code failed verification or the native module does
+    // not fit it, run returns it
+    std::optional<std::string> invalid;
+
+    axe::jit jit;
+    uint64_t jit_threshold;
+    uint64_t optimize_threshold;
+    bool background_optimization;
+    uint64_t deoptimizations;
+    // the entries of the native module by the byte code they replace
+    std::unordered_map<const instructions*, const void*> native_entries;
+
+    std::optional<std::string> load_native_module(const byte_code& byte_code,
+                                                  const aot_table* table);
+    const decoded_function& decode_function(const instructions& ins,
+                                            size_t num_locals,
+                                            size_t num_params,
+                                            size_t max_stack);
+
+    const decoded_function& function_prototype(heap_function* fn);
 
     frame& current_frame();
     void push_frame(frame frame);
     frame& pop_frame();
 
-    std::optional<std::string> push(const object& obj);
-    const object& pop();
+    // the stack has room for every push of a function, call_function
+    // makes sure of that when the frame is pushed
+    void push(value val);
+    value pop();
+
+    void rewrite(const code_word* word, op_code op);
+    void quicken(const code_word* word, value lhs, value rhs, op_code int_op,
+                 op_code float_op);
+    const code_word* deoptimize(const code_word* word, op_code op);
+    void set_top_int(int64_t i);
+
+    void maybe_collect_garbage();
+    void collect_garbage();
+
+    // these record the error and return false when the call fails
+    bool callee_prototype(size_t num_args, const decoded_function*& fn);
+    bool cached_prototype(size_t num_args, call_cache* cache,
+                          const decoded_function*& fn);
+    bool call_function(size_t num_args, const decoded_function& fn);
+    bool tail_call_function(size_t num_args, const decoded_function& fn);
+    bool reserve_frame(size_t base_pointer, const decoded_function& fn);
+    void clear_locals(size_t begin);
 
-    std::optional<std::string> call_function(size_t num_args);
+    // counts a call of fn and moves fn up a tier once it got hot
+    void count_call(const decoded_function& fn);
+    void install_optimized();
+    std::vector<type_feedback> feedback(const decoded_function& fn);
+    void deoptimize_frame(frame& frame, const code_word* site);
+    // runs frames as long as the current one is native, false when one
+    // of them failed
+    bool run_native();
+    static void jit_collect(jit_context* ctx);
 };
 
 } // namespace axe
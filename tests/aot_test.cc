@@ -0,0 +1,139 @@
+#include "../src/aot.h"
+#include "../src/compiler.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/vm.h"
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+
+using compiler = axe::compiler<std::vector<axe::object>, axe::symbol_table>;
+
+static axe::ast parse(const std::string& input) {
+    axe::lexer l(input);
+    axe::parser p(l);
+    return p.parse();
+}
+
+// the result or the error of running the byte code of c, with the
+// native module when it is not nullptr
+static std::string run(compiler& c, const axe::aot_table* module,
+                       size_t* ahead_of_time = nullptr) {
+    axe::vm_options options;
+    options.native_module = module;
+    axe::vm<axe::globals_owned> vm(c.get_byte_code(), options);
+    auto err = vm.run();
+    if (ahead_of_time != nullptr) {
+        *ahead_of_time = vm.get_jit_stats().ahead_of_time;
+    }
+    if (err.has_value()) {
+        return *err + " at " + std::to_string(vm.get_error().position());
+    }
+    return vm.last_popped_stack_element().string();
+}
+
+TEST(Aot, MatchesInterpreter) {
+    // one module per program, so the programs pack in as much as they can
+    std::string inputs[] = {
+        "fn fib(n) { if n < 2 { n } else { fib(n - 1) + fib(n - 2) } } "
+        "fib(20)",
+        "fn f(a, b) { a * b - a / b } fn g(a) { -a } "
+        "f(7, 2) + f(9, 3) + g(5) + g(140737488355328) + "
+        "f(140737488355327, 2)",
+        "fn f(a, b) { a + b } fn g(a, b) { a - b } fn h(a, b) { a * b / 2.0 "
+        "} f(1.5, 2.25) - g(1.5, 0.25) + h(3.0, 4.0)",
+        "fn f(a, b) { a + b } f(\"ax\", \"e\")",
+        "fn f(a, b) { if a == b { 1 } else { if a != b { 2 } } } "
+        "fn g(a) { if !a { 10 } else { 20 } } "
+        "f(1, 1) + f(1, 2) + f(\"a\", \"a\") * 3 + g(0) + g(\"\") + g(1)",
+        "let g = 1; fn f(a) { g = g + a; let b = g * 2; b } "
+        "f(1); f(2); f(3) + g",
+        "fn count(n, acc) { if n == 0 { acc } else { count(n - 1, acc + 1) } "
+        "} count(100000, 0)",
+        "fn build(n, s) { if n == 0 { s } else { build(n - 1, s + \"a\" + "
+        "\"b\" + \"c\" + \"d\") } } let s = build(400, \"\"); build(0, s)",
+        "fn inc(x) { x + 1 } fn apply(f, x) { f(x) } apply(inc, 1); "
+        "apply(fn(x) { -x }, true)",
+        "fn f(a) { a(1) } f(fn(x) { x }); f(fn() { 1 })",
+        "fn f() { } fn g(a) { if a > 2.5 { return true; } false } "
+        "f(); g(3.0) == g(2.0)",
+        "fn f(a) { match a { 1 => 10, 2 => 20, 4 => 40, _ => 0, } } "
+        "fn g(a) { match a { 1 => 1, 1000 => 2, 140737488355328 => 3, } } "
+        "fn h(a) { match a { \"a\" => 1, \"b\" => 2, _ => 3, } } "
+        "f(1) + f(3) + f(4) + g(1000) + g(140737488355328) + h(\"b\") + "
+        "h(\"c\") + h(1)",
+    };
+
+    auto source = testing::TempDir() + "aot_test.cc";
+    auto output = testing::TempDir() + "aot_test.so";
+    for (auto& input : inputs) {
+        compiler c;
+        ASSERT_FALSE(c.compile(parse(input)).has_value()) << input;
+        {
+            std::ofstream file(source);
+            file << axe::aot_translate(c.get_byte_code());
+        }
+        auto err = axe::aot_build(source, output, AXE_CXX, AXE_INCLUDE_DIR);
+        ASSERT_FALSE(err.has_value()) << *err << '\n' << input;
+
+        axe::native_module module;
+        err = module.open(output);
+        ASSERT_FALSE(err.has_value()) << *err;
+        auto table = module.get_table();
+        EXPECT_EQ(table->fingerprint, axe::aot_fingerprint(c.get_byte_code()));
+        size_t ahead_of_time;
+        EXPECT_EQ(run(c, table, &ahead_of_time), run(c, nullptr)) << input;
+        EXPECT_EQ(ahead_of_time, table->num_functions);
+        EXPECT_GT(ahead_of_time, 0) << input;
+    }
+    std::remove(source.c_str());
+    std::remove(output.c_str());
+}
+
+TEST(Aot, Fingerprint) {
+    compiler a;
+    compiler b;
+    compiler c;
+    ASSERT_FALSE(a.compile(parse("fn f(x) { x + 1 } f(2)")).has_value());
+    ASSERT_FALSE(b.compile(parse("fn f(x) { x + 1 } f(2)")).has_value());
+    ASSERT_FALSE(c.compile(parse("fn f(x) { x + 2 } f(2)")).has_value());
+    EXPECT_EQ(axe::aot_fingerprint(a.get_byte_code()),
+              axe::aot_fingerprint(b.get_byte_code()));
+    EXPECT_NE(axe::aot_fingerprint(a.get_byte_code()),
+              axe::aot_fingerprint(c.get_byte_code()));
+}
+
+TEST(Aot, OpenFails) {
+    axe::native_module module;
+    EXPECT_TRUE(module.open(testing::TempDir() + "missing.so").has_value());
+    EXPECT_EQ(module.get_table(), nullptr);
+}
+
+TEST(Aot, RefusesModulesOfOtherByteCode) {
+    compiler c;
+    ASSERT_FALSE(c.compile(parse("fn f(x) { x + 1 } f(2)")).has_value());
+    auto fingerprint = axe::aot_fingerprint(c.get_byte_code());
+    // nothing of a module is called before it is checked
+    axe::aot_function functions[] = {{99, nullptr}};
+    struct test {
+        uint64_t fingerprint;
+        size_t num_functions;
+        std::string expected;
+    };
+    test tests[] = {
+        {fingerprint + 1, 0, "native module built from another program"},
+        {fingerprint, 1,
+         "native module entry for constant 99, which is not a function"},
+    };
+
+    for (auto& test : tests) {
+        axe::aot_table table = {AXE_AOT_VERSION, test.fingerprint,
+                                test.num_functions, functions, nullptr};
+        axe::vm_options options;
+        options.native_module = &table;
+        axe::vm<axe::globals_owned> vm(c.get_byte_code(), options);
+        auto err = vm.run();
+        ASSERT_TRUE(err.has_value());
+        EXPECT_EQ(*err, test.expected);
+    }
+}
@@ -0,0 +1,35 @@
+#include "../src/atom.h"
+#include "../src/lexer.h"
+#include <gtest/gtest.h>
+
+TEST(Atom, Intern) {
+    axe::atom a("abc");
+    axe::atom b(std::string("abc"));
+    axe::atom c("abd");
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(a.get_id(), b.get_id());
+    EXPECT_NE(a, c);
+    EXPECT_EQ(a.string(), "abc");
+    EXPECT_EQ(c.string(), "abd");
+    EXPECT_EQ(axe::atom().string(), "");
+    EXPECT_EQ(axe::atom(""), axe::atom());
+}
+
+TEST(Atom, Lexer) {
+    std::string input = "let x = \"x\"; x";
+    axe::lexer l(input);
+    std::vector<axe::atom> atoms;
+    for (auto tok = l.next_token(); tok.get_type() != axe::token_type::Eof;
+         tok = l.next_token()) {
+        if (tok.get_type() == axe::token_type::Ident) {
+            atoms.push_back(tok.get_atom());
+        }
+        // string literals are not interned
+        if (tok.get_type() == axe::token_type::String) {
+            EXPECT_EQ(tok.get_literal(), "x");
+        }
+    }
+    ASSERT_EQ(atoms.size(), 2);
+    EXPECT_EQ(atoms[0], axe::atom("x"));
+    EXPECT_EQ(atoms[1], atoms[0]);
+}
@@ -74,3 +74,147 @@ TEST(Code, ReadOperands) {
         }
     }
 }
+
+TEST(Code, AssembleRetargetsJumps) {
+    axe::instructions ins;
+    for (auto& bytes : {
+             axe::make(axe::op_code::OpTrue, {}),
+             axe::make(axe::op_code::OpJumpNotTruthy, {8}),
+             axe::make(axe::op_code::OpConstant, {0}),
+             axe::make(axe::op_code::OpPop, {}),
+             axe::make(axe::op_code::OpJump, {12}),
+             axe::make(axe::op_code::OpNull, {}),
+         }) {
+        ins.insert(ins.end(), bytes.begin(), bytes.end());
+    }
+    auto list = axe::disassemble(ins);
+    EXPECT_EQ(list.size(), 6);
+    EXPECT_EQ(list[3].position, 7);
+    EXPECT_EQ(axe::assemble(list), ins);
+
+    // dropping the OpConstant moves the jump targets after it
+    list.erase(list.begin() + 2);
+    std::string expected = "\
+0000 OpTrue\n\
+0001 OpJumpNotTruthy 5\n\
+0004 OpPop\n\
+0005 OpJump 9\n\
+0008 OpNull\n\
+";
+    EXPECT_EQ(axe::instructions_string(axe::assemble(list)), expected);
+}
+
+TEST(Code, Assembler) {
+    axe::assembler code;
+    auto top = code.new_label();
+    auto end = code.new_label();
+    auto other = code.new_label();
+    code.bind(top);
+    code.emit(axe::op_code::OpTrue);
+    code.emit(axe::op_code::OpJumpNotTruthy, other);
+    code.emit(axe::op_code::OpConstant, {65534});
+    code.emit(axe::op_code::OpJump, end);
+    code.bind(other);
+    code.emit(axe::op_code::OpCase, 3, end);
+    code.emit(axe::op_code::OpJump, top);
+    code.bind(end);
+    code.emit(axe::op_code::OpGetLocalConstant, {1, 2});
+
+    std::string expected = "\
+0000 OpTrue\n\
+0001 OpJumpNotTruthy 10\n\
+0004 OpConstant 65534\n\
+0007 OpJump 18\n\
+0010 OpCase 3 18\n\
+0015 OpJump 0\n\
+0018 OpGetLocalConstant 1 2\n\
+";
+    EXPECT_EQ(axe::instructions_string(code.get_instructions()), expected);
+    EXPECT_EQ(code.size(), 22);
+
+    axe::assembler registers;
+    auto after = registers.new_label();
+    registers.emit(axe::register_op_code::OpJumpNotTruthy, 1, after);
+    registers.emit(axe::register_op_code::OpAdd, {0, 1, 2});
+    registers.bind(after);
+    registers.emit(axe::register_op_code::OpReturnValue, {0});
+    axe::instructions ins;
+    for (auto& bytes : {
+             axe::make(axe::register_op_code::OpJumpNotTruthy, {1, 8}),
+             axe::make(axe::register_op_code::OpAdd, {0, 1, 2}),
+             axe::make(axe::register_op_code::OpReturnValue, {0}),
+         }) {
+        ins.insert(ins.end(), bytes.begin(), bytes.end());
+    }
+    EXPECT_EQ(registers.get_instructions(), ins);
+}
+
+TEST(Code, MaxStackDepth) {
+    struct max_stack_test {
+        std::vector<axe::instructions> ins;
+        size_t expected;
+    };
+    max_stack_test tests[] = {
+        {{}, 0},
+        {
+            {
+                axe::make(axe::op_code::OpGetGlobal, {0}),
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpCall, {2}),
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpAdd, {}),
+                axe::make(axe::op_code::OpReturnValue, {}),
+            },
+            3,
+        },
+        {
+            // 0000 OpTrue
+            // 0001 OpJumpNotTruthy 12
+            // 0004 OpGetLocalGetLocal 0 1
+            // 0007 OpAdd
+            // 0008 OpJump 13
+            // 0011 OpReturn
+            // 0012 OpNull
+            // 0013 OpReturnValue
+            {
+                axe::make(axe::op_code::OpTrue, {}),
+                axe::make(axe::op_code::OpJumpNotTruthy, {12}),
+                axe::make(axe::op_code::OpGetLocalGetLocal, {0, 1}),
+                axe::make(axe::op_code::OpAdd, {}),
+                axe::make(axe::op_code::OpJump, {13}),
+                axe::make(axe::op_code::OpReturn, {}),
+                axe::make(axe::op_code::OpNull, {}),
+                axe::make(axe::op_code::OpReturnValue, {}),
+            },
+            2,
+        },
+        {
+            // the cases are reached through the table only
+            // 0000 OpConstant 0
+            // 0003 OpJumpTable 0 1
+            // 0008 OpJump 17
+            // 0011 OpJump 14
+            // 0014 OpGetLocalGetLocal 0 1
+            // 0017 OpReturnValue
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpJumpTable, {0, 1}),
+                axe::make(axe::op_code::OpJump, {17}),
+                axe::make(axe::op_code::OpJump, {14}),
+                axe::make(axe::op_code::OpGetLocalGetLocal, {0, 1}),
+                axe::make(axe::op_code::OpReturnValue, {}),
+            },
+            2,
+        },
+    };
+
+    for (auto& test : tests) {
+        axe::instructions ins;
+        for (auto& bytes : test.ins) {
+            ins.insert(ins.end(), bytes.begin(), bytes.end());
+        }
+        EXPECT_EQ(axe::max_stack_depth(ins), test.expected)
+            << axe::instructions_string(ins);
+    }
+}
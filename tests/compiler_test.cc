@@ -48,9 +48,24 @@ static void test_constants(const std::vector<axe::object> expected,
     }
 }
 
-static void run_compiler_test(const compiler_test& test) {
+// the expected instructions of most tests are written without the
+// optimizations so they read like the source
+static axe::compiler_options unoptimized() {
+    axe::compiler_options options;
+    options.superinstructions = false;
+    options.tail_calls = false;
+    options.fold_constants = false;
+    options.peephole = false;
+    options.ssa = false;
+    options.inline_calls = false;
+    return options;
+}
+
+static void run_compiler_test(const compiler_test& test,
+                              axe::compiler_options options = unoptimized()) {
     auto ast = parse(test.input);
-    axe::compiler<axe::constants_owned, axe::symbol_table_owned> compiler;
+    axe::compiler<axe::constants_owned, axe::symbol_table_owned> compiler(
+        options);
     auto err = compiler.compile(ast);
     if (err.has_value()) {
         std::cout << *err << '\n';
@@ -681,3 +696,866 @@ TEST(Compiler, LetStatementScopes) {
         run_compiler_test(test);
     }
 }
+
+TEST(Compiler, Superinstructions) {
+    axe::compiler_options options;
+    options.peephole = false;
+    compiler_test tests[] = {
+        {
+            "fn(a, b) { if a > b { a - 1 } else { b + 2 } }",
+            {
+                axe::object(axe::object_type::Integer, 1),
+                axe::object(axe::object_type::Integer, 2),
+                axe::object(
+                    axe::object_type::Function,
+                    axe::compiled_function(
+                        concatinate_instructions({
+                            // 0000
+                            axe::make(axe::op_code::OpGetLocalGetLocal,
+                                      {0, 1}),
+                            // 0003
+                            axe::make(axe::op_code::OpGreaterThanJumpNotTruthy,
+                                      {13}),
+                            // 0006
+                            axe::make(axe::op_code::OpSubLocalConstant,
+                                      {0, 0}),
+                            // 0010
+                            axe::make(axe::op_code::OpJump, {17}),
+                            // 0013
+                            axe::make(axe::op_code::OpAddLocalConstant,
+                                      {1, 1}),
+                            // 0017
+                            axe::make(axe::op_code::OpReturnValue, {}),
+                        }),
+                        2, 2)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "fn(n) { if n == 0 { n } else { n * 2 } }",
+            {
+                axe::object(axe::object_type::Integer, 0),
+                axe::object(axe::object_type::Integer, 2),
+                axe::object(
+                    axe::object_type::Function,
+                    axe::compiled_function(
+                        concatinate_instructions({
+                            // 0000
+                            axe::make(axe::op_code::OpGetLocalConstant,
+                                      {0, 0}),
+                            // 0004
+                            axe::make(axe::op_code::OpEqJumpNotTruthy, {12}),
+                            // 0007
+                            axe::make(axe::op_code::OpGetLocal, {0}),
+                            // 0009
+                            axe::make(axe::op_code::OpJump, {17}),
+                            // 0012
+                            axe::make(axe::op_code::OpGetLocalConstant,
+                                      {0, 1}),
+                            // 0016
+                            axe::make(axe::op_code::OpMul, {}),
+                            // 0017
+                            axe::make(axe::op_code::OpReturnValue, {}),
+                        }),
+                        1, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+    };
+
+    for (auto& test : tests) {
+        run_compiler_test(test, options);
+    }
+}
+
+TEST(Compiler, ConstantFolding) {
+    axe::compiler_options options = unoptimized();
+    options.fold_constants = true;
+    compiler_test tests[] = {
+        {
+            "60 * 60 * 24",
+            {axe::object(axe::object_type::Integer, 86400)},
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "-(2.5 * 2.0) + 1.0",
+            {axe::object(axe::object_type::Float, -4.0)},
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "\"ax\" + \"e\"",
+            {axe::object(axe::object_type::String, "axe")},
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "(1 < 2) == !false; \"a\" != \"a\"; 1 == 1.0",
+            {},
+            {
+                axe::make(axe::op_code::OpTrue, {}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpFalse, {}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpFalse, {}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // left to the vm, which fails or makes null
+            "1 / 0; 1 + 1.5",
+            {axe::object(axe::object_type::Integer, 1),
+             axe::object(axe::object_type::Integer, 0),
+             axe::object(axe::object_type::Float, 1.5)},
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpDiv, {}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpAdd, {}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "let a = 2; a * (3 + 4)",
+            {axe::object(axe::object_type::Integer, 2),
+             axe::object(axe::object_type::Integer, 7)},
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+                axe::make(axe::op_code::OpGetGlobal, {0}),
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpMul, {}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "if 2 > 1 { 10 } else { 20 }; 3333",
+            {axe::object(axe::object_type::Integer, 10),
+             axe::object(axe::object_type::Integer, 3333)},
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "if \"\" == \"a\" { 10 }; 3333",
+            {axe::object(axe::object_type::Integer, 3333)},
+            {
+                axe::make(axe::op_code::OpNull, {}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // names defined by the branch that is thrown away still exist
+            "if false { let a = 10; a } else { 20 }; a",
+            {axe::object(axe::object_type::Integer, 20)},
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpGetGlobal, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // in a function, around what cannot be folded
+            "fn(a) { if true { a * (2 + 3) } else { 0 } }",
+            {
+                axe::object(axe::object_type::Integer, 5),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpConstant, {0}),
+                                    axe::make(axe::op_code::OpMul, {}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                1, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "fn() { if !0 { 1 } else { 2 } }",
+            {
+                axe::object(axe::object_type::Integer, 1),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpConstant, {0}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                0, 0)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+    };
+
+    for (auto& test : tests) {
+        run_compiler_test(test, options);
+    }
+}
+
+TEST(Compiler, Peephole) {
+    compiler_test tests[] = {
+        {
+            // the jump out of the consequence returns right away
+            "fn(a) { if a { 1 } else { 2 } }",
+            {
+                axe::object(axe::object_type::Integer, 1),
+                axe::object(axe::object_type::Integer, 2),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    // 0000
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    // 0002
+                                    axe::make(axe::op_code::OpJumpNotTruthy,
+                                              {9}),
+                                    // 0005
+                                    axe::make(axe::op_code::OpConstant, {0}),
+                                    // 0008
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                    // 0009
+                                    axe::make(axe::op_code::OpConstant, {1}),
+                                    // 0012
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                1, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // the negation becomes the branch, the missing alternative
+            // and the jumps around it are gone
+            "let a = true; if !a { 1 }; 2",
+            {axe::object(axe::object_type::Integer, 1),
+             axe::object(axe::object_type::Integer, 2)},
+            {
+                // 0000
+                axe::make(axe::op_code::OpTrue, {}),
+                // 0001
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+                // 0004
+                axe::make(axe::op_code::OpGetGlobal, {0}),
+                // 0007
+                axe::make(axe::op_code::OpJumpTruthy, {14}),
+                // 0010
+                axe::make(axe::op_code::OpConstant, {0}),
+                // 0013
+                axe::make(axe::op_code::OpPop, {}),
+                // 0014
+                axe::make(axe::op_code::OpConstant, {1}),
+                // 0017
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "if true { 1 } else { 2 }; if false { 3 }; 4",
+            {axe::object(axe::object_type::Integer, 1),
+             axe::object(axe::object_type::Integer, 2),
+             axe::object(axe::object_type::Integer, 3),
+             axe::object(axe::object_type::Integer, 4)},
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {3}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // the jump out of the inner consequence lands on the jump
+            // out of the outer one, so it goes straight to its target
+            "let a = 0; if a { if a { 1 } else { 2 } } else { 3 }; 4",
+            {axe::object(axe::object_type::Integer, 0),
+             axe::object(axe::object_type::Integer, 1),
+             axe::object(axe::object_type::Integer, 2),
+             axe::object(axe::object_type::Integer, 3),
+             axe::object(axe::object_type::Integer, 4)},
+            {
+                // 0000
+                axe::make(axe::op_code::OpConstant, {0}),
+                // 0003
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+                // 0006
+                axe::make(axe::op_code::OpGetGlobal, {0}),
+                // 0009
+                axe::make(axe::op_code::OpJumpNotTruthy, {30}),
+                // 0012
+                axe::make(axe::op_code::OpGetGlobal, {0}),
+                // 0015
+                axe::make(axe::op_code::OpJumpNotTruthy, {24}),
+                // 0018
+                axe::make(axe::op_code::OpConstant, {1}),
+                // 0021
+                axe::make(axe::op_code::OpJump, {33}),
+                // 0024
+                axe::make(axe::op_code::OpConstant, {2}),
+                // 0027
+                axe::make(axe::op_code::OpJump, {33}),
+                // 0030
+                axe::make(axe::op_code::OpConstant, {3}),
+                // 0033
+                axe::make(axe::op_code::OpPop, {}),
+                // 0034
+                axe::make(axe::op_code::OpConstant, {4}),
+                // 0037
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // the repl prints the null of the last statement
+            "if false { 1 }",
+            {axe::object(axe::object_type::Integer, 1)},
+            {
+                axe::make(axe::op_code::OpNull, {}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+    };
+
+    auto options = unoptimized();
+    options.peephole = true;
+    for (auto& test : tests) {
+        run_compiler_test(test, options);
+    }
+}
+
+TEST(Compiler, Ssa) {
+    compiler_test tests[] = {
+        {
+            // the second sum is the first one, the copies of the lets
+            // are gone
+            "fn(a, b) { let c = a + b; let d = a + b; let e = d; c * e }",
+            {
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpGetLocal, {1}),
+                                    axe::make(axe::op_code::OpAdd, {}),
+                                    axe::make(axe::op_code::OpSetLocal, {2}),
+                                    axe::make(axe::op_code::OpGetLocal, {2}),
+                                    axe::make(axe::op_code::OpGetLocal, {2}),
+                                    axe::make(axe::op_code::OpMul, {}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                3, 2)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // the first write is overwritten before anything sees it and
+            // the read takes the value written
+            "let g = 0; fn(a) { g = a; g = a * 2; a == 0; g }",
+            {
+                axe::object(axe::object_type::Integer, 0),
+                axe::object(axe::object_type::Integer, 2),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpConstant, {1}),
+                                    axe::make(axe::op_code::OpMul, {}),
+                                    axe::make(axe::op_code::OpSetLocal, {1}),
+                                    axe::make(axe::op_code::OpGetLocal, {1}),
+                                    axe::make(axe::op_code::OpSetGlobal, {0}),
+                                    axe::make(axe::op_code::OpGetLocal, {1}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                2, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // the second read of g is the first one, kept in a local
+            "let g = 1; fn(a) { g * a + g }",
+            {
+                axe::object(axe::object_type::Integer, 1),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetGlobal, {0}),
+                                    axe::make(axe::op_code::OpSetLocal, {1}),
+                                    axe::make(axe::op_code::OpGetLocal, {1}),
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpMul, {}),
+                                    axe::make(axe::op_code::OpGetLocal, {1}),
+                                    axe::make(axe::op_code::OpAdd, {}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                2, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // the value of the if is left on the stack by both branches
+            "fn(a) { let b = if a { 1 } else { 2 }; b + 1 }",
+            {
+                axe::object(axe::object_type::Integer, 1),
+                axe::object(axe::object_type::Integer, 2),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    // 0000
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    // 0002
+                                    axe::make(axe::op_code::OpJumpNotTruthy,
+                                              {11}),
+                                    // 0005
+                                    axe::make(axe::op_code::OpConstant, {0}),
+                                    // 0008
+                                    axe::make(axe::op_code::OpJump, {14}),
+                                    // 0011
+                                    axe::make(axe::op_code::OpConstant, {1}),
+                                    // 0014
+                                    axe::make(axe::op_code::OpConstant, {0}),
+                                    // 0017
+                                    axe::make(axe::op_code::OpAdd, {}),
+                                    // 0018
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                1, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+    };
+
+    auto options = unoptimized();
+    options.ssa = true;
+    for (auto& test : tests) {
+        run_compiler_test(test, options);
+    }
+}
+
+TEST(Compiler, Inlining) {
+    compiler_test tests[] = {
+        {
+            // the body of add takes the place of the call
+            "fn add(a, b) { a + b } fn f(x) { add(x, 1) }",
+            {
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpGetLocal, {1}),
+                                    axe::make(axe::op_code::OpAdd, {}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                2, 2)),
+                axe::object(axe::object_type::Integer, 1),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpConstant, {1}),
+                                    axe::make(axe::op_code::OpAdd, {}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                1, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpSetGlobal, {1}),
+            },
+        },
+        {
+            // both calls of one are gone, only its constant is left
+            "fn one() { 1 } fn two() { one() + one() }",
+            {
+                axe::object(axe::object_type::Integer, 1),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpConstant, {0}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                0, 0)),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpConstant, {0}),
+                                    axe::make(axe::op_code::OpConstant, {0}),
+                                    axe::make(axe::op_code::OpAdd, {}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                0, 0)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpSetGlobal, {1}),
+            },
+        },
+        {
+            // add is bound again, so the call stays
+            "fn add(a) { a } fn f(x) { add(x) } add = 1",
+            {
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                1, 1)),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetGlobal, {0}),
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpCall, {1}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                1, 1)),
+                axe::object(axe::object_type::Integer, 1),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpSetGlobal, {1}),
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+            },
+        },
+    };
+
+    auto options = unoptimized();
+    options.ssa = true;
+    options.inline_calls = true;
+    for (auto& test : tests) {
+        run_compiler_test(test, options);
+    }
+}
+
+TEST(Compiler, Match) {
+    compiler_test tests[] = {
+        {
+            // the ints the cases skip jump to the default
+            "match 2 { 1 => 10, 3 => 30, _ => 0, }",
+            {axe::object(axe::object_type::Integer, 2),
+             axe::object(axe::object_type::Integer, 1),
+             axe::object(axe::object_type::Integer, 10),
+             axe::object(axe::object_type::Integer, 30),
+             axe::object(axe::object_type::Integer, 0)},
+            {
+                // 0000
+                axe::make(axe::op_code::OpConstant, {0}),
+                // 0003
+                axe::make(axe::op_code::OpJumpTable, {1, 3}),
+                // 0008
+                axe::make(axe::op_code::OpJump, {32}),
+                // 0011
+                axe::make(axe::op_code::OpJump, {20}),
+                // 0014
+                axe::make(axe::op_code::OpJump, {32}),
+                // 0017
+                axe::make(axe::op_code::OpJump, {26}),
+                // 0020
+                axe::make(axe::op_code::OpConstant, {2}),
+                // 0023
+                axe::make(axe::op_code::OpJump, {35}),
+                // 0026
+                axe::make(axe::op_code::OpConstant, {3}),
+                // 0029
+                axe::make(axe::op_code::OpJump, {35}),
+                // 0032
+                axe::make(axe::op_code::OpConstant, {4}),
+                // 0035
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // the cases are sorted, without a default the match is null
+            "match \"b\" { \"b\" => 1, \"a\" => 2, }",
+            {axe::object(axe::object_type::String, "b"),
+             axe::object(axe::object_type::String, "a"),
+             axe::object(axe::object_type::Integer, 1),
+             axe::object(axe::object_type::Integer, 2)},
+            {
+                // 0000
+                axe::make(axe::op_code::OpConstant, {0}),
+                // 0003
+                axe::make(axe::op_code::OpSwitch, {2}),
+                // 0006
+                axe::make(axe::op_code::OpJump, {31}),
+                // 0009
+                axe::make(axe::op_code::OpCase, {1, 25}),
+                // 0014
+                axe::make(axe::op_code::OpCase, {0, 19}),
+                // 0019
+                axe::make(axe::op_code::OpConstant, {2}),
+                // 0022
+                axe::make(axe::op_code::OpJump, {32}),
+                // 0025
+                axe::make(axe::op_code::OpConstant, {3}),
+                // 0028
+                axe::make(axe::op_code::OpJump, {32}),
+                // 0031
+                axe::make(axe::op_code::OpNull, {}),
+                // 0032
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            // the value is kept in a global and compared with each
+            // pattern
+            "let y = 1; match 2 { y => 3, }",
+            {axe::object(axe::object_type::Integer, 1),
+             axe::object(axe::object_type::Integer, 2),
+             axe::object(axe::object_type::Integer, 3)},
+            {
+                // 0000
+                axe::make(axe::op_code::OpConstant, {0}),
+                // 0003
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+                // 0006
+                axe::make(axe::op_code::OpConstant, {1}),
+                // 0009
+                axe::make(axe::op_code::OpSetGlobal, {1}),
+                // 0012
+                axe::make(axe::op_code::OpGetGlobal, {1}),
+                // 0015
+                axe::make(axe::op_code::OpGetGlobal, {0}),
+                // 0018
+                axe::make(axe::op_code::OpEq, {}),
+                // 0019
+                axe::make(axe::op_code::OpJumpNotTruthy, {28}),
+                // 0022
+                axe::make(axe::op_code::OpConstant, {2}),
+                // 0025
+                axe::make(axe::op_code::OpJump, {29}),
+                // 0028
+                axe::make(axe::op_code::OpNull, {}),
+                // 0029
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+    };
+
+    for (auto& test : tests) {
+        run_compiler_test(test);
+    }
+}
+
+TEST(Compiler, InternedConstants) {
+    compiler_test tests[] = {
+        {
+            "1; 2; 1; \"a\"; 2.0; \"a\"; 2.0; 2",
+            {axe::object(axe::object_type::Integer, 1),
+             axe::object(axe::object_type::Integer, 2),
+             axe::object(axe::object_type::String, "a"),
+             axe::object(axe::object_type::Float, 2.0)},
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {3}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {2}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {3}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+        {
+            "fn(a) { a + 1 }; fn(b) { b + 1 }; fn(a) { a + 2 }",
+            {
+                axe::object(axe::object_type::Integer, 1),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpConstant, {0}),
+                                    axe::make(axe::op_code::OpAdd, {}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                1, 1)),
+                axe::object(axe::object_type::Integer, 2),
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::op_code::OpGetLocal, {0}),
+                                    axe::make(axe::op_code::OpConstant, {2}),
+                                    axe::make(axe::op_code::OpAdd, {}),
+                                    axe::make(axe::op_code::OpReturnValue, {}),
+                                }),
+                                1, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpPop, {}),
+                axe::make(axe::op_code::OpConstant, {3}),
+                axe::make(axe::op_code::OpPop, {}),
+            },
+        },
+    };
+
+    for (auto& test : tests) {
+        run_compiler_test(test);
+    }
+
+    // 0.0 and -0.0 compare equal but divide differently
+    axe::compiler_options options;
+    axe::compiler<axe::constants_owned, axe::symbol_table_owned> compiler(
+        options);
+    ASSERT_FALSE(compiler.compile(parse("0.0; -0.0; 0.0")).has_value());
+    EXPECT_EQ(compiler.get_byte_code().constants.size(), 2);
+}
+
+TEST(Compiler, InternedConstantsAcrossLines) {
+    axe::symbol_table symbol_table;
+    std::vector<axe::object> constants;
+    std::string lines[] = {"let a = 1; \"x\"", "a + 1; \"x\"", "3; 1"};
+    for (auto& line : lines) {
+        axe::compiler<axe::constants_ref, axe::symbol_table_ref> compiler(
+            symbol_table, constants, unoptimized());
+        ASSERT_FALSE(compiler.compile(parse(line)).has_value());
+    }
+    test_constants({axe::object(axe::object_type::Integer, 1),
+                    axe::object(axe::object_type::String, "x"),
+                    axe::object(axe::object_type::Integer, 3)},
+                   constants);
+}
+
+TEST(Compiler, MatchSubjectAcrossLines) {
+    axe::symbol_table symbol_table;
+    std::vector<axe::object> constants;
+    std::string lines[] = {"let y = 1;", "match 1 { y => 2, _ => 3, }",
+                           "match 2 { y => 2, _ => 3, }",
+                           "let z = match 3 { y => 2, _ => 3, };"};
+    for (auto& line : lines) {
+        axe::compiler<axe::constants_ref, axe::symbol_table_ref> compiler(
+            symbol_table, constants, unoptimized());
+        ASSERT_FALSE(compiler.compile(parse(line)).has_value());
+    }
+    // y, the one subject of every match and z
+    EXPECT_EQ(symbol_table.size(), 3);
+}
+
+TEST(Compiler, TailCalls) {
+    axe::compiler_options options;
+    options.superinstructions = false;
+    options.peephole = false;
+    options.ssa = false;
+    compiler_test tests[] = {
+        {
+            "fn f(n) { if n { f(n) } else { return f(n); } }",
+            {
+                axe::object(
+                    axe::object_type::Function,
+                    axe::compiled_function(
+                        concatinate_instructions({
+                            // 0000
+                            axe::make(axe::op_code::OpGetLocal, {0}),
+                            // 0002
+                            axe::make(axe::op_code::OpJumpNotTruthy, {15}),
+                            // 0005
+                            axe::make(axe::op_code::OpGetGlobal, {0}),
+                            // 0008
+                            axe::make(axe::op_code::OpGetLocal, {0}),
+                            // 0010
+                            axe::make(axe::op_code::OpTailCall, {1}),
+                            // 0012
+                            axe::make(axe::op_code::OpJump, {23}),
+                            // 0015
+                            axe::make(axe::op_code::OpGetGlobal, {0}),
+                            // 0018
+                            axe::make(axe::op_code::OpGetLocal, {0}),
+                            // 0020
+                            axe::make(axe::op_code::OpTailCall, {1}),
+                            // 0022
+                            axe::make(axe::op_code::OpReturnValue, {}),
+                            // 0023
+                            axe::make(axe::op_code::OpReturnValue, {}),
+                        }),
+                        1, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {0}),
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+            },
+        },
+        {
+            "fn f(n) { f(n) + 1 }",
+            {
+                axe::object(axe::object_type::Integer, 1),
+                axe::object(
+                    axe::object_type::Function,
+                    axe::compiled_function(
+                        concatinate_instructions({
+                            axe::make(axe::op_code::OpGetGlobal, {0}),
+                            axe::make(axe::op_code::OpGetLocal, {0}),
+                            axe::make(axe::op_code::OpCall, {1}),
+                            axe::make(axe::op_code::OpConstant, {0}),
+                            axe::make(axe::op_code::OpAdd, {}),
+                            axe::make(axe::op_code::OpReturnValue, {}),
+                        }),
+                        1, 1)),
+            },
+            {
+                axe::make(axe::op_code::OpConstant, {1}),
+                axe::make(axe::op_code::OpSetGlobal, {0}),
+            },
+        },
+    };
+
+    for (auto& test : tests) {
+        run_compiler_test(test, options);
+    }
+}
@@ -0,0 +1,97 @@
+#include "../src/code.h"
+#include "../src/decode.h"
+#include "../src/value.h"
+#include <gtest/gtest.h>
+
+static axe::instructions
+concatinate_instructions(const std::vector<axe::instructions>& instructions) {
+    axe::instructions res;
+    for (auto& ins : instructions) {
+        res.insert(res.end(), ins.begin(), ins.end());
+    }
+    return res;
+}
+
+TEST(Decode, Operands) {
+    std::vector<axe::value> constants = {
+        axe::value::from_small_int(1),
+        axe::value::from_small_int(2),
+    };
+    std::vector<axe::value> globals(4);
+    auto ins = concatinate_instructions({
+        axe::make(axe::op_code::OpConstant, {1}),
+        axe::make(axe::op_code::OpSetGlobal, {3}),
+        axe::make(axe::op_code::OpGetLocal, {2}),
+        axe::make(axe::op_code::OpCall, {1}),
+        axe::make(axe::op_code::OpAdd, {}),
+    });
+
+    auto fn = axe::decode(ins, 3, 1, 2, nullptr, constants, globals.data());
+    EXPECT_EQ(fn.num_locals, 3);
+    EXPECT_EQ(fn.num_params, 1);
+    EXPECT_EQ(fn.max_stack, 2);
+    EXPECT_EQ(fn.source, &ins);
+    ASSERT_EQ(fn.code.size(), 10);
+    EXPECT_EQ(fn.code[0].op, axe::op_code::OpConstant);
+    EXPECT_EQ(fn.code[1].constant, &constants[1]);
+    EXPECT_EQ(fn.code[2].op, axe::op_code::OpSetGlobal);
+    EXPECT_EQ(fn.code[3].global, &globals[3]);
+    EXPECT_EQ(fn.code[4].op, axe::op_code::OpGetLocal);
+    EXPECT_EQ(fn.code[5].operand, 2);
+    EXPECT_EQ(fn.code[6].op, axe::op_code::OpCall);
+    EXPECT_EQ(fn.code[7].operand, 1);
+    ASSERT_EQ(fn.caches.size(), 1);
+    EXPECT_EQ(fn.code[8].cache, &fn.caches[0]);
+    EXPECT_EQ(fn.caches[0].prototype, nullptr);
+    EXPECT_EQ(fn.code[9].op, axe::op_code::OpAdd);
+}
+
+TEST(Decode, JumpTargets) {
+    std::vector<axe::value> constants = {
+        axe::value::from_small_int(1),
+    };
+    // 0000 OpTrue
+    // 0001 OpJumpNotTruthy 10
+    // 0004 OpConstant 0
+    // 0007 OpJump 11
+    // 0010 OpNull
+    // 0011 OpPop
+    auto ins = concatinate_instructions({
+        axe::make(axe::op_code::OpTrue, {}),
+        axe::make(axe::op_code::OpJumpNotTruthy, {10}),
+        axe::make(axe::op_code::OpConstant, {0}),
+        axe::make(axe::op_code::OpJump, {11}),
+        axe::make(axe::op_code::OpNull, {}),
+        axe::make(axe::op_code::OpPop, {}),
+    });
+
+    auto fn = axe::decode(ins, 0, 0, 1, nullptr, constants, nullptr);
+    ASSERT_EQ(fn.code.size(), 9);
+    EXPECT_EQ(fn.code[1].op, axe::op_code::OpJumpNotTruthy);
+    EXPECT_EQ(fn.code[2].target, &fn.code[7]);
+    EXPECT_EQ(fn.code[5].op, axe::op_code::OpJump);
+    EXPECT_EQ(fn.code[6].target, &fn.code[8]);
+    EXPECT_EQ(fn.code[7].op, axe::op_code::OpNull);
+    EXPECT_EQ(fn.code[8].op, axe::op_code::OpPop);
+}
+
+TEST(Decode, SourcePositions) {
+    std::vector<axe::value> constants = {
+        axe::value::from_small_int(1),
+    };
+    auto ins = concatinate_instructions({
+        axe::make(axe::op_code::OpTrue, {}),
+        axe::make(axe::op_code::OpJumpNotTruthy, {10}),
+        axe::make(axe::op_code::OpConstant, {0}),
+        axe::make(axe::op_code::OpJump, {11}),
+        axe::make(axe::op_code::OpNull, {}),
+        axe::make(axe::op_code::OpPop, {}),
+    });
+
+    auto fn = axe::decode(ins, 0, 0, 1, nullptr, constants, nullptr);
+    size_t expected[] = {0, 1, 1, 4, 4, 7, 7, 10, 11};
+    ASSERT_EQ(fn.code.size(), 9);
+    for (size_t i = 0; i < fn.code.size(); ++i) {
+        EXPECT_EQ(axe::source_position(fn, &fn.code[i]), expected[i]) << i;
+    }
+}
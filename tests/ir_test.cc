@@ -0,0 +1,196 @@
+#include "../src/code.h"
+#include "../src/ir.h"
+#include <gtest/gtest.h>
+
+static axe::instructions
+concatinate_instructions(const std::vector<axe::instructions>& instructions) {
+    axe::instructions res;
+    for (auto& ins : instructions) {
+        res.insert(res.end(), ins.begin(), ins.end());
+    }
+    return res;
+}
+
+TEST(Ir, PropagateCopies) {
+    axe::ir_function fn(1);
+    auto param = fn.add(0, axe::ir_op::Param, {}, 0);
+    auto copy = fn.add(0, axe::ir_op::Copy, {param});
+    size_t then_block = fn.new_block();
+    size_t else_block = fn.new_block();
+    fn.branch(0, copy, then_block, else_block);
+    auto other = fn.add(then_block, axe::ir_op::Copy, {copy});
+    size_t join = fn.new_block();
+    fn.jump(then_block, join);
+    fn.jump(else_block, join);
+    auto phi = fn.add_phi(join, {other, copy});
+    fn.ret(join, phi);
+
+    EXPECT_TRUE(fn.propagate_copies());
+    EXPECT_EQ(fn.string(), "b0:\n"
+                           "  %0 = param 0\n"
+                           "  branch %0 b1 b2\n"
+                           "b1:\n"
+                           "  jump b3\n"
+                           "b2:\n"
+                           "  jump b3\n"
+                           "b3:\n"
+                           "  return %0\n");
+    EXPECT_FALSE(fn.propagate_copies());
+}
+
+TEST(Ir, EliminateCommonSubexpressions) {
+    axe::ir_function fn(2);
+    auto a = fn.add(0, axe::ir_op::Param, {}, 0);
+    auto b = fn.add(0, axe::ir_op::Param, {}, 1);
+    auto sum = fn.add(0, axe::ir_op::Add, {a, b});
+    size_t then_block = fn.new_block();
+    size_t else_block = fn.new_block();
+    fn.branch(0, sum, then_block, else_block);
+    // dominated by the first sum
+    auto again = fn.add(then_block, axe::ir_op::Add, {a, b});
+    auto product = fn.add(then_block, axe::ir_op::Mul, {again, b});
+    // not dominated by the product of the other branch
+    auto other = fn.add(else_block, axe::ir_op::Mul, {sum, b});
+    size_t join = fn.new_block();
+    fn.jump(then_block, join);
+    fn.jump(else_block, join);
+    fn.ret(join, fn.add_phi(join, {product, other}));
+
+    EXPECT_TRUE(fn.eliminate_common_subexpressions());
+    EXPECT_EQ(fn.string(), "b0:\n"
+                           "  %0 = param 0\n"
+                           "  %1 = param 1\n"
+                           "  %2 = add %0 %1\n"
+                           "  branch %2 b1 b2\n"
+                           "b1:\n"
+                           "  %4 = mul %2 %1\n"
+                           "  jump b3\n"
+                           "b2:\n"
+                           "  %5 = mul %2 %1\n"
+                           "  jump b3\n"
+                           "b3:\n"
+                           "  %6 = phi %4 %5\n"
+                           "  return %6\n");
+}
+
+TEST(Ir, EliminateRedundantGlobals) {
+    axe::ir_function fn(1);
+    auto a = fn.add(0, axe::ir_op::Param, {}, 0);
+    fn.add(0, axe::ir_op::SetGlobal, {a}, 0);
+    auto read = fn.add(0, axe::ir_op::GetGlobal, {}, 0);
+    fn.add(0, axe::ir_op::SetGlobal, {read}, 1);
+    fn.add(0, axe::ir_op::SetGlobal, {a}, 1);
+    auto other = fn.add(0, axe::ir_op::GetGlobal, {}, 2);
+    auto call = fn.add(0, axe::ir_op::Call, {other});
+    auto after = fn.add(0, axe::ir_op::GetGlobal, {}, 2);
+    fn.ret(0, fn.add(0, axe::ir_op::Add, {call, after}));
+
+    EXPECT_TRUE(fn.eliminate_redundant_globals());
+    // the call may read and write every global
+    EXPECT_EQ(fn.string(), "b0:\n"
+                           "  %0 = param 0\n"
+                           "  set_global 0 %0\n"
+                           "  set_global 1 %0\n"
+                           "  %5 = get_global 2\n"
+                           "  %6 = call %5\n"
+                           "  %7 = get_global 2\n"
+                           "  %8 = add %6 %7\n"
+                           "  return %8\n");
+}
+
+TEST(Ir, EliminateDeadCode) {
+    axe::ir_function fn(1);
+    auto a = fn.add(0, axe::ir_op::Param, {}, 0);
+    auto unused = fn.add(0, axe::ir_op::Add, {a, a});
+    fn.add(0, axe::ir_op::Bang, {unused});
+    // may fail, so it stays
+    fn.add(0, axe::ir_op::Div, {a, a});
+    fn.ret(0, fn.add(0, axe::ir_op::Null));
+
+    EXPECT_TRUE(fn.eliminate_dead_code());
+    EXPECT_EQ(fn.string(), "b0:\n"
+                           "  %0 = param 0\n"
+                           "  %3 = div %0 %0\n"
+                           "  %4 = null\n"
+                           "  return %4\n");
+}
+
+TEST(Ir, FoldBranches) {
+    axe::ir_function fn(0);
+    auto cond = fn.add(0, axe::ir_op::False);
+    size_t then_block = fn.new_block();
+    size_t else_block = fn.new_block();
+    fn.branch(0, cond, then_block, else_block);
+    auto one = fn.add(then_block, axe::ir_op::Constant, {}, 0);
+    auto two = fn.add(else_block, axe::ir_op::Constant, {}, 1);
+    size_t join = fn.new_block();
+    fn.jump(then_block, join);
+    fn.jump(else_block, join);
+    fn.ret(join, fn.add_phi(join, {one, two}));
+
+    fn.optimize();
+    EXPECT_EQ(fn.string(), "b0:\n"
+                           "  jump b2\n"
+                           "b2:\n"
+                           "  %2 = constant 1\n"
+                           "  jump b3\n"
+                           "b3:\n"
+                           "  return %2\n");
+}
+
+TEST(Ir, Generate) {
+    // fn(a, b) { let c = a * b; (if a { c } else { b - 1 }) + c }
+    axe::ir_function fn(2);
+    auto a = fn.add(0, axe::ir_op::Param, {}, 0);
+    auto b = fn.add(0, axe::ir_op::Param, {}, 1);
+    auto c = fn.add(0, axe::ir_op::Mul, {a, b});
+    size_t then_block = fn.new_block();
+    size_t else_block = fn.new_block();
+    fn.branch(0, a, then_block, else_block);
+    auto one = fn.add(else_block, axe::ir_op::Constant, {}, 0);
+    auto difference = fn.add(else_block, axe::ir_op::Sub, {b, one});
+    size_t join = fn.new_block();
+    fn.jump(then_block, join);
+    fn.jump(else_block, join);
+    auto phi = fn.add_phi(join, {c, difference});
+    fn.ret(join, fn.add(join, axe::ir_op::Add, {phi, c}));
+
+    size_t num_locals;
+    auto ins = fn.generate(num_locals);
+    ASSERT_TRUE(ins.has_value());
+    EXPECT_EQ(num_locals, 3);
+    // c is used twice and goes in a local, the phi is left on the
+    // stack by both branches
+    auto expected = concatinate_instructions({
+        // 0000
+        axe::make(axe::op_code::OpGetLocal, {0}),
+        // 0002
+        axe::make(axe::op_code::OpGetLocal, {1}),
+        // 0004
+        axe::make(axe::op_code::OpMul, {}),
+        // 0005
+        axe::make(axe::op_code::OpSetLocal, {2}),
+        // 0007
+        axe::make(axe::op_code::OpGetLocal, {0}),
+        // 0009
+        axe::make(axe::op_code::OpJumpNotTruthy, {17}),
+        // 0012
+        axe::make(axe::op_code::OpGetLocal, {2}),
+        // 0014
+        axe::make(axe::op_code::OpJump, {23}),
+        // 0017
+        axe::make(axe::op_code::OpGetLocal, {1}),
+        // 0019
+        axe::make(axe::op_code::OpConstant, {0}),
+        // 0022
+        axe::make(axe::op_code::OpSub, {}),
+        // 0023
+        axe::make(axe::op_code::OpGetLocal, {2}),
+        // 0025
+        axe::make(axe::op_code::OpAdd, {}),
+        // 0026
+        axe::make(axe::op_code::OpReturnValue, {}),
+    });
+    EXPECT_EQ(axe::instructions_string(*ins),
+              axe::instructions_string(expected));
+}
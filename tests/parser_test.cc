@@ -42,7 +42,7 @@ TEST(Parser, LetStatements) {
         auto& statement = statements[0];
         EXPECT_EQ(statement.get_type(), axe::statement_type::LetStatement);
         auto& let = statement.get_let();
-        EXPECT_STREQ(let.get_name().c_str(), test.name.c_str());
+        EXPECT_STREQ(let.get_name().string().c_str(), test.name.c_str());
         test_integer(let.get_value(), test.expected);
     }
 }
@@ -119,7 +119,7 @@ TEST(Parser, Floats) {
 void test_ident(const axe::expression& expression,
                 const std::string& expected) {
     EXPECT_EQ(expression.get_type(), axe::expression_type::Ident);
-    auto& value = expression.get_ident();
+    auto& value = expression.get_ident().string();
     EXPECT_STREQ(value.c_str(), expected.c_str());
 }
 
@@ -267,7 +267,7 @@ TEST(Parser, Assignment) {
         auto& expression = statement.get_expression();
         EXPECT_EQ(expression.get_type(), axe::expression_type::Assignment);
         auto& assignment = expression.get_assignment();
-        EXPECT_EQ(assignment.get_ident(), test.expected.ident);
+        EXPECT_EQ(assignment.get_ident().string(), test.expected.ident);
         auto& rhs = assignment.get_rhs();
         EXPECT_EQ(rhs->get_type(), test.expected.type);
     }
@@ -603,7 +603,7 @@ TEST(Parser, Functions) {
     EXPECT_EQ(expression.get_type(), axe::expression_type::Function);
     auto& function = expression.get_function();
     EXPECT_TRUE(function.get_name().has_value());
-    EXPECT_STREQ((*function.get_name()).c_str(), "add");
+    EXPECT_STREQ(function.get_name()->string().c_str(), "add");
     const char* expected_params[] = {"a", "b"};
     size_t length = sizeof expected_params / sizeof expected_params[0];
     auto& params = function.get_params();
@@ -611,7 +611,7 @@ TEST(Parser, Functions) {
     for (size_t i = 0; i < length; ++i) {
         const char* expected = expected_params[i];
         auto& param = params[i];
-        EXPECT_STREQ(param.c_str(), expected);
+        EXPECT_STREQ(param.string().c_str(), expected);
     }
     auto body_str = function.get_body().string();
     EXPECT_STREQ(body_str.c_str(), "(a + b)");
@@ -638,7 +638,7 @@ TEST(Parser, AnonymousFunction) {
     for (size_t i = 0; i < length; ++i) {
         const char* expected = expected_params[i];
         auto& param = params[i];
-        EXPECT_STREQ(param.c_str(), expected);
+        EXPECT_STREQ(param.string().c_str(), expected);
     }
     auto body_str = function.get_body().string();
     EXPECT_STREQ(body_str.c_str(), "(a + b)");
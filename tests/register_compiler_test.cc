@@ -0,0 +1,246 @@
+#include "../src/ast.h"
+#include "../src/code.h"
+#include "../src/lexer.h"
+#include "../src/object.h"
+#include "../src/parser.h"
+#include "../src/register_compiler.h"
+#include <gtest/gtest.h>
+
+struct register_compiler_test {
+    std::string input;
+    std::vector<axe::object> expected_constants;
+    std::vector<axe::instructions> expected_instructions;
+    size_t expected_num_registers;
+};
+
+static axe::ast parse(const std::string& input) {
+    axe::lexer l(input);
+    axe::parser p(l);
+    return p.parse();
+}
+
+static axe::instructions
+concatinate_instructions(const std::vector<axe::instructions>& instructions) {
+    axe::instructions res;
+    for (auto& ins : instructions) {
+        res.insert(res.end(), ins.begin(), ins.end());
+    }
+    return res;
+}
+
+static void run_register_compiler_test(const register_compiler_test& test) {
+    auto ast = parse(test.input);
+    axe::register_compiler<axe::constants_owned, axe::symbol_table_owned>
+        compiler;
+    auto err = compiler.compile(ast);
+    if (err.has_value()) {
+        std::cout << *err << '\n';
+    }
+    EXPECT_FALSE(err.has_value());
+    auto& byte_code = compiler.get_byte_code();
+    auto expected = concatinate_instructions(test.expected_instructions);
+    EXPECT_EQ(axe::register_instructions_string(expected),
+              axe::register_instructions_string(byte_code.ins));
+    EXPECT_EQ(byte_code.num_registers, test.expected_num_registers);
+    EXPECT_EQ(test.expected_constants.size(), byte_code.constants.size());
+    for (size_t i = 0; i < test.expected_constants.size(); ++i) {
+        EXPECT_EQ(test.expected_constants[i], byte_code.constants[i]);
+    }
+}
+
+TEST(RegisterCompiler, Arithmatic) {
+    register_compiler_test tests[] = {
+        {
+            "1 + 2",
+            {axe::object(axe::object_type::Integer, 1),
+             axe::object(axe::object_type::Integer, 2)},
+            {
+                axe::make(axe::register_op_code::OpLoadConstant, {1, 0}),
+                axe::make(axe::register_op_code::OpLoadConstant, {2, 1}),
+                axe::make(axe::register_op_code::OpAdd, {0, 1, 2}),
+                axe::make(axe::register_op_code::OpPop, {0}),
+            },
+            3,
+        },
+        {
+            "1 < 2",
+            {axe::object(axe::object_type::Integer, 2),
+             axe::object(axe::object_type::Integer, 1)},
+            {
+                axe::make(axe::register_op_code::OpLoadConstant, {1, 0}),
+                axe::make(axe::register_op_code::OpLoadConstant, {2, 1}),
+                axe::make(axe::register_op_code::OpGreaterThan, {0, 1, 2}),
+                axe::make(axe::register_op_code::OpPop, {0}),
+            },
+            3,
+        },
+        {
+            "-1",
+            {axe::object(axe::object_type::Integer, 1)},
+            {
+                axe::make(axe::register_op_code::OpLoadConstant, {1, 0}),
+                axe::make(axe::register_op_code::OpMinus, {0, 1}),
+                axe::make(axe::register_op_code::OpPop, {0}),
+            },
+            2,
+        },
+    };
+
+    for (auto& test : tests) {
+        run_register_compiler_test(test);
+    }
+}
+
+TEST(RegisterCompiler, Globals) {
+    register_compiler_test tests[] = {
+        {
+            "let one = 1; let two = one; two",
+            {axe::object(axe::object_type::Integer, 1)},
+            {
+                axe::make(axe::register_op_code::OpLoadConstant, {0, 0}),
+                axe::make(axe::register_op_code::OpSetGlobal, {0, 0}),
+                axe::make(axe::register_op_code::OpGetGlobal, {0, 0}),
+                axe::make(axe::register_op_code::OpSetGlobal, {0, 1}),
+                axe::make(axe::register_op_code::OpGetGlobal, {0, 1}),
+                axe::make(axe::register_op_code::OpPop, {0}),
+            },
+            1,
+        },
+    };
+
+    for (auto& test : tests) {
+        run_register_compiler_test(test);
+    }
+}
+
+TEST(RegisterCompiler, Conditionals) {
+    register_compiler_test tests[] = {
+        {
+            "if true { 10 }; 3333",
+            {axe::object(axe::object_type::Integer, 10),
+             axe::object(axe::object_type::Integer, 3333)},
+            {
+                // 0000
+                axe::make(axe::register_op_code::OpLoadTrue, {1}),
+                // 0002
+                axe::make(axe::register_op_code::OpJumpNotTruthy, {1, 13}),
+                // 0006
+                axe::make(axe::register_op_code::OpLoadConstant, {0, 0}),
+                // 0010
+                axe::make(axe::register_op_code::OpJump, {15}),
+                // 0013
+                axe::make(axe::register_op_code::OpLoadNull, {0}),
+                // 0015
+                axe::make(axe::register_op_code::OpPop, {0}),
+                // 0017
+                axe::make(axe::register_op_code::OpLoadConstant, {0, 1}),
+                // 0020
+                axe::make(axe::register_op_code::OpPop, {0}),
+            },
+            2,
+        },
+    };
+
+    for (auto& test : tests) {
+        run_register_compiler_test(test);
+    }
+}
+
+TEST(RegisterCompiler, LocalsLiveInRegisters) {
+    register_compiler_test tests[] = {
+        {
+            "fn(a, b) { let c = a + b; c * 2 }",
+            {
+                axe::object(axe::object_type::Integer, 2),
+                axe::object(
+                    axe::object_type::Function,
+                    axe::compiled_function(
+                        concatinate_instructions({
+                            axe::make(axe::register_op_code::OpAdd, {2, 0, 1}),
+                            axe::make(axe::register_op_code::OpLoadConstant,
+                                      {4, 0}),
+                            axe::make(axe::register_op_code::OpMul, {3, 2, 4}),
+                            axe::make(axe::register_op_code::OpReturnValue,
+                                      {3}),
+                        }),
+                        5, 2)),
+            },
+            {
+                axe::make(axe::register_op_code::OpLoadConstant, {0, 1}),
+                axe::make(axe::register_op_code::OpPop, {0}),
+            },
+            1,
+        },
+        {
+            "fn() { }",
+            {
+                axe::object(axe::object_type::Function,
+                            axe::compiled_function(
+                                concatinate_instructions({
+                                    axe::make(axe::register_op_code::OpReturn,
+                                              {}),
+                                }),
+                                0, 0)),
+            },
+            {
+                axe::make(axe::register_op_code::OpLoadConstant, {0, 0}),
+                axe::make(axe::register_op_code::OpPop, {0}),
+            },
+            1,
+        },
+    };
+
+    for (auto& test : tests) {
+        run_register_compiler_test(test);
+    }
+}
+
+TEST(RegisterCompiler, FunctionCalls) {
+    register_compiler_test tests[] = {
+        {
+            "fn id(a) { a }; id(24)",
+            {
+                axe::object(
+                    axe::object_type::Function,
+                    axe::compiled_function(
+                        concatinate_instructions({
+                            axe::make(axe::register_op_code::OpReturnValue,
+                                      {0}),
+                        }),
+                        1, 1)),
+                axe::object(axe::object_type::Integer, 24),
+            },
+            {
+                axe::make(axe::register_op_code::OpLoadConstant, {0, 0}),
+                axe::make(axe::register_op_code::OpSetGlobal, {0, 0}),
+                axe::make(axe::register_op_code::OpGetGlobal, {0, 0}),
+                axe::make(axe::register_op_code::OpLoadConstant, {1, 1}),
+                axe::make(axe::register_op_code::OpCall, {0, 1}),
+                axe::make(axe::register_op_code::OpPop, {0}),
+            },
+            2,
+        },
+    };
+
+    for (auto& test : tests) {
+        run_register_compiler_test(test);
+    }
+}
+
+TEST(RegisterCompiler, InternedConstantsAcrossLines) {
+    axe::symbol_table symbol_table;
+    std::vector<axe::object> constants;
+    std::string lines[] = {"let a = 1; \"x\"; 2.0", "a + 1; \"x\"",
+                           "3; 1; fn(x) { x }; fn(y) { y }"};
+    for (auto& line : lines) {
+        axe::register_compiler<axe::constants_ref, axe::symbol_table_ref>
+            compiler(symbol_table, constants);
+        ASSERT_FALSE(compiler.compile(parse(line)).has_value());
+    }
+    ASSERT_EQ(constants.size(), 5);
+    EXPECT_EQ(constants[0], axe::object(axe::object_type::Integer, 1));
+    EXPECT_EQ(constants[1], axe::object(axe::object_type::String, "x"));
+    EXPECT_EQ(constants[2], axe::object(axe::object_type::Float, 2.0));
+    EXPECT_EQ(constants[3], axe::object(axe::object_type::Integer, 3));
+    EXPECT_EQ(constants[4].get_type(), axe::object_type::Function);
+}
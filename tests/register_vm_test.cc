@@ -0,0 +1,154 @@
+#include "../src/ast.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/register_compiler.h"
+#include "../src/register_vm.h"
+#include <gtest/gtest.h>
+
+static axe::ast parse(const std::string& input) {
+    axe::lexer l(input);
+    axe::parser p(l);
+    return p.parse();
+}
+
+struct register_vm_test {
+    std::string input;
+    axe::object expected;
+};
+
+static void run_register_vm_test(const register_vm_test& test) {
+    auto ast = parse(test.input);
+    axe::register_compiler<axe::constants_owned, axe::symbol_table_owned>
+        compiler;
+    auto err = compiler.compile(ast);
+    if (err.has_value()) {
+        std::cout << *err << '\n';
+    }
+    EXPECT_FALSE(err.has_value());
+    axe::register_vm<axe::globals_owned> vm(compiler.get_byte_code());
+    err = vm.run();
+    if (err.has_value()) {
+        std::cout << *err << '\n';
+    }
+    EXPECT_FALSE(err.has_value());
+    auto got = vm.last_popped_stack_element();
+    EXPECT_EQ(got.get_type(), test.expected.get_type()) << test.input;
+    EXPECT_EQ(got, test.expected) << test.input;
+}
+
+static axe::object integer(int64_t value) {
+    return axe::object(axe::object_type::Integer, value);
+}
+
+static axe::object boolean(bool value) {
+    return axe::object(axe::object_type::Bool, value);
+}
+
+TEST(RegisterVM, Arithmatic) {
+    register_vm_test tests[] = {
+        {"1", integer(1)},
+        {"1 + 2", integer(3)},
+        {"50 / 2 * 2 + 10 - 5", integer(55)},
+        {"5 * (2 + 10)", integer(60)},
+        {"-50 + 100 + -50", integer(0)},
+        {"(5 + 10 * 2 + 15 / 3) * 2 + -10", integer(50)},
+        {"5.5 * 3.3", axe::object(axe::object_type::Float, 5.5 * 3.3)},
+        {"\"ax\" + \"e\"", axe::object(axe::object_type::String, "axe")},
+    };
+
+    for (auto& test : tests) {
+        run_register_vm_test(test);
+    }
+}
+
+TEST(RegisterVM, Booleans) {
+    register_vm_test tests[] = {
+        {"1 < 2", boolean(true)},
+        {"1 > 2", boolean(false)},
+        {"1 != 2", boolean(true)},
+        {"(1 < 2) == false", boolean(false)},
+        {"!!5", boolean(true)},
+        {"!(if (false) { 5; })", boolean(true)},
+    };
+
+    for (auto& test : tests) {
+        run_register_vm_test(test);
+    }
+}
+
+TEST(RegisterVM, Conditionals) {
+    register_vm_test tests[] = {
+        {"if true { 10 } else { 20 }", integer(10)},
+        {"if 1 > 2 { 10 } else { 20 }", integer(20)},
+        {"if ((if (false) { 10 })) { 10 } else { 20 }", integer(20)},
+        {"if false { 10 }", axe::object()},
+    };
+
+    for (auto& test : tests) {
+        run_register_vm_test(test);
+    }
+}
+
+TEST(RegisterVM, Globals) {
+    register_vm_test tests[] = {
+        {"let one = 1; let two = one + one; one + two", integer(3)},
+        {"let foo = 1; let bar = foo; foo = 2; bar", integer(1)},
+        {"let foo = 1; foo = 2; foo", integer(2)},
+    };
+
+    for (auto& test : tests) {
+        run_register_vm_test(test);
+    }
+}
+
+TEST(RegisterVM, Functions) {
+    register_vm_test tests[] = {
+        {"fn a() { 1 } fn b() { a() + 1 }; fn c() { b() + 1 }; c()",
+         integer(3)},
+        {"fn earlyExit() { return 99; 100; }; earlyExit()", integer(99)},
+        {"fn noReturn() { }; noReturn()", axe::object()},
+        {"fn returnsOneReturner() { fn returnsOne() { 1 } returnsOne }\
+          returnsOneReturner()()",
+         integer(1)},
+        {"fn foo(a) { a = 5; a }; foo(10)", integer(5)},
+        {"fn sum(a, b) { let c = a + b; c }; fn outer() { sum(1, 2) + "
+         "sum(3, 4) }; outer()",
+         integer(10)},
+        {"let globalNum = 10; fn sum(a, b) { let c = a + b; c + globalNum };\
+          fn outer() { sum(1, 2) + sum(3, 4) + globalNum }; outer() + globalNum",
+         integer(50)},
+        {"fn f(a) { let b = if a > 1 { let c = a * 2; c } else { 0 }; b + 1 } "
+         "f(5)",
+         integer(11)},
+        {"fn f(a) { let g = fn h(x) { x + 1 }; g(a) }; f(2)", integer(3)},
+        {"fn fib(n) { if n < 2 { n } else { fib(n - 1) + fib(n - 2) } } "
+         "fib(15)",
+         integer(610)},
+        {"fn f(n) { if n == 0 { 0 } else { f(n - 1) + 1 } } f(20000)",
+         integer(20000)},
+    };
+
+    for (auto& test : tests) {
+        run_register_vm_test(test);
+    }
+}
+
+TEST(RegisterVM, CallingFunctionsWithWrongArguments) {
+    std::pair<std::string, std::string> tests[] = {
+        {"fn() { 1; }(1)", "wrong number of arguments: want 0, got 1"},
+        {"fn(a, b) { a + b }(1)", "wrong number of arguments: want 2, got 1"},
+        {"let a = 1; a()", "calling non-function, Integer"},
+    };
+
+    for (auto& [input, expected] : tests) {
+        auto ast = parse(input);
+        axe::register_compiler<axe::constants_owned, axe::symbol_table_owned>
+            compiler;
+        EXPECT_FALSE(compiler.compile(ast).has_value());
+        axe::register_vm<axe::globals_owned> vm(
+            compiler.get_byte_code());
+        auto err = vm.run();
+        EXPECT_TRUE(err.has_value());
+        EXPECT_EQ(*err, expected);
+    }
+}
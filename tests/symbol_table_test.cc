@@ -2,53 +2,53 @@
 #include <gtest/gtest.h>
 
 TEST(SymbolTable, Define) {
-    std::unordered_map<std::string, axe::symbol> expected = {
-        {"a", {"a", axe::symbol_scope::GlobalScope, 0}},
-        {"b", {"b", axe::symbol_scope::GlobalScope, 1}},
-        {"c", {"c", axe::symbol_scope::LocalScope, 0}},
-        {"d", {"d", axe::symbol_scope::LocalScope, 1}},
-        {"e", {"e", axe::symbol_scope::LocalScope, 0}},
-        {"f", {"f", axe::symbol_scope::LocalScope, 1}},
+    std::unordered_map<axe::atom, axe::symbol> expected = {
+        {axe::atom("a"), {axe::atom("a"), axe::symbol_scope::GlobalScope, 0}},
+        {axe::atom("b"), {axe::atom("b"), axe::symbol_scope::GlobalScope, 1}},
+        {axe::atom("c"), {axe::atom("c"), axe::symbol_scope::LocalScope, 0}},
+        {axe::atom("d"), {axe::atom("d"), axe::symbol_scope::LocalScope, 1}},
+        {axe::atom("e"), {axe::atom("e"), axe::symbol_scope::LocalScope, 0}},
+        {axe::atom("f"), {axe::atom("f"), axe::symbol_scope::LocalScope, 1}},
     };
 
-    axe::symbol_table global;
+    axe::symbol_table table;
 
-    auto a = global.define("a");
-    auto a_expected = expected.find("a")->second;
+    auto a = table.define(axe::atom("a"));
+    auto a_expected = expected.find(axe::atom("a"))->second;
     EXPECT_EQ(a, a_expected);
 
-    auto b = global.define("b");
-    auto b_expected = expected.find("b")->second;
+    auto b = table.define(axe::atom("b"));
+    auto b_expected = expected.find(axe::atom("b"))->second;
     EXPECT_EQ(b, b_expected);
 
-    auto first_local = axe::symbol_table::with_outer(global);
+    table.push_scope();
 
-    auto c = first_local.define("c");
-    auto c_expected = expected.find("c")->second;
+    auto c = table.define(axe::atom("c"));
+    auto c_expected = expected.find(axe::atom("c"))->second;
     EXPECT_EQ(c, c_expected);
 
-    auto d = first_local.define("d");
-    auto d_expected = expected.find("d")->second;
+    auto d = table.define(axe::atom("d"));
+    auto d_expected = expected.find(axe::atom("d"))->second;
     EXPECT_EQ(d, d_expected);
 
-    auto second_local = axe::symbol_table::with_outer(first_local);
+    table.push_scope();
 
-    auto e = second_local.define("e");
-    auto e_expected = expected.find("e")->second;
+    auto e = table.define(axe::atom("e"));
+    auto e_expected = expected.find(axe::atom("e"))->second;
     EXPECT_EQ(e, e_expected);
 
-    auto f = second_local.define("f");
-    auto f_expected = expected.find("f")->second;
+    auto f = table.define(axe::atom("f"));
+    auto f_expected = expected.find(axe::atom("f"))->second;
     EXPECT_EQ(f, f_expected);
 }
 
 TEST(SymbolTable, ResolveGlobal) {
     axe::symbol_table global;
-    global.define("a");
-    global.define("b");
-    std::unordered_map<std::string, axe::symbol> expected = {
-        {"a", {"a", axe::symbol_scope::GlobalScope, 0}},
-        {"b", {"b", axe::symbol_scope::GlobalScope, 1}},
+    global.define(axe::atom("a"));
+    global.define(axe::atom("b"));
+    std::unordered_map<axe::atom, axe::symbol> expected = {
+        {axe::atom("a"), {axe::atom("a"), axe::symbol_scope::GlobalScope, 0}},
+        {axe::atom("b"), {axe::atom("b"), axe::symbol_scope::GlobalScope, 1}},
     };
     for (auto& it : expected) {
         auto expected = it.second;
@@ -59,81 +59,135 @@ TEST(SymbolTable, ResolveGlobal) {
 }
 
 TEST(SymbolTable, ResolveLocal) {
-    axe::symbol_table global;
-    global.define("a");
-    global.define("b");
-    auto local = axe::symbol_table::with_outer(global);
-    local.define("c");
-    local.define("d");
-    std::unordered_map<std::string, axe::symbol> expected = {
-        {"a", {"a", axe::symbol_scope::GlobalScope, 0}},
-        {"b", {"b", axe::symbol_scope::GlobalScope, 1}},
-        {"c", {"c", axe::symbol_scope::LocalScope, 0}},
-        {"d", {"d", axe::symbol_scope::LocalScope, 1}},
+    axe::symbol_table table;
+    table.define(axe::atom("a"));
+    table.define(axe::atom("b"));
+    table.push_scope();
+    table.define(axe::atom("c"));
+    table.define(axe::atom("d"));
+    std::unordered_map<axe::atom, axe::symbol> expected = {
+        {axe::atom("a"), {axe::atom("a"), axe::symbol_scope::GlobalScope, 0}},
+        {axe::atom("b"), {axe::atom("b"), axe::symbol_scope::GlobalScope, 1}},
+        {axe::atom("c"), {axe::atom("c"), axe::symbol_scope::LocalScope, 0}},
+        {axe::atom("d"), {axe::atom("d"), axe::symbol_scope::LocalScope, 1}},
     };
 
     for (auto& it : expected) {
         auto expected = it.second;
-        auto found = local.resolve(it.first);
+        auto found = table.resolve(it.first);
         EXPECT_TRUE(found.has_value());
         EXPECT_EQ(*found, expected);
     }
 }
 
-struct resolve_nested_local_test {
-    axe::symbol_table& table;
-    std::vector<axe::symbol> expected;
-};
-
 TEST(SymbolTable, ResolveNestedLocal) {
-    axe::symbol_table global;
-    global.define("a");
-    global.define("b");
-    auto first_local = axe::symbol_table::with_outer(global);
-    first_local.define("c");
-    first_local.define("d");
-    auto second_local = axe::symbol_table::with_outer(first_local);
-    second_local.define("e");
-    second_local.define("f");
-
-    resolve_nested_local_test tests[] = {
-        {
-            first_local,
-            {
-                {"a", axe::symbol_scope::GlobalScope, 0},
-                {"b", axe::symbol_scope::GlobalScope, 1},
-                {"c", axe::symbol_scope::LocalScope, 0},
-                {"d", axe::symbol_scope::LocalScope, 1},
-            },
-        },
-        {
-            second_local,
-            {
-                {"a", axe::symbol_scope::GlobalScope, 0},
-                {"b", axe::symbol_scope::GlobalScope, 1},
-                {"e", axe::symbol_scope::LocalScope, 0},
-                {"f", axe::symbol_scope::LocalScope, 1},
-            },
-        },
+    axe::symbol_table table;
+    table.define(axe::atom("a"));
+    table.define(axe::atom("b"));
+    table.push_scope();
+    table.define(axe::atom("c"));
+    table.define(axe::atom("d"));
+
+    std::vector<axe::symbol> first_local = {
+        {axe::atom("a"), axe::symbol_scope::GlobalScope, 0},
+        {axe::atom("b"), axe::symbol_scope::GlobalScope, 1},
+        {axe::atom("c"), axe::symbol_scope::LocalScope, 0},
+        {axe::atom("d"), axe::symbol_scope::LocalScope, 1},
+    };
+    for (auto& symb : first_local) {
+        auto got = table.resolve(symb.name);
+        EXPECT_TRUE(got.has_value());
+        EXPECT_EQ(*got, symb);
+    }
+
+    table.push_scope();
+    table.define(axe::atom("e"));
+    table.define(axe::atom("f"));
+
+    std::vector<axe::symbol> second_local = {
+        {axe::atom("a"), axe::symbol_scope::GlobalScope, 0},
+        {axe::atom("b"), axe::symbol_scope::GlobalScope, 1},
+        {axe::atom("e"), axe::symbol_scope::LocalScope, 0},
+        {axe::atom("f"), axe::symbol_scope::LocalScope, 1},
     };
+    for (auto& symb : second_local) {
+        auto got = table.resolve(symb.name);
+        EXPECT_TRUE(got.has_value());
+        EXPECT_EQ(*got, symb);
+    }
 
-    for (auto& test : tests) {
-        for (auto& symb : test.expected) {
-            auto got = test.table.resolve(symb.name);
-            EXPECT_TRUE(got.has_value());
-            EXPECT_EQ(*got, symb);
-        }
+    table.pop_scope();
+    EXPECT_FALSE(table.resolve(axe::atom("e")).has_value());
+    for (auto& symb : first_local) {
+        auto got = table.resolve(symb.name);
+        EXPECT_TRUE(got.has_value());
+        EXPECT_EQ(*got, symb);
     }
 }
 
 TEST(SymbolTable, NoValue) {
-    axe::symbol_table global;
-    auto got = global.resolve("b");
+    axe::symbol_table table;
+    auto got = table.resolve(axe::atom("b"));
     EXPECT_FALSE(got.has_value());
-    auto local = axe::symbol_table::with_outer(global);
-    auto got_local = local.resolve("b");
+    table.push_scope();
+    auto got_local = table.resolve(axe::atom("b"));
     EXPECT_FALSE(got_local.has_value());
-    auto global_out = local.get_outer();
-    auto got_global_2 = global_out.resolve("b");
+    table.pop_scope();
+    auto got_global_2 = table.resolve(axe::atom("b"));
     EXPECT_FALSE(got_global_2.has_value());
 }
+
+TEST(SymbolTable, Shadow) {
+    axe::symbol_table table;
+    table.define(axe::atom("a"));
+    table.push_scope();
+    table.define(axe::atom("b"));
+    table.define(axe::atom("a"));
+    EXPECT_EQ(*table.resolve(axe::atom("a")),
+              axe::symbol(axe::atom("a"), axe::symbol_scope::LocalScope, 1));
+    EXPECT_EQ(table.get_num_definitions(), 2);
+
+    table.erase(axe::atom("a"));
+    EXPECT_EQ(*table.resolve(axe::atom("a")),
+              axe::symbol(axe::atom("a"), axe::symbol_scope::GlobalScope, 0));
+    EXPECT_EQ(table.get_num_definitions(), 1);
+
+    size_t size = table.size();
+    table.define(axe::atom("c"));
+    table.define(axe::atom("a"));
+    table.truncate(size);
+    EXPECT_FALSE(table.resolve(axe::atom("c")).has_value());
+    EXPECT_EQ(*table.resolve(axe::atom("a")),
+              axe::symbol(axe::atom("a"), axe::symbol_scope::GlobalScope, 0));
+
+    table.pop_scope();
+    EXPECT_EQ(table.get_num_definitions(), 1);
+}
+
+TEST(SymbolTable, Visible) {
+    axe::symbol_table table;
+    table.define(axe::atom("a"));
+    size_t visible = table.size();
+    table.define(axe::atom("b"));
+    table.define(axe::atom("a"));
+    table.push_scope();
+    table.define(axe::atom("c"));
+
+    // only the first a is seen, the scope that is pushed sees neither b
+    // nor c
+    table.push_scope(visible);
+    EXPECT_EQ(*table.resolve(axe::atom("a")),
+              axe::symbol(axe::atom("a"), axe::symbol_scope::GlobalScope, 0));
+    EXPECT_FALSE(table.resolve(axe::atom("b")).has_value());
+    EXPECT_FALSE(table.resolve(axe::atom("c")).has_value());
+    table.define(axe::atom("d"));
+    EXPECT_EQ(*table.resolve(axe::atom("d")),
+              axe::symbol(axe::atom("d"), axe::symbol_scope::LocalScope, 0));
+
+    table.pop_scope();
+    EXPECT_EQ(*table.resolve(axe::atom("a")),
+              axe::symbol(axe::atom("a"), axe::symbol_scope::GlobalScope, 2));
+    EXPECT_EQ(*table.resolve(axe::atom("c")),
+              axe::symbol(axe::atom("c"), axe::symbol_scope::LocalScope, 0));
+    EXPECT_FALSE(table.resolve(axe::atom("d")).has_value());
+}
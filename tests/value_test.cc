@@ -0,0 +1,121 @@
+#include "../src/object.h"
+#include "../src/value.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <limits>
+
+TEST(Value, InlineValues) {
+    axe::value null;
+    EXPECT_TRUE(null.is_null());
+    EXPECT_EQ(null.get_type(), axe::object_type::Null);
+
+    auto t = axe::value::from_bool(true);
+    auto f = axe::value::from_bool(false);
+    EXPECT_EQ(t.get_type(), axe::object_type::Bool);
+    EXPECT_TRUE(t.get_bool());
+    EXPECT_FALSE(f.get_bool());
+
+    int64_t ints[] = {0, 1, -1, (INT64_C(1) << 47) - 1, -(INT64_C(1) << 47)};
+    for (auto i : ints) {
+        auto v = axe::value::from_small_int(i);
+        EXPECT_EQ(v.get_type(), axe::object_type::Integer) << i;
+        EXPECT_EQ(v.get_int(), i);
+    }
+
+    double doubles[] = {0.0, -0.0, 1.5, -3.25,
+                        std::numeric_limits<double>::infinity(),
+                        -std::numeric_limits<double>::infinity()};
+    for (auto d : doubles) {
+        auto v = axe::value::from_double(d);
+        EXPECT_EQ(v.get_type(), axe::object_type::Float) << d;
+        EXPECT_EQ(v.get_float(), d);
+    }
+
+    auto nan = axe::value::from_double(std::nan(""));
+    EXPECT_EQ(nan.get_type(), axe::object_type::Float);
+    EXPECT_TRUE(std::isnan(nan.get_float()));
+}
+
+TEST(Value, BigIntegersAreBoxed) {
+    axe::heap heap;
+    int64_t ints[] = {INT64_C(1) << 47, -(INT64_C(1) << 47) - 1, INT64_MAX,
+                      INT64_MIN};
+    for (auto i : ints) {
+        auto v = heap.make_int(i);
+        EXPECT_TRUE(v.is_heap_object()) << i;
+        EXPECT_EQ(v.get_type(), axe::object_type::Integer);
+        EXPECT_EQ(v.get_int(), i);
+    }
+    EXPECT_EQ(heap.size(), 4);
+
+    auto big = axe::value::from_small_int((INT64_C(1) << 47) - 1);
+    auto sum = axe::add(big, axe::value::from_small_int(1), heap);
+    EXPECT_EQ(sum.get_int(), INT64_C(1) << 47);
+    auto back = axe::sub(sum, axe::value::from_small_int(1), heap);
+    EXPECT_TRUE(back.is_small_int());
+    EXPECT_TRUE(axe::equals(back, big));
+}
+
+TEST(Value, Operators) {
+    axe::heap heap;
+    auto one = axe::value::from_small_int(1);
+    auto two = axe::value::from_small_int(2);
+    EXPECT_EQ(axe::add(one, two, heap).get_int(), 3);
+    EXPECT_EQ(axe::mul(two, two, heap).get_int(), 4);
+    EXPECT_EQ(axe::div(two, one, heap).get_int(), 2);
+    EXPECT_TRUE(axe::greater_than(two, one));
+    EXPECT_FALSE(axe::greater_than(one, two));
+    EXPECT_TRUE(axe::add(one, axe::value::from_double(1.0), heap).is_null());
+
+    auto ax = heap.make_string("ax");
+    auto e = heap.make_string("e");
+    auto axe_str = axe::add(ax, e, heap);
+    EXPECT_EQ(axe_str.get_string(), "axe");
+    EXPECT_TRUE(axe::equals(axe_str, heap.make_string("axe")));
+    EXPECT_FALSE(axe::equals(axe_str, ax));
+
+    EXPECT_TRUE(axe::is_truthy(one));
+    EXPECT_FALSE(axe::is_truthy(axe::value::from_small_int(0)));
+    EXPECT_TRUE(axe::is_truthy(ax));
+    EXPECT_FALSE(axe::is_truthy(axe::value()));
+}
+
+TEST(Value, ObjectRoundTrip) {
+    axe::heap heap;
+    axe::object objects[] = {
+        axe::object(),
+        axe::object(axe::object_type::Bool, true),
+        axe::object(axe::object_type::Integer, int64_t(42)),
+        axe::object(axe::object_type::Integer, INT64_MAX),
+        axe::object(axe::object_type::Float, 2.5),
+        axe::object(axe::object_type::String, "axe"),
+        axe::object(axe::object_type::Function,
+                    axe::compiled_function(
+                        axe::make(axe::op_code::OpReturn, {}), 1, 0)),
+    };
+    for (auto& obj : objects) {
+        auto v = axe::to_value(obj, heap);
+        EXPECT_EQ(v.get_type(), obj.get_type());
+        EXPECT_EQ(axe::to_object(v), obj) << obj.string();
+    }
+}
+
+TEST(Value, Collection) {
+    axe::heap heap;
+    auto pinned = heap.make_string("pinned");
+    heap.pin(pinned);
+    auto live = heap.make_string("live");
+    heap.make_string("garbage");
+    EXPECT_EQ(heap.size(), 3);
+
+    heap.mark(live);
+    heap.sweep();
+    EXPECT_EQ(heap.size(), 2);
+    EXPECT_EQ(pinned.get_string(), "pinned");
+    EXPECT_EQ(live.get_string(), "live");
+
+    // marks do not survive a sweep
+    heap.unpin(pinned);
+    heap.sweep();
+    EXPECT_EQ(heap.size(), 0);
+}
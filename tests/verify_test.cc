@@ -0,0 +1,213 @@
+#include "../src/code.h"
+#include "../src/compiler.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/verify.h"
+#include "../src/vm.h"
+#include <gtest/gtest.h>
+
+using compiler = axe::compiler<std::vector<axe::object>, axe::symbol_table>;
+
+static axe::ast parse(const std::string& input) {
+    axe::lexer l(input);
+    axe::parser p(l);
+    return p.parse();
+}
+
+static axe::instructions
+concatinate_instructions(const std::vector<axe::instructions>& instructions) {
+    axe::instructions res;
+    for (auto& ins : instructions) {
+        res.insert(res.end(), ins.begin(), ins.end());
+    }
+    return res;
+}
+
+static axe::object int_constant(int64_t i) {
+    return axe::object(axe::object_type::Integer, i);
+}
+
+static axe::object function_constant(axe::instructions ins,
+                                     size_t num_locals, size_t num_params,
+                                     size_t max_stack) {
+    return axe::object(axe::object_type::Function,
+                       axe::compiled_function(std::move(ins), num_locals,
+                                              num_params, max_stack));
+}
+
+TEST(Verify, CompiledPrograms) {
+    struct test {
+        std::string input;
+        std::string expected;
+    };
+    test tests[] = {
+        {"let a = 1; let b = a + 2; if b > a { b } else { a }", "3"},
+        {"fn fib(n) { if n < 2 { n } else { fib(n - 1) + fib(n - 2) } } "
+         "fib(15)",
+         "610"},
+        {"fn f(a, b) { let c = a * b; c - a } f(3, 4) + f(1, 1)", "9"},
+        {"fn f(a) { match a { 1 => 10, 2 => 20, 4 => 40, _ => 0, } } "
+         "fn g(a) { match a { 1 => 1, 1000 => 2, } } "
+         "fn h(a) { match a { \"a\" => 1, \"b\" => 2, _ => 3, } } "
+         "f(4) + g(1000) + h(\"b\") + h(1)",
+         "47"},
+        {"fn count(n, acc) { if n == 0 { acc } else { count(n - 1, acc + 1) } "
+         "} count(1000, 0)",
+         "1000"},
+        {"let g = 1; fn f() { g = g + 1; } f(); if true { } g", "2"},
+    };
+
+    for (auto& test : tests) {
+        compiler c;
+        ASSERT_FALSE(c.compile(parse(test.input)).has_value()) << test.input;
+        auto byte_code = c.get_byte_code();
+        auto err = axe::verify(byte_code.ins, byte_code.constants,
+                               byte_code.num_globals, byte_code.max_stack);
+        EXPECT_FALSE(err.has_value()) << *err << '\n' << test.input;
+
+        axe::vm<axe::globals_owned> vm(byte_code);
+        err = vm.run();
+        ASSERT_FALSE(err.has_value()) << *err << '\n' << test.input;
+        EXPECT_EQ(vm.last_popped_stack_element().string(), test.expected);
+    }
+}
+
+TEST(Verify, Errors) {
+    struct test {
+        axe::instructions ins;
+        std::vector<axe::object> constants;
+        size_t num_globals;
+        size_t max_stack;
+        std::string expected;
+    };
+    auto jump_to_middle = concatinate_instructions({
+        axe::make(axe::op_code::OpJump, {1}),
+    });
+    auto unsorted_switch = concatinate_instructions({
+        axe::make(axe::op_code::OpConstant, {0}),
+        axe::make(axe::op_code::OpSwitch, {2}),
+        axe::make(axe::op_code::OpJump, {19}),
+        axe::make(axe::op_code::OpCase, {1, 19}),
+        axe::make(axe::op_code::OpCase, {0, 19}),
+        axe::make(axe::op_code::OpNull, {}),
+        axe::make(axe::op_code::OpPop, {}),
+    });
+    auto call_function = concatinate_instructions({
+        axe::make(axe::op_code::OpConstant, {0}),
+        axe::make(axe::op_code::OpCall, {0}),
+        axe::make(axe::op_code::OpPop, {}),
+    });
+    test tests[] = {
+        {{0xff}, {}, 0, 0, "main program at 0: undefined opcode 255"},
+        {{static_cast<uint8_t>(axe::op_code::OpConstant), 0},
+         {int_constant(1)},
+         0,
+         1,
+         "main program at 0: OpConstant is cut off"},
+        {axe::make(axe::op_code::OpConstant, {5}),
+         {int_constant(1)},
+         0,
+         1,
+         "main program at 0: constant 5 out of range"},
+        {axe::make(axe::op_code::OpGetGlobal, {2}),
+         {},
+         2,
+         1,
+         "main program at 0: global 2 out of range"},
+        {axe::make(axe::op_code::OpGetLocal, {0}),
+         {},
+         0,
+         1,
+         "main program at 0: local 0 out of range"},
+        {jump_to_middle,
+         {},
+         0,
+         0,
+         "main program at 0: jump to 1, which is not an instruction"},
+        {axe::make(axe::op_code::OpJump, {4}),
+         {},
+         0,
+         0,
+         "main program at 0: jump to 4, which is not an instruction"},
+        {axe::make(axe::op_code::OpPop, {}),
+         {},
+         0,
+         0,
+         "main program at 0: takes 1 values off 0"},
+        {concatinate_instructions({
+             axe::make(axe::op_code::OpTrue, {}),
+             axe::make(axe::op_code::OpTrue, {}),
+         }),
+         {},
+         0,
+         1,
+         "main program at 1: needs more than 1 values on the stack"},
+        {concatinate_instructions({
+             axe::make(axe::op_code::OpTrue, {}),
+             axe::make(axe::op_code::OpJumpNotTruthy, {5}),
+             axe::make(axe::op_code::OpTrue, {}),
+             axe::make(axe::op_code::OpNull, {}),
+         }),
+         {},
+         0,
+         2,
+         "main program at 4: the stack has 0 or 1 values where paths merge"},
+        {axe::make(axe::op_code::OpReturn, {}),
+         {},
+         0,
+         0,
+         "main program at 0: return outside of a function"},
+        {axe::make(axe::op_code::OpHalt, {}),
+         {},
+         0,
+         0,
+         "main program at 0: OpHalt is only appended by the vm"},
+        {axe::make(axe::op_code::OpCase, {0, 0}),
+         {int_constant(1)},
+         0,
+         0,
+         "main program at 0: OpCase outside of a switch"},
+        {unsorted_switch,
+         {int_constant(1), int_constant(2)},
+         0,
+         1,
+         "main program at 3: the cases of a switch are not sorted"},
+        {call_function,
+         {function_constant(axe::make(axe::op_code::OpNull, {}), 0, 0, 1)},
+         0,
+         1,
+         "function 0 at 0: runs off the end of the function"},
+        {call_function,
+         {function_constant(concatinate_instructions({
+                                axe::make(axe::op_code::OpGetLocal, {1}),
+                                axe::make(axe::op_code::OpReturnValue, {}),
+                            }),
+                            1, 0, 1)},
+         0,
+         1,
+         "function 0 at 0: local 1 out of range"},
+        {call_function,
+         {function_constant(axe::make(axe::op_code::OpReturn, {}), 0, 1,
+                            0)},
+         0,
+         1,
+         "function 0 has more params than locals"},
+    };
+
+    for (auto& test : tests) {
+        auto err = axe::verify(test.ins, test.constants, test.num_globals,
+                               test.max_stack);
+        ASSERT_TRUE(err.has_value()) << test.expected;
+        EXPECT_EQ(*err, test.expected);
+    }
+}
+
+TEST(Verify, VmRejectsInvalidByteCode) {
+    auto ins = axe::make(axe::op_code::OpGetLocal, {3});
+    std::vector<axe::object> constants;
+    axe::vm<axe::globals_owned> vm({ins, constants, 0, 1});
+    auto err = vm.run();
+    ASSERT_TRUE(err.has_value());
+    EXPECT_EQ(*err,
+              "invalid byte code, main program at 0: local 3 out of range");
+}
@@ -5,11 +5,6 @@
 #include "../src/vm.h"
 #include <gtest/gtest.h>
 
-// NOTE: these tests take a long time
-// because it constructs a vector with
-// 65536 objects in it on vm construction
-// find a way to speed these up.
-
 axe::ast parse(const std::string& input) {
     axe::lexer l(input);
     axe::parser p(l);
@@ -39,7 +34,7 @@ void run_vm_int_test(const vm_test<int64_t>& test) {
         std::cout << *err << '\n';
     }
     EXPECT_FALSE(err.has_value());
-    axe::vm<std::vector<axe::object>> vm(compiler.get_byte_code());
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code());
     err = vm.run();
     if (err.has_value()) {
         std::cout << *err << '\n';
@@ -87,7 +82,7 @@ void run_vm_float_test(const vm_test<double>& test) {
         std::cout << *err << '\n';
     }
     EXPECT_FALSE(err.has_value());
-    axe::vm<std::vector<axe::object>> vm(compiler.get_byte_code());
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code());
     err = vm.run();
     if (err.has_value()) {
         std::cout << *err << '\n';
@@ -121,7 +116,7 @@ void run_vm_bool_test(const vm_test<bool>& test) {
         std::cout << *err << '\n';
     }
     EXPECT_FALSE(err.has_value());
-    axe::vm<std::vector<axe::object>> vm(compiler.get_byte_code());
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code());
     err = vm.run();
     if (err.has_value()) {
         std::cout << *err << '\n';
@@ -191,7 +186,7 @@ void run_vm_null_test(const std::string& test) {
         std::cout << *err << '\n';
     }
     EXPECT_FALSE(err.has_value());
-    axe::vm<std::vector<axe::object>> vm(compiler.get_byte_code());
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code());
     err = vm.run();
     if (err.has_value()) {
         std::cout << *err << '\n';
@@ -205,6 +200,11 @@ TEST(VM, NullConditions) {
     std::string tests[] = {
         "if 1 > 2 { 10 }",
         "if false { 10 }",
+        "if 1 < 2 { }",
+        "if true { }",
+        "let x = if 1 < 2 { let a = 1; }; x",
+        "fn f(c) { if c { 1 } else { let b = 2; } } f(false)",
+        "fn f(c) { match c { 1 => { }, _ => 2, } } f(1)",
     };
 
     for (auto& test : tests) {
@@ -217,6 +217,8 @@ TEST(VM, GlobalLetStatements) {
         {"let one = 1; one", 1},
         {"let one = 1; let two = 2; one + two", 3},
         {"let one = 1; let two = one + one; one + two", 3},
+        {"let one = 1; let one = one + 1; one", 2},
+        {"fn f() { let a = 1; let a = a + 1; a } f()", 2},
     };
     for (auto& test : tests) {
         run_vm_int_test(test);
@@ -243,7 +245,7 @@ void run_vm_string_test(vm_test<std::string> test) {
         std::cout << *err << '\n';
     }
     EXPECT_FALSE(err.has_value());
-    axe::vm<std::vector<axe::object>> vm(compiler.get_byte_code());
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code());
     err = vm.run();
     if (err.has_value()) {
         std::cout << *err << '\n';
@@ -265,6 +267,37 @@ TEST(VM, Strings) {
     }
 }
 
+TEST(VM, StringsSurviveCollection) {
+    // every call allocates four strings, enough to collect while most of
+    // the partial results are still on the stack
+    std::string expected;
+    for (int i = 0; i < 400; ++i) {
+        expected += "abcd";
+    }
+    vm_test<std::string> tests[] = {
+        {"fn build(n, s) { if n == 0 { s } else { build(n - 1, s + \"a\" + "
+         "\"b\" + \"c\" + \"d\") } } let s = build(400, \"\"); build(0, s)",
+         expected},
+    };
+
+    for (auto& test : tests) {
+        run_vm_string_test(test);
+    }
+}
+
+TEST(VM, BigIntegers) {
+    vm_test<int64_t> tests[] = {
+        {"140737488355327 + 1", INT64_C(140737488355328)},
+        {"let big = 140737488355327 * 1000; big / 1000 - 1",
+         INT64_C(140737488355326)},
+        {"-140737488355328 - 1", INT64_C(-140737488355329)},
+    };
+
+    for (auto& test : tests) {
+        run_vm_int_test(test);
+    }
+}
+
 TEST(VM, FunctionCallsNoArgs) {
     vm_test<int64_t> tests[] = {
         {"fn fivePlusTen() { 5 + 10 }; fivePlusTen()", 15},
@@ -399,6 +432,24 @@ TEST(VM, CallingFunctionsWithArgumentsAndBindings) {
     }
 }
 
+TEST(VM, Superinstructions) {
+    vm_test<int64_t> tests[] = {
+        {"fn fib(n) { if n < 2 { n } else { fib(n - 1) + fib(n - 2) } } "
+         "fib(15)",
+         610},
+        {"fn count(n, acc) { if n == 0 { acc } else { count(n - 1, acc + 1) } "
+         "} count(100, 0)",
+         100},
+        {"fn max(a, b) { if a > b { a } else { b } } max(3, 7) + max(9, 2)",
+         16},
+        {"fn f(a, b) { let c = a * b; c + 1 } f(3, 4)", 13},
+    };
+
+    for (auto& test : tests) {
+        run_vm_int_test(test);
+    }
+}
+
 void run_vm_error_test(const vm_test<std::string>& test) {
     auto ast = parse(test.input);
     axe::compiler<std::vector<axe::object>, axe::symbol_table> compiler;
@@ -407,7 +458,7 @@ void run_vm_error_test(const vm_test<std::string>& test) {
         std::cout << *err << '\n';
     }
     EXPECT_FALSE(err.has_value());
-    axe::vm<std::vector<axe::object>> vm(compiler.get_byte_code());
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code());
     err = vm.run();
     EXPECT_TRUE(err.has_value());
     EXPECT_EQ(*err, test.expected);
@@ -433,3 +484,541 @@ TEST(VM, CallingFunctionsWithWrongArguments) {
         run_vm_error_test(test);
     }
 }
+
+TEST(VM, FunctionsOutliveTheirVm) {
+    // like the repl, every line gets its own compiler and vm but they
+    // share the symbol table, the constants and the globals
+    std::string lines[] = {
+        "fn double(a) { a * 2 }",
+        "double(2)",
+        "double(double(3))",
+    };
+    int64_t expected[] = {0, 4, 12};
+    axe::symbol_table symbol_table;
+    std::vector<axe::object> constants;
+    axe::globals_store globals;
+    for (size_t i = 0; i < 3; ++i) {
+        auto ast = parse(lines[i]);
+        axe::compiler<axe::constants_ref, axe::symbol_table_ref> compiler(
+            symbol_table, constants);
+        EXPECT_FALSE(compiler.compile(ast).has_value());
+        axe::vm<axe::globals_ref> vm(compiler.get_byte_code(), globals);
+        auto err = vm.run();
+        EXPECT_FALSE(err.has_value());
+        if (i != 0) {
+            test_integer(vm.last_popped_stack_element(), expected[i]);
+        }
+    }
+}
+
+TEST(VM, StackOverflow) {
+    vm_test<std::string> tests[] = {
+        {"fn f(n) { f(n + 1) + 1 } f(0)", "stack overflow"},
+        {"fn f() { 1 + f() } f()", "stack overflow"},
+    };
+
+    for (auto& test : tests) {
+        run_vm_error_test(test);
+    }
+}
+
+TEST(VM, ErrorLocations) {
+    // 0000 OpConstant 0, 0003 OpSetGlobal 0, 0006 OpTrue, 0007 OpMinus
+    auto ast = parse("let a = 1; -true");
+    axe::compiler<std::vector<axe::object>, axe::symbol_table> compiler;
+    EXPECT_FALSE(compiler.compile(std::move(ast)).has_value());
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code());
+    auto err = vm.run();
+    EXPECT_TRUE(err.has_value());
+    EXPECT_EQ(vm.get_error().code, axe::vm_error_code::UnsupportedNegation);
+    EXPECT_EQ(vm.get_error().type, axe::object_type::Bool);
+    EXPECT_EQ(vm.get_error().position(), 7);
+    EXPECT_EQ(*err, vm.get_error().message());
+
+    // 0000 OpGetLocal 0, 0002 OpConstant 1, 0005 OpCall 1
+    ast = parse("fn f(g) { g(1) + 1 } f(2)");
+    axe::compiler_options options;
+    options.superinstructions = false;
+    options.tail_calls = false;
+    axe::compiler<std::vector<axe::object>, axe::symbol_table> compiler2(
+        options);
+    EXPECT_FALSE(compiler2.compile(std::move(ast)).has_value());
+    axe::vm<axe::globals_owned> vm2(compiler2.get_byte_code());
+    err = vm2.run();
+    EXPECT_TRUE(err.has_value());
+    EXPECT_EQ(*err, "calling non-function, Integer");
+    EXPECT_EQ(vm2.get_error().code, axe::vm_error_code::CallingNonFunction);
+    EXPECT_EQ(vm2.get_error().position(), 5);
+}
+
+TEST(VM, DeepRecursion) {
+    // far deeper than the stack and frames a vm starts with
+    vm_test<int64_t> tests[] = {
+        {"fn f(n) { if n == 0 { 0 } else { f(n - 1) + 1 } } f(20000)", 20000},
+        {"fn f(n) { if n == 0 { 0 } else { let a = n; let b = n; "
+         "f(n - 1) + a - b + 1 } } f(5000)",
+         5000},
+    };
+
+    for (auto& test : tests) {
+        run_vm_int_test(test);
+    }
+}
+
+TEST(VM, Limits) {
+    auto ast = parse("fn f(n) { if n == 0 { 0 } else { f(n - 1) + 1 } } "
+                     "f(100)");
+    axe::compiler<std::vector<axe::object>, axe::symbol_table> compiler;
+    EXPECT_FALSE(compiler.compile(std::move(ast)).has_value());
+
+    axe::vm_options few_frames;
+    few_frames.max_frames = 50;
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code(), few_frames);
+    auto err = vm.run();
+    EXPECT_TRUE(err.has_value());
+    EXPECT_EQ(*err, "stack overflow");
+
+    axe::vm_options small_stack;
+    small_stack.max_stack_size = 100;
+    axe::vm<axe::globals_owned> vm2(compiler.get_byte_code(), small_stack);
+    err = vm2.run();
+    EXPECT_TRUE(err.has_value());
+    EXPECT_EQ(*err, "stack overflow");
+
+    axe::vm_options enough;
+    enough.max_frames = 102;
+    enough.max_stack_size = 512;
+    axe::vm<axe::globals_owned> vm3(compiler.get_byte_code(), enough);
+    EXPECT_FALSE(vm3.run().has_value());
+    test_integer(vm3.last_popped_stack_element(), 100);
+}
+
+TEST(VM, Quickening) {
+    // every site runs with ints first, so it is quickened, and then sees
+    // other types, so it has to fall back
+    std::string fns = "fn add(a, b) { a + b } fn sub(a, b) { a - b } "
+                      "fn gt(a, b) { a > b } fn eq(a, b) { a == b } "
+                      "add(1, 2); sub(1, 2); gt(1, 2); eq(1, 2); ";
+    vm_test<int64_t> int_tests[] = {
+        {fns + "add(1.5, 2.5); add(3, 4)", 7},
+        {fns + "sub(1.5, 2.5); sub(3, 4)", -1},
+        {fns + "add(140737488355327, 1)", 140737488355328},
+        {fns + "add(\"a\", \"b\"); add(2, 2)", 4},
+        {fns + "fn sum(i, s) { if eq(i, 10) { s } else { "
+               "sum(add(i, 1), add(s, i)) } } sum(0, 0)",
+         45},
+    };
+    for (auto& test : int_tests) {
+        run_vm_int_test(test);
+    }
+
+    vm_test<double> float_tests[] = {
+        {fns + "add(1.5, 2.5)", 4.0},
+        {fns + "add(1.5, 2.5); add(1, 1); add(0.5, 0.25)", 0.75},
+        {fns + "sub(1.5, 2.5); sub(1, 1); sub(0.5, 0.25)", 0.25},
+    };
+    for (auto& test : float_tests) {
+        run_vm_float_test(test);
+    }
+
+    vm_test<bool> bool_tests[] = {
+        {fns + "gt(2.5, 1.5)", true},
+        {fns + "gt(2.5, 1.5); gt(1, 2)", false},
+        {fns + "eq(1.5, 1.5)", true},
+        {fns + "eq(1, 1); eq(1.0, 1.0)", true},
+        {fns + "eq(1, 1); eq(true, true)", true},
+        {fns + "eq(1, 1); eq(1, true)", false},
+        {fns + "eq(1, 1); eq(\"a\", \"a\")", true},
+    };
+    for (auto& test : bool_tests) {
+        run_vm_bool_test(test);
+    }
+}
+
+TEST(VM, InlineCaches) {
+    struct cache_test {
+        std::string input;
+        int64_t expected;
+        uint64_t hits;
+        uint64_t misses;
+    };
+    cache_test tests[] = {
+        // each site misses the first time only
+        {"fn one() { 1 } fn sum(n) { if n == 0 { 0 } else { one() + "
+         "sum(n - 1) } } sum(100)",
+         100, 198, 3},
+        // the site in apply sees a different callee every call
+        {"fn inc(x) { x + 1 } fn dec(x) { x - 1 } fn apply(f, x) { f(x) } "
+         "apply(inc, 1) + apply(dec, 1) + apply(inc, 1) + apply(dec, 1)",
+         4, 0, 8},
+    };
+
+    for (auto& test : tests) {
+        auto ast = parse(test.input);
+        axe::compiler_options options;
+        options.superinstructions = false;
+        // the calls are what is counted
+        options.tail_calls = false;
+        options.inline_calls = false;
+        axe::compiler<std::vector<axe::object>, axe::symbol_table> compiler(
+            options);
+        EXPECT_FALSE(compiler.compile(std::move(ast)).has_value());
+        axe::vm<axe::globals_owned> vm(compiler.get_byte_code());
+        EXPECT_FALSE(vm.run().has_value());
+        test_integer(vm.last_popped_stack_element(), test.expected);
+        auto stats = vm.get_call_cache_stats();
+        EXPECT_EQ(stats.hits, test.hits) << test.input;
+        EXPECT_EQ(stats.misses, test.misses) << test.input;
+    }
+
+    // a site that hit before still checks a callee it has not seen
+    vm_test<std::string> error_tests[] = {
+        {"fn one() { 1 } fn call(f) { f() } call(one); call(one); call(1)",
+         "calling non-function, Integer"},
+        {"fn one() { 1 } fn two(a) { 2 } fn call(f) { f() } call(one); "
+         "call(two)",
+         "wrong number of arguments: want 1, got 0"},
+        {"let a = if (false) { 1 }; a()", "calling non-function, Null"},
+    };
+    for (auto& test : error_tests) {
+        run_vm_error_test(test);
+    }
+}
+
+TEST(VM, TailCalls) {
+    vm_test<int64_t> tests[] = {
+        {"fn count(n, acc) { if n == 0 { acc } else { count(n - 1, acc + 1) } "
+         "} count(100000, 0)",
+         100000},
+        {"fn count(n) { if n == 0 { return 0; } return count(n - 1); } "
+         "count(5000)",
+         0},
+        {"fn g(a) { let b = a + 1; b } fn f(x) { g(x * 2) } f(5) + f(1)", 14},
+    };
+
+    for (auto& test : tests) {
+        run_vm_int_test(test);
+    }
+}
+
+// the result or the error of running input, with its position
+std::string run_vm_with(const std::string& input, axe::vm_options options,
+                        axe::jit_stats* stats = nullptr) {
+    auto ast = parse(input);
+    axe::compiler<std::vector<axe::object>, axe::symbol_table> compiler;
+    EXPECT_FALSE(compiler.compile(std::move(ast)).has_value());
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code(), options);
+    auto err = vm.run();
+    if (stats != nullptr) {
+        *stats = vm.get_jit_stats();
+    }
+    if (err.has_value()) {
+        return *err + " at " + std::to_string(vm.get_error().position());
+    }
+    return vm.last_popped_stack_element().string();
+}
+
+static const char* jit_inputs[] = {
+    "fn fib(n) { if n < 2 { n } else { fib(n - 1) + fib(n - 2) } } "
+    "fib(20)",
+    "fn f(a, b) { a * b - a / b } f(7, 2) + f(9, 3)",
+    "fn f(a, b) { a + b } f(1, 2); f(1.5, 2.25)",
+    "fn f(a, b) { a - b } f(1.5, 2.25); f(10, 3)",
+    "fn f(a, b) { a + b } f(\"ax\", \"e\")",
+    "fn f(a) { a + 1 } f(140737488355327)",
+    "fn f(a) { a - 1 } f(-140737488355328)",
+    "fn f(a) { a * 1000 } f(140737488355327)",
+    "fn f(a, b) { a < b } f(1, 2)",
+    "fn f(a, b) { a == b } f(1, 2)",
+    "fn f(a, b) { a != b } f(1, 2)",
+    "fn f(a, b) { a > b } f(2.5, 1.5)",
+    "fn f(a, b) { a == b } f(\"a\", \"a\")",
+    "fn f(a, b) { a != b } f(true, false)",
+    "fn f(a) { !a } f(0)",
+    "fn f(a) { !a } f(\"\")",
+    "fn f(a) { -a } f(5) + f(-7)",
+    "fn f(a) { -a } f(2.5)",
+    "fn f(a) { if a { 1 } else { 2 } } f(0) + f(3) * 10",
+    "fn f(a) { if a { 1 } } f(false)",
+    "fn f(a) { if !a { 1 } else { 2 } } f(0) + f(3) * 10 + f(\"\") * 100",
+    "fn f(a) { if !!a { 1 } } f(false); f(2.5)",
+    "fn f() { } f()",
+    "fn f(a) { let b = a * 2; let c = b + 1; a = c; a } f(20)",
+    "let g = 1; fn f(a) { g = g + a; g } f(1); f(2); f(3)",
+    "fn count(n, acc) { if n == 0 { acc } else { count(n - 1, acc + 1) } "
+    "} count(100000, 0)",
+    "fn f(n) { if n == 0 { 0 } else { f(n - 1) + 1 } } f(20000)",
+    "fn inc(x) { x + 1 } fn dec(x) { x - 1 } fn apply(f, x) { f(x) } "
+    "apply(inc, 1) + apply(dec, 1) + apply(inc, 1) + apply(dec, 1)",
+    "fn build(n, s) { if n == 0 { s } else { build(n - 1, s + \"a\" + "
+    "\"b\" + \"c\" + \"d\") } } let s = build(400, \"\"); build(0, s)",
+    "fn f(a) { -a } f(1); f(true)",
+    "fn f(a) { a() } f(fn() { 1 }); f(1)",
+    "fn f(a) { a(1) } f(fn(x) { x }); f(fn() { 1 })",
+    "fn f(n) { 1 + f(n + 1) } f(0)",
+    "fn f(a) { match a { 1 => 10, 2 => 20, 100 => 30, _ => 0, } } "
+    "f(1) + f(100) + f(7)",
+};
+
+TEST(VM, Jit) {
+    for (auto input : jit_inputs) {
+        auto expected = run_vm_with(input, axe::vm_options());
+        for (uint64_t threshold : {1, 2}) {
+            axe::vm_options options;
+            options.jit_threshold = threshold;
+            EXPECT_EQ(run_vm_with(input, options), expected)
+                << input << " with threshold " << threshold;
+        }
+    }
+
+    axe::vm_options options;
+    options.jit_threshold = 2;
+    axe::jit_stats stats;
+    EXPECT_EQ(run_vm_with("fn one() { 1 } fn two() { 2 } one(); two(); one()",
+                          options, &stats),
+              "1");
+#ifdef AXE_JIT
+    EXPECT_EQ(stats.compiled, 1);
+#else
+    EXPECT_EQ(stats.compiled, 0);
+#endif
+}
+
+TEST(VM, OptimizingJit) {
+    for (auto input : jit_inputs) {
+        auto expected = run_vm_with(input, axe::vm_options());
+        for (uint64_t jit_threshold : {0, 1}) {
+            for (uint64_t threshold : {1, 2, 3}) {
+                axe::vm_options options;
+                options.jit_threshold = jit_threshold;
+                options.optimize_threshold = threshold;
+                options.background_optimization = false;
+                EXPECT_EQ(run_vm_with(input, options), expected)
+                    << input << " with threshold " << threshold;
+            }
+        }
+    }
+
+    // specialized on ints, then called with strings
+    axe::vm_options options;
+    options.optimize_threshold = 3;
+    options.background_optimization = false;
+    axe::jit_stats stats;
+    EXPECT_EQ(run_vm_with("fn f(a, b) { a + b } f(1, 2); f(3, 4); f(5, 6); "
+                          "f(\"a\", \"b\")",
+                          options, &stats),
+              "\"ab\"");
+#ifdef AXE_JIT
+    EXPECT_EQ(stats.optimized, 1);
+    EXPECT_EQ(stats.deoptimizations, 1);
+#else
+    EXPECT_EQ(stats.optimized, 0);
+    EXPECT_EQ(stats.deoptimizations, 0);
+#endif
+
+    // the background thread may or may not be done before the program
+    options.background_optimization = true;
+    options.optimize_threshold = 1;
+    EXPECT_EQ(run_vm_with("fn fib(n) { if n < 2 { n } else { fib(n - 1) + "
+                          "fib(n - 2) } } fib(22)",
+                          options),
+              "17711");
+}
+
+// the result of input compiled with options, or its error
+static std::string run_compiled_with(const std::string& input,
+                                     axe::compiler_options options) {
+    axe::compiler<std::vector<axe::object>, axe::symbol_table> compiler(
+        options);
+    EXPECT_FALSE(compiler.compile(parse(input)).has_value());
+    axe::vm<axe::globals_owned> vm(compiler.get_byte_code());
+    auto err = vm.run();
+    if (err.has_value()) {
+        return *err;
+    }
+    return vm.last_popped_stack_element().string();
+}
+
+// a pass must not change what a program does, every input gives the same
+// result compiled with and without it. that the pass changes the code
+// is up to the compiler tests.
+static void expect_same_results(const std::vector<std::string>& inputs,
+                                axe::compiler_options with,
+                                axe::compiler_options without) {
+    for (auto& input : inputs) {
+        EXPECT_EQ(run_compiled_with(input, with),
+                  run_compiled_with(input, without))
+            << input;
+    }
+}
+
+TEST(VM, ConstantFolding) {
+    std::vector<std::string> inputs = {
+        "60 * 60 * 24",
+        "140737488355327 + 1",
+        "-(-140737488355328)",
+        "3000000000 * 3000000000",
+        "7 / 2 - 7 / -2",
+        "1.5 * 4.0 / 3.0 - 0.5",
+        "\"a\" + \"b\" == \"ab\"",
+        "1 < 2.0",
+        "2.5 > 1.5",
+        "!0.0",
+        "!\"\"",
+        "1 + 1.5",
+        "-true",
+        "if 1 - 1 { 1 } else { 2 }",
+        "if \"\" { 1 } else { 2 }",
+        "if 1 > 2 { 1 }",
+        "fn f(a) { if true { a * (2 + 3) } else { 0 } } f(4)",
+        "let x = if false { let y = 1; y } else { 2 }; x + 1",
+    };
+    axe::compiler_options unfolded;
+    unfolded.fold_constants = false;
+    expect_same_results(inputs, axe::compiler_options(), unfolded);
+}
+
+TEST(VM, Peephole) {
+    std::vector<std::string> inputs = {
+        "if true { 1 } else { 2 }",
+        "if false { 1 }",
+        "if false { 1 }; 2",
+        "let a = 0; if !a { 1 }; if !!a { 2 }",
+        "let a = 0; if !a { 1 } else { 2 }; if a { 3 }; 4",
+        "fn f(a) { if a { if !a { 1 } else { 2 } } else { 3 } } "
+        "f(true) + f(false) * 10",
+        "fn f(a) { if a { return 1; } if !a { 2 } } f(0) + f(1)",
+    };
+    axe::compiler_options unfolded;
+    unfolded.fold_constants = false;
+    auto plain = unfolded;
+    plain.peephole = false;
+    expect_same_results(inputs, unfolded, plain);
+}
+
+TEST(VM, Ssa) {
+    std::vector<std::string> inputs = {
+        "fn f(a, b) { let c = a + b; let d = a + b; c * d } f(2, 3)",
+        "fn f(a) { let b = a; b = b + 1; let c = b; c * a } f(4)",
+        "let g = 1; fn f(a) { g = a; g = g + a; g * 2 } f(3) + g",
+        "let g = 1; fn h() { g = g + 10; 0 } "
+        "fn f() { let a = g; h(); g + a } f()",
+        "fn f(a) { let x = if a { 1 } else { 2 }; x + 1 } f(true) + f(false)",
+        "fn f(a) { let b = 1; if a { b = 2; 0 } else { 0 }; b * 3 } "
+        "f(true) * 10 + f(false)",
+        "fn f(a) { 5 - if a { if !a { 1 } else { 2 } } } f(true)",
+        "fn f(a) { 5 - if a { if !a { 1 } else { 2 } } } f(false)",
+        "fn f(a) { if a { return 1; } let c = a * 2; c } f(0) + f(3)",
+        "fn f(n) { if n < 2 { n } else { f(n - 1) + f(n - 2) } } f(15)",
+        "fn f(a) { let b = -a; let c = -a; b + c } f(2); f(true)",
+        "fn f(a) { a / 0; 1 } f(1.0)",
+        "fn f() { if true { 1 } else { 2 } } f()",
+        "fn f(a) { let a = 2; a } f(1)",
+        "fn f(a) { fn g(x) { x * 2 } g(a) + g(a) } f(4)",
+        // left to the stack compiler
+        "fn f(a) { if a { let b = 1; 1 } else { 2 }; 3 } f(true)",
+        "fn f(a) { let b = 1; if a { b } else { 2 } } f(false)",
+        "fn f(n, acc) { if n == 0 { acc } else { f(n - 1, acc + n) } } "
+        "f(1000, 0)",
+    };
+    axe::compiler_options without;
+    without.ssa = false;
+    expect_same_results(inputs, axe::compiler_options(), without);
+}
+
+TEST(VM, Match) {
+    struct match_test {
+        std::string input;
+        std::string expected;
+    };
+    match_test tests[] = {
+        // dense, through a jump table
+        {"match 3 { 1 => 10, 2 => 20, 3 => 30, _ => 0, }", "30"},
+        {"match 0 { 1 => 10, 2 => 20, 4 => 40, _ => 0, }", "0"},
+        {"match 3 { 1 => 10, 2 => 20, 4 => 40, _ => 0, }", "0"},
+        {"match 9 { 1 => 10, 2 => 20, 3 => 30, }", "Null"},
+        {"match -1 { -1 => 1, 0 => 2, }", "1"},
+        {"match 2 { 1 => 10, 2 => 20, 2 => 30, }", "20"},
+        // sparse, through a binary search
+        {"match 1000 { 1 => 10, 1000 => 20, -5 => 30, }", "20"},
+        {"match -5 { 1 => 10, 1000 => 20, -5 => 30, }", "30"},
+        {"match 6 { 1 => 10, 1000 => 20, -5 => 30, _ => 0, }", "0"},
+        {"match 140737488355328 { 140737488355328 => 1, 0 => 2, }", "1"},
+        // strings, through a hash table
+        {"match \"b\" { \"a\" => 1, \"b\" => 2, }", "2"},
+        {"match \"c\" { \"a\" => 1, _ => { let x = 3; x * 2 } }", "6"},
+        {"match \"a\" + \"b\" { \"ab\" => 1, \"a\" => 2, }", "1"},
+        // the types have to be the same
+        {"match 1.0 { 1 => 1, _ => 2, }", "2"},
+        {"match \"1\" { 1 => 1, 2 => 2, }", "Null"},
+        {"match 1 { \"1\" => 1, _ => 2, }", "2"},
+        // one pattern after another
+        {"let y = 2; match 2 { 1 => 1, y => 5, _ => 7, }", "5"},
+        {"match true { false => 1, true => 2, }", "2"},
+        {"match \"x\" { 1 => 1, \"x\" => 2, }", "2"},
+        {"match 2.5 { 2.5 => 1, }", "1"},
+        {"match 1 { _ => 1, 1 => 2, }", "1"},
+        {"match 1 { }", "Null"},
+        {"let g = 0; fn f() { g = g + 1; g } match f() { 2 => 0, 1 => g, }",
+         "1"},
+        {"fn f(x) { match x { 0 => \"zero\", 1 => \"one\", 4 => \"four\", "
+         "_ => \"many\", } } f(0) + f(1) + f(2) + f(4)",
+         "\"zeroonemanyfour\""},
+        {"fn f(x) { let y = x * 2; match y { 2 => 1, x => 2, _ => 3, } } "
+         "f(1) * 100 + f(0) * 10 + f(5)",
+         "123"},
+        // the chains share a subject, except one in a pattern
+        {"let y = 1; let a = match 1 { y => 2, _ => 3, }; "
+         "let b = match 5 { y => 2, _ => 3, }; a * 10 + b",
+         "23"},
+        {"let y = 1; match 2 { match y { y => 1, _ => 0, } => 10, "
+         "y + 1 => 20, _ => 30, }",
+         "20"},
+    };
+
+    // the compare chain is all the unoptimized compiler has
+    axe::compiler_options plain;
+    plain.superinstructions = false;
+    plain.tail_calls = false;
+    plain.fold_constants = false;
+    plain.peephole = false;
+    plain.ssa = false;
+    plain.inline_calls = false;
+    for (auto& test : tests) {
+        EXPECT_EQ(run_vm_with(test.input, axe::vm_options()), test.expected)
+            << test.input;
+        EXPECT_EQ(run_compiled_with(test.input, plain), test.expected)
+            << test.input;
+    }
+}
+
+TEST(VM, Inlining) {
+    std::vector<std::string> inputs = {
+        "fn add(a, b) { a + b } fn f(x) { add(x, 1) * add(x, 2) } f(3)",
+        "let sq = fn(a) { a * a }; fn f(x) { sq(x) + sq(x + 1) } f(4)",
+        "fn g(a) { if a > 1 { return a; } let b = a * 10; b } "
+        "fn f(x) { g(x) + g(x + 5) } f(0)",
+        "fn abs(a) { if a < 0 { -a } else { a } } "
+        "fn f(x) { abs(x) - abs(0 - x) + abs(x - 10) } f(3)",
+        "fn one() { 1 } fn two() { one() + one() } fn f() { two() * two() } "
+        "f()",
+        "let g = 1; fn bump(a) { g = g + a; g } fn f() { bump(1); bump(2) } "
+        "f() + g",
+        "fn fib(n) { if n < 2 { n } else { fib(n - 1) + fib(n - 2) } } "
+        "fn f(x) { fib(x) } f(15)",
+        "let h = 0; fn g(n) { if n == 0 { 1 } else { h(n - 1) } } "
+        "h = fn(n) { g(n) * 2 }; fn f(x) { g(x) } f(3)",
+        "fn id(a) { a } fn f() { id(1, 2) } f()",
+        "fn neg(a) { -a } fn f() { neg(true) } f()",
+        "let x = 5; fn get() { x } fn f(x) { get() + x } f(1)",
+        "fn add(a) { a + 1 } fn f(x) { add(x) } add = fn(a) { a - 1 }; f(1)",
+        "fn add(a) { a + 1 } fn f(x) { add(x) } fn add(a) { a } f(1)",
+        "fn nothing(a) { let b = a; } fn f() { nothing(1) } f()",
+        "fn early(a) { return a; a + 1 } fn f() { early(2) * 3 } f()",
+        "fn pick(a) { if a { return 1; } 2 } "
+        "fn f(x) { let b = pick(x); b + pick(!x) } f(true)",
+    };
+    axe::compiler_options without;
+    without.inline_calls = false;
+    expect_same_results(inputs, axe::compiler_options(), without);
+}